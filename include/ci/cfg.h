@@ -0,0 +1,79 @@
+#ifndef CI_CFG_H
+#define CI_CFG_H
+#include <stdbool.h>
+#include <stddef.h>
+#include "command.h"
+#include "linker.h"
+
+#define CFG_NO_BLOCK ((size_t) -1)  // Dominator of a root or of an unreachable block.
+
+/**
+ * @brief A run of commands that is only entered at its first command and only
+ * left after its last one.
+ */
+typedef struct {
+    size_t first;      // Index of the block's first command.
+    size_t last;       // Index of the block's last command.
+    size_t succs[2];   // Blocks control may continue in.
+    size_t num_succs;  // Number of entries in `succs`.
+    size_t idom;       // The block's immediate dominator, or CFG_NO_BLOCK.
+} BasicBlock;
+
+/**
+ * @brief A natural loop: a header block and every block that can get back to
+ * it without leaving the loop.
+ */
+typedef struct {
+    size_t header;      // The block that every iteration starts in.
+    bool  *blocks;      // Whether each block of the graph is part of the loop.
+    size_t num_blocks;  // Number of blocks in the loop, including the header.
+} Loop;
+
+/**
+ * @brief The control-flow graph of a linked command list.
+ *
+ * Blocks end at every branch, call and return. A call's block continues in
+ * the block after it, which is where the call returns to; the called block
+ * is a root of the graph, as is the first block. Loops are found from back
+ * edges, branches to a block that dominates them. Loops sharing a header are
+ * merged, and `loops` is ordered from the smallest loop to the largest, so
+ * that inner loops come before the loops around them.
+ */
+typedef struct {
+    CommandArray array;       // The commands, with their targets as indices.
+    BasicBlock  *blocks;      // The blocks, in command order.
+    size_t       num_blocks;  // Number of entries in `blocks`.
+    size_t      *block_of;    // The block of each command.
+    Loop        *loops;       // The natural loops.
+    size_t       num_loops;   // Number of entries in `loops`.
+} Cfg;
+
+/**
+ * @brief Builds the control-flow graph, dominators and loops of a command list.
+ *
+ * @param cfg Pointer to the `Cfg` to initialize.
+ * @param commands Pointer to the first `Command` of the linked list.
+ * @return true if the graph was built, false if memory could not be allocated.
+ */
+bool cfg_build(Cfg *cfg, Command *commands);
+
+/**
+ * @brief Frees the resources associated with a control-flow graph, but not
+ * the commands themselves.
+ *
+ * @param cfg Pointer to the `Cfg` to free.
+ */
+void cfg_free(Cfg *cfg);
+
+/**
+ * @brief Determines whether every path from a root to one block passes
+ * through another.
+ *
+ * @param cfg The control-flow graph.
+ * @param a The block that may dominate.
+ * @param b The block that may be dominated.
+ * @return True if `a` dominates `b`; every reachable block dominates itself.
+ */
+bool cfg_dominates(const Cfg *cfg, size_t a, size_t b);
+
+#endif
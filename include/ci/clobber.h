@@ -0,0 +1,26 @@
+#ifndef CI_CLOBBER_H
+#define CI_CLOBBER_H
+#include <stddef.h>
+#include "program.h"
+
+/**
+ * @brief Narrows the registers each call saves to those its callee may write.
+ *
+ * A call saves every variable and its return restores all but x0, so only
+ * the variables the callee can change need saving at all. For each call
+ * target, this walks every instruction reachable from it up to a `ret` and
+ * collects the destinations written along the way. A nested call returns with
+ * every variable but x0 restored, so it contributes only x0, which is never
+ * restored anyway. A tail call is followed into its callee instead, since
+ * the callee's `ret` pops the caller's frame. The result replaces PROGRAM_SAVE_ALL in the call's
+ * `PROGRAM_CALL_SAVES` mask.
+ *
+ * Must run on the program as lowered, before `program_fuse` and
+ * `program_specialize`.
+ *
+ * @param prog Pointer to the `Program` to analyze.
+ * @return The number of calls that now save fewer than every variable.
+ */
+size_t program_compute_clobbers(Program *prog);
+
+#endif
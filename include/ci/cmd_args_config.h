@@ -1,13 +1,28 @@
 #ifndef CI_CMD_ARGS_CONFIG_H
 #define CI_CMD_ARGS_CONFIG_H
 #include <stdbool.h>
+#include <stddef.h>
 
 typedef struct {
-    bool  print_lex;     // Lex; do not parse
-    bool  print_parse;   // Print result of parsing. Implicitly performs lexing
-    bool  repl;          // Set when no arguments are supplied
-    char *in_filename;   // What are we running?
-    char *out_filename;  // File to output to
+    bool   print_lex;     // Lex; do not parse
+    bool   print_parse;   // Print result of parsing. Implicitly performs lexing
+    bool   repl;          // Set when no arguments are supplied
+    bool   threaded;      // Run with the threaded dispatch engine
+    bool   jit;           // Compile the program to native code before running it
+    bool   trace;         // Compile hot loops to native code while running
+    bool   tiered;        // Move hot functions to the threaded engine while running
+    bool   stats;         // Print counters collected while running
+    bool   optimize;      // Run the optimization passes before lowering
+    bool   no_dump;       // Skip the final variable, flag and memory dumps
+    bool   emit_c;        // Translate the program to C instead of running it
+    size_t max_depth;     // Maximum call depth, or 0 for no limit
+    size_t inline_size;   // Largest function -O inlines, in commands; 0 for none
+    size_t inline_depth;  // Fewest loops a call must be in for -O to inline it
+    size_t unroll;        // Iterations per trip of loops -O unrolls; 0 or 1 for none
+    char  *in_filename;   // What are we running?
+    char  *out_filename;  // File to output to
+    char  *profile_out;   // File to write instruction sequence counts to, or NULL
+    char  *profile_in;    // File to read instruction sequence counts from, or NULL
 } CmdArgsConfig;
 
 void config_free(CmdArgsConfig *conf);
@@ -44,6 +44,8 @@ typedef struct cmd {
     bool            is_a_string;       // Indicates if the first operand is a string.
     bool            is_b_string;       // Indicates if the second operand is a string.
     BranchCondition branch_condition;  // The branching condition for the command.
+    struct cmd     *target;            // The command a branch or call jumps to, filled in by
+                                       // the linker (see linker.h).
 } Command;
 
 /**
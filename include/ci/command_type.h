@@ -89,6 +89,69 @@ typedef enum {
     // sub x0 x1 5
     // Can either be variable variable variable or variable variable number
     CMD_SUB,
+
+    // Sentinel placed after the last instruction of a lowered program
+    // Never produced by the parser
+    CMD_HALT,
+
+    // Superinstructions produced by the fusion pass (see fusion.h)
+    // Each one replaces the first command of a group; the operands are still
+    // read from the untouched commands that follow it
+
+    // cmp x1 x2; b.cond l1
+    // The _NOFLAGS forms skip writing the flags when no one reads them
+    CMD_CMP_BRANCH,
+    CMD_CMP_BRANCH_NOFLAGS,
+    CMD_CMP_U_BRANCH,
+    CMD_CMP_U_BRANCH_NOFLAGS,
+
+    // add x1 x1 1; cmp x1 x2; b.cond l1
+    CMD_ADD_CMP_BRANCH,
+    CMD_ADD_CMP_BRANCH_NOFLAGS,
+
+    // add x1 x1 1; b l1
+    CMD_ADD_BRANCH,
+
+    // mov x0 5; store x0 100 8
+    CMD_MOV_STORE,
+
+    // orr x0 x1 x15; call foo
+    CMD_ORR_CALL,
+
+    // Operand-form specializations produced by the loader (see specialize.h)
+    // R is a variable operand and I an immediate one, in operand order
+
+    // add x0 x1 x2 / add x0 x1 5
+    CMD_ADD_RRR,
+    CMD_ADD_RRI,
+
+    // sub x0 x1 x2 / sub x0 x1 5
+    CMD_SUB_RRR,
+    CMD_SUB_RRI,
+
+    // cmp x1 x2 / cmp x1 5, and their unsigned variants
+    CMD_CMP_RR,
+    CMD_CMP_RI,
+    CMD_CMP_U_RR,
+    CMD_CMP_U_RI,
+
+    // lsl x0 x1 1, with the shift amount known to be within 0..63
+    CMD_LSL_RRI,
+    CMD_LSR_RRI,
+    CMD_ASR_RRI,
+
+    // load x0 8 100 / load x0 8 x1, with a valid width
+    // The RII form is verified (see verify.h), so it needs no checks at all
+    CMD_LOAD_RII,
+    CMD_LOAD_RIR,
+
+    // store x0 100 8 / store x0 x1 8, likewise
+    CMD_STORE_RII,
+    CMD_STORE_RRI,
+
+    // Two specialized forms, optionally followed by a branch, run as one
+    // instruction; produced from a profile by the composition pass (see fusion.h)
+    CMD_COMPOSED,
 } CommandType;
 
 #endif
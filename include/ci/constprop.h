@@ -0,0 +1,66 @@
+#ifndef CI_CONSTPROP_H
+#define CI_CONSTPROP_H
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "command.h"
+#include "interpreter.h"
+#include "linker.h"
+
+/**
+ * @brief What is known about the variables on entry to a command.
+ */
+typedef struct {
+    bool     reached;                // Whether any path leading here has been seen.
+    uint32_t known;                  // Bit `i` is set if variable `i` holds `values[i]`.
+    int64_t  values[NUM_VARIABLES];  // The known values.
+} ConstState;
+
+/**
+ * @brief Finds the variables whose value is known on entry to each command.
+ *
+ * This is the analysis behind `propagate_constants`; see there for how
+ * knowledge flows between commands. Commands that cannot run are left with
+ * `reached` unset.
+ *
+ * @param array The linked command list, laid out as an array.
+ * @return An array with one state per command, to be freed by the caller, or
+ * NULL if memory could not be allocated.
+ */
+ConstState *constants_compute(CommandArray *array);
+
+/**
+ * @brief Looks up the known value of a variable.
+ *
+ * @param state The state to look in.
+ * @param index The variable index.
+ * @param value Set to the variable's value if it is known.
+ * @return True if `index` is a variable whose value is known.
+ */
+bool constant_value(const ConstState *state, int64_t index, int64_t *value);
+
+/**
+ * @brief Propagates and folds constants through a parsed program.
+ *
+ * Tracks which variables hold a value known before execution, starting from
+ * the all-zero state the interpreter begins in. Knowledge flows along
+ * fallthrough, into branch and call targets, and past calls: a return
+ * restores every variable but x0, so everything else known at the call is
+ * still known after it. Where several paths meet, such as at a label that is
+ * branched to, only the variables every path agrees on stay known.
+ *
+ * Arithmetic, bitwise and shift commands whose operands are all known are
+ * rewritten into a `mov` of the result. Shifts by an amount outside 0..63
+ * are left alone so that they still fail when run. Otherwise, a known
+ * variable operand is replaced by its value wherever the command also
+ * accepts an immediate there, which saves a variable read.
+ *
+ * Must run on the linked command list (see `link_commands`), before it is
+ * lowered by `program_init`.
+ *
+ * @param commands Pointer to the first `Command` of the linked list.
+ * @return The number of commands rewritten.
+ */
+size_t propagate_constants(Command *commands);
+
+#endif
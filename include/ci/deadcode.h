@@ -0,0 +1,29 @@
+#ifndef CI_DEADCODE_H
+#define CI_DEADCODE_H
+#include <stdbool.h>
+#include <stddef.h>
+#include "command.h"
+
+/**
+ * @brief Deletes unreachable commands and writes whose result is never read.
+ *
+ * Commands that `liveness_compute` finds unreachable are removed, which
+ * drops functions that are never called. Of the rest, a command whose only
+ * effect is to write a variable or the flags is removed if nothing reads that
+ * result before it is overwritten; the final dump counts as a read unless
+ * `dumps_state` is false. Removing commands repeats until nothing else
+ * becomes dead. Branches and calls to a removed command are redirected to
+ * the next command that is kept.
+ *
+ * Must run on the linked command list (see `link_commands`), before it is
+ * lowered by `program_init`.
+ *
+ * @param commands Pointer to the head of the linked list, updated if the
+ * first command is removed.
+ * @param dumps_state Whether the variables and flags are printed at the end.
+ * @param calls_may_fail Whether a call can fail, ending the program.
+ * @return The number of commands removed.
+ */
+size_t eliminate_dead_code(Command **commands, bool dumps_state, bool calls_may_fail);
+
+#endif
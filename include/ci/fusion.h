@@ -0,0 +1,85 @@
+#ifndef CI_FUSION_H
+#define CI_FUSION_H
+#include <stddef.h>
+#include "profile.h"
+#include "program.h"
+
+// The forms `program_compose` builds composed instructions from: those whose
+// threaded handlers cannot fail and fall through to the next instruction.
+// The threaded engine has a handler for every pair, so the list is given
+// twice: once on its own, and once paired with a fixed first form.
+#define COMPOSABLE_FORMS(X)                                                                   \
+    X(CMD_MOV) X(CMD_AND) X(CMD_EOR) X(CMD_ORR) X(CMD_ADD_RRR) X(CMD_ADD_RRI) X(CMD_SUB_RRR)  \
+    X(CMD_SUB_RRI) X(CMD_CMP_RR) X(CMD_CMP_RI) X(CMD_CMP_U_RR) X(CMD_CMP_U_RI) X(CMD_LSL_RRI) \
+    X(CMD_LSR_RRI) X(CMD_ASR_RRI) X(CMD_LOAD_RII) X(CMD_STORE_RII)
+#define COMPOSABLE_FORMS_AFTER(X, first)                                                      \
+    X(first, CMD_MOV) X(first, CMD_AND) X(first, CMD_EOR) X(first, CMD_ORR)                   \
+    X(first, CMD_ADD_RRR) X(first, CMD_ADD_RRI) X(first, CMD_SUB_RRR) X(first, CMD_SUB_RRI)   \
+    X(first, CMD_CMP_RR) X(first, CMD_CMP_RI) X(first, CMD_CMP_U_RR) X(first, CMD_CMP_U_RI)   \
+    X(first, CMD_LSL_RRI) X(first, CMD_LSR_RRI) X(first, CMD_ASR_RRI) X(first, CMD_LOAD_RII)  \
+    X(first, CMD_STORE_RII)
+
+// A composed instruction keeps the form of its first part and the number of
+// its parts in `target`, which none of the composable forms use
+#define COMPOSED_TYPE(insn)   ((uint8_t) ((insn)->target & 0xFF))
+#define COMPOSED_LENGTH(insn) ((size_t) ((insn)->target >> 8))
+
+#define COMPOSABLE_INDEX(type) COMPOSABLE_##type,
+/**
+ * @brief The composable forms, numbered in the order of `COMPOSABLE_FORMS`.
+ */
+typedef enum {
+    COMPOSABLE_FORMS(COMPOSABLE_INDEX)
+    NUM_COMPOSABLE,
+} ComposableForm;
+#undef COMPOSABLE_INDEX
+
+/**
+ * @brief Replaces common instruction sequences with superinstructions.
+ *
+ * Rewrites the first instruction of each recognized pair or triple into one
+ * of the fused `CommandType`s, which the threaded engine runs in a single
+ * dispatch. The remaining instructions of the group are left in place, so
+ * branch targets keep their indices and the fused handler reads its operands
+ * from them. A group is never formed if any instruction after its first one
+ * can be jumped to, whether by a branch, a call, or a return.
+ *
+ * Compares whose flags are overwritten before any branch reads them are fused
+ * into the _NOFLAGS forms, which do not store the flags at all.
+ *
+ * @param prog Pointer to the `Program` to rewrite.
+ * @return The number of superinstructions formed.
+ */
+size_t program_fuse(Program *prog);
+
+/**
+ * @brief Composes the instruction sequences that ran most often in a profile
+ * into single instructions.
+ *
+ * Picks the `max_sequences` most frequent sequences of the profile that are
+ * made of two composable forms, optionally followed by a branch, and turns
+ * every occurrence of them into a `CMD_COMPOSED` instruction, which the
+ * threaded engine runs in a single dispatch. As with `program_fuse`, the
+ * other instructions of a group stay in place for their operands, and no
+ * group is formed that control can enter other than at its start.
+ *
+ * Must run after `program_fuse` and `program_specialize`, so that the forms
+ * match those the profile was recorded with and hand-written
+ * superinstructions take precedence.
+ *
+ * @param prog Pointer to the `Program` to rewrite.
+ * @param profile Pointer to the `Profile` to pick sequences from.
+ * @param max_sequences Most sequences to compose.
+ * @return The number of instructions composed.
+ */
+size_t program_compose(Program *prog, const Profile *profile, size_t max_sequences);
+
+/**
+ * @brief Finds the position of a form in `COMPOSABLE_FORMS`.
+ *
+ * @param type The `CommandType` of an instruction.
+ * @return The form's `ComposableForm`, or -1 if it is not composable.
+ */
+int composable_index(uint8_t type);
+
+#endif
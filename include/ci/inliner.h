@@ -0,0 +1,51 @@
+#ifndef CI_INLINER_H
+#define CI_INLINER_H
+#include <stdbool.h>
+#include <stddef.h>
+#include "command.h"
+
+#define INLINE_MAX_SIZE       12  // Default for `InlineConfig.max_size`.
+#define INLINE_MIN_LOOP_DEPTH 1   // Default for `InlineConfig.min_loop_depth`.
+
+/**
+ * @brief Limits on which calls `inline_calls` replaces.
+ */
+typedef struct {
+    size_t max_size;        // Most commands a callee may have; 0 disables inlining.
+    size_t min_loop_depth;  // Fewest loops a call must be nested in; 0 allows any call.
+} InlineConfig;
+
+/**
+ * @brief Replaces calls to small leaf functions with a copy of their body.
+ *
+ * A call can be inlined if its callee never calls, never leaves the
+ * program, and has at most `max_size` commands, and the call sits in at
+ * least `min_loop_depth` natural loops. While the state is dumped, the
+ * callee must also be unable to fail, since a failure inside it shows the
+ * callee's variables.
+ *
+ * A return restores every variable but x0, so each variable other than x0
+ * that the callee writes is renamed in the copy to one the callee does not
+ * use and that is dead after the call (see `liveness_compute`), which is
+ * first set from the original if the callee reads it. x0 and the flags are
+ * written directly, as the return would leave them. Each `ret` becomes a
+ * branch to the command after the call. Calls no longer push a frame, so the
+ * peak call depth reported at the end may be lower.
+ *
+ * Nothing is inlined while `calls_may_fail`, since a call past the maximum
+ * depth must still fail.
+ *
+ * Must run on the linked command list (see `link_commands`), before it is
+ * lowered by `program_init`.
+ *
+ * @param commands Pointer to the head of the linked list.
+ * @param config The limits to apply.
+ * @param dumps_state Whether the variables and flags are printed at the end.
+ * @param calls_may_fail Whether a call can fail, ending the program.
+ * @param report Whether to print the decision taken for every call.
+ * @return The number of calls inlined.
+ */
+size_t inline_calls(Command **commands, const InlineConfig *config, bool dumps_state,
+                    bool calls_may_fail, bool report);
+
+#endif
@@ -1,19 +1,94 @@
 #ifndef CI_INTERPRETER_H
 #define CI_INTERPRETER_H
-#include "command.h"
-#include "label_map.h"
+#include "memo.h"
+#include "profile.h"
+#include "program.h"
 
-#define NUM_VARIABLES 32  // Maximum number of defined variables.
+#define NUM_VARIABLES      32   // Maximum number of defined variables.
+#define STACK_MIN_SIZE     64   // Frames allocated by the first call; the stack doubles from there.
+#define TIER_HOT_THRESHOLD 256  // Calls and taken backward branches before a function is promoted.
+#define TIER_LOG_SIZE      16   // Promotions recorded for the stats dump.
+
+// Bits of the packed flag word. A compare sets exactly one of them; the word
+// is zero until the first compare runs.
+#define FLAG_GREATER 0x1
+#define FLAG_EQUAL   0x2
+#define FLAG_LESS    0x4
+
+// The packed flag word for a comparison of `a` with `b`, in their own type.
+#define FLAGS_OF(a, b) \
+    ((uint8_t) (((a) > (b)) * FLAG_GREATER | ((a) == (b)) * FLAG_EQUAL | ((a) < (b)) * FLAG_LESS))
+
+/**
+ * @brief For each `BranchCondition` except BRANCH_NONE, a mask with bit `w` set
+ * if the condition holds when the packed flag word is `w`.
+ */
+static const uint8_t CONDITION_TABLE[] = {
+    [BRANCH_ALWAYS]        = 0xFF,  // Always.
+    [BRANCH_EQUAL]         = 0xCC,  // Equal.
+    [BRANCH_NOT_EQUAL]     = 0x33,  // Not equal.
+    [BRANCH_GREATER]       = 0xAA,  // Greater.
+    [BRANCH_LESS]          = 0xF0,  // Less.
+    [BRANCH_GREATER_EQUAL] = 0xEE,  // Greater or equal.
+    [BRANCH_LESS_EQUAL]    = 0xFC,  // Less or equal.
+};
+
+// Whether `cond` holds for the packed flag word `flags`.
+#define CONDITION_HOLDS(cond, flags) ((CONDITION_TABLE[(cond)] >> (flags)) & 1)
+
+/**
+ * @brief The kind of the last compare, which decides how its operands are
+ * compared when a branch asks for the flags.
+ */
+typedef enum {
+    COMPARE_NONE,      // No compare has run yet; every flag is clear.
+    COMPARE_SIGNED,    // The last compare was `cmp`.
+    COMPARE_UNSIGNED,  // The last compare was `cmp_u`.
+} CompareKind;
 
 /**
  * @brief Represents a single entry in the interpreter's call stack.
  */
-typedef struct st_entry {
-    Command         *command;                   // The command stored in this stack entry.
-    int64_t          variables[NUM_VARIABLES];  // Variables in this stack frame.
-    struct st_entry *next;                      // Pointer to the next stack entry.
+typedef struct {
+    size_t   return_pc;                 // Index of the instruction to return to.
+    uint32_t saved;                     // Mask of the variables saved in this frame.
+    uint32_t memo_slot;                 // Memo entry to record the call's result in,
+                                        // or MEMO_NONE.
+    int64_t  variables[NUM_VARIABLES];  // Variables in this stack frame; only those
+                                        // in `saved` are set.
 } StackEntry;
 
+/**
+ * @brief Selects how `interpret` dispatches instructions.
+ */
+typedef enum {
+    ENGINE_SWITCH,    // Reference engine: a checked switch over every instruction.
+    ENGINE_THREADED,  // Threaded engine: each handler jumps directly to the next one.
+    ENGINE_JIT,       // Compiles the program to native code; see jit.h.
+    ENGINE_TRACE,     // Reference engine that compiles hot loops to native code; see trace.h.
+    ENGINE_TIERED,    // Reference engine that moves hot functions to the threaded engine.
+} Engine;
+
+/**
+ * @brief A function moved to optimized code by the tiered engine.
+ */
+typedef struct {
+    size_t      entry;  // Index of the function's first instruction.
+    const char *name;   // The function's label, or NULL for the code before any function.
+    uint32_t    calls;  // Calls to the function counted when it was promoted.
+    uint32_t    loops;  // Taken backward branches in it counted when it was promoted.
+} TierPromotion;
+
+/**
+ * @brief What the tiered engine did, for the stats dump.
+ */
+typedef struct {
+    TierPromotion promotions[TIER_LOG_SIZE];  // The first promotions, in order.
+    size_t        num_promotions;             // Number of functions promoted.
+    size_t        entries;                    // Times execution moved to optimized code.
+    size_t        exits;                      // Times it came back to the reference engine.
+} TierLog;
+
 /**
  * @brief Represents the state of the interpreter during execution.
  */
@@ -22,30 +97,102 @@ typedef struct {
                                        // interpreter.
     bool had_error;                    // Flag indicating if an error occurred during
                                        // interpretation.
-    LabelMap *label_map;               // Pointer to the map of labels for branch resolution.
-    bool      is_greater;              //  Flag indicating the result of the last comparison
-                                       //  (greater).
-    bool        is_less;               // Flag indicating the result of the last comparison (less).
-    bool        is_equal;              // Flag indicating the result of the last comparison (equal).
-    StackEntry *the_stack;             // Pointer to the top of the interpreter's stack.
+    int64_t     compare_a;             // First operand of the last compare.
+    int64_t     compare_b;             // Second operand of the last compare.
+    uint8_t     compare_kind;          // The `CompareKind` of the last compare. The
+                                       // flags are only evaluated when read.
+    StackEntry *the_stack;             // Contiguous call stack; the top frame is
+                                       // `the_stack[depth - 1]`.
+    size_t      depth;                 // Number of frames on the stack.
+    size_t      capacity;              // Number of frames allocated in `the_stack`.
+    size_t      max_depth;             // Deepest the stack may grow, or 0 for no limit.
+    size_t      peak_depth;            // Deepest the stack has been.
+    MemoTable   memo;                  // Results of calls to pure functions.
+    Engine      engine;                // The dispatch engine used by `interpret`.
+    TierLog     tiers;                 // Promotions made by the tiered engine.
+    Profiler   *profiler;              // Counts instruction sequences as the reference
+                                       // engine runs them, or NULL.
 } Interpreter;
 
 /**
  * @brief Initializes the interpreter state.
  *
  * @param intr Pointer to the `Interpreter` to initialize.
- * @param map Pointer to the `LabelMap` used for jump resolution.
  */
-void interpreter_init(Interpreter *intr, LabelMap *map);
+void interpreter_init(Interpreter *intr);
 
 /**
- * @brief Executes a list of commands using the interpreter.
+ * @brief Executes a lowered program using the interpreter.
+ *
+ * Execution starts at the first instruction and stops when control runs off
+ * the end of the program, a top-level `ret` is reached, or an error occurs.
  *
- * @param intr Pointer to the `Interpreter` that will execute the commands.
- * @param commands Pointer to the first `Command` in the list of commands to
- * interpret.
+ * @param intr Pointer to the `Interpreter` that will execute the program.
+ * @param prog Pointer to the `Program` to interpret.
  */
-void interpret(Interpreter *intr, Command *commands);
+void interpret(Interpreter *intr, Program *prog);
+
+/**
+ * @brief Executes a single print, put, load or store instruction.
+ *
+ * Gives compiled code access to the interpreter's reference semantics for
+ * instructions it does not generate inline.
+ *
+ * @param intr Pointer to the `Interpreter` holding variable state.
+ * @param prog Pointer to the `Program` holding the instruction's constants.
+ * @param insn Pointer to the instruction to execute.
+ * @return true if the instruction succeeded, false on error or if `insn` is
+ * of any other type.
+ */
+bool interpreter_exec(Interpreter *intr, Program *prog, Instruction *insn);
+
+/**
+ * @brief Pushes a call frame holding a snapshot of the given variables.
+ *
+ * Saving only the variables the callee may write, as computed by
+ * `program_compute_clobbers`, is indistinguishable from saving all of them.
+ * The stack doubles in size when it is full. Pushing past `intr->max_depth`
+ * reports a stack overflow instead.
+ *
+ * @param intr Pointer to the `Interpreter` holding variable state.
+ * @param return_pc The index of the instruction to resume at on return.
+ * @param saves The variables to save, as given by `PROGRAM_CALL_SAVES`.
+ * @return true if the frame was pushed, false on stack overflow or if the
+ * stack could not be grown.
+ */
+bool interpreter_push_frame(Interpreter *intr, size_t return_pc, uint32_t saves);
+
+/**
+ * @brief Executes a call marked `is_memoized` by `program_find_pure`.
+ *
+ * If the call's inputs have been seen before, sets x0 and the flags to the
+ * recorded result without running the callee. Otherwise runs it as a normal
+ * (or tail) call and, unless it is a tail call, records its result when it
+ * returns.
+ *
+ * @param intr Pointer to the `Interpreter` holding variable state.
+ * @param prog Pointer to the `Program` holding the call.
+ * @param insn Pointer to the call instruction.
+ * @return The index of the instruction to continue at, or -1 on error.
+ */
+int64_t interpreter_call_memoized(Interpreter *intr, Program *prog, Instruction *insn);
+
+/**
+ * @brief Pops the top call frame, restoring the variables it saved except x0.
+ *
+ * @param intr Pointer to the `Interpreter`, whose `depth` must not be zero.
+ * @return The index of the instruction to resume at.
+ */
+size_t interpreter_pop_frame(Interpreter *intr);
+
+/**
+ * @brief Evaluates the flags set by the last compare.
+ *
+ * @param intr Pointer to the `Interpreter` holding the last compare.
+ * @return The packed flag word: a combination of FLAG_GREATER, FLAG_EQUAL
+ * and FLAG_LESS.
+ */
+uint8_t interpreter_flags(Interpreter *intr);
 
 /**
  * @brief Prints the current state of the interpreter.
@@ -57,4 +204,11 @@ void interpret(Interpreter *intr, Command *commands);
  */
 void print_interpreter_state(Interpreter *intr);
 
+/**
+ * @brief Prints counters collected while running, such as memo hits.
+ *
+ * @param intr Pointer to the `Interpreter` whose counters are to be printed.
+ */
+void print_interpreter_stats(Interpreter *intr);
+
 #endif
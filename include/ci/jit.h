@@ -0,0 +1,73 @@
+#ifndef CI_JIT_H
+#define CI_JIT_H
+#include <stdbool.h>
+#include <stddef.h>
+#include "interpreter.h"
+#include "program.h"
+
+/**
+ * @brief Determines whether this build can compile programs to native code.
+ *
+ * The JIT targets x86-64 Linux only.
+ *
+ * @return true if `jit_run` is able to compile programs, false otherwise.
+ */
+bool jit_available(void);
+
+/**
+ * @brief Compiles a program to x86-64 machine code and runs it.
+ *
+ * Variables stay in `intr->variables`, which the generated code addresses
+ * through a pinned base register, as it does the memory image. Arithmetic,
+ * compares, branches, loads and stores are generated inline. Print, put, and
+ * the call/ret frame snapshots call back into the interpreter, and every
+ * error leaves through a single exit that sets `intr->had_error`.
+ *
+ * Only unfused, unspecialized programs are supported.
+ *
+ * @param intr Pointer to the initialized `Interpreter` to run with.
+ * @param prog Pointer to the `Program` to compile.
+ * @return true if the program was compiled and run, false if it could not be
+ * compiled, in which case nothing was executed.
+ */
+bool jit_run(Interpreter *intr, Program *prog);
+
+/**
+ * @brief A loop trace compiled to machine code.
+ */
+typedef struct JitTrace JitTrace;
+
+/**
+ * @brief Compiles one recorded iteration of a loop to machine code.
+ *
+ * The compiled trace repeats the recorded path for as long as every
+ * conditional branch on it goes the same way it did while recording. Each
+ * branch is compiled to a guard that leaves the trace when it does not.
+ *
+ * @param prog Pointer to the unfused, unspecialized `Program` the trace is from.
+ * @param pcs Indices of the instructions executed in one iteration, starting
+ * at the loop header; the last one is followed by `pcs[0]` again.
+ * @param length Number of entries in `pcs`.
+ * @return The compiled trace, or NULL if it contains calls, returns or
+ * unsupported instructions, or if this build has no JIT.
+ */
+JitTrace *jit_compile_trace(Program *prog, const size_t *pcs, size_t length);
+
+/**
+ * @brief Runs a compiled trace until one of its guards fails.
+ *
+ * @param trace Pointer to the `JitTrace` to run.
+ * @param intr Pointer to the `Interpreter` whose state the trace updates.
+ * @return The index of the instruction to resume interpreting at. Meaningless
+ * if the trace stopped because of an error, which sets `intr->had_error`.
+ */
+size_t jit_run_trace(JitTrace *trace, Interpreter *intr);
+
+/**
+ * @brief Frees a compiled trace.
+ *
+ * @param trace Pointer to the `JitTrace` to free; may be NULL.
+ */
+void jit_free_trace(JitTrace *trace);
+
+#endif
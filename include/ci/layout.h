@@ -0,0 +1,39 @@
+#ifndef CI_LAYOUT_H
+#define CI_LAYOUT_H
+#include <stdbool.h>
+#include "command.h"
+#include "profile.h"
+
+/**
+ * @brief Reorders the basic blocks of a command list so that each
+ * conditional branch falls through to the successor it went to most often.
+ *
+ * Blocks are chained greedily, the most executed branches first: a branch
+ * taken more often than not gets its target placed right after it, and any
+ * other branch keeps its fallthrough. A block that ends in neither a branch
+ * nor a return always stays right before the block it falls into, so a call
+ * still returns to the command after it. The first block stays first, the
+ * other chains keep their source order, so cold blocks end up after the
+ * chains that skip them.
+ *
+ * Where a block no longer precedes the block it used to fall into, its
+ * branch condition is inverted when that makes the new next block the
+ * target, and an unconditional branch is added otherwise. `b.eq` and `b.ne`
+ * can always be inverted; the ordered conditions only after a compare in the
+ * same block, since before any compare `b.gt` and `b.le` are both false.
+ * Every command still runs in the same order, so the program prints and
+ * dumps the same; only the instruction indices change.
+ *
+ * Must run on the linked command list (see `link_commands`), before it is
+ * lowered by `program_init`.
+ *
+ * @param commands Pointer to the head of the linked list, which stays first.
+ * @param profile Branch counts from a run of the same command list, as
+ * lowered by `program_init` and recorded by a `Profiler`.
+ * @return false if the profile does not describe this command list, which is
+ * then left alone; true otherwise, including when memory runs out and the
+ * list is left in order.
+ */
+bool layout_blocks(Command **commands, const Profile *profile);
+
+#endif
@@ -0,0 +1,39 @@
+#ifndef CI_LICM_H
+#define CI_LICM_H
+#include <stdbool.h>
+#include <stddef.h>
+#include "command.h"
+
+/**
+ * @brief Moves commands that compute the same value on every iteration of a
+ * loop out of it.
+ *
+ * Works on the natural loops found by `cfg_build`, innermost first. Hoisted
+ * commands are placed in a preheader inserted just before the loop header,
+ * which every entry into the loop runs once and the loop's back edges skip.
+ * A command may be hoisted if it is a move, arithmetic, bitwise or shift
+ * command, or a load from a loop that never writes memory, and if:
+ *
+ * - nothing else in the loop writes its destination,
+ * - nothing in the loop writes the variables it reads, other than commands
+ *   that are themselves hoisted, and
+ * - either it cannot fail and the old value of its destination is never read
+ *   once the loop is entered (see `liveness_compute`), or it is part of the
+ *   loop header's leading run of hoisted commands, which then run in the same
+ *   order as on the first iteration.
+ *
+ * Loops whose header is called, or is fallen into from inside the loop, are
+ * left alone.
+ *
+ * Must run on the linked command list (see `link_commands`), before it is
+ * lowered by `program_init`.
+ *
+ * @param commands Pointer to the head of the linked list, updated if a
+ * preheader is inserted before the first command.
+ * @param dumps_state Whether the variables and flags are printed at the end.
+ * @param calls_may_fail Whether a call can fail, ending the program.
+ * @return The number of commands hoisted.
+ */
+size_t hoist_loop_invariants(Command **commands, bool dumps_state, bool calls_may_fail);
+
+#endif
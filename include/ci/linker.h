@@ -0,0 +1,79 @@
+#ifndef CI_LINKER_H
+#define CI_LINKER_H
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "command.h"
+#include "label_map.h"
+
+/**
+ * @brief Sentinel target for branches that leave the program.
+ *
+ * Branches to undefined labels starting with ".L" fall off the end of the
+ * program; the linker points them here instead of leaving them unresolved.
+ */
+extern Command link_halt;
+
+#define LINK_HALT (&link_halt)  // Target of a branch that ends execution.
+#define LINK_NO_INDEX (-1)      // Index of a target that is not in the list.
+
+/**
+ * @brief A linked command list laid out as an array, for passes that need to
+ * find a command's position or walk the list backwards.
+ */
+typedef struct {
+    Command **commands;  // The commands, in list order.
+    int64_t  *targets;   // Index of each command's target, or LINK_NO_INDEX if it
+                         // has none, is `LINK_HALT`, or is undefined.
+    size_t    count;     // Number of entries in `commands` and `targets`.
+} CommandArray;
+
+/**
+ * @brief Resolves the label operand of every branch and call command.
+ *
+ * Sets the `target` of each `CMD_BRANCH` and `CMD_CALL` to the labelled
+ * command, so that nothing has to be looked up by name while interpreting.
+ * Branches to undefined ".L" labels are linked to `LINK_HALT`. Any other
+ * undefined label leaves `target` as NULL and is reported on stderr; the
+ * interpreter raises the usual error only if such a command actually runs.
+ *
+ * @param commands Pointer to the first `Command` of the parsed list.
+ * @param map Pointer to the `LabelMap` filled in by the parser.
+ * @return The number of commands referring to undefined labels.
+ */
+size_t link_commands(Command *commands, LabelMap *map);
+
+/**
+ * @brief Lays out a linked command list as an array.
+ *
+ * @param array Pointer to the `CommandArray` to initialize.
+ * @param commands Pointer to the first `Command` of the linked list.
+ * @return true if the array was built, false if memory could not be allocated.
+ */
+bool command_array_init(CommandArray *array, Command *commands);
+
+/**
+ * @brief Unlinks and frees the marked commands of a list.
+ *
+ * Only commands that fall through to the next one may be removed. Branches
+ * and calls to a removed command are redirected to the next command that is
+ * kept, or to `LINK_HALT` if none is.
+ *
+ * @param commands Pointer to the head of the linked list, updated if the
+ * first command is removed.
+ * @param array The list laid out as an array; its commands must not be used
+ * afterwards.
+ * @param removed Whether each command of `array` is to be removed.
+ * @return The number of commands removed.
+ */
+size_t remove_commands(Command **commands, CommandArray *array, const bool *removed);
+
+/**
+ * @brief Frees the resources associated with a command array, but not the
+ * commands themselves.
+ *
+ * @param array Pointer to the `CommandArray` to free.
+ */
+void command_array_free(CommandArray *array);
+
+#endif
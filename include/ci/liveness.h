@@ -0,0 +1,83 @@
+#ifndef CI_LIVENESS_H
+#define CI_LIVENESS_H
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "command.h"
+#include "interpreter.h"
+#include "linker.h"
+
+// Liveness masks have bit `i` set for variable `i`, and LIVE_FLAGS for the flags
+#define LIVE_FLAGS  ((uint64_t) 1 << NUM_VARIABLES)
+#define LIVE_ALL    (((uint64_t) 1 << (NUM_VARIABLES + 1)) - 1)
+#define LIVE_AT_RET ((uint64_t) 1 | LIVE_FLAGS)  // What a return hands back: x0 and the flags.
+
+/**
+ * @brief Which commands of a linked list can run, and what each may read
+ * before it is written.
+ */
+typedef struct {
+    bool     *reached;      // Whether each command can run at all.
+    bool     *top_level;    // Whether each command can run outside of any call.
+    bool     *in_function;  // Whether each command can run inside a call.
+    uint64_t *live;         // What is live on entry to each command, with one extra
+                            // entry for falling off the end of the list.
+} Liveness;
+
+/**
+ * @brief Computes which commands are reachable and what is live before each.
+ *
+ * Commands are reachable from the first command through fallthrough,
+ * branches, calls and returns. A return restores every variable but x0, so a
+ * `ret` that can only run inside a call reads just x0 and the flags.
+ *
+ * The final dump of variables and flags reads all of them, both when the
+ * program ends and when a command fails. If `dumps_state` is false the dump
+ * is assumed to be disabled and neither counts as a read. Calls are only
+ * treated as able to fail when `calls_may_fail` is set, as they are when a
+ * maximum call depth is in effect.
+ *
+ * @param liveness Pointer to the `Liveness` to fill in.
+ * @param array The linked command list, laid out as an array.
+ * @param dumps_state Whether the variables and flags are printed at the end.
+ * @param calls_may_fail Whether a call can fail, ending the program.
+ * @return true on success, false if memory could not be allocated.
+ */
+bool liveness_compute(Liveness *liveness, CommandArray *array, bool dumps_state,
+                      bool calls_may_fail);
+
+/**
+ * @brief Frees the resources associated with a liveness analysis.
+ *
+ * @param liveness Pointer to the `Liveness` to free.
+ */
+void liveness_free(Liveness *liveness);
+
+/**
+ * @brief Determines whether a command that is not control flow may fail.
+ *
+ * Follows the same rules as `program_verify`.
+ *
+ * @param cmd The command to check.
+ * @return False if the command is known to always succeed, true otherwise.
+ */
+bool command_may_fail(const Command *cmd);
+
+/**
+ * @brief Finds the variables a command that is not control flow reads.
+ *
+ * @param cmd The command.
+ * @return A liveness mask of the variables read.
+ */
+uint64_t command_reads(const Command *cmd);
+
+/**
+ * @brief Finds the variables and flags a command that is not control flow
+ * writes.
+ *
+ * @param cmd The command.
+ * @return A liveness mask of what is written, with LIVE_FLAGS for compares.
+ */
+uint64_t command_writes(const Command *cmd);
+
+#endif
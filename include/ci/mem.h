@@ -26,6 +26,16 @@ bool mem_load(uint8_t *destination, size_t offset, size_t bytes);
  */
 bool mem_store(uint8_t *source, size_t offset, size_t bytes);
 
+/**
+ * @brief Returns the backing memory image of `MEM_CAPACITY` bytes.
+ *
+ * Lets generated code address memory directly. Callers are responsible for
+ * their own bounds checks.
+ *
+ * @return A pointer to the first byte of memory.
+ */
+uint8_t *mem_image(void);
+
 /**
  * @brief Prints the memory state to the console
  */
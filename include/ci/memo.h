@@ -0,0 +1,94 @@
+#ifndef CI_MEMO_H
+#define CI_MEMO_H
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "program.h"
+
+#define MEMO_CAPACITY 16384       // Entries in a memo table; must be a power of two.
+#define MEMO_NONE     UINT32_MAX  // Slot of a call whose result is not being recorded.
+
+/**
+ * @brief The state of a memo table entry.
+ */
+typedef enum {
+    MEMO_EMPTY,    // The entry holds nothing.
+    MEMO_PENDING,  // The entry's call is still running.
+    MEMO_READY,    // The entry holds the result of a call.
+} MemoState;
+
+/**
+ * @brief The recorded result of one call to a pure function.
+ */
+typedef struct {
+    uint8_t  state;                       // The `MemoState` of the entry.
+    uint8_t  function;                    // Index of the function in the program's `pure`.
+    uint8_t  flags_in;                    // The flag word on entry, if the function reads it.
+    uint8_t  flags_out;                   // The flag word on return.
+    uint32_t depth;                       // Stack depth of the call while it is pending.
+    int64_t  inputs[PROGRAM_MAX_INPUTS];  // Values of the function's input variables.
+    int64_t  result;                      // The value of x0 on return.
+} MemoEntry;
+
+/**
+ * @brief A fixed-size, direct-mapped table of call results.
+ *
+ * Each call hashes to a single entry. Recording a call evicts whatever that
+ * entry held before, so the table never grows past MEMO_CAPACITY entries.
+ */
+typedef struct {
+    MemoEntry *entries;    // The entries, allocated on first use.
+    size_t     hits;       // Calls answered from the table.
+    size_t     misses;     // Calls that had to run.
+    size_t     evictions;  // Recorded results overwritten by another call.
+} MemoTable;
+
+/**
+ * @brief Initializes an empty memo table.
+ *
+ * @param memo Pointer to the `MemoTable` to initialize.
+ */
+void memo_init(MemoTable *memo);
+
+/**
+ * @brief Frees a memo table's entries, keeping its counters.
+ *
+ * @param memo Pointer to the `MemoTable` to free.
+ */
+void memo_free(MemoTable *memo);
+
+/**
+ * @brief Looks up a call to a pure function.
+ *
+ * On a miss, the call's entry is claimed for it if `slot` is not NULL, and
+ * must be completed with `memo_fill` when the call returns.
+ *
+ * @param memo Pointer to the `MemoTable` to search.
+ * @param prog Pointer to the `Program` holding the function.
+ * @param function Index of the function in `prog->pure`.
+ * @param variables The variables at the time of the call.
+ * @param flags The flag word at the time of the call.
+ * @param depth The stack depth the call will run at.
+ * @param slot Set to the claimed entry, or MEMO_NONE if none was; may be NULL.
+ * @param result Set to the recorded x0 on a hit.
+ * @param flags_out Set to the recorded flag word on a hit.
+ * @return true on a hit, false on a miss.
+ */
+bool memo_lookup(MemoTable *memo, Program *prog, uint8_t function, const int64_t *variables,
+                 uint8_t flags, size_t depth, uint32_t *slot, int64_t *result,
+                 uint8_t *flags_out);
+
+/**
+ * @brief Records the result of a call claimed by `memo_lookup`.
+ *
+ * Does nothing if the entry has since been claimed by another call.
+ *
+ * @param memo Pointer to the `MemoTable` holding the entry.
+ * @param slot The slot returned by `memo_lookup`.
+ * @param depth The stack depth the call ran at.
+ * @param result The value of x0 on return.
+ * @param flags The flag word on return.
+ */
+void memo_fill(MemoTable *memo, uint32_t slot, size_t depth, int64_t result, uint8_t flags);
+
+#endif
@@ -0,0 +1,48 @@
+#ifndef CI_PEEPHOLE_H
+#define CI_PEEPHOLE_H
+#include <stddef.h>
+#include "command.h"
+
+/**
+ * @brief The rewrite rules of the peephole optimizer, in the order they are
+ * tried. Each has an entry in the rule table of peephole.c.
+ */
+typedef enum {
+    PEEPHOLE_REDUNDANT_MOVE,  // Drops a command that leaves its destination unchanged.
+    PEEPHOLE_ZERO_OPERAND,    // Turns an operation with a zero operand into a copy.
+    PEEPHOLE_ADD_CHAIN,       // Merges two immediate adds or subtracts.
+    PEEPHOLE_SHIFT_CHAIN,     // Merges two immediate shifts of the same kind.
+    PEEPHOLE_REDUNDANT_MASK,  // Drops an and that only keeps bits a shift left clear.
+    PEEPHOLE_DEAD_COMPARE,    // Drops a compare whose flags are replaced unread.
+    PEEPHOLE_NUM_RULES,
+} PeepholeRule;
+
+/**
+ * @brief Applies local rewrite rules to short runs of commands.
+ *
+ * Each rule looks at one command, or at a command and those following it in
+ * the same basic block, and rewrites or drops them when a cheaper sequence
+ * has the same effect. Rules may use the values `constants_compute` knows
+ * variables to hold, for instance to treat a variable as a zero register.
+ * Passes over the list repeat until no rule applies.
+ *
+ * Must run on the linked command list (see `link_commands`), before it is
+ * lowered by `program_init`.
+ *
+ * @param commands Pointer to the head of the linked list, updated if the
+ * first command is dropped.
+ * @param hits Array of PEEPHOLE_NUM_RULES counters, each increased by the
+ * number of times its rule applied.
+ * @return The total number of times any rule applied.
+ */
+size_t peephole_optimize(Command **commands, size_t *hits);
+
+/**
+ * @brief Prints how many times each peephole rule applied.
+ *
+ * @param hits Array of PEEPHOLE_NUM_RULES counters, as filled in by
+ * `peephole_optimize`.
+ */
+void print_peephole_hits(const size_t *hits);
+
+#endif
@@ -0,0 +1,147 @@
+#ifndef CI_PROFILE_H
+#define CI_PROFILE_H
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "program.h"
+
+#define PROFILE_MAX_LENGTH    3   // Longest instruction sequence counted.
+#define PROFILE_TOP_SEQUENCES 16  // Most sequences `program_compose` builds handlers for.
+
+/**
+ * @brief A sequence of instruction forms and how often it ran.
+ *
+ * A form is the `CommandType` an instruction has once `program_specialize`
+ * has run, which tells its operand kinds apart: `add_rri` and `add_rrr` are
+ * different forms.
+ */
+typedef struct {
+    uint64_t count;                      // Times the sequence ran.
+    uint8_t  forms[PROFILE_MAX_LENGTH];  // The form of each instruction, in order.
+    uint8_t  length;                     // Number of instructions: 2 or 3.
+} ProfileSequence;
+
+/**
+ * @brief How often a branch instruction went each way.
+ */
+typedef struct {
+    size_t   index;      // Index of the branch in the profiled program.
+    uint64_t taken;      // Times the branch jumped to its target.
+    uint64_t not_taken;  // Times it fell through to the next instruction.
+} ProfileBranch;
+
+/**
+ * @brief Dynamic bigram and trigram counts of instruction forms, and the
+ * direction counts of every branch that ran.
+ */
+typedef struct {
+    ProfileSequence *sequences;      // Every sequence that ran, by decreasing count.
+    size_t           num_sequences;  // Number of entries in `sequences`.
+    ProfileBranch   *branches;       // Every branch that ran, by index.
+    size_t           num_branches;   // Number of entries in `branches`.
+    size_t           length;         // Number of instructions in the profiled program.
+} Profile;
+
+/**
+ * @brief Counters updated while a program runs, for building a `Profile`.
+ *
+ * Only instructions that run one after the other in program order are
+ * counted together, whether the first falls through or branches to the
+ * next: those are the sequences `program_compose` can turn into one
+ * instruction. A branch counts as taken whenever the instruction run after
+ * it is not the next one.
+ */
+typedef struct {
+    uint8_t  *forms;      // The form of each instruction.
+    uint64_t *pairs;      // Times each instruction ran right after the one before it.
+    uint64_t *triples;    // Times each ran right after the two before it.
+    uint64_t *taken;      // Times each branch jumped to its target.
+    uint64_t *not_taken;  // Times each branch fell through.
+    size_t    length;     // Number of instructions in the program.
+    size_t    last;       // Index of the instruction that ran last.
+    size_t    run;        // Instructions run in program order up to `last`.
+} Profiler;
+
+/**
+ * @brief Initializes a profiler with zeroed counters for a program.
+ *
+ * @param profiler Pointer to the `Profiler` to initialize.
+ * @param prog Pointer to the unfused, unspecialized `Program` to profile.
+ * @return true on success, false if memory could not be allocated.
+ */
+bool profiler_init(Profiler *profiler, Program *prog);
+
+/**
+ * @brief Frees the resources associated with a profiler.
+ *
+ * @param profiler Pointer to the `Profiler` to free.
+ */
+void profiler_free(Profiler *profiler);
+
+/**
+ * @brief Counts an instruction about to be executed.
+ *
+ * @param profiler Pointer to the `Profiler` of the running program.
+ * @param pc Index of the instruction.
+ */
+static inline void profiler_record(Profiler *profiler, size_t pc) {
+    if (profiler->run && profiler->forms[profiler->last] == CMD_BRANCH) {
+        if (pc == profiler->last + 1) {
+            profiler->not_taken[profiler->last]++;
+        } else {
+            profiler->taken[profiler->last]++;
+        }
+    }
+    if (profiler->run && pc == profiler->last + 1) {
+        profiler->pairs[pc]++;
+        if (profiler->run >= 2) {
+            profiler->triples[pc]++;
+        }
+        profiler->run++;
+    } else {
+        profiler->run = 1;
+    }
+    profiler->last = pc;
+}
+
+/**
+ * @brief Sums a profiler's counters by the forms of the instructions.
+ *
+ * @param profiler Pointer to the `Profiler` to summarize.
+ * @param profile Pointer to the `Profile` to initialize.
+ * @return true on success, false if memory could not be allocated.
+ */
+bool profiler_summarize(const Profiler *profiler, Profile *profile);
+
+/**
+ * @brief Writes a profile as text: the number of instructions profiled, one
+ * line per branch with its index and direction counts, then one line per
+ * sequence with its count and the names of its forms.
+ *
+ * @param profile Pointer to the `Profile` to write.
+ * @param out The stream to write to.
+ * @return true if the profile was written, false if writing failed.
+ */
+bool profile_write(const Profile *profile, FILE *out);
+
+/**
+ * @brief Reads a profile written by `profile_write`.
+ *
+ * Blank lines and lines starting with `#` are ignored.
+ *
+ * @param profile Pointer to the `Profile` to initialize.
+ * @param in The stream to read from.
+ * @return true on success, false if a line is malformed, names an unknown
+ * form, or memory could not be allocated.
+ */
+bool profile_read(Profile *profile, FILE *in);
+
+/**
+ * @brief Frees the resources associated with a profile.
+ *
+ * @param profile Pointer to the `Profile` to free.
+ */
+void profile_free(Profile *profile);
+
+#endif
@@ -0,0 +1,116 @@
+#ifndef CI_PROGRAM_H
+#define CI_PROGRAM_H
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "command.h"
+
+#define PROGRAM_NO_TARGET  (-1)         // Target of an instruction whose label is undefined.
+#define PROGRAM_SAVE_ALL   0xFFFFFFFEu  // Call save mask covering every variable but x0.
+#define PROGRAM_MAX_INPUTS 4            // Most variables a memoized function may read.
+#define PROGRAM_MAX_PURE   256          // Most functions a program may memoize.
+
+/**
+ * @brief A single lowered instruction, packed into 16 bytes.
+ *
+ * Mirrors `Command`, except that instructions live in one contiguous array and
+ * control flow is expressed through indices into that array: fallthrough is
+ * always `pc + 1` and branch/call targets are stored in `target`.
+ *
+ * Variable operands are stored as their index. Immediates are stored inline
+ * when they fit in 32 bits and in the program's constant pool otherwise;
+ * strings (including label names) always live in the string pool. Use
+ * `PROGRAM_OPERAND_A/B` and `PROGRAM_STRING_A` to read operands.
+ */
+typedef struct {
+    uint8_t type;                 // The type of the instruction (a `CommandType`).
+    int8_t  branch_condition;     // The branching condition (a `BranchCondition`).
+    uint8_t destination;          // The destination variable (the index into the
+                                  // program's pure functions for a memoized call).
+    bool    is_a_immediate : 1;   // Indicates if the first operand is an immediate.
+    bool    is_b_immediate : 1;   // Indicates if the second operand is an immediate.
+    bool    is_a_pooled    : 1;   // Indicates if `val_a` indexes the constant pool.
+    bool    is_b_pooled    : 1;   // Indicates if `val_b` indexes the constant pool.
+    bool    is_a_string    : 1;   // Indicates if `val_a` indexes the string pool.
+    bool    is_verified    : 1;   // Set by `program_verify` if the instruction cannot fail.
+    bool    is_tail_call   : 1;   // Set on a call directly followed by ret.
+    bool    is_memoized    : 1;   // Set by `program_find_pure` on a call to a pure function.
+    int32_t val_a;                // The first operand.
+    int32_t val_b;                // The second operand (the base character for print,
+                                  // the save mask for call).
+    int32_t target;               // Index of the branch/call target (`length` to
+                                  // halt), or PROGRAM_NO_TARGET if undefined.
+} Instruction;
+
+_Static_assert(sizeof(Instruction) == 16, "Instruction must stay packed into 16 bytes");
+
+/**
+ * @brief A function whose effect on return depends only on its inputs; see
+ * purity.h.
+ */
+typedef struct {
+    uint8_t num_inputs;                  // Number of variables in `inputs`.
+    uint8_t inputs[PROGRAM_MAX_INPUTS];  // Variables the function may read before
+                                         // writing them.
+    bool    reads_flags;                 // Whether the flags on entry affect the result.
+} PureFunction;
+
+/**
+ * @brief A parsed program lowered into a flat instruction array.
+ */
+typedef struct {
+    Instruction  *code;           // Contiguous array of instructions, followed by a
+                                  // CMD_HALT sentinel at index `length`.
+    size_t        length;         // Number of instructions in `code`, excluding the sentinel.
+    int64_t      *constants;      // Immediates too wide to be stored in an instruction.
+    size_t        num_constants;  // Number of entries in `constants`.
+    char        **strings;        // String operands and label names.
+    size_t        num_strings;    // Number of entries in `strings`.
+    PureFunction *pure;           // Functions whose calls may be memoized.
+    size_t        num_pure;       // Number of entries in `pure`.
+} Program;
+
+// The full value of an instruction's first or second operand: a variable
+// index, or an immediate read from the constant pool if it did not fit inline.
+#define PROGRAM_OPERAND_A(prog, insn) \
+    ((insn)->is_a_pooled ? (prog)->constants[(insn)->val_a] : (int64_t) (insn)->val_a)
+#define PROGRAM_OPERAND_B(prog, insn) \
+    ((insn)->is_b_pooled ? (prog)->constants[(insn)->val_b] : (int64_t) (insn)->val_b)
+
+// The string operand of a put, or the label name of a branch or call.
+#define PROGRAM_STRING_A(prog, insn) ((prog)->strings[(insn)->val_a])
+
+// The variables a call saves and its return restores, as a mask with bit `i`
+// set for variable `i`. PROGRAM_SAVE_ALL until `program_compute_clobbers`.
+#define PROGRAM_CALL_SAVES(insn) ((uint32_t) (insn)->val_b)
+
+/**
+ * @brief Lowers a linked list of commands into a flat program.
+ *
+ * Copies every command into one contiguous array and translates the targets
+ * set by `link_commands` into array indices. A branch linked to `LINK_HALT`
+ * targets index `length`, one past the last instruction. String operands are
+ * moved into the program's string pool and wide immediates are copied into
+ * its constant pool, so the command list may (and should) be freed once this
+ * returns.
+ *
+ * A call directly followed by `ret` is marked as a tail call. When the stack
+ * is not empty, engines run it as a plain jump: the callee's `ret` then pops
+ * the caller's frame, which restores everything the callee wrote as long as
+ * the caller's save mask covers the callee's (see `program_compute_clobbers`).
+ * At the top level, where that `ret` would halt instead, it is a normal call.
+ *
+ * @param prog Pointer to the `Program` to initialize.
+ * @param commands Pointer to the first `Command` of the linked list.
+ * @return true if the program was lowered successfully, false otherwise.
+ */
+bool program_init(Program *prog, Command *commands);
+
+/**
+ * @brief Frees the resources associated with a program.
+ *
+ * @param prog Pointer to the `Program` to free.
+ */
+void program_free(Program *prog);
+
+#endif
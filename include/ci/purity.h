@@ -0,0 +1,29 @@
+#ifndef CI_PURITY_H
+#define CI_PURITY_H
+#include <stddef.h>
+#include "program.h"
+
+/**
+ * @brief Finds the call targets whose calls can be memoized.
+ *
+ * A call's only lasting effects are x0 and the flags, because its return
+ * restores every other variable. A function is pure if it never touches
+ * memory, never prints, never refers to an undefined label, and only calls
+ * pure functions. Such a function always returns the same x0 and flags for
+ * the same inputs. Its inputs are the variables, and possibly the flags, it
+ * may read before writing them, including x0 and the flags when some path
+ * leaves them unchanged.
+ *
+ * Pure functions with at most PROGRAM_MAX_INPUTS input variables are added
+ * to `prog->pure`, and every call to one gets `is_memoized` set, with its
+ * `destination` holding the function's index.
+ *
+ * Must run on the program as lowered, before `program_fuse` and
+ * `program_specialize`.
+ *
+ * @param prog Pointer to the `Program` to analyze.
+ * @return The number of calls marked as memoized.
+ */
+size_t program_find_pure(Program *prog);
+
+#endif
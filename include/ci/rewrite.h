@@ -0,0 +1,57 @@
+#ifndef CI_REWRITE_H
+#define CI_REWRITE_H
+#include <stdbool.h>
+#include <stdint.h>
+#include "command.h"
+
+#define REWRITE_NO_VARIABLE (-1)  // A rename table entry that keeps its name, or no spare found.
+
+/**
+ * @brief Creates a command with no operands.
+ *
+ * @param type The type of the command.
+ * @return The command, or NULL if memory could not be allocated.
+ */
+Command *command_new(CommandType type);
+
+/**
+ * @brief Creates a branch to a command, for a pass that adds control flow.
+ *
+ * @param condition The branch condition.
+ * @param target The command to branch to, `LINK_HALT`, or NULL if it is set
+ * later.
+ * @param label The label to show for the target, which is copied.
+ * @return The command, or NULL if memory could not be allocated.
+ */
+Command *command_new_branch(BranchCondition condition, Command *target, const char *label);
+
+/**
+ * @brief Copies a command, unlinked, with its own copies of any strings.
+ *
+ * @param cmd The command to copy.
+ * @param rename NULL to keep every variable, or what each of the
+ * NUM_VARIABLES variables becomes in the copy, REWRITE_NO_VARIABLE for one
+ * that keeps its name.
+ * @return The copy, or NULL if memory could not be allocated.
+ */
+Command *command_copy(const Command *cmd, const int8_t *rename);
+
+/**
+ * @brief Finds a variable other than x0 that a pass may use for its own
+ * value over a stretch of the list.
+ *
+ * A variable the stretch does not use will do if it is dead after the
+ * stretch, or if nothing in the list writes it, so that it is known to be
+ * zero and can be zeroed again at the end. Dead variables are preferred,
+ * as they need nothing done at the end; among either kind, the highest.
+ *
+ * @param used Variables the stretch reads or writes, as a liveness mask.
+ * @param live_after What is live after the stretch.
+ * @param written Variables some command of the list writes.
+ * @param restore Set to whether the variable must be zeroed again.
+ * @return The variable, or REWRITE_NO_VARIABLE if there is none.
+ */
+int64_t find_spare_variable(uint64_t used, uint64_t live_after, uint64_t written,
+                            bool *restore);
+
+#endif
@@ -0,0 +1,27 @@
+#ifndef CI_SPECIALIZE_H
+#define CI_SPECIALIZE_H
+#include <stddef.h>
+#include "program.h"
+
+/**
+ * @brief Rewrites instructions into forms specialized by operand kind.
+ *
+ * Replaces `add`, `sub`, `cmp`, `cmp_u`, `load`, `store` and immediate shifts
+ * with variants such as `CMD_ADD_RRI` whose threaded handlers know up front
+ * which operands are variables and which are immediates. Shifts, and loads
+ * and stores at immediate addresses, are only specialized once
+ * `program_verify` has proven them valid, so their handlers need no checks;
+ * loads and stores at variable addresses keep only their bounds check.
+ * Anything else keeps the generic, checked form and still fails at runtime.
+ * Instructions with an immediate in the constant pool are also left generic,
+ * so specialized handlers can read their immediates straight from the
+ * instruction.
+ *
+ * Superinstructions formed by `program_fuse` are left untouched.
+ *
+ * @param prog Pointer to the `Program` to rewrite.
+ * @return The number of instructions specialized.
+ */
+size_t program_specialize(Program *prog);
+
+#endif
@@ -0,0 +1,160 @@
+#ifndef CI_SSA_H
+#define CI_SSA_H
+#include <stdbool.h>
+#include <stddef.h>
+#include "cfg.h"
+#include "command.h"
+#include "interpreter.h"
+
+// Slots are the variables, then the flags and memory, which are versioned alike
+#define SSA_FLAGS     NUM_VARIABLES        // Slot of the comparison flags.
+#define SSA_MEMORY    (NUM_VARIABLES + 1)  // Slot of the whole of memory.
+#define SSA_NUM_SLOTS (NUM_VARIABLES + 2)
+
+#define SSA_NO_VALUE ((size_t) -1)  // No value, for operands that are not variables.
+#define SSA_ENTRY    ((size_t) -1)  // The predecessor of a root block, entered from outside.
+
+/**
+ * @brief How an SSA value comes to be.
+ */
+typedef enum {
+    SSA_VALUE_ENTRY,  // What a slot holds when a root block is entered from outside.
+    SSA_VALUE_PHI,    // The merge of a slot's values where control flow joins.
+    SSA_VALUE_INSTR,  // The result of an instruction.
+} SsaValueKind;
+
+/**
+ * @brief The register operands of an instruction.
+ */
+typedef enum {
+    SSA_OPERAND_DEST,  // The destination, read as a source only by `store`.
+    SSA_OPERAND_A,
+    SSA_OPERAND_B,
+    SSA_NUM_OPERANDS,
+} SsaOperand;
+
+/**
+ * @brief A value assigned exactly once: a version of one slot.
+ */
+typedef struct {
+    SsaValueKind kind;   // How the value is defined.
+    size_t       slot;   // The variable, SSA_FLAGS or SSA_MEMORY this is a version of.
+    size_t       block;  // The block the value is defined in.
+    size_t       def;    // The defining instruction or phi; unused for entry values.
+} SsaValue;
+
+/**
+ * @brief A phi at the start of a block, choosing a value by the edge taken.
+ */
+typedef struct {
+    size_t value;  // The value the phi defines.
+    size_t args;   // Start in `pool` of one value per predecessor of the block.
+} SsaPhi;
+
+/**
+ * @brief A command and the values it reads and writes.
+ *
+ * Memory is a single slot: loads and `print` of a string read it, while
+ * stores and `put` read it and write a new version. A call hands every slot
+ * to the callee and writes only x0, the flags and memory, since returning
+ * restores every other variable; the values of the other variables after a
+ * call are those before it. A return hands back every slot, as it ends the
+ * program when no call is active.
+ */
+typedef struct {
+    Command *cmd;                      // The command, for its type, immediates and target.
+    size_t   block;                    // The block the instruction belongs to.
+    bool     removed;                  // Whether lowering should leave it out.
+    size_t   uses[SSA_NUM_OPERANDS];   // Values read by the operands that are variables.
+    size_t   flags_in;                 // Flags read by a conditional branch.
+    size_t   memory_in;                // Memory read by loads, stores, strings, calls and returns.
+    size_t   result;                   // Variable written by the command.
+    size_t   flags_out;                // Flags written by compares and calls.
+    size_t   memory_out;               // Memory written by stores, `put` and calls.
+    size_t   state;                    // Start in `pool` of every slot's value, for calls and
+                                       // returns; SSA_NO_VALUE otherwise.
+} SsaInstr;
+
+/**
+ * @brief The SSA view of a basic block of the control-flow graph.
+ */
+typedef struct {
+    bool   reached;    // Whether the block can run; unreachable blocks have no values.
+    size_t preds;      // Start in `pool` of the predecessors; SSA_ENTRY for a root.
+    size_t num_preds;  // Number of predecessors, including SSA_ENTRY.
+    size_t phis;       // Index of the block's first phi in `phis`.
+    size_t num_phis;   // Number of phis of the block.
+    size_t out;        // Start in `pool` of every slot's value when the block ends.
+} SsaBlock;
+
+/**
+ * @brief A linked command list in static single assignment form.
+ *
+ * Each block and instruction of `cfg` has an entry in `blocks` and `instrs`,
+ * with the same index. Every slot has a value at the start of every root,
+ * the first block and each called block; those of the first block are the
+ * zeros the interpreter starts from. Phis are placed where values of a slot
+ * defined in different places meet, and at every reachable block that no
+ * single block dominates.
+ */
+typedef struct {
+    Cfg       cfg;         // The graph the form is built on.
+    SsaBlock *blocks;      // One per block of `cfg`.
+    SsaInstr *instrs;      // One per command of `cfg.array`.
+    SsaValue *values;      // Every value.
+    size_t    num_values;  // Number of entries in `values`.
+    SsaPhi   *phis;        // Every phi, grouped by block.
+    size_t    num_phis;    // Number of entries in `phis`.
+    size_t   *pool;        // Storage for the lists indexed by blocks, phis and instructions.
+    size_t    pool_size;   // Number of entries used in `pool`.
+    size_t    pool_cap;    // Number of entries allocated for `pool`.
+} SsaProgram;
+
+/**
+ * @brief Builds the SSA form of a linked command list.
+ *
+ * Must run on the linked command list (see `link_commands`), before it is
+ * lowered by `program_init`. The commands are borrowed and must outlive the
+ * form.
+ *
+ * @param ssa Pointer to the `SsaProgram` to initialize.
+ * @param commands Pointer to the first `Command` of the linked list.
+ * @return true if the form was built, false if memory could not be allocated.
+ */
+bool ssa_build(SsaProgram *ssa, Command *commands);
+
+/**
+ * @brief Frees the resources associated with an SSA form, but not the
+ * commands it was built from.
+ *
+ * @param ssa Pointer to the `SsaProgram` to free.
+ */
+void ssa_free(SsaProgram *ssa);
+
+/**
+ * @brief Prints an SSA form, one block at a time, in a human-readable format.
+ *
+ * @param ssa The form to print.
+ */
+void ssa_print(const SsaProgram *ssa);
+
+/**
+ * @brief Lowers an SSA form back into a linked command list.
+ *
+ * Instructions are emitted in block order, leaving out those marked as
+ * removed, with each operand and destination naming the variable its value
+ * is a version of. Phis need no code, which requires every phi's arguments
+ * to be versions of the phi's own slot. Branches and calls to a removed
+ * instruction go to the next one that is kept.
+ *
+ * The new list has its own copies of any strings, so the old one is left
+ * as it was, to be freed by the caller.
+ *
+ * @param ssa The form to lower.
+ * @param commands Set to the first `Command` of the new list.
+ * @return true on success, false if a phi merges different slots or memory
+ * could not be allocated.
+ */
+bool ssa_lower(SsaProgram *ssa, Command **commands);
+
+#endif
@@ -0,0 +1,76 @@
+#ifndef CI_TRACE_H
+#define CI_TRACE_H
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "interpreter.h"
+#include "jit.h"
+#include "program.h"
+
+#define TRACE_HOT_THRESHOLD 64   // Taken backward branches before a loop is traced.
+#define TRACE_MAX_LENGTH    512  // Longest trace recorded before giving up.
+#define TRACE_NOT_RECORDING (-1) // `TraceCache.header` when no trace is being recorded.
+
+/**
+ * @brief Hot loop detection and the traces compiled for hot loops.
+ *
+ * Every taken backward branch counts towards its target, the loop header.
+ * Once a header is hot, the next iteration through it is recorded and
+ * compiled with `jit_compile_trace`, and later iterations run the compiled
+ * trace instead of being interpreted.
+ */
+typedef struct {
+    Program   *prog;      // The program being run.
+    uint32_t  *counters;  // Taken backward branches into each instruction.
+    JitTrace **traces;    // The compiled trace for each loop header, if any.
+    size_t    *recorded;  // Instructions executed so far while recording.
+    size_t     length;    // Number of entries in `recorded`.
+    int64_t    header;    // Loop header being recorded, or -1 if not recording.
+} TraceCache;
+
+/**
+ * @brief Initializes an empty trace cache for a program.
+ *
+ * @param cache Pointer to the `TraceCache` to initialize.
+ * @param prog Pointer to the unfused, unspecialized `Program` to trace.
+ * @return true on success, false if memory could not be allocated.
+ */
+bool trace_cache_init(TraceCache *cache, Program *prog);
+
+/**
+ * @brief Frees the resources associated with a trace cache, including every
+ * compiled trace.
+ *
+ * @param cache Pointer to the `TraceCache` to free.
+ */
+void trace_cache_free(TraceCache *cache);
+
+/**
+ * @brief Notes a taken branch, and runs the trace for its target if it is a
+ * loop header with a compiled trace.
+ *
+ * Starts recording once the target becomes hot. Does nothing while a trace is
+ * being recorded, as the recording has to see every instruction executed.
+ *
+ * @param cache Pointer to the `TraceCache` of the running program.
+ * @param intr Pointer to the `Interpreter` running the program.
+ * @param from Index of the branch.
+ * @param to Index of the branch target.
+ * @return The index to continue interpreting at: `to`, wherever the trace
+ * left the loop, or the program length if the trace stopped on an error.
+ */
+size_t trace_branch(TraceCache *cache, Interpreter *intr, size_t from, size_t to);
+
+/**
+ * @brief Records an instruction about to be executed while a trace is being
+ * recorded, and compiles the trace once execution is back at its header.
+ *
+ * A loop whose trace grows too long or reaches a call or return is never
+ * traced again.
+ *
+ * @param cache Pointer to the `TraceCache` of the running program.
+ * @param pc Index of the instruction about to be executed.
+ */
+void trace_record(TraceCache *cache, size_t pc);
+
+#endif
@@ -0,0 +1,31 @@
+#ifndef CI_TRANSPILE_H
+#define CI_TRANSPILE_H
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include "program.h"
+
+/**
+ * @brief Translates a program into a self-contained C source file.
+ *
+ * The generated program prints exactly what `interpret` would, followed by
+ * the final `print_interpreter_state` and `mem_print` dumps if `dumps_state`
+ * is set. Variables become locals and memory a static array. Every
+ * instruction that is jumped to gets a C label. Calls push a frame holding
+ * the return site and the variables they save, and returns dispatch on that
+ * return site. Tail calls and memoized calls behave as they do in the
+ * engines, so that the peak call depth matches too.
+ *
+ * Must run on the program as lowered and analyzed by `program_verify`,
+ * `program_compute_clobbers` and `program_find_pure`, before `program_fuse`
+ * and `program_specialize`.
+ *
+ * @param prog Pointer to the `Program` to translate.
+ * @param out The stream to write the C source to.
+ * @param max_depth Deepest the call stack may grow, or 0 for no limit.
+ * @param dumps_state Whether the generated program prints the final dumps.
+ * @return true if the source was written, false if writing failed.
+ */
+bool program_emit_c(Program *prog, FILE *out, size_t max_depth, bool dumps_state);
+
+#endif
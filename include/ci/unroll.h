@@ -0,0 +1,44 @@
+#ifndef CI_UNROLL_H
+#define CI_UNROLL_H
+#include <stdbool.h>
+#include <stddef.h>
+#include "command.h"
+
+#define UNROLL_FACTOR       4   // Default number of iterations per unrolled trip.
+#define UNROLL_MAX_COMMANDS 64  // Most commands the unrolled copies of a loop may add up to.
+
+/**
+ * @brief Unrolls counted loops, so that several iterations share one compare
+ * and branch.
+ *
+ * A counted loop is a single block that steps a variable by a constant with
+ * `add` or `sub`, and ends by comparing it with `cmp` to an immediate or to a
+ * variable the loop does not write, then branching back while it is below
+ * (`b.lt`, `b.le`) or, for a negative step, above (`b.gt`, `b.ge`) the bound.
+ *
+ * The unrolled loop runs `factor` copies of the body per trip, and only
+ * starts a trip when every test it skips would pass: when the variable is
+ * below (or above) the bound less the steps of `factor - 1` iterations,
+ * worked out without overflow. The original loop follows as the remainder
+ * loop, for the last iterations. If the body reads the variable only to step
+ * it, the copies step it once, by `factor` times the step. A variable bound
+ * needs a spare variable to hold the guard's bound (see
+ * `find_spare_variable`), or the loop is left alone.
+ *
+ * While the state is dumped, only loops whose commands cannot fail are
+ * unrolled, since a failure inside a copy would show the copies' flags.
+ *
+ * Must run on the linked command list (see `link_commands`), before it is
+ * lowered by `program_init`.
+ *
+ * @param commands Pointer to the head of the linked list, updated if a loop
+ * starts the list.
+ * @param factor Number of iterations per unrolled trip; below 2 unrolls
+ * nothing.
+ * @param dumps_state Whether the variables and flags are printed at the end.
+ * @param calls_may_fail Whether a call can fail, ending the program.
+ * @return The number of loops unrolled.
+ */
+size_t unroll_loops(Command **commands, size_t factor, bool dumps_state, bool calls_may_fail);
+
+#endif
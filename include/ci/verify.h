@@ -0,0 +1,28 @@
+#ifndef CI_VERIFY_H
+#define CI_VERIFY_H
+#include <stddef.h>
+#include "program.h"
+
+/**
+ * @brief Proves, before execution, which instructions can never fail.
+ *
+ * Sets `is_verified` on every instruction whose operands are statically known
+ * to be valid: variables within x0..x31, immediate shift amounts within
+ * 0..63, immediate access widths of 1, 2, 4 or 8 bytes, and immediate
+ * addresses whose whole access lies in memory. Engines may run verified
+ * instructions without any runtime checks. Instructions with a variable
+ * address or shift amount, calls, and branches to undefined labels are never
+ * verified, as they can only be checked while running.
+ *
+ * Instructions that are statically known to fail are reported on stderr. As
+ * with undefined labels, they still only raise an error if they actually run.
+ *
+ * Must run on the program as lowered, before `program_fuse` and
+ * `program_specialize`.
+ *
+ * @param prog Pointer to the `Program` to verify.
+ * @return The number of instructions that always fail.
+ */
+size_t program_verify(Program *prog);
+
+#endif
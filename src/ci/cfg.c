@@ -0,0 +1,442 @@
+#include "cfg.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include "command_type.h"
+
+/**
+ * @brief Predecessor lists of every block, stored back to back.
+ */
+typedef struct {
+    size_t *start;  // Where each block's predecessors begin in `preds`; one extra
+                    // entry marks the end of the last block's.
+    size_t *preds;  // The predecessors, including the virtual root for roots.
+} PredLists;
+
+static bool   find_blocks(Cfg *cfg);
+static bool   find_preds(Cfg *cfg, const bool *is_root, PredLists *lists);
+static bool   find_dominators(Cfg *cfg, const bool *is_root, PredLists *lists, size_t *rpo_index);
+static size_t intersect(const size_t *idom, const size_t *rpo_index, size_t a, size_t b);
+static bool   find_loops(Cfg *cfg, PredLists *lists, const size_t *rpo_index);
+static bool   add_loop_body(Cfg *cfg, Loop *loop, size_t tail, PredLists *lists,
+                            const size_t *rpo_index);
+static int    compare_loop_size(const void *lhs, const void *rhs);
+
+bool cfg_build(Cfg *cfg, Command *commands) {
+    cfg->blocks     = NULL;
+    cfg->num_blocks = 0;
+    cfg->block_of   = NULL;
+    cfg->loops      = NULL;
+    cfg->num_loops  = 0;
+    if (!command_array_init(&cfg->array, commands)) {
+        return false;
+    }
+    if (!find_blocks(cfg)) {
+        cfg_free(cfg);
+        return false;
+    }
+
+    // The first block and every called block are entered from outside the graph
+    size_t    slots     = cfg->num_blocks + 1;
+    bool     *is_root   = calloc(slots, sizeof(bool));
+    size_t   *rpo_index = malloc(slots * sizeof(size_t));
+    PredLists lists     = {NULL, NULL};
+    bool      built     = false;
+    if (!is_root || !rpo_index) {
+        goto done;
+    }
+    if (cfg->num_blocks > 0) {
+        is_root[0] = true;
+    }
+    for (size_t i = 0; i < cfg->array.count; i++) {
+        if (cfg->array.commands[i]->type == CMD_CALL && cfg->array.targets[i] >= 0) {
+            is_root[cfg->block_of[cfg->array.targets[i]]] = true;
+        }
+    }
+
+    built = find_preds(cfg, is_root, &lists) && find_dominators(cfg, is_root, &lists, rpo_index) &&
+            find_loops(cfg, &lists, rpo_index);
+
+done:
+    free(is_root);
+    free(rpo_index);
+    free(lists.start);
+    free(lists.preds);
+    if (!built) {
+        cfg_free(cfg);
+    }
+    return built;
+}
+
+void cfg_free(Cfg *cfg) {
+    if (!cfg) {
+        return;
+    }
+
+    for (size_t l = 0; l < cfg->num_loops; l++) {
+        free(cfg->loops[l].blocks);
+    }
+    command_array_free(&cfg->array);
+    free(cfg->blocks);
+    free(cfg->block_of);
+    free(cfg->loops);
+    cfg->blocks     = NULL;
+    cfg->num_blocks = 0;
+    cfg->block_of   = NULL;
+    cfg->loops      = NULL;
+    cfg->num_loops  = 0;
+}
+
+bool cfg_dominates(const Cfg *cfg, size_t a, size_t b) {
+    for (size_t block = b; block != CFG_NO_BLOCK; block = cfg->blocks[block].idom) {
+        if (block == a) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Splits the commands into basic blocks and links each block to its
+ * successors.
+ *
+ * @param cfg The graph being built, with `array` set.
+ * @return True on success, false if memory could not be allocated.
+ */
+static bool find_blocks(Cfg *cfg) {
+    CommandArray *array   = &cfg->array;
+    size_t        count   = array->count;
+    bool         *leaders = calloc(count + 1, sizeof(bool));
+    cfg->block_of         = malloc((count + 1) * sizeof(size_t));
+    cfg->blocks           = malloc((count + 1) * sizeof(BasicBlock));
+    if (!leaders || !cfg->block_of || !cfg->blocks) {
+        free(leaders);
+        return false;
+    }
+
+    // Blocks start at the first command, at jump targets and after control flow
+    leaders[0] = true;
+    for (size_t i = 0; i < count; i++) {
+        CommandType type = array->commands[i]->type;
+        if (type == CMD_BRANCH || type == CMD_CALL || type == CMD_RET) {
+            leaders[i + 1] = true;
+        }
+        if (array->targets[i] >= 0) {
+            leaders[array->targets[i]] = true;
+        }
+    }
+    for (size_t i = 0; i < count; i++) {
+        if (leaders[i]) {
+            BasicBlock *block = &cfg->blocks[cfg->num_blocks++];
+            block->first      = i;
+            block->num_succs  = 0;
+            block->idom       = CFG_NO_BLOCK;
+        }
+        cfg->blocks[cfg->num_blocks - 1].last = i;
+        cfg->block_of[i]                      = cfg->num_blocks - 1;
+    }
+    free(leaders);
+
+    for (size_t b = 0; b < cfg->num_blocks; b++) {
+        BasicBlock *block  = &cfg->blocks[b];
+        Command    *last   = array->commands[block->last];
+        int64_t     target = array->targets[block->last];
+        bool        falls  = block->last + 1 < count;
+
+        switch (last->type) {
+            case CMD_RET:
+                falls = false;
+                break;
+            case CMD_BRANCH:
+                if (target >= 0) {
+                    block->succs[block->num_succs++] = cfg->block_of[target];
+                }
+                falls = falls && last->branch_condition != BRANCH_ALWAYS;
+                break;
+            case CMD_CALL:
+                // The callee is a root of its own; the call continues where it returns
+                falls = falls && target >= 0;
+                break;
+            default:
+                break;
+        }
+        if (falls && (block->num_succs == 0 || block->succs[0] != b + 1)) {
+            block->succs[block->num_succs++] = b + 1;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Collects the predecessors of every block.
+ *
+ * @param cfg The graph being built, with its blocks linked.
+ * @param is_root Whether each block is entered from outside the graph.
+ * @param lists Set to the predecessor lists; freed by the caller.
+ * @return True on success, false if memory could not be allocated.
+ */
+static bool find_preds(Cfg *cfg, const bool *is_root, PredLists *lists) {
+    size_t  num_blocks = cfg->num_blocks;
+    size_t  num_edges  = 0;
+    size_t *fill       = calloc(num_blocks + 1, sizeof(size_t));
+    lists->start       = calloc(num_blocks + 2, sizeof(size_t));
+    if (!fill || !lists->start) {
+        free(fill);
+        return false;
+    }
+
+    for (size_t b = 0; b < num_blocks; b++) {
+        for (size_t s = 0; s < cfg->blocks[b].num_succs; s++) {
+            lists->start[cfg->blocks[b].succs[s] + 1]++;
+            num_edges++;
+        }
+        if (is_root[b]) {
+            lists->start[b + 1]++;
+            num_edges++;
+        }
+    }
+    for (size_t b = 0; b < num_blocks; b++) {
+        lists->start[b + 1] += lists->start[b];
+    }
+    lists->start[num_blocks + 1] = lists->start[num_blocks];
+
+    lists->preds = malloc((num_edges + 1) * sizeof(size_t));
+    if (!lists->preds) {
+        free(fill);
+        return false;
+    }
+    for (size_t b = 0; b < num_blocks; b++) {
+        for (size_t s = 0; s < cfg->blocks[b].num_succs; s++) {
+            size_t succ                                      = cfg->blocks[b].succs[s];
+            lists->preds[lists->start[succ] + fill[succ]++] = b;
+        }
+        if (is_root[b]) {
+            lists->preds[lists->start[b] + fill[b]++] = num_blocks;
+        }
+    }
+    free(fill);
+    return true;
+}
+
+/**
+ * @brief Computes every block's immediate dominator.
+ *
+ * Uses the iterative algorithm of Cooper, Harvey and Kennedy, with a virtual
+ * root, numbered `num_blocks`, above the first block and every called block.
+ *
+ * @param cfg The graph being built, with its blocks linked.
+ * @param is_root Whether each block is entered from outside the graph.
+ * @param lists The predecessors of every block.
+ * @param rpo_index Set to each block's reverse postorder number, or
+ * CFG_NO_BLOCK for unreachable blocks; `num_blocks + 1` entries.
+ * @return True on success, false if memory could not be allocated.
+ */
+static bool find_dominators(Cfg *cfg, const bool *is_root, PredLists *lists, size_t *rpo_index) {
+    size_t  num_blocks = cfg->num_blocks;
+    size_t  root       = num_blocks;
+    size_t *order      = malloc((num_blocks + 1) * sizeof(size_t));
+    size_t *stack      = malloc((num_blocks + 1) * sizeof(size_t));
+    size_t *next_succ  = calloc(num_blocks + 1, sizeof(size_t));
+    size_t *idom       = malloc((num_blocks + 1) * sizeof(size_t));
+    bool   *visited    = calloc(num_blocks + 1, sizeof(bool));
+    bool    found      = false;
+    if (!order || !stack || !next_succ || !idom || !visited) {
+        goto done;
+    }
+
+    // Depth-first search for a postorder; the root's successors are the roots
+    size_t num_ordered = 0;
+    size_t depth       = 0;
+    stack[depth++]     = root;
+    visited[root]      = true;
+    while (depth > 0) {
+        size_t b         = stack[depth - 1];
+        size_t num_succs = (b == root) ? num_blocks : cfg->blocks[b].num_succs;
+        size_t succ      = CFG_NO_BLOCK;
+        while (next_succ[b] < num_succs && succ == CFG_NO_BLOCK) {
+            size_t k = next_succ[b]++;
+            if (b == root) {
+                succ = is_root[k] ? k : CFG_NO_BLOCK;
+            } else {
+                succ = cfg->blocks[b].succs[k];
+            }
+            if (succ != CFG_NO_BLOCK && visited[succ]) {
+                succ = CFG_NO_BLOCK;
+            }
+        }
+        if (succ == CFG_NO_BLOCK) {
+            order[num_ordered++] = b;
+            depth--;
+        } else {
+            visited[succ]  = true;
+            stack[depth++] = succ;
+        }
+    }
+
+    for (size_t b = 0; b <= num_blocks; b++) {
+        rpo_index[b] = CFG_NO_BLOCK;
+        idom[b]      = CFG_NO_BLOCK;
+    }
+    for (size_t k = 0; k < num_ordered; k++) {
+        rpo_index[order[k]] = num_ordered - 1 - k;
+    }
+
+    idom[root]   = root;
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (size_t k = num_ordered - 1; k-- > 0;) {
+            size_t b        = order[k];
+            size_t new_idom = CFG_NO_BLOCK;
+            for (size_t p = lists->start[b]; p < lists->start[b + 1]; p++) {
+                size_t pred = lists->preds[p];
+                if (idom[pred] == CFG_NO_BLOCK) {
+                    continue;
+                }
+                new_idom = (new_idom == CFG_NO_BLOCK) ? pred
+                                                      : intersect(idom, rpo_index, pred, new_idom);
+            }
+            if (new_idom != idom[b]) {
+                idom[b] = new_idom;
+                changed = true;
+            }
+        }
+    }
+
+    for (size_t b = 0; b < num_blocks; b++) {
+        cfg->blocks[b].idom = (idom[b] == root) ? CFG_NO_BLOCK : idom[b];
+    }
+    found = true;
+
+done:
+    free(order);
+    free(stack);
+    free(next_succ);
+    free(idom);
+    free(visited);
+    return found;
+}
+
+/**
+ * @brief Finds the nearest common dominator of two blocks.
+ *
+ * @param idom The dominators found so far.
+ * @param rpo_index Each block's reverse postorder number.
+ * @param a The first block.
+ * @param b The second block.
+ * @return The closest block dominating both.
+ */
+static size_t intersect(const size_t *idom, const size_t *rpo_index, size_t a, size_t b) {
+    while (a != b) {
+        while (rpo_index[a] > rpo_index[b]) {
+            a = idom[a];
+        }
+        while (rpo_index[b] > rpo_index[a]) {
+            b = idom[b];
+        }
+    }
+    return a;
+}
+
+/**
+ * @brief Finds the natural loops of the graph from its back edges.
+ *
+ * @param cfg The graph being built, with dominators computed.
+ * @param lists The predecessors of every block.
+ * @param rpo_index Each block's reverse postorder number, or CFG_NO_BLOCK.
+ * @return True on success, false if memory could not be allocated.
+ */
+static bool find_loops(Cfg *cfg, PredLists *lists, const size_t *rpo_index) {
+    cfg->loops = malloc((cfg->num_blocks + 1) * sizeof(Loop));
+    if (!cfg->loops) {
+        return false;
+    }
+
+    for (size_t b = 0; b < cfg->num_blocks; b++) {
+        if (rpo_index[b] == CFG_NO_BLOCK) {
+            continue;
+        }
+        for (size_t s = 0; s < cfg->blocks[b].num_succs; s++) {
+            size_t header = cfg->blocks[b].succs[s];
+            if (!cfg_dominates(cfg, header, b)) {
+                continue;
+            }
+
+            Loop *loop = NULL;
+            for (size_t l = 0; l < cfg->num_loops && !loop; l++) {
+                if (cfg->loops[l].header == header) {
+                    loop = &cfg->loops[l];
+                }
+            }
+            if (!loop) {
+                loop             = &cfg->loops[cfg->num_loops];
+                loop->header     = header;
+                loop->num_blocks = 1;
+                loop->blocks     = calloc(cfg->num_blocks, sizeof(bool));
+                if (!loop->blocks) {
+                    return false;
+                }
+                loop->blocks[header] = true;
+                cfg->num_loops++;
+            }
+            if (!add_loop_body(cfg, loop, b, lists, rpo_index)) {
+                return false;
+            }
+        }
+    }
+
+    qsort(cfg->loops, cfg->num_loops, sizeof(Loop), compare_loop_size);
+    return true;
+}
+
+/**
+ * @brief Adds the blocks of a back edge's natural loop to a loop.
+ *
+ * @param cfg The graph being built.
+ * @param loop The loop, with its header already a member.
+ * @param tail The block the back edge leaves from.
+ * @param lists The predecessors of every block.
+ * @param rpo_index Each block's reverse postorder number, or CFG_NO_BLOCK.
+ * @return True on success, false if memory could not be allocated.
+ */
+static bool add_loop_body(Cfg *cfg, Loop *loop, size_t tail, PredLists *lists,
+                          const size_t *rpo_index) {
+    if (loop->blocks[tail]) {
+        return true;
+    }
+    size_t *worklist = malloc((cfg->num_blocks + 1) * sizeof(size_t));
+    if (!worklist) {
+        return false;
+    }
+
+    // Walk backwards from the tail; the header stops the walk
+    size_t pending      = 0;
+    loop->blocks[tail]  = true;
+    loop->num_blocks++;
+    worklist[pending++] = tail;
+    while (pending > 0) {
+        size_t b = worklist[--pending];
+        for (size_t p = lists->start[b]; p < lists->start[b + 1]; p++) {
+            size_t pred = lists->preds[p];
+            if (pred < cfg->num_blocks && rpo_index[pred] != CFG_NO_BLOCK && !loop->blocks[pred]) {
+                loop->blocks[pred] = true;
+                loop->num_blocks++;
+                worklist[pending++] = pred;
+            }
+        }
+    }
+    free(worklist);
+    return true;
+}
+
+/**
+ * @brief Orders loops from the fewest blocks to the most.
+ *
+ * @param lhs Pointer to the first `Loop`.
+ * @param rhs Pointer to the second `Loop`.
+ * @return A negative, zero or positive value, as required by `qsort`.
+ */
+static int compare_loop_size(const void *lhs, const void *rhs) {
+    size_t a = ((const Loop *) lhs)->num_blocks;
+    size_t b = ((const Loop *) rhs)->num_blocks;
+    return (a > b) - (a < b);
+}
@@ -1,15 +1,32 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include "clobber.h"
 #include "cmd_args_config.h"
 #include "command.h"
+#include "constprop.h"
+#include "deadcode.h"
+#include "fusion.h"
+#include "inliner.h"
 #include "interpreter.h"
 #include "label_map.h"
+#include "layout.h"
 #include "lexer.h"
+#include "licm.h"
+#include "linker.h"
 #include "mem.h"
 #include "parser.h"
+#include "peephole.h"
+#include "profile.h"
+#include "program.h"
+#include "purity.h"
+#include "specialize.h"
+#include "ssa.h"
 #include "token.h"
 #include "token_type.h"
+#include "transpile.h"
+#include "unroll.h"
+#include "verify.h"
 #include <ctype.h>
 
 #define CAPACITY 50
@@ -17,10 +34,14 @@
 static int   run_interpreter(CmdArgsConfig *conf);
 static char *run_repl(void);
 static char *read_file(const char *path);
-static int   run_file(const char *src, bool print_lex, bool print_parse);
+static int   run_file(const char *src, CmdArgsConfig *conf);
+static void  write_profile(const Profiler *profiler, const char *path);
+static bool  read_profile(Profile *profile, const char *path);
 
 int main(int argc, char **argv) {
-    CmdArgsConfig conf = {false, false, false, NULL, NULL};
+    CmdArgsConfig conf = {false, false, false, false, false, false, false, false, false, false,
+                          false, 0,     INLINE_MAX_SIZE, INLINE_MIN_LOOP_DEPTH, UNROLL_FACTOR,
+                          NULL,  NULL,  NULL, NULL};
     if (!parse_cmd_args(&conf, argv + 1, argc - 1)) {
         printf("Aborting\n");
         config_free(&conf);
@@ -62,7 +83,7 @@ static int run_interpreter(CmdArgsConfig *conf) {
             return -1;
         }
     }
-    status = run_file(src, conf->print_lex, conf->print_parse);
+    status = run_file(src, conf);
     free(src);
     return status;
 }
@@ -151,10 +172,10 @@ static char *read_file(const char *path) {
     return buffer;
 }
 
-static int run_file(const char *src, bool print_lex, bool print_parse) {
+static int run_file(const char *src, CmdArgsConfig *conf) {
     Lexer l;
     lexer_init(&l, src);
-    if (print_lex) {
+    if (conf->print_lex) {
         print_lexed_tokens(&l);
         // Reset so we can parse
         lexer_init(&l, src);
@@ -169,7 +190,7 @@ static int run_file(const char *src, bool print_lex, bool print_parse) {
     Parser p;
     parser_init(&p, &l, &lbm);
     Command *commands = parse_commands(&p);
-    if (print_parse) {
+    if (conf->print_parse) {
         print_commands(commands);
     }
 
@@ -184,14 +205,163 @@ static int run_file(const char *src, bool print_lex, bool print_parse) {
         return -1;
     }
 
-    Interpreter i;
-    interpreter_init(&i, &lbm);
-    interpret(&i, commands);
-    print_interpreter_state(&i);
-    mem_print();
+    // Resolve labels up front, then lower into a flat program; the parsed list
+    // and labels are no longer needed afterwards
+    link_commands(commands, &lbm);
+    if (conf->optimize) {
+        // Inline first, so that the other passes see through the copied bodies
+        InlineConfig inlining = {conf->inline_size, conf->inline_depth};
+        inline_calls(&commands, &inlining, !conf->no_dump, conf->max_depth != 0,
+                     conf->print_parse);
+
+        size_t hits[PEEPHOLE_NUM_RULES] = {0};
+        propagate_constants(commands);
+        peephole_optimize(&commands, hits);
+        if (conf->print_parse) {
+            print_peephole_hits(hits);
+        }
+        hoist_loop_invariants(&commands, !conf->no_dump, conf->max_depth != 0);
+        eliminate_dead_code(&commands, !conf->no_dump, conf->max_depth != 0);
+        unroll_loops(&commands, conf->unroll, !conf->no_dump, conf->max_depth != 0);
 
+        // Lower through the SSA form, which later passes rewrite in place
+        SsaProgram ssa;
+        if (ssa_build(&ssa, commands)) {
+            if (conf->print_parse) {
+                ssa_print(&ssa);
+            }
+            Command *lowered;
+            if (ssa_lower(&ssa, &lowered)) {
+                free_command(commands);
+                commands = lowered;
+            }
+            ssa_free(&ssa);
+        }
+    }
+    Profile profile;
+    bool    profiled = conf->profile_in && read_profile(&profile, conf->profile_in);
+    if (profiled && !layout_blocks(&commands, &profile)) {
+        fprintf(stderr, "Warning: profile %s does not match the program; blocks left in order\n",
+                conf->profile_in);
+    }
+    Program prog;
+    bool    lowered = program_init(&prog, commands);
     free_command(commands);
     label_map_free(&lbm);
+    if (!lowered) {
+        printf("Unable to allocate program. Aborting\n");
+        if (profiled) {
+            profile_free(&profile);
+        }
+        return -1;
+    }
+    program_verify(&prog);
+    program_compute_clobbers(&prog);
+    // A remembered result would skip the calls that must hit the maximum depth
+    if (conf->max_depth == 0) {
+        program_find_pure(&prog);
+    }
+    if (conf->emit_c) {
+        bool emitted = program_emit_c(&prog, stdout, conf->max_depth, !conf->no_dump);
+        program_free(&prog);
+        if (profiled) {
+            profile_free(&profile);
+        }
+        return emitted ? 0 : -1;
+    }
+    bool profiling = conf->profile_out != NULL;
+    if (conf->threaded && !conf->jit && !conf->trace && !conf->tiered && !profiling) {
+        // Superinstructions and specialized forms only exist in the threaded engine
+        program_fuse(&prog);
+        program_specialize(&prog);
+        if (profiled) {
+            program_compose(&prog, &profile, PROFILE_TOP_SEQUENCES);
+        }
+    }
+
+    Interpreter i;
+    Profiler    profiler;
+    interpreter_init(&i);
+    i.max_depth = conf->max_depth;
+    if (profiling) {
+        // Sequences are counted on the reference engine, before any rewriting
+        i.engine = ENGINE_SWITCH;
+        if (profiler_init(&profiler, &prog)) {
+            i.profiler = &profiler;
+        } else {
+            fprintf(stderr, "Warning: unable to allocate profiler; no profile written\n");
+        }
+    } else if (conf->jit) {
+        i.engine = ENGINE_JIT;
+    } else if (conf->trace) {
+        i.engine = ENGINE_TRACE;
+    } else if (conf->tiered) {
+        i.engine = ENGINE_TIERED;
+    } else if (conf->threaded) {
+        i.engine = ENGINE_THREADED;
+    } else {
+        i.engine = ENGINE_SWITCH;
+    }
+    interpret(&i, &prog);
+    if (!conf->no_dump) {
+        print_interpreter_state(&i);
+        mem_print();
+    }
+    if (conf->stats) {
+        print_interpreter_stats(&i);
+    }
+    if (i.profiler) {
+        write_profile(&profiler, conf->profile_out);
+        profiler_free(&profiler);
+    }
+
+    program_free(&prog);
+    if (profiled) {
+        profile_free(&profile);
+    }
 
     return (i.had_error) ? -1 : 0;
 }
+
+/**
+ * @brief Writes the sequences a profiler counted to a file, warning if it
+ * cannot.
+ *
+ * @param profiler Pointer to the `Profiler` of the finished run.
+ * @param path The file to write.
+ */
+static void write_profile(const Profiler *profiler, const char *path) {
+    Profile profile;
+    if (!profiler_summarize(profiler, &profile)) {
+        fprintf(stderr, "Warning: unable to allocate profile; no profile written\n");
+        return;
+    }
+    FILE *out     = fopen(path, "w");
+    bool  written = out && profile_write(&profile, out);
+    if (out && fclose(out) != 0) {
+        written = false;
+    }
+    if (!written) {
+        fprintf(stderr, "Warning: cannot write profile %s\n", path);
+    }
+    profile_free(&profile);
+}
+
+/**
+ * @brief Reads a profile written by an earlier run, warning if it cannot.
+ *
+ * @param profile Pointer to the `Profile` to initialize.
+ * @param path The profile to read.
+ * @return true if the profile was read, false otherwise.
+ */
+static bool read_profile(Profile *profile, const char *path) {
+    FILE *in   = fopen(path, "r");
+    bool  read = in && profile_read(profile, in);
+    if (in) {
+        fclose(in);
+    }
+    if (!read) {
+        fprintf(stderr, "Warning: cannot read profile %s\n", path);
+    }
+    return read;
+}
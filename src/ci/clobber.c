@@ -0,0 +1,135 @@
+#include "clobber.h"
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include "command_type.h"
+#include "interpreter.h"
+
+static uint32_t callee_writes(Program *prog, size_t entry, bool *seen, size_t *work);
+static bool     writes_destination(Instruction *insn);
+
+size_t program_compute_clobbers(Program *prog) {
+    if (!prog || prog->length == 0) {
+        return 0;
+    }
+
+    // Each callee is walked once, however many calls share it
+    uint32_t *writes   = malloc((prog->length + 1) * sizeof(uint32_t));
+    bool     *analyzed = calloc(prog->length + 1, sizeof(bool));
+    bool     *seen     = malloc((prog->length + 1) * sizeof(bool));
+    size_t   *work     = malloc((prog->length + 1) * sizeof(size_t));
+    if (!writes || !analyzed || !seen || !work) {
+        free(writes);
+        free(analyzed);
+        free(seen);
+        free(work);
+        return 0;
+    }
+
+    size_t narrowed = 0;
+    for (size_t i = 0; i < prog->length; i++) {
+        Instruction *insn = &prog->code[i];
+        if (insn->type != CMD_CALL || insn->target == PROGRAM_NO_TARGET) {
+            continue;
+        }
+
+        size_t entry = (size_t) insn->target;
+        if (!analyzed[entry]) {
+            writes[entry]   = callee_writes(prog, entry, seen, work);
+            analyzed[entry] = true;
+        }
+        insn->val_b = (int32_t) writes[entry];
+        if (writes[entry] != PROGRAM_SAVE_ALL) {
+            narrowed++;
+        }
+    }
+
+    free(writes);
+    free(analyzed);
+    free(seen);
+    free(work);
+    return narrowed;
+}
+
+/**
+ * @brief Collects the variables a callee may write before it returns.
+ *
+ * @param prog The program being analyzed.
+ * @param entry The index of the callee's first instruction.
+ * @param seen Scratch space for `prog->length + 1` flags.
+ * @param work Scratch space for `prog->length + 1` indices.
+ * @return A mask of the variables written, excluding x0.
+ */
+static uint32_t callee_writes(Program *prog, size_t entry, bool *seen, size_t *work) {
+    memset(seen, 0, (prog->length + 1) * sizeof(bool));
+
+    uint32_t written = 0;
+    size_t   pending = 0;
+    work[pending++]  = entry;
+    seen[entry]      = true;
+    while (pending > 0) {
+        size_t       pc   = work[--pending];
+        Instruction *insn = &prog->code[pc];
+        size_t       next[2];
+        size_t       num_next = 0;
+
+        if (writes_destination(insn) && insn->destination < NUM_VARIABLES) {
+            written |= (uint32_t) 1 << insn->destination;
+        }
+        switch (insn->type) {
+            case CMD_HALT:
+            case CMD_RET:
+                break;
+            case CMD_BRANCH:
+                if (insn->target != PROGRAM_NO_TARGET) {
+                    next[num_next++] = (size_t) insn->target;
+                }
+                if (insn->branch_condition != BRANCH_ALWAYS) {
+                    next[num_next++] = pc + 1;
+                }
+                break;
+            case CMD_CALL:
+                // A nested call returns here with everything but x0 restored,
+                // but a tail call is a jump that returns for the caller
+                if (insn->target != PROGRAM_NO_TARGET) {
+                    next[num_next++] = insn->is_tail_call ? (size_t) insn->target : pc + 1;
+                }
+                break;
+            default:
+                next[num_next++] = pc + 1;
+                break;
+        }
+
+        for (size_t i = 0; i < num_next; i++) {
+            if (!seen[next[i]]) {
+                seen[next[i]]   = true;
+                work[pending++] = next[i];
+            }
+        }
+    }
+    return written & PROGRAM_SAVE_ALL;
+}
+
+/**
+ * @brief Determines whether an instruction writes its destination variable.
+ *
+ * @param insn The instruction to check.
+ * @return True if `insn` may store to `insn->destination`.
+ */
+static bool writes_destination(Instruction *insn) {
+    switch (insn->type) {
+        case CMD_MOV:
+        case CMD_ADD:
+        case CMD_SUB:
+        case CMD_AND:
+        case CMD_EOR:
+        case CMD_ORR:
+        case CMD_LSL:
+        case CMD_LSR:
+        case CMD_ASR:
+        case CMD_LOAD:
+            return true;
+        default:
+            return false;
+    }
+}
@@ -3,6 +3,9 @@
 #include <stdio.h>
 #include <string.h>
 
+static bool copy_filename(char **dest, char **args, int arg_count, int *i);
+static bool parse_size(size_t *dest, char **args, int arg_count, int *i);
+
 void config_free(CmdArgsConfig *conf) {
     if (!conf) {
         return;
@@ -10,8 +13,12 @@ void config_free(CmdArgsConfig *conf) {
 
     free(conf->in_filename);
     free(conf->out_filename);
+    free(conf->profile_out);
+    free(conf->profile_in);
     conf->in_filename  = NULL;
     conf->out_filename = NULL;
+    conf->profile_out  = NULL;
+    conf->profile_in   = NULL;
 }
 
 bool parse_cmd_args(CmdArgsConfig *conf, char **args, int arg_count) {
@@ -24,10 +31,60 @@ bool parse_cmd_args(CmdArgsConfig *conf, char **args, int arg_count) {
     }
 
     for (int i = 0; i < arg_count; i++) {
-        if (strncmp(args[i], "-l", 2) == 0) {
+        if (strcmp(args[i], "--jit") == 0) {
+            conf->jit = true;
+        } else if (strcmp(args[i], "--trace") == 0) {
+            conf->trace = true;
+        } else if (strcmp(args[i], "--tiered") == 0) {
+            conf->tiered = true;
+        } else if (strcmp(args[i], "--stats") == 0) {
+            conf->stats = true;
+        } else if (strcmp(args[i], "--no-dump") == 0) {
+            conf->no_dump = true;
+        } else if (strcmp(args[i], "--emit-c") == 0) {
+            conf->emit_c = true;
+        } else if (strcmp(args[i], "--profile-out") == 0) {
+            if (!copy_filename(&conf->profile_out, args, arg_count, &i)) {
+                return false;
+            }
+        } else if (strcmp(args[i], "--profile-in") == 0) {
+            if (!copy_filename(&conf->profile_in, args, arg_count, &i)) {
+                return false;
+            }
+            conf->threaded = true;  // Composed instructions only run threaded
+        } else if (strcmp(args[i], "--inline-size") == 0) {
+            if (!parse_size(&conf->inline_size, args, arg_count, &i)) {
+                return false;
+            }
+        } else if (strcmp(args[i], "--inline-depth") == 0) {
+            if (!parse_size(&conf->inline_depth, args, arg_count, &i)) {
+                return false;
+            }
+        } else if (strcmp(args[i], "--unroll") == 0) {
+            if (!parse_size(&conf->unroll, args, arg_count, &i)) {
+                return false;
+            }
+        } else if (strcmp(args[i], "--max-depth") == 0) {
+            i++;
+            if (i >= arg_count) {
+                printf("Maximum depth not specified\n");
+                return false;
+            }
+
+            char *end;
+            conf->max_depth = strtoull(args[i], &end, 10);
+            if (*end != '\0' || args[i][0] == '-' || conf->max_depth == 0) {
+                printf("Invalid maximum depth %s\n", args[i]);
+                return false;
+            }
+        } else if (strncmp(args[i], "-O", 2) == 0) {
+            conf->optimize = true;
+        } else if (strncmp(args[i], "-l", 2) == 0) {
             conf->print_lex = true;
         } else if (strncmp(args[i], "-p", 2) == 0) {
             conf->print_parse = true;
+        } else if (strncmp(args[i], "-t", 2) == 0) {
+            conf->threaded = true;
         } else if (strncmp(args[i], "-i", 2) == 0) {
             i++;
             if (i >= arg_count) {
@@ -61,3 +118,56 @@ bool parse_cmd_args(CmdArgsConfig *conf, char **args, int arg_count) {
 
     return true;
 }
+
+/**
+ * @brief Copies the filename following an option.
+ *
+ * @param dest Set to a newly allocated copy of the filename.
+ * @param args The command line arguments.
+ * @param arg_count Number of entries in `args`.
+ * @param i Index of the option, advanced past the filename.
+ * @return true on success, false if the filename is missing or could not be
+ * copied.
+ */
+static bool copy_filename(char **dest, char **args, int arg_count, int *i) {
+    (*i)++;
+    if (*i >= arg_count) {
+        printf("Filename not specified\n");
+        return false;
+    }
+
+    free(*dest);
+    *dest = calloc(strlen(args[*i]) + 1, sizeof(char));
+    if (!*dest) {
+        printf("Failed to allocate space for filename\n");
+        return false;
+    }
+
+    strcpy(*dest, args[*i]);
+    return true;
+}
+
+/**
+ * @brief Reads the number following an option.
+ *
+ * @param dest Set to the number.
+ * @param args The command line arguments.
+ * @param arg_count Number of entries in `args`.
+ * @param i Index of the option, advanced past the number.
+ * @return true on success, false if the number is missing or invalid.
+ */
+static bool parse_size(size_t *dest, char **args, int arg_count, int *i) {
+    (*i)++;
+    if (*i >= arg_count) {
+        printf("Value not specified for %s\n", args[*i - 1]);
+        return false;
+    }
+
+    char *end;
+    *dest = strtoull(args[*i], &end, 10);
+    if (*end != '\0' || end == args[*i] || args[*i][0] == '-') {
+        printf("Invalid value %s for %s\n", args[*i], args[*i - 1]);
+        return false;
+    }
+    return true;
+}
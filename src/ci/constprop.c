@@ -0,0 +1,274 @@
+#include "constprop.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include "command_type.h"
+#include "interpreter.h"
+#include "linker.h"
+
+#define ALL_KNOWN 0xFFFFFFFFu  // Known mask with every variable set.
+
+static bool merge_state(ConstState *into, const ConstState *from);
+static void transfer(const Command *cmd, ConstState *state);
+static bool evaluate(const Command *cmd, const ConstState *state, int64_t *result);
+static bool accepts_immediate_b(CommandType type);
+
+ConstState *constants_compute(CommandArray *array) {
+    size_t      count     = array->count;
+    Command   **order     = array->commands;
+    int64_t    *target_of = array->targets;
+    ConstState *states    = calloc(count + 1, sizeof(ConstState));
+    if (!states || count == 0) {
+        return states;
+    }
+
+    // Execution starts with every variable zeroed
+    states[0].reached = true;
+    states[0].known   = ALL_KNOWN;
+
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (size_t i = 0; i < count; i++) {
+            if (!states[i].reached) {
+                continue;
+            }
+            Command   *cmd  = order[i];
+            ConstState out  = states[i];
+            bool       next = true;
+            switch (cmd->type) {
+                case CMD_RET:
+                    next = false;
+                    break;
+                case CMD_BRANCH:
+                    if (target_of[i] >= 0) {
+                        changed |= merge_state(&states[target_of[i]], &out);
+                    }
+                    next = cmd->branch_condition != BRANCH_ALWAYS;
+                    break;
+                case CMD_CALL:
+                    if (target_of[i] >= 0) {
+                        changed |= merge_state(&states[target_of[i]], &out);
+                    }
+                    // The return restores everything but x0
+                    out.known &= ~(uint32_t) 1;
+                    break;
+                default:
+                    transfer(cmd, &out);
+                    break;
+            }
+            if (next && i + 1 < count) {
+                changed |= merge_state(&states[i + 1], &out);
+            }
+        }
+    }
+    return states;
+}
+
+bool constant_value(const ConstState *state, int64_t index, int64_t *value) {
+    if (index < 0 || index >= NUM_VARIABLES || !((state->known >> index) & 1)) {
+        return false;
+    }
+    *value = state->values[index];
+    return true;
+}
+
+size_t propagate_constants(Command *commands) {
+    CommandArray array;
+    if (!commands || !command_array_init(&array, commands)) {
+        return 0;
+    }
+
+    size_t      count     = array.count;
+    Command   **order     = array.commands;
+    ConstState *states    = constants_compute(&array);
+    size_t      rewritten = 0;
+    if (!states) {
+        goto done;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        Command    *cmd   = order[i];
+        ConstState *state = &states[i];
+        int64_t     value;
+        if (!state->reached || cmd->type == CMD_MOV) {
+            continue;
+        }
+
+        if (evaluate(cmd, state, &value)) {
+            cmd->type           = CMD_MOV;
+            cmd->val_a.num_val  = value;
+            cmd->is_a_immediate = true;
+            cmd->val_b.num_val  = 0;
+            cmd->is_b_immediate = false;
+            rewritten++;
+        } else if (cmd->type == CMD_PRINT) {
+            if (!cmd->is_a_immediate && constant_value(state, cmd->val_a.num_val, &value)) {
+                cmd->val_a.num_val  = value;
+                cmd->is_a_immediate = true;
+                rewritten++;
+            }
+        } else if (accepts_immediate_b(cmd->type) && !cmd->is_b_immediate &&
+                   constant_value(state, cmd->val_b.num_val, &value)) {
+            cmd->val_b.num_val  = value;
+            cmd->is_b_immediate = true;
+            rewritten++;
+        }
+    }
+
+done:
+    command_array_free(&array);
+    free(states);
+    return rewritten;
+}
+
+/**
+ * @brief Merges the state along one path into a command's entry state.
+ *
+ * @param into The entry state to update.
+ * @param from The state at the end of the incoming path.
+ * @return True if `into` changed.
+ */
+static bool merge_state(ConstState *into, const ConstState *from) {
+    if (!into->reached) {
+        *into = *from;
+        return true;
+    }
+
+    uint32_t known = into->known & from->known;
+    for (size_t v = 0; v < NUM_VARIABLES; v++) {
+        if (((known >> v) & 1) && into->values[v] != from->values[v]) {
+            known &= ~((uint32_t) 1 << v);
+        }
+    }
+    if (known == into->known) {
+        return false;
+    }
+    into->known = known;
+    return true;
+}
+
+/**
+ * @brief Applies the effect of a command that is not control flow.
+ *
+ * @param cmd The command.
+ * @param state The state before `cmd`, updated to the state after it.
+ */
+static void transfer(const Command *cmd, ConstState *state) {
+    int64_t dest = cmd->destination.num_val;
+    int64_t value;
+    switch (cmd->type) {
+        case CMD_MOV:
+        case CMD_ADD:
+        case CMD_SUB:
+        case CMD_AND:
+        case CMD_EOR:
+        case CMD_ORR:
+        case CMD_LSL:
+        case CMD_LSR:
+        case CMD_ASR:
+        case CMD_LOAD:
+            break;
+        default:
+            return;
+    }
+    if (dest < 0 || dest >= NUM_VARIABLES) {
+        return;
+    }
+
+    if (cmd->type == CMD_MOV && cmd->is_a_immediate) {
+        value = cmd->val_a.num_val;
+    } else if (cmd->type == CMD_LOAD || !evaluate(cmd, state, &value)) {
+        state->known &= ~((uint32_t) 1 << dest);
+        return;
+    }
+    state->known |= (uint32_t) 1 << dest;
+    state->values[dest] = value;
+}
+
+/**
+ * @brief Computes the result of an arithmetic, bitwise or shift command.
+ *
+ * @param cmd The command.
+ * @param state The state before `cmd`.
+ * @param result Set to the result on success.
+ * @return True if every operand is known and the command cannot fail.
+ */
+static bool evaluate(const Command *cmd, const ConstState *state, int64_t *result) {
+    int64_t a;
+    int64_t b = cmd->val_b.num_val;
+    switch (cmd->type) {
+        case CMD_ADD:
+        case CMD_SUB:
+        case CMD_AND:
+        case CMD_EOR:
+        case CMD_ORR:
+        case CMD_LSL:
+        case CMD_LSR:
+        case CMD_ASR:
+            break;
+        default:
+            return false;
+    }
+    if (!constant_value(state, cmd->val_a.num_val, &a) ||
+        (!cmd->is_b_immediate && !constant_value(state, cmd->val_b.num_val, &b))) {
+        return false;
+    }
+
+    switch (cmd->type) {
+        case CMD_ADD:
+            *result = (int64_t) ((uint64_t) a + (uint64_t) b);
+            return true;
+        case CMD_SUB:
+            *result = (int64_t) ((uint64_t) a - (uint64_t) b);
+            return true;
+        case CMD_AND:
+            *result = a & b;
+            return true;
+        case CMD_EOR:
+            *result = a ^ b;
+            return true;
+        case CMD_ORR:
+            *result = a | b;
+            return true;
+        default:
+            break;
+    }
+
+    // Out of range shifts are errors, which must still happen when run
+    if (b < 0 || b > 63) {
+        return false;
+    }
+    if (cmd->type == CMD_LSL) {
+        *result = (int64_t) ((uint64_t) a << b);
+    } else if (cmd->type == CMD_LSR) {
+        *result = (int64_t) ((uint64_t) a >> b);
+    } else {
+        *result = a >> b;
+    }
+    return true;
+}
+
+/**
+ * @brief Determines whether a command's second operand may be an immediate.
+ *
+ * @param type The command type.
+ * @return True if the parser accepts an immediate as the second operand.
+ */
+static bool accepts_immediate_b(CommandType type) {
+    switch (type) {
+        case CMD_ADD:
+        case CMD_SUB:
+        case CMD_CMP:
+        case CMD_CMP_U:
+        case CMD_LSL:
+        case CMD_LSR:
+        case CMD_ASR:
+        case CMD_LOAD:
+        case CMD_STORE:
+        case CMD_PUT:
+            return true;
+        default:
+            return false;
+    }
+}
@@ -0,0 +1,92 @@
+#include "deadcode.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include "command_type.h"
+#include "linker.h"
+#include "liveness.h"
+
+static size_t remove_dead(Command **commands, bool dumps_state, bool calls_may_fail);
+static bool   is_removable(const Command *cmd);
+
+size_t eliminate_dead_code(Command **commands, bool dumps_state, bool calls_may_fail) {
+    if (!commands) {
+        return 0;
+    }
+
+    // Each removal can leave the commands that fed it dead in turn
+    size_t removed = 0;
+    size_t pass;
+    do {
+        pass = remove_dead(commands, dumps_state, calls_may_fail);
+        removed += pass;
+    } while (pass > 0);
+    return removed;
+}
+
+/**
+ * @brief Runs one round of liveness analysis and removes what it finds dead.
+ *
+ * @param commands Pointer to the head of the linked list.
+ * @param dumps_state Whether the variables and flags are printed at the end.
+ * @param calls_may_fail Whether a call can fail, ending the program.
+ * @return The number of commands removed.
+ */
+static size_t remove_dead(Command **commands, bool dumps_state, bool calls_may_fail) {
+    CommandArray array;
+    if (!*commands || !command_array_init(&array, *commands)) {
+        return 0;
+    }
+
+    Liveness liveness;
+    if (!liveness_compute(&liveness, &array, dumps_state, calls_may_fail)) {
+        command_array_free(&array);
+        return 0;
+    }
+
+    size_t    count   = array.count;
+    uint64_t *live    = liveness.live;
+    bool     *dead    = calloc(count + 1, sizeof(bool));
+    size_t    removed = 0;
+    if (!dead) {
+        goto done;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        Command *cmd = array.commands[i];
+        dead[i]      = !liveness.reached[i] ||
+                       (is_removable(cmd) && !(command_writes(cmd) & live[i + 1]));
+    }
+    removed = remove_commands(commands, &array, dead);
+
+done:
+    command_array_free(&array);
+    liveness_free(&liveness);
+    free(dead);
+    return removed;
+}
+
+/**
+ * @brief Determines whether a command's only effect is the value it writes.
+ *
+ * @param cmd The command to check.
+ * @return True if the command may be removed when nothing reads its result.
+ */
+static bool is_removable(const Command *cmd) {
+    switch (cmd->type) {
+        case CMD_MOV:
+        case CMD_ADD:
+        case CMD_SUB:
+        case CMD_AND:
+        case CMD_EOR:
+        case CMD_ORR:
+        case CMD_LSL:
+        case CMD_LSR:
+        case CMD_ASR:
+        case CMD_LOAD:
+        case CMD_CMP:
+        case CMD_CMP_U:
+            return !command_may_fail(cmd);
+        default:
+            return false;
+    }
+}
@@ -0,0 +1,320 @@
+#include "fusion.h"
+#include <stdbool.h>
+#include <stdlib.h>
+
+static bool  *find_entry_points(Program *prog);
+static bool  *compute_flag_liveness(Program *prog);
+static bool   flags_live_after_branch(Program *prog, bool *live_in, size_t branch);
+static bool   is_linked_branch(Instruction *insn, BranchCondition cond);
+static bool   enters_group(bool *entry, size_t start, size_t length);
+static size_t fused_width(uint8_t type);
+static bool   is_composable(const ProfileSequence *sequence);
+static bool   matches_sequence(Program *prog, bool *entry, size_t start,
+                               const ProfileSequence *sequence);
+
+size_t program_fuse(Program *prog) {
+    if (!prog || prog->length == 0) {
+        return 0;
+    }
+
+    bool *entry   = find_entry_points(prog);
+    bool *live_in = compute_flag_liveness(prog);
+    if (!entry || !live_in) {
+        free(entry);
+        free(live_in);
+        return 0;
+    }
+
+    Instruction *code  = prog->code;
+    size_t       fused = 0;
+    size_t       i     = 0;
+    while (i < prog->length) {
+        size_t remaining = prog->length - i;
+        size_t width     = 1;
+
+        if (remaining >= 3 && code[i].type == CMD_ADD && code[i + 1].type == CMD_CMP &&
+            is_linked_branch(&code[i + 2], BRANCH_NONE) && !enters_group(entry, i, 3)) {
+            // add x1 x1 1; cmp x1 x2; b.cond l1
+            bool live    = flags_live_after_branch(prog, live_in, i + 2);
+            code[i].type = live ? CMD_ADD_CMP_BRANCH : CMD_ADD_CMP_BRANCH_NOFLAGS;
+            width        = 3;
+        } else if (remaining >= 2 && (code[i].type == CMD_CMP || code[i].type == CMD_CMP_U) &&
+                   is_linked_branch(&code[i + 1], BRANCH_NONE) && !enters_group(entry, i, 2)) {
+            // cmp x1 x2; b.cond l1
+            bool live = flags_live_after_branch(prog, live_in, i + 1);
+            if (code[i].type == CMD_CMP) {
+                code[i].type = live ? CMD_CMP_BRANCH : CMD_CMP_BRANCH_NOFLAGS;
+            } else {
+                code[i].type = live ? CMD_CMP_U_BRANCH : CMD_CMP_U_BRANCH_NOFLAGS;
+            }
+            width = 2;
+        } else if (remaining >= 2 && code[i].type == CMD_ADD &&
+                   is_linked_branch(&code[i + 1], BRANCH_ALWAYS) && !enters_group(entry, i, 2)) {
+            // add x1 x1 1; b l1
+            code[i].type = CMD_ADD_BRANCH;
+            width        = 2;
+        } else if (remaining >= 2 && code[i].type == CMD_MOV && code[i + 1].type == CMD_STORE &&
+                   !enters_group(entry, i, 2)) {
+            // mov x0 5; store x0 100 8
+            code[i].type = CMD_MOV_STORE;
+            width        = 2;
+        } else if (remaining >= 2 && code[i].type == CMD_ORR && code[i + 1].type == CMD_CALL &&
+                   code[i + 1].target != PROGRAM_NO_TARGET && !enters_group(entry, i, 2)) {
+            // orr x0 x1 x15; call foo
+            code[i].type = CMD_ORR_CALL;
+            width        = 2;
+        }
+
+        if (width > 1) {
+            fused++;
+        }
+        i += width;
+    }
+
+    free(entry);
+    free(live_in);
+    return fused;
+}
+
+size_t program_compose(Program *prog, const Profile *profile, size_t max_sequences) {
+    if (!prog || !profile || prog->length == 0) {
+        return 0;
+    }
+
+    // The profile is sorted by count, so the first composable sequences are the hottest
+    const ProfileSequence **chosen = calloc(max_sequences ? max_sequences : 1, sizeof(*chosen));
+    bool                   *entry  = find_entry_points(prog);
+    if (!chosen || !entry) {
+        free(chosen);
+        free(entry);
+        return 0;
+    }
+    size_t num_chosen = 0;
+    for (size_t i = 0; i < profile->num_sequences && num_chosen < max_sequences; i++) {
+        if (is_composable(&profile->sequences[i])) {
+            chosen[num_chosen++] = &profile->sequences[i];
+        }
+    }
+
+    Instruction *code     = prog->code;
+    size_t       composed = 0;
+    size_t       i        = 0;
+    while (i < prog->length) {
+        size_t width = fused_width(code[i].type);
+        for (size_t k = 0; k < num_chosen && width == 1; k++) {
+            if (matches_sequence(prog, entry, i, chosen[k])) {
+                code[i].target = (int32_t) (code[i].type | chosen[k]->length << 8);
+                code[i].type   = CMD_COMPOSED;
+                width          = chosen[k]->length;
+                composed++;
+            }
+        }
+        i += width;
+    }
+
+    free(chosen);
+    free(entry);
+    return composed;
+}
+
+int composable_index(uint8_t type) {
+#define COMPOSABLE_CASE(form) \
+    case form: return COMPOSABLE_##form;
+    switch (type) {
+        COMPOSABLE_FORMS(COMPOSABLE_CASE)
+        default: return -1;
+    }
+#undef COMPOSABLE_CASE
+}
+
+/**
+ * @brief Marks every instruction that control can arrive at other than by
+ * falling through: branch and call targets, and the instruction after each
+ * call, which `ret` jumps back to.
+ *
+ * @param prog The program to scan.
+ * @return A heap-allocated array of `prog->length + 1` flags, or NULL if it
+ * could not be allocated.
+ */
+static bool *find_entry_points(Program *prog) {
+    bool *entry = calloc(prog->length + 1, sizeof(bool));
+    if (!entry) {
+        return NULL;
+    }
+
+    entry[0] = true;
+    for (size_t i = 0; i < prog->length; i++) {
+        Instruction *insn = &prog->code[i];
+        if ((insn->type == CMD_BRANCH || insn->type == CMD_CALL) &&
+            insn->target != PROGRAM_NO_TARGET) {
+            entry[insn->target] = true;
+        }
+        if (insn->type == CMD_CALL) {
+            entry[i + 1] = true;
+        }
+    }
+    return entry;
+}
+
+/**
+ * @brief Computes, for each instruction, whether the flags may be read before
+ * they are next written when control reaches it.
+ *
+ * Returns, the end of the program, undefined labels and instructions that
+ * may fail (see `program_verify`) are treated as reads, since the flags are
+ * printed once execution stops.
+ *
+ * @param prog The program to analyze.
+ * @return A heap-allocated array of `prog->length + 1` flags, or NULL if it
+ * could not be allocated.
+ */
+static bool *compute_flag_liveness(Program *prog) {
+    bool *live_in = calloc(prog->length + 1, sizeof(bool));
+    if (!live_in) {
+        return NULL;
+    }
+
+    live_in[prog->length] = true;
+    bool changed          = true;
+    while (changed) {
+        changed = false;
+        for (size_t i = prog->length; i-- > 0;) {
+            Instruction *insn   = &prog->code[i];
+            bool         linked = insn->target != PROGRAM_NO_TARGET;
+            bool         live;
+            switch (insn->type) {
+                case CMD_CMP:
+                case CMD_CMP_U:
+                    live = false;
+                    break;
+                case CMD_BRANCH:
+                    if (insn->branch_condition != BRANCH_ALWAYS || !linked) {
+                        live = true;
+                    } else {
+                        live = live_in[insn->target];
+                    }
+                    break;
+                case CMD_CALL:
+                    live = !linked || live_in[insn->target];
+                    break;
+                case CMD_RET:
+                    live = true;
+                    break;
+                default:
+                    // A failure dumps the flags, so only verified instructions skip them
+                    live = !insn->is_verified || live_in[i + 1];
+                    break;
+            }
+            if (live != live_in[i]) {
+                live_in[i] = live;
+                changed    = true;
+            }
+        }
+    }
+    return live_in;
+}
+
+/**
+ * @brief Determines whether the flags may be read after the given branch.
+ *
+ * @param prog The program being fused.
+ * @param live_in The flag liveness computed by `compute_flag_liveness`.
+ * @param branch The index of a linked branch.
+ * @return True if either successor of the branch may read the flags.
+ */
+static bool flags_live_after_branch(Program *prog, bool *live_in, size_t branch) {
+    Instruction *insn = &prog->code[branch];
+    return live_in[insn->target] ||
+           (insn->branch_condition != BRANCH_ALWAYS && live_in[branch + 1]);
+}
+
+/**
+ * @brief Determines whether an instruction is a branch with a known target.
+ *
+ * @param insn The instruction to check.
+ * @param cond The required condition, or BRANCH_NONE to accept any.
+ * @return True if `insn` is a linked branch matching `cond`.
+ */
+static bool is_linked_branch(Instruction *insn, BranchCondition cond) {
+    return insn->type == CMD_BRANCH && insn->target != PROGRAM_NO_TARGET &&
+           (cond == BRANCH_NONE || insn->branch_condition == cond);
+}
+
+/**
+ * @brief Determines whether control can enter a group other than at its start.
+ *
+ * @param entry The entry points computed by `find_entry_points`.
+ * @param start The index of the first instruction in the group.
+ * @param length The number of instructions in the group.
+ * @return True if any instruction after the first is an entry point.
+ */
+static bool enters_group(bool *entry, size_t start, size_t length) {
+    for (size_t i = start + 1; i < start + length; i++) {
+        if (entry[i]) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Finds how many instructions a superinstruction of `program_fuse`
+ * covers.
+ *
+ * @param type The `CommandType` of an instruction.
+ * @return The number of instructions the instruction runs.
+ */
+static size_t fused_width(uint8_t type) {
+    switch (type) {
+        case CMD_ADD_CMP_BRANCH:
+        case CMD_ADD_CMP_BRANCH_NOFLAGS:
+            return 3;
+        case CMD_CMP_BRANCH:
+        case CMD_CMP_BRANCH_NOFLAGS:
+        case CMD_CMP_U_BRANCH:
+        case CMD_CMP_U_BRANCH_NOFLAGS:
+        case CMD_ADD_BRANCH:
+        case CMD_MOV_STORE:
+        case CMD_ORR_CALL:
+            return 2;
+        default:
+            return 1;
+    }
+}
+
+/**
+ * @brief Determines whether a profiled sequence has a composed form: two
+ * composable forms, optionally followed by a branch.
+ *
+ * @param sequence The sequence to check.
+ * @return True if `program_compose` can compose the sequence.
+ */
+static bool is_composable(const ProfileSequence *sequence) {
+    return composable_index(sequence->forms[0]) >= 0 &&
+           composable_index(sequence->forms[1]) >= 0 &&
+           (sequence->length == 2 || sequence->forms[2] == CMD_BRANCH);
+}
+
+/**
+ * @brief Determines whether the instructions at an index form a sequence
+ * that can be composed there.
+ *
+ * @param prog The program being composed.
+ * @param entry The entry points computed by `find_entry_points`.
+ * @param start The index of the first instruction.
+ * @param sequence A sequence accepted by `is_composable`.
+ * @return True if the instructions have the sequence's forms, and control
+ * cannot enter them other than at `start`.
+ */
+static bool matches_sequence(Program *prog, bool *entry, size_t start,
+                             const ProfileSequence *sequence) {
+    if (prog->length - start < sequence->length || enters_group(entry, start, sequence->length)) {
+        return false;
+    }
+    for (uint8_t k = 0; k < sequence->length; k++) {
+        if (prog->code[start + k].type != sequence->forms[k]) {
+            return false;
+        }
+    }
+    return sequence->length == 2 || is_linked_branch(&prog->code[start + 2], BRANCH_NONE);
+}
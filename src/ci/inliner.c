@@ -0,0 +1,546 @@
+#include "inliner.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "cfg.h"
+#include "command_type.h"
+#include "interpreter.h"
+#include "linker.h"
+#include "liveness.h"
+#include "rewrite.h"
+
+#define RETURN_LABEL ".Lret"  // Label of the branches that replace a copied `ret`.
+
+/**
+ * @brief What became of a call.
+ */
+typedef enum {
+    DECISION_INLINED,
+    DECISION_UNREACHED,
+    DECISION_DEPTH_LIMIT,
+    DECISION_UNDEFINED,
+    DECISION_SHALLOW,
+    DECISION_TOO_LARGE,
+    DECISION_CALLS,
+    DECISION_LEAVES,
+    DECISION_MAY_FAIL,
+    DECISION_NO_REGISTER,
+    DECISION_NO_MEMORY,
+} Decision;
+
+// Why a call was not inlined, as printed by `report_decision`
+static const char *const REASONS[] = {
+    [DECISION_UNREACHED]   = "never runs",
+    [DECISION_DEPTH_LIMIT] = "calls may exceed the maximum depth",
+    [DECISION_UNDEFINED]   = "callee is undefined",
+    [DECISION_SHALLOW]     = "not nested in enough loops",
+    [DECISION_TOO_LARGE]   = "callee is too large",
+    [DECISION_CALLS]       = "callee makes calls",
+    [DECISION_LEAVES]      = "callee may leave the program",
+    [DECISION_MAY_FAIL]    = "callee may fail while the state is dumped",
+    [DECISION_NO_REGISTER] = "no free variable to rename a write to",
+    [DECISION_NO_MEMORY]   = "out of memory",
+};
+
+/**
+ * @brief The body of a called function, and how its copy renames variables.
+ */
+typedef struct {
+    size_t  *body;                   // Indices of its commands, in list order.
+    size_t   size;                   // Number of entries in `body`.
+    bool    *in_body;                // Whether each command is in `body`.
+    uint64_t reads;                  // Variables the body reads.
+    uint64_t writes;                 // Variables the body writes, x0 included.
+    int8_t   rename[NUM_VARIABLES];  // What each variable becomes; see `command_copy`.
+    uint64_t restores;               // Renamed-to variables that must be zeroed on return.
+} Callee;
+
+static Decision  decide(const Cfg *cfg, const Liveness *liveness, size_t call,
+                        const InlineConfig *config, bool dumps_state, uint64_t written,
+                        Callee *callee);
+static size_t    loop_depth(const Cfg *cfg, size_t block);
+static Decision  find_body(const CommandArray *array, size_t entry, size_t max_size,
+                           bool dumps_state, Callee *callee);
+static bool      pick_renames(Callee *callee, uint64_t live_after, uint64_t written);
+static bool      splice(const CommandArray *array, size_t call, const Callee *callee,
+                        char **callee_name, bool *emptied);
+static void      drop_calls(Command **commands, Command **dropped, size_t num_dropped);
+static bool      is_dropped(const Command *cmd, Command *const *dropped, size_t num_dropped);
+static bool      add_exit(Command ***link, const Callee *callee, Command *return_site,
+                          bool falls_through);
+static void      report_decision(const char *name, size_t call, Decision decision,
+                                 const InlineConfig *config, const Callee *callee);
+
+size_t inline_calls(Command **commands, const InlineConfig *config, bool dumps_state,
+                    bool calls_may_fail, bool report) {
+    Cfg cfg;
+    if (!*commands || !cfg_build(&cfg, *commands)) {
+        return 0;
+    }
+    Liveness liveness;
+    if (!liveness_compute(&liveness, &cfg.array, dumps_state, calls_may_fail)) {
+        cfg_free(&cfg);
+        return 0;
+    }
+
+    size_t    count       = cfg.array.count;
+    size_t    inlined     = 0;
+    size_t    num_dropped = 0;
+    Command **dropped     = malloc((count + 1) * sizeof(Command *));
+    Callee    callee;
+    callee.size    = 0;
+    callee.body    = malloc((count + 1) * sizeof(size_t));
+    callee.in_body = calloc(count + 1, sizeof(bool));
+    if (!dropped || !callee.body || !callee.in_body) {
+        goto done;
+    }
+
+    // Variables nothing writes stay zero, so a copy may borrow them and re-zero them
+    uint64_t written = 0;
+    for (size_t i = 0; i < count; i++) {
+        written |= command_writes(cfg.array.commands[i]);
+    }
+
+    // Copies only add commands around the calls, so the analysis holds for all of them
+    if (report) {
+        printf("Inlining decisions:\n");
+    }
+    for (size_t i = 0; i < count; i++) {
+        if (cfg.array.commands[i]->type != CMD_CALL) {
+            continue;
+        }
+        Decision decision = calls_may_fail ? DECISION_DEPTH_LIMIT
+                                           : decide(&cfg, &liveness, i, config, dumps_state,
+                                                    written, &callee);
+        char    *name     = cfg.array.commands[i]->val_a.str_val;
+        bool     owned    = false;
+        bool     emptied  = false;
+        if (decision == DECISION_INLINED) {
+            owned    = splice(&cfg.array, i, &callee, &name, &emptied);
+            decision = owned ? DECISION_INLINED : DECISION_NO_MEMORY;
+        }
+        if (emptied) {
+            dropped[num_dropped++] = cfg.array.commands[i];
+        }
+        inlined += decision == DECISION_INLINED;
+        if (report) {
+            report_decision(name, i, decision, config, &callee);
+        }
+        if (owned) {
+            free(name);
+        }
+        for (size_t k = 0; k < callee.size; k++) {
+            callee.in_body[callee.body[k]] = false;
+        }
+        callee.size = 0;
+    }
+    if (report) {
+        printf("\n");
+    }
+    drop_calls(commands, dropped, num_dropped);
+
+done:
+    free(dropped);
+    free(callee.body);
+    free(callee.in_body);
+    liveness_free(&liveness);
+    cfg_free(&cfg);
+    return inlined;
+}
+
+/**
+ * @brief Decides whether a call can be inlined, finding its callee's body and
+ * renames if so.
+ *
+ * @param cfg The control-flow graph.
+ * @param liveness What is live before each command.
+ * @param call Index of the call.
+ * @param config The limits to apply.
+ * @param dumps_state Whether the variables and flags are printed at the end.
+ * @param written Variables some command of the list writes.
+ * @param callee Filled in with the callee's body and renames.
+ * @return DECISION_INLINED if the call can be inlined, the reason it cannot
+ * otherwise.
+ */
+static Decision decide(const Cfg *cfg, const Liveness *liveness, size_t call,
+                       const InlineConfig *config, bool dumps_state, uint64_t written,
+                       Callee *callee) {
+    const CommandArray *array = &cfg->array;
+    callee->size              = 0;
+    if (!liveness->reached[call]) {
+        return DECISION_UNREACHED;
+    }
+    if (array->targets[call] < 0) {
+        return DECISION_UNDEFINED;
+    }
+    if (loop_depth(cfg, cfg->block_of[call]) < config->min_loop_depth) {
+        return DECISION_SHALLOW;
+    }
+
+    Decision decision =
+        find_body(array, (size_t) array->targets[call], config->max_size, dumps_state, callee);
+    if (decision != DECISION_INLINED) {
+        return decision;
+    }
+    return pick_renames(callee, liveness->live[call + 1], written) ? DECISION_INLINED
+                                                                   : DECISION_NO_REGISTER;
+}
+
+/**
+ * @brief Counts the natural loops a block is part of.
+ *
+ * @param cfg The control-flow graph.
+ * @param block The block.
+ * @return The number of loops containing the block.
+ */
+static size_t loop_depth(const Cfg *cfg, size_t block) {
+    size_t depth = 0;
+    for (size_t l = 0; l < cfg->num_loops; l++) {
+        depth += cfg->loops[l].blocks[block];
+    }
+    return depth;
+}
+
+/**
+ * @brief Collects the commands a function can run before it returns.
+ *
+ * @param array The command list.
+ * @param entry Index of the function's first command.
+ * @param max_size Most commands the body may have.
+ * @param dumps_state Whether the variables and flags are printed at the end.
+ * @param callee Filled in with the body and the variables it reads and writes.
+ * @return DECISION_INLINED if the body can be copied, the reason it cannot
+ * otherwise.
+ */
+static Decision find_body(const CommandArray *array, size_t entry, size_t max_size,
+                          bool dumps_state, Callee *callee) {
+    callee->reads  = 0;
+    callee->writes = 0;
+    if (max_size == 0) {
+        return DECISION_TOO_LARGE;
+    }
+
+    // `body` doubles as the worklist: commands after `next` are still to be visited
+    callee->body[callee->size++] = entry;
+    callee->in_body[entry]       = true;
+    for (size_t next = 0; next < callee->size; next++) {
+        size_t   k         = callee->body[next];
+        Command *cmd       = array->commands[k];
+        int64_t  successor = (int64_t) k + 1;
+        int64_t  target    = LINK_NO_INDEX;
+        switch (cmd->type) {
+            case CMD_CALL:
+                return DECISION_CALLS;
+            case CMD_RET:
+                successor = LINK_NO_INDEX;
+                break;
+            case CMD_BRANCH:
+                target = array->targets[k];
+                if (target < 0) {
+                    return DECISION_LEAVES;
+                }
+                if (cmd->branch_condition == BRANCH_ALWAYS) {
+                    successor = LINK_NO_INDEX;
+                }
+                break;
+            default:
+                if (dumps_state && command_may_fail(cmd)) {
+                    return DECISION_MAY_FAIL;
+                }
+                callee->reads |= command_reads(cmd);
+                callee->writes |= command_writes(cmd) & ~LIVE_FLAGS;
+                break;
+        }
+
+        int64_t pending[2] = {successor, target};
+        for (size_t p = 0; p < 2; p++) {
+            if (pending[p] == LINK_NO_INDEX) {
+                continue;
+            }
+            if ((size_t) pending[p] >= array->count) {
+                return DECISION_LEAVES;
+            }
+            if (!callee->in_body[pending[p]]) {
+                if (callee->size == max_size) {
+                    return DECISION_TOO_LARGE;
+                }
+                callee->body[callee->size++] = (size_t) pending[p];
+                callee->in_body[pending[p]]  = true;
+            }
+        }
+    }
+
+    // Copy in list order, so that every fallthrough stays one
+    for (size_t k = 1; k < callee->size; k++) {
+        size_t index = callee->body[k];
+        size_t j     = k;
+        for (; j > 0 && callee->body[j - 1] > index; j--) {
+            callee->body[j] = callee->body[j - 1];
+        }
+        callee->body[j] = index;
+    }
+    return DECISION_INLINED;
+}
+
+/**
+ * @brief Picks a variable for each one other than x0 that a body writes.
+ *
+ * Each stand-in is a spare variable over the body (see
+ * `find_spare_variable`), and is zeroed again on return if it was borrowed
+ * from those that stay zero.
+ *
+ * @param callee The callee, whose `rename` and `restores` are filled in.
+ * @param live_after What is live after the call returns.
+ * @param written Variables some command of the list writes.
+ * @return true if every write could be renamed, false otherwise.
+ */
+static bool pick_renames(Callee *callee, uint64_t live_after, uint64_t written) {
+    uint64_t used     = callee->reads | callee->writes;
+    callee->restores  = 0;
+    for (size_t v = 0; v < NUM_VARIABLES; v++) {
+        callee->rename[v] = REWRITE_NO_VARIABLE;
+    }
+    for (size_t v = 1; v < NUM_VARIABLES; v++) {
+        if (!(callee->writes >> v & 1)) {
+            continue;
+        }
+
+        bool    restore;
+        int64_t spare = find_spare_variable(used, live_after, written, &restore);
+        if (spare == REWRITE_NO_VARIABLE) {
+            return false;
+        }
+        callee->rename[v]  = (int8_t) spare;
+        callee->restores  |= (uint64_t) restore << spare;
+        used              |= (uint64_t) 1 << spare;
+    }
+    return true;
+}
+
+/**
+ * @brief Replaces a call with a copy of its callee's body.
+ *
+ * The copy starts by setting each renamed variable the body reads from the
+ * original. Each `ret` becomes the zeroing of borrowed variables and a
+ * branch to the command after the call; the last one falls through instead.
+ * The call command itself becomes the copy's first command, so that branches
+ * to the call now enter the copy. A copy with no commands at all, as for a
+ * callee that only returns, leaves the call to be removed by `drop_calls`.
+ *
+ * @param array The command list.
+ * @param call Index of the call.
+ * @param callee The callee's body and renames.
+ * @param callee_name Set to the call's label, which the caller must free, on
+ * success.
+ * @param emptied Set to whether the copy is empty, so that the call must be
+ * removed.
+ * @return true on success, false if memory could not be allocated, in which
+ * case the call is left alone.
+ */
+static bool splice(const CommandArray *array, size_t call, const Callee *callee,
+                   char **callee_name, bool *emptied) {
+    Command  *call_cmd    = array->commands[call];
+    Command  *return_site = call_cmd->next ? call_cmd->next : LINK_HALT;
+    Command **copy_of     = calloc(array->count, sizeof(Command *));
+    Command  *head        = NULL;
+    Command **link        = &head;
+    bool      ok          = copy_of != NULL;
+
+    // Renamed variables the body reads start out with the original's value,
+    // copied with `add rename, v, 0` since `mov` only takes an immediate
+    for (size_t v = 1; v < NUM_VARIABLES && ok; v++) {
+        if (callee->rename[v] != REWRITE_NO_VARIABLE && (callee->reads >> v & 1)) {
+            Command *copy = command_new(CMD_ADD);
+            ok            = copy != NULL;
+            if (copy) {
+                copy->destination.num_val = callee->rename[v];
+                copy->val_a.num_val       = (int64_t) v;
+                copy->val_b.num_val       = 0;
+                copy->is_b_immediate      = true;
+                *link                     = copy;
+                link                      = &copy->next;
+            }
+        }
+    }
+    for (size_t k = 0; k < callee->size && ok; k++) {
+        Command *cmd   = array->commands[callee->body[k]];
+        Command *first = NULL;
+        if (cmd->type == CMD_RET) {
+            Command **start = link;
+            ok              = add_exit(&link, callee, return_site, k + 1 == callee->size);
+            first           = *start ? *start : return_site;
+        } else {
+            first = command_copy(cmd, callee->rename);
+            ok    = first != NULL;
+            if (first) {
+                *link = first;
+                link  = &first->next;
+            }
+        }
+        copy_of[callee->body[k]] = first;
+    }
+    if (!ok) {
+        free_command(head);
+        free(copy_of);
+        return false;
+    }
+    *callee_name = call_cmd->val_a.str_val;
+    if (!head) {
+        free(copy_of);
+        call_cmd->val_a.str_val = NULL;
+        call_cmd->is_a_string   = false;
+        *emptied                = true;
+        return true;
+    }
+
+    // Branches inside the copy go to the copies of their targets
+    for (Command *cmd = head; cmd; cmd = cmd->next) {
+        if (cmd->type == CMD_BRANCH && cmd->target != return_site) {
+            for (size_t k = 0; k < callee->size; k++) {
+                if (cmd->target == array->commands[callee->body[k]]) {
+                    cmd->target = copy_of[callee->body[k]];
+                    break;
+                }
+            }
+        }
+    }
+
+    // The call becomes the first copied command, keeping its place in the list
+    *link          = call_cmd->next;
+    Command *first = head;
+    *call_cmd      = *first;
+    for (Command *cmd = call_cmd; cmd; cmd = cmd->next) {
+        if (cmd->type == CMD_BRANCH && cmd->target == first) {
+            cmd->target = call_cmd;
+        }
+        if (cmd->next == return_site) {
+            break;
+        }
+    }
+    free(first);
+    free(copy_of);
+    return true;
+}
+
+/**
+ * @brief Removes the calls whose copies turned out empty.
+ *
+ * Branches and calls to a removed call go to the first command kept after
+ * it, or end the program if there is none.
+ *
+ * @param commands Pointer to the head of the linked list.
+ * @param dropped The calls to remove, whose labels were already taken.
+ * @param num_dropped Number of entries in `dropped`.
+ */
+static void drop_calls(Command **commands, Command **dropped, size_t num_dropped) {
+    if (num_dropped == 0) {
+        return;
+    }
+    for (Command *cmd = *commands; cmd; cmd = cmd->next) {
+        if (cmd->type != CMD_BRANCH && cmd->type != CMD_CALL) {
+            continue;
+        }
+        Command *target = cmd->target;
+        while (is_dropped(target, dropped, num_dropped)) {
+            target = target->next ? target->next : LINK_HALT;
+        }
+        cmd->target = target;
+    }
+    for (Command **link = commands; *link;) {
+        if (is_dropped(*link, dropped, num_dropped)) {
+            *link = (*link)->next;
+        } else {
+            link = &(*link)->next;
+        }
+    }
+    for (size_t k = 0; k < num_dropped; k++) {
+        free(dropped[k]);
+    }
+}
+
+/**
+ * @brief Determines whether a command is one of the calls being removed.
+ *
+ * @param cmd The command, which may be NULL or `LINK_HALT`.
+ * @param dropped The calls being removed.
+ * @param num_dropped Number of entries in `dropped`.
+ * @return True if `cmd` is in `dropped`.
+ */
+static bool is_dropped(const Command *cmd, Command *const *dropped, size_t num_dropped) {
+    for (size_t k = 0; k < num_dropped; k++) {
+        if (dropped[k] == cmd) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Appends what a copied `ret` turns into.
+ *
+ * @param link Where to link the next command, advanced past those added.
+ * @param callee The callee, whose borrowed variables are zeroed.
+ * @param return_site The command after the call, or `LINK_HALT`.
+ * @param falls_through Whether the copy ends here, so that no branch is needed.
+ * @return true on success, false if memory could not be allocated.
+ */
+static bool add_exit(Command ***link, const Callee *callee, Command *return_site,
+                     bool falls_through) {
+    for (size_t t = 1; t < NUM_VARIABLES; t++) {
+        if (callee->restores >> t & 1) {
+            Command *zero = command_new(CMD_MOV);
+            if (!zero) {
+                return false;
+            }
+            zero->destination.num_val = (int64_t) t;
+            zero->is_a_immediate      = true;
+            **link                    = zero;
+            *link                     = &zero->next;
+        }
+    }
+    if (falls_through) {
+        return true;
+    }
+
+    Command *jump = command_new_branch(BRANCH_ALWAYS, return_site, RETURN_LABEL);
+    if (!jump) {
+        return false;
+    }
+    **link = jump;
+    *link  = &jump->next;
+    return true;
+}
+
+/**
+ * @brief Prints what became of a call.
+ *
+ * @param name The label the call referred to.
+ * @param call Index of the call.
+ * @param decision What became of it.
+ * @param config The limits that applied.
+ * @param callee The callee's body and renames, if it was inlined.
+ */
+static void report_decision(const char *name, size_t call, Decision decision,
+                            const InlineConfig *config, const Callee *callee) {
+    printf("call %s at command %zu: ", name, call);
+    if (decision != DECISION_INLINED) {
+        printf("not inlined, %s", REASONS[decision]);
+        if (decision == DECISION_TOO_LARGE) {
+            printf(" (limit %zu commands)", config->max_size);
+        } else if (decision == DECISION_SHALLOW) {
+            printf(" (needs %zu)", config->min_loop_depth);
+        }
+        printf("\n");
+        return;
+    }
+
+    printf("inlined %zu commands", callee->size);
+    const char *separator = ", renaming ";
+    for (size_t v = 1; v < NUM_VARIABLES; v++) {
+        if (callee->rename[v] != REWRITE_NO_VARIABLE) {
+            printf("%sx%zu to x%d", separator, v, callee->rename[v]);
+            separator = ", ";
+        }
+    }
+    printf("\n");
+}
@@ -7,53 +7,170 @@
 #include <stdlib.h>
 
 #include "command_type.h"
+#include "fusion.h"
+#include "jit.h"
 #include "mem.h"
+#include "specialize.h"
+#include "trace.h"
 
-static bool    cond_holds(Interpreter *intr, BranchCondition cond);
-static int64_t fetch_number_value(Interpreter *intr, Operand *op, bool is_im);
-static bool    print_base(Interpreter *intr, Command *cmd);
+// The threaded engine uses the GCC/Clang labels-as-values extension when it is
+// available. Build with -DCI_NO_COMPUTED_GOTO to drive it with a switch instead.
+#if defined(__GNUC__) && !defined(CI_NO_COMPUTED_GOTO)
+#define CI_COMPUTED_GOTO 1
+#else
+#define CI_COMPUTED_GOTO 0
+#endif
+
+/**
+ * @brief The counters of the tiered engine, and the optimized code that hot
+ * functions move to.
+ *
+ * A function starts at the first instruction or at a call target, and runs
+ * up to the next such instruction. Calls count towards their target, and
+ * taken backward branches towards the function they are in.
+ */
+typedef struct {
+    Program   fast;      // Fused and specialized copy of the program, once built.
+    bool      compiled;  // Whether `fast` has been built.
+    bool      failed;    // Whether building `fast` failed, which stops all promotion.
+    void    **handlers;  // Threaded handlers of `fast`, resolved on its first run.
+    size_t   *owner;     // Entry of the function each instruction belongs to.
+    uint32_t *calls;     // Calls to each function, by entry.
+    uint32_t *loops;     // Taken backward branches in each function, by entry.
+    bool     *hot;       // Whether each function has been promoted, by entry.
+} Tiers;
+
+static int64_t fetch_number_value(Interpreter *intr, int64_t operand, bool is_im);
+static bool    print_base(Interpreter *intr, Program *prog, Instruction *cmd);
+static bool    load_value(Interpreter *intr, Program *prog, Instruction *cmd);
+static bool    store_value(Interpreter *intr, Program *prog, Instruction *cmd);
+static bool    store_bytes(int64_t value, int64_t offset, int64_t bytes);
+static bool    put_string(Interpreter *intr, Program *prog, Instruction *cmd);
+static void    free_stack(Interpreter *intr);
+static size_t  lowest_variable(uint32_t mask);
+static void    set_flags(Interpreter *intr, uint8_t flags);
+static void    interpret_switch(Interpreter *intr, Program *prog, TraceCache *traces, Tiers *tiers);
+static size_t  interpret_threaded(Interpreter *intr, Program *prog, size_t pc, size_t stop_depth,
+                                  void ***cache);
+static void    run_threaded(Interpreter *intr, Program *prog);
+static bool    tiers_init(Tiers *tiers, Program *prog);
+static void    tiers_free(Tiers *tiers);
+static size_t  tier_call(Tiers *tiers, Interpreter *intr, Program *prog, size_t target);
+static size_t  tier_branch(Tiers *tiers, Interpreter *intr, Program *prog, size_t from, size_t to);
+static void    tier_promote(Tiers *tiers, Interpreter *intr, Program *prog, size_t entry);
+static size_t  tier_enter(Tiers *tiers, Interpreter *intr, size_t pc);
 // Function for binary conversion
 static void to_binary_string(uint64_t num, char *bit_string, size_t bit_string_size);
 
-void interpreter_init(Interpreter *intr, LabelMap *map) {
+void interpreter_init(Interpreter *intr) {
     if (!intr) {
         return;
     }
 
-    intr->had_error  = false;
-    intr->label_map  = map;
-    intr->is_greater = false;
-    intr->is_equal   = false;
-    intr->is_less    = false;
-    intr->the_stack  = NULL;
+    intr->had_error    = false;
+    intr->compare_a    = 0;
+    intr->compare_b    = 0;
+    intr->compare_kind = COMPARE_NONE;
+    intr->the_stack    = NULL;
+    intr->depth        = 0;
+    intr->capacity     = 0;
+    intr->max_depth    = 0;
+    intr->peak_depth   = 0;
+    memo_init(&intr->memo);
+    intr->engine       = ENGINE_SWITCH;
+    memset(&intr->tiers, 0, sizeof(intr->tiers));
+    intr->profiler     = NULL;
 
     for (size_t i = 0; i < NUM_VARIABLES; i++) {
         intr->variables[i] = 0;
     }
 }
 
-void interpret(Interpreter *intr, Command *commands) {
-    if (!intr || !commands) {
+void interpret(Interpreter *intr, Program *prog) {
+    if (!intr || !prog) {
         return;
     }
 
-    Command *current = commands;
-    while (current && !intr->had_error) {
-        bool jumped = false;
+    switch (intr->engine) {
+        case ENGINE_JIT:
+            if (jit_run(intr, prog)) {
+                break;
+            }
+            // No native code for this program or platform; run it threaded instead
+            run_threaded(intr, prog);
+            break;
+        case ENGINE_THREADED:
+            run_threaded(intr, prog);
+            break;
+        case ENGINE_TRACE: {
+            TraceCache traces;
+            if (!trace_cache_init(&traces, prog)) {
+                interpret_switch(intr, prog, NULL, NULL);
+                break;
+            }
+            interpret_switch(intr, prog, &traces, NULL);
+            trace_cache_free(&traces);
+            break;
+        }
+        case ENGINE_TIERED: {
+            Tiers tiers;
+            if (!tiers_init(&tiers, prog)) {
+                interpret_switch(intr, prog, NULL, NULL);
+                break;
+            }
+            interpret_switch(intr, prog, NULL, &tiers);
+            tiers_free(&tiers);
+            break;
+        }
+        default:
+            interpret_switch(intr, prog, NULL, NULL);
+            break;
+    }
+    // Week 4: free the stack at the end
+    free_stack(intr);
+    memo_free(&intr->memo);
+}
+
+/**
+ * @brief Executes a program with the reference engine.
+ *
+ * Decodes every instruction through a single `switch`, checking operands and
+ * the error flag as it goes, except where `program_verify` has proven an
+ * instruction cannot fail. With a trace cache, hot loops are recorded and
+ * run as compiled traces; see trace.h. With tiers, calls and taken backward
+ * branches are counted, and execution moves to the threaded engine whenever
+ * it enters a function that has been promoted.
+ *
+ * @param intr The pointer to the interpreter holding variable state.
+ * @param prog The program to execute.
+ * @param traces The trace cache to use, or NULL to interpret everything.
+ * @param tiers The tier counters to use, or NULL to interpret everything.
+ */
+static void interpret_switch(Interpreter *intr, Program *prog, TraceCache *traces, Tiers *tiers) {
+    size_t pc = 0;
+    while (pc < prog->length) {
+        Instruction *current = &prog->code[pc];
+        bool         jumped  = false;
+        if (traces && traces->header != TRACE_NOT_RECORDING) {
+            trace_record(traces, pc);
+        }
+        if (intr->profiler) {
+            profiler_record(intr->profiler, pc);
+        }
         switch (current->type) {
             // STUDENT TODO: process the commands and take actions as appropriate
             case CMD_MOV: {
-                int64_t value = fetch_number_value(intr, &current->val_a, current->is_a_immediate);
+                int64_t value = fetch_number_value(intr, PROGRAM_OPERAND_A(prog, current), current->is_a_immediate);
                 if (intr->had_error) {
                     break;
                 }
-                intr->variables[current->destination.num_val] = value;
+                intr->variables[current->destination] = value;
                 break;
             }
             case CMD_ADD:
             case CMD_SUB: {
-                uint64_t a = (uint64_t)fetch_number_value(intr, &current->val_a, false);
-                uint64_t b = (uint64_t)fetch_number_value(intr, &current->val_b, current->is_b_immediate);
+                uint64_t a = (uint64_t)fetch_number_value(intr, PROGRAM_OPERAND_A(prog, current), false);
+                uint64_t b = (uint64_t)fetch_number_value(intr, PROGRAM_OPERAND_B(prog, current), current->is_b_immediate);
                 if (intr->had_error) {
                     break;
                 }
@@ -63,8 +180,8 @@ void interpret(Interpreter *intr, Command *commands) {
                 } else {
                     result = a - b; 
                 }
-                int64_t dest_index = current->destination.num_val;
-                if (dest_index < 0 || dest_index >= NUM_VARIABLES) {
+                int64_t dest_index = current->destination;
+                if (!current->is_verified && (dest_index < 0 || dest_index >= NUM_VARIABLES)) {
                     intr->had_error = true; 
                     break;
                 }
@@ -73,40 +190,40 @@ void interpret(Interpreter *intr, Command *commands) {
             }
             case CMD_CMP:
             case CMD_CMP_U: {
-                int64_t a = fetch_number_value(intr, &current->val_a, false);
-                int64_t b = fetch_number_value(intr, &current->val_b, current->is_b_immediate);
+                int64_t a = fetch_number_value(intr, PROGRAM_OPERAND_A(prog, current), false);
+                int64_t b = fetch_number_value(intr, PROGRAM_OPERAND_B(prog, current), current->is_b_immediate);
                 if (intr->had_error) {
                     break;
                 }
-                intr->is_greater = (current->type == CMD_CMP) ? (a > b) : ((uint64_t)a > (uint64_t)b);
-                intr->is_equal = (a == b);
-                intr->is_less = !(intr->is_greater || intr->is_equal);
+                intr->compare_a = a;
+                intr->compare_b = b;
+                intr->compare_kind = (current->type == CMD_CMP) ? COMPARE_SIGNED : COMPARE_UNSIGNED;
                 break;
             }
             case CMD_PRINT:
-                if (!print_base(intr, current)) {
+                if (!print_base(intr, prog, current)) {
                     intr->had_error = true;
                 }
                 break;
             case CMD_AND:
             case CMD_EOR:
             case CMD_ORR: {
-                int64_t a = fetch_number_value(intr, &current->val_a, false);
-                int64_t b = fetch_number_value(intr, &current->val_b, false);
+                int64_t a = fetch_number_value(intr, PROGRAM_OPERAND_A(prog, current), false);
+                int64_t b = fetch_number_value(intr, PROGRAM_OPERAND_B(prog, current), false);
                 if (intr->had_error) {
                     break;
                 }
 
                 int64_t result = (current->type == CMD_AND) ? (a & b) : 
                                  (current->type == CMD_EOR) ? (a ^ b) : (a | b);
-                intr->variables[current->destination.num_val] = result;
+                intr->variables[current->destination] = result;
                 break;
             }
             case CMD_LSL:
             case CMD_LSR:
             case CMD_ASR: {
-                int64_t a = fetch_number_value(intr, &current->val_a, false);
-                int64_t b = fetch_number_value(intr, &current->val_b, current->is_b_immediate);
+                int64_t a = fetch_number_value(intr, PROGRAM_OPERAND_A(prog, current), false);
+                int64_t b = fetch_number_value(intr, PROGRAM_OPERAND_B(prog, current), current->is_b_immediate);
                 if (intr->had_error) {
                     break;
                 }
@@ -116,124 +233,89 @@ void interpret(Interpreter *intr, Command *commands) {
                 }
                 int64_t result;
                 if (current->type == CMD_LSL) {
-                    result = a << b;
+                    result = (int64_t) ((uint64_t) a << b);
                 } else if (current->type == CMD_LSR) {
                     result = (uint64_t)a >> b; // Logical shift fills with zeros
                 } else { 
                     result = a >> b; // Shift preserves sign bit
                 }
-                intr->variables[current->destination.num_val] = result;
+                intr->variables[current->destination] = result;
                 break;
             }
-            case CMD_LOAD: {
-                uint8_t *dest_index = (uint8_t*) &intr->variables[current->destination.num_val];
-                size_t offset = fetch_number_value(intr, &current->val_b, current->is_b_immediate);
-                size_t bytes = fetch_number_value(intr, &current->val_a, current->is_a_immediate);
-                intr->variables[current->destination.num_val] = 0;
-                if (!mem_load(dest_index, offset, bytes)) {
+            case CMD_LOAD:
+                if (!load_value(intr, prog, current)) {
                     intr->had_error = true;
-                    break;
                 }
                 break;
-            }
-            case CMD_STORE: {
-                int64_t src_index = current->destination.num_val;
-                int64_t bytes = fetch_number_value(intr, &current->val_a, current->is_a_immediate);
-                int64_t offset = fetch_number_value(intr, &current->val_b, current->is_b_immediate);
-                // Validate byte size
-                if (bytes != 1 && bytes != 2 && bytes != 4 && bytes != 8) {
+            case CMD_STORE:
+                if (!store_value(intr, prog, current)) {
                     intr->had_error = true;
-                    break;
-                }
-                // Validate memory bounds
-                if (offset + bytes > MEM_CAPACITY) {
-                    intr->had_error = true;
-                    break;
-                }
-                uint8_t buffer[8] = {0};
-                int64_t value = intr->variables[src_index];
-                // Store bytes in little-endian order
-                for (int i = 0; i < bytes; i++) {
-                    buffer[i] = (value >> (i * 8)) & 0xFF;
-                }
-                if (!mem_store(buffer, (size_t)offset, (size_t)bytes)) {
-                    intr->had_error = true;
-                    break;
                 }
                 break;
-            }
-            case CMD_PUT: {
-                int64_t offset = fetch_number_value(intr, &current->val_b, current->is_b_immediate);
-                const char *str = current->val_a.str_val;
-                if (!intr->had_error && str) {
-                    size_t str_len = strlen(str) + 1;
-                    for (size_t i = 0; i < str_len; i++) {
-                        if (!mem_store((uint8_t *)&str[i], offset + i, 1)) {
-                            intr->had_error = true;
-                            break;
-                        }
-                    }
-                } else {
+            case CMD_PUT:
+                if (!put_string(intr, prog, current)) {
                     intr->had_error = true;
                 }
                 break;
-            }
             case CMD_BRANCH: {
-                if (cond_holds(intr, current->branch_condition)) {
-                    const char *label = current->val_a.str_val;
-                    Entry *entry = get_label(intr->label_map, (char *)label);
-                    if (!entry) {
-                        if (strncmp(label, ".L", 2) == 0) {
-                            current = NULL;
-                            jumped = true;
-                            break;
-                        }
+                if (CONDITION_HOLDS(current->branch_condition, interpreter_flags(intr))) {
+                    if (current->target == PROGRAM_NO_TARGET) {
                         intr->had_error = true;
-                        printf("Label not found: %s\n", label);
+                        printf("Label not found: %s\n", PROGRAM_STRING_A(prog, current));
                         break;
                     }
-                    current = entry->command; 
+                    pc = (size_t)current->target;  // Linked .L labels target the end
+                    if (traces) {
+                        pc = trace_branch(traces, intr, (size_t)(current - prog->code), pc);
+                    }
+                    if (tiers && pc <= (size_t)(current - prog->code)) {
+                        pc = tier_branch(tiers, intr, prog, (size_t)(current - prog->code), pc);
+                    }
                 } else {
-                    current = current->next;  
+                    pc++;
                 }
                 jumped = true;
                 break;
             }
             case CMD_CALL: {
-                const char *label = current->val_a.str_val;
-                Entry *target = get_label(intr->label_map, (char*)label);
-                if (!target) {
+                if (current->target == PROGRAM_NO_TARGET) {
                     intr->had_error = true;
-                    printf("Label not found: %s\n", label);
+                    printf("Label not found: %s\n", PROGRAM_STRING_A(prog, current));
                     break;
                 }
-                // Allocate a new stack frame
-                StackEntry *stack_entry = malloc(sizeof(StackEntry));
-                if (!stack_entry) {
+                if (current->is_memoized) {
+                    int64_t next = interpreter_call_memoized(intr, prog, current);
+                    if (next < 0) {
+                        intr->had_error = true;
+                        break;
+                    }
+                    pc = (size_t)next;
+                    jumped = true;
+                    if (tiers && next == current->target) {
+                        pc = tier_call(tiers, intr, prog, pc);
+                    }
+                    break;
+                }
+                // A tail call returns straight to the caller's caller
+                if (!(current->is_tail_call && intr->depth > 0) &&
+                    !interpreter_push_frame(intr, pc + 1, PROGRAM_CALL_SAVES(current))) {
                     intr->had_error = true;
                     break;
                 }
-                // Save all registers and the return address
-                memcpy(stack_entry->variables, intr->variables, sizeof(int64_t) * NUM_VARIABLES);
-                stack_entry->command = current->next;
-                stack_entry->next = intr->the_stack;
-                intr->the_stack = stack_entry;
-                current = target->command;  // Jump to function label
+                pc = (size_t)current->target;  // Jump to function label
                 jumped = true;
+                if (tiers) {
+                    pc = tier_call(tiers, intr, prog, pc);
+                }
                 break;
             }
             case CMD_RET: {
-                if (!intr->the_stack) {
-                    current = NULL;  // No stack frame to return to -> end execution
+                if (intr->depth == 0) {
+                    pc = prog->length;  // No stack frame to return to -> end execution
                     jumped = true;   
                     break;
                 }
-                StackEntry *stack_entry = intr->the_stack;
-                intr->the_stack = stack_entry->next;
-                // Restore all registers except x0
-                memcpy(&intr->variables[1], &stack_entry->variables[1], sizeof(int64_t) * (NUM_VARIABLES - 1));
-                current = stack_entry->command; 
-                free(stack_entry);
+                pc = interpreter_pop_frame(intr);
                 jumped = true;
                 break;
             }
@@ -241,17 +323,789 @@ void interpret(Interpreter *intr, Command *commands) {
                 intr->had_error = true;
                 break;
         }
-        // Move to the next command if no errors occurred
-        if (!intr->had_error && !jumped) {
-            current = current->next;
+        // Verified instructions cannot fail, so only the others need the error test
+        if (!current->is_verified && intr->had_error) {
+            break;
+        }
+        if (!jumped) {
+            pc++;
         }
     }
-    // Week 4: free the stack at the end
-    while (intr->the_stack) {
-        StackEntry *temp = intr->the_stack;
-        intr->the_stack = temp->next;
-        free(temp);
+}
+
+/**
+ * @brief Executes a program with the threaded engine.
+ *
+ * Every handler ends by jumping straight to the handler of the next
+ * instruction, so there is no central dispatch point and no per-instruction
+ * error test. Handlers that fail jump to a single exit. Register operands are
+ * read without bounds checks, as the parser only accepts x0 through x31.
+ *
+ * When built without computed goto, the same handlers are driven by a switch.
+ *
+ * @param intr The pointer to the interpreter holding variable state.
+ * @param prog The program to execute.
+ * @param pc Index of the instruction to start at: 0, or any instruction that
+ * `program_fuse` treats as jumped to.
+ * @param stop_depth Stop once a return leaves fewer frames than this, or 0 to
+ * run until the program stops.
+ * @param cache Handlers of the program's instructions, resolved on the first
+ * run if NULL and freed by the caller.
+ * @return The index of the instruction to resume at after a return left fewer
+ * than `stop_depth` frames, or the program length once it stopped.
+ */
+static size_t interpret_threaded(Interpreter *intr, Program *prog, size_t pc, size_t stop_depth,
+                                 void ***cache) {
+    Instruction *code = prog->code;
+    int64_t     *vars = intr->variables;
+    uint8_t     *mem  = mem_image();
+    Instruction *insn;
+
+// Specialized forms only ever carry inline immediates (see specialize.h)
+#define DEST  vars[insn->destination]
+#define REG_A vars[insn->val_a]
+#define CON_A PROGRAM_OPERAND_A(prog, insn)
+#define VAL_B (insn->is_b_immediate ? PROGRAM_OPERAND_B(prog, insn) : vars[insn->val_b])
+#define REG_B vars[insn->val_b]
+#define IMM_A ((int64_t) insn->val_a)
+#define IMM_B ((int64_t) insn->val_b)
+
+// Superinstructions read the operands of the instructions they cover
+#define SET_FLAGS(a, b, kind)               \
+    do {                                    \
+        intr->compare_a    = (int64_t) (a); \
+        intr->compare_b    = (int64_t) (b); \
+        intr->compare_kind = (kind);        \
+    } while (0)
+#define BRANCH_ON(br, a, b)                                                     \
+    pc = CONDITION_HOLDS((br)->branch_condition, FLAGS_OF(a, b))               \
+             ? (size_t) (br)->target                                            \
+             : (size_t) ((br) - code) + 1
+
+// Composed instructions run each part on its own operands, then the branch
+// that may end them on the flags as they stand (see fusion.h)
+#define PART_CMD_MOV(p)       vars[(p)->destination] = PROGRAM_OPERAND_A(prog, p)
+#define PART_CMD_AND(p)       vars[(p)->destination] = vars[(p)->val_a] & vars[(p)->val_b]
+#define PART_CMD_EOR(p)       vars[(p)->destination] = vars[(p)->val_a] ^ vars[(p)->val_b]
+#define PART_CMD_ORR(p)       vars[(p)->destination] = vars[(p)->val_a] | vars[(p)->val_b]
+#define PART_CMD_ADD_RRR(p)   \
+    vars[(p)->destination] = (int64_t) ((uint64_t) vars[(p)->val_a] + (uint64_t) vars[(p)->val_b])
+#define PART_CMD_ADD_RRI(p)   \
+    vars[(p)->destination] = (int64_t) ((uint64_t) vars[(p)->val_a] + (uint64_t) (p)->val_b)
+#define PART_CMD_SUB_RRR(p)   \
+    vars[(p)->destination] = (int64_t) ((uint64_t) vars[(p)->val_a] - (uint64_t) vars[(p)->val_b])
+#define PART_CMD_SUB_RRI(p)   \
+    vars[(p)->destination] = (int64_t) ((uint64_t) vars[(p)->val_a] - (uint64_t) (p)->val_b)
+#define PART_CMD_CMP_RR(p)    SET_FLAGS(vars[(p)->val_a], vars[(p)->val_b], COMPARE_SIGNED)
+#define PART_CMD_CMP_RI(p)    SET_FLAGS(vars[(p)->val_a], (p)->val_b, COMPARE_SIGNED)
+#define PART_CMD_CMP_U_RR(p)  SET_FLAGS(vars[(p)->val_a], vars[(p)->val_b], COMPARE_UNSIGNED)
+#define PART_CMD_CMP_U_RI(p)  SET_FLAGS(vars[(p)->val_a], (p)->val_b, COMPARE_UNSIGNED)
+#define PART_CMD_LSL_RRI(p)   \
+    vars[(p)->destination] = (int64_t) ((uint64_t) vars[(p)->val_a] << (p)->val_b)
+#define PART_CMD_LSR_RRI(p)   \
+    vars[(p)->destination] = (int64_t) ((uint64_t) vars[(p)->val_a] >> (p)->val_b)
+#define PART_CMD_ASR_RRI(p)   vars[(p)->destination] = vars[(p)->val_a] >> (p)->val_b
+#define PART_CMD_LOAD_RII(p)                                                    \
+    do {                                                                        \
+        vars[(p)->destination] = 0;                                             \
+        memcpy(&vars[(p)->destination], mem + (p)->val_b, (size_t) (p)->val_a); \
+    } while (0)
+#define PART_CMD_STORE_RII(p) memcpy(mem + (p)->val_b, &vars[(p)->destination], (size_t) (p)->val_a)
+#define BRANCH_ON_FLAGS(br)                                                     \
+    pc = CONDITION_HOLDS((br)->branch_condition, interpreter_flags(intr))      \
+             ? (size_t) (br)->target                                            \
+             : (size_t) ((br) - code) + 1
+
+#if CI_COMPUTED_GOTO
+    static void *const labels[] = {
+        [CMD_ADD] = &&TARGET_CMD_ADD,     [CMD_AND] = &&TARGET_CMD_AND,
+        [CMD_ASR] = &&TARGET_CMD_ASR,     [CMD_BRANCH] = &&TARGET_CMD_BRANCH,
+        [CMD_CALL] = &&TARGET_CMD_CALL,   [CMD_CMP] = &&TARGET_CMD_CMP,
+        [CMD_CMP_U] = &&TARGET_CMD_CMP_U, [CMD_ERR] = &&TARGET_CMD_ERR,
+        [CMD_EOR] = &&TARGET_CMD_EOR,     [CMD_LOAD] = &&TARGET_CMD_LOAD,
+        [CMD_LSL] = &&TARGET_CMD_LSL,     [CMD_LSR] = &&TARGET_CMD_LSR,
+        [CMD_MOV] = &&TARGET_CMD_MOV,     [CMD_ORR] = &&TARGET_CMD_ORR,
+        [CMD_PRINT] = &&TARGET_CMD_PRINT, [CMD_PUT] = &&TARGET_CMD_PUT,
+        [CMD_RET] = &&TARGET_CMD_RET,     [CMD_STORE] = &&TARGET_CMD_STORE,
+        [CMD_SUB] = &&TARGET_CMD_SUB,     [CMD_HALT] = &&TARGET_CMD_HALT,
+
+        [CMD_CMP_BRANCH]             = &&TARGET_CMD_CMP_BRANCH,
+        [CMD_CMP_BRANCH_NOFLAGS]     = &&TARGET_CMD_CMP_BRANCH_NOFLAGS,
+        [CMD_CMP_U_BRANCH]           = &&TARGET_CMD_CMP_U_BRANCH,
+        [CMD_CMP_U_BRANCH_NOFLAGS]   = &&TARGET_CMD_CMP_U_BRANCH_NOFLAGS,
+        [CMD_ADD_CMP_BRANCH]         = &&TARGET_CMD_ADD_CMP_BRANCH,
+        [CMD_ADD_CMP_BRANCH_NOFLAGS] = &&TARGET_CMD_ADD_CMP_BRANCH_NOFLAGS,
+        [CMD_ADD_BRANCH]             = &&TARGET_CMD_ADD_BRANCH,
+        [CMD_MOV_STORE]              = &&TARGET_CMD_MOV_STORE,
+        [CMD_ORR_CALL]               = &&TARGET_CMD_ORR_CALL,
+
+        [CMD_ADD_RRR] = &&TARGET_CMD_ADD_RRR,     [CMD_ADD_RRI] = &&TARGET_CMD_ADD_RRI,
+        [CMD_SUB_RRR] = &&TARGET_CMD_SUB_RRR,     [CMD_SUB_RRI] = &&TARGET_CMD_SUB_RRI,
+        [CMD_CMP_RR] = &&TARGET_CMD_CMP_RR,       [CMD_CMP_RI] = &&TARGET_CMD_CMP_RI,
+        [CMD_CMP_U_RR] = &&TARGET_CMD_CMP_U_RR,   [CMD_CMP_U_RI] = &&TARGET_CMD_CMP_U_RI,
+        [CMD_LSL_RRI] = &&TARGET_CMD_LSL_RRI,     [CMD_LSR_RRI] = &&TARGET_CMD_LSR_RRI,
+        [CMD_ASR_RRI] = &&TARGET_CMD_ASR_RRI,     [CMD_LOAD_RII] = &&TARGET_CMD_LOAD_RII,
+        [CMD_LOAD_RIR] = &&TARGET_CMD_LOAD_RIR,   [CMD_STORE_RII] = &&TARGET_CMD_STORE_RII,
+        [CMD_STORE_RRI] = &&TARGET_CMD_STORE_RRI,
+
+        [CMD_COMPOSED] = &&TARGET_CMD_COMPOSED,
+    };
+
+    // A handler for every pair of composable forms, with or without a branch
+#define COMPOSED_LABEL(first, second)        &&COMPOSED_##first##_##second,
+#define COMPOSED_BRANCH_LABEL(first, second) &&COMPOSED_BRANCH_##first##_##second,
+#define COMPOSED_ROW(first)        {COMPOSABLE_FORMS_AFTER(COMPOSED_LABEL, first)},
+#define COMPOSED_BRANCH_ROW(first) {COMPOSABLE_FORMS_AFTER(COMPOSED_BRANCH_LABEL, first)},
+    static void *const composed[NUM_COMPOSABLE][NUM_COMPOSABLE] = {
+        COMPOSABLE_FORMS(COMPOSED_ROW)
+    };
+    static void *const composed_branch[NUM_COMPOSABLE][NUM_COMPOSABLE] = {
+        COMPOSABLE_FORMS(COMPOSED_BRANCH_ROW)
+    };
+#undef COMPOSED_LABEL
+#undef COMPOSED_BRANCH_LABEL
+#undef COMPOSED_ROW
+#undef COMPOSED_BRANCH_ROW
+
+    // Direct threading: resolve each instruction's handler once, up front
+    if (!*cache) {
+        *cache = malloc((prog->length + 1) * sizeof(void *));
+        if (!*cache) {
+            intr->had_error = true;
+            return prog->length;
+        }
+        for (size_t i = 0; i <= prog->length; i++) {
+            (*cache)[i] = labels[code[i].type];
+            if (code[i].type == CMD_COMPOSED) {
+                int first  = composable_index(COMPOSED_TYPE(&code[i]));
+                int second = composable_index(code[i + 1].type);
+                (*cache)[i] = (COMPOSED_LENGTH(&code[i]) == 3) ? composed_branch[first][second]
+                                                               : composed[first][second];
+            }
+        }
+    }
+    void **handlers = *cache;
+
+#define TARGET(op) TARGET_##op:
+#define DISPATCH()               \
+    do {                         \
+        insn = &code[pc];        \
+        goto *handlers[pc];      \
+    } while (0)
+
+    DISPATCH();
+#else
+#define TARGET(op) case op:
+#define DISPATCH() goto dispatch
+
+    (void) cache;
+
+dispatch:
+    insn = &code[pc];
+    switch (insn->type) {
+#endif
+
+    TARGET(CMD_MOV) {
+        DEST = CON_A;
+        pc++;
+        DISPATCH();
+    }
+    TARGET(CMD_ADD) {
+        DEST = (int64_t) ((uint64_t) REG_A + (uint64_t) VAL_B);
+        pc++;
+        DISPATCH();
+    }
+    TARGET(CMD_SUB) {
+        DEST = (int64_t) ((uint64_t) REG_A - (uint64_t) VAL_B);
+        pc++;
+        DISPATCH();
+    }
+    TARGET(CMD_CMP) {
+        SET_FLAGS(REG_A, VAL_B, COMPARE_SIGNED);
+        pc++;
+        DISPATCH();
+    }
+    TARGET(CMD_CMP_U) {
+        SET_FLAGS(REG_A, VAL_B, COMPARE_UNSIGNED);
+        pc++;
+        DISPATCH();
+    }
+    TARGET(CMD_AND) {
+        DEST = REG_A & REG_B;
+        pc++;
+        DISPATCH();
+    }
+    TARGET(CMD_EOR) {
+        DEST = REG_A ^ REG_B;
+        pc++;
+        DISPATCH();
+    }
+    TARGET(CMD_ORR) {
+        DEST = REG_A | REG_B;
+        pc++;
+        DISPATCH();
+    }
+    TARGET(CMD_LSL) {
+        int64_t b = VAL_B;
+        if (b < 0 || b > 63) {
+            goto error;
+        }
+        DEST = (int64_t) ((uint64_t) REG_A << b);
+        pc++;
+        DISPATCH();
+    }
+    TARGET(CMD_LSR) {
+        int64_t b = VAL_B;
+        if (b < 0 || b > 63) {
+            goto error;
+        }
+        DEST = (int64_t) ((uint64_t) REG_A >> b);
+        pc++;
+        DISPATCH();
+    }
+    TARGET(CMD_ASR) {
+        int64_t b = VAL_B;
+        if (b < 0 || b > 63) {
+            goto error;
+        }
+        DEST = REG_A >> b;
+        pc++;
+        DISPATCH();
+    }
+    TARGET(CMD_LOAD) {
+        if (!load_value(intr, prog, insn)) {
+            goto error;
+        }
+        pc++;
+        DISPATCH();
+    }
+    TARGET(CMD_STORE) {
+        if (!store_value(intr, prog, insn)) {
+            goto error;
+        }
+        pc++;
+        DISPATCH();
+    }
+    TARGET(CMD_PUT) {
+        if (!put_string(intr, prog, insn)) {
+            goto error;
+        }
+        pc++;
+        DISPATCH();
+    }
+    TARGET(CMD_PRINT) {
+        if (!print_base(intr, prog, insn)) {
+            goto error;
+        }
+        pc++;
+        DISPATCH();
+    }
+    TARGET(CMD_BRANCH) {
+        if (!CONDITION_HOLDS(insn->branch_condition, interpreter_flags(intr))) {
+            pc++;
+            DISPATCH();
+        }
+        if (insn->target == PROGRAM_NO_TARGET) {
+            printf("Label not found: %s\n", PROGRAM_STRING_A(prog, insn));
+            goto error;
+        }
+        pc = (size_t) insn->target;
+        DISPATCH();
+    }
+    TARGET(CMD_CALL) {
+        if (insn->target == PROGRAM_NO_TARGET) {
+            printf("Label not found: %s\n", PROGRAM_STRING_A(prog, insn));
+            goto error;
+        }
+        if (insn->is_memoized) {
+            int64_t next = interpreter_call_memoized(intr, prog, insn);
+            if (next < 0) {
+                goto error;
+            }
+            pc = (size_t) next;
+            DISPATCH();
+        }
+        if (!(insn->is_tail_call && intr->depth > 0) &&
+            !interpreter_push_frame(intr, pc + 1, PROGRAM_CALL_SAVES(insn))) {
+            goto error;
+        }
+        pc = (size_t) insn->target;
+        DISPATCH();
+    }
+    TARGET(CMD_RET) {
+        if (intr->depth == 0) {
+            goto done;  // No stack frame to return to -> end execution
+        }
+        pc = interpreter_pop_frame(intr);
+        if (intr->depth < stop_depth) {
+            return pc;  // The frame the run started in has returned
+        }
+        DISPATCH();
+    }
+    TARGET(CMD_HALT) {
+        goto done;
+    }
+    TARGET(CMD_CMP_BRANCH) {
+        int64_t a = REG_A;
+        int64_t b = VAL_B;
+        SET_FLAGS(a, b, COMPARE_SIGNED);
+        BRANCH_ON(insn + 1, a, b);
+        DISPATCH();
+    }
+    TARGET(CMD_CMP_BRANCH_NOFLAGS) {
+        int64_t a = REG_A;
+        int64_t b = VAL_B;
+        BRANCH_ON(insn + 1, a, b);
+        DISPATCH();
+    }
+    TARGET(CMD_CMP_U_BRANCH) {
+        uint64_t a = (uint64_t) REG_A;
+        uint64_t b = (uint64_t) VAL_B;
+        SET_FLAGS(a, b, COMPARE_UNSIGNED);
+        BRANCH_ON(insn + 1, a, b);
+        DISPATCH();
+    }
+    TARGET(CMD_CMP_U_BRANCH_NOFLAGS) {
+        uint64_t a = (uint64_t) REG_A;
+        uint64_t b = (uint64_t) VAL_B;
+        BRANCH_ON(insn + 1, a, b);
+        DISPATCH();
+    }
+    TARGET(CMD_ADD_CMP_BRANCH) {
+        DEST      = (int64_t) ((uint64_t) REG_A + (uint64_t) VAL_B);
+        insn      = insn + 1;
+        int64_t a = REG_A;
+        int64_t b = VAL_B;
+        SET_FLAGS(a, b, COMPARE_SIGNED);
+        BRANCH_ON(insn + 1, a, b);
+        DISPATCH();
+    }
+    TARGET(CMD_ADD_CMP_BRANCH_NOFLAGS) {
+        DEST      = (int64_t) ((uint64_t) REG_A + (uint64_t) VAL_B);
+        insn      = insn + 1;
+        int64_t a = REG_A;
+        int64_t b = VAL_B;
+        BRANCH_ON(insn + 1, a, b);
+        DISPATCH();
+    }
+    TARGET(CMD_ADD_BRANCH) {
+        DEST = (int64_t) ((uint64_t) REG_A + (uint64_t) VAL_B);
+        pc   = (size_t) insn[1].target;
+        DISPATCH();
+    }
+    TARGET(CMD_MOV_STORE) {
+        DEST = CON_A;
+        if (!store_value(intr, prog, insn + 1)) {
+            goto error;
+        }
+        pc += 2;
+        DISPATCH();
+    }
+    TARGET(CMD_ORR_CALL) {
+        DEST = REG_A | REG_B;
+        if (insn[1].is_memoized) {
+            int64_t next = interpreter_call_memoized(intr, prog, insn + 1);
+            if (next < 0) {
+                goto error;
+            }
+            pc = (size_t) next;
+            DISPATCH();
+        }
+        if (!(insn[1].is_tail_call && intr->depth > 0) &&
+            !interpreter_push_frame(intr, pc + 2, PROGRAM_CALL_SAVES(insn + 1))) {
+            goto error;
+        }
+        pc = (size_t) insn[1].target;
+        DISPATCH();
+    }
+    TARGET(CMD_ADD_RRR) {
+        DEST = (int64_t) ((uint64_t) REG_A + (uint64_t) REG_B);
+        pc++;
+        DISPATCH();
+    }
+    TARGET(CMD_ADD_RRI) {
+        DEST = (int64_t) ((uint64_t) REG_A + (uint64_t) IMM_B);
+        pc++;
+        DISPATCH();
+    }
+    TARGET(CMD_SUB_RRR) {
+        DEST = (int64_t) ((uint64_t) REG_A - (uint64_t) REG_B);
+        pc++;
+        DISPATCH();
+    }
+    TARGET(CMD_SUB_RRI) {
+        DEST = (int64_t) ((uint64_t) REG_A - (uint64_t) IMM_B);
+        pc++;
+        DISPATCH();
+    }
+    TARGET(CMD_CMP_RR) {
+        SET_FLAGS(REG_A, REG_B, COMPARE_SIGNED);
+        pc++;
+        DISPATCH();
+    }
+    TARGET(CMD_CMP_RI) {
+        SET_FLAGS(REG_A, IMM_B, COMPARE_SIGNED);
+        pc++;
+        DISPATCH();
+    }
+    TARGET(CMD_CMP_U_RR) {
+        SET_FLAGS(REG_A, REG_B, COMPARE_UNSIGNED);
+        pc++;
+        DISPATCH();
+    }
+    TARGET(CMD_CMP_U_RI) {
+        SET_FLAGS(REG_A, IMM_B, COMPARE_UNSIGNED);
+        pc++;
+        DISPATCH();
+    }
+    TARGET(CMD_LSL_RRI) {
+        DEST = (int64_t) ((uint64_t) REG_A << IMM_B);
+        pc++;
+        DISPATCH();
+    }
+    TARGET(CMD_LSR_RRI) {
+        DEST = (int64_t) ((uint64_t) REG_A >> IMM_B);
+        pc++;
+        DISPATCH();
+    }
+    TARGET(CMD_ASR_RRI) {
+        DEST = REG_A >> IMM_B;
+        pc++;
+        DISPATCH();
+    }
+    TARGET(CMD_LOAD_RII) {
+        DEST = 0;
+        memcpy(&DEST, mem + IMM_B, (size_t) IMM_A);
+        pc++;
+        DISPATCH();
+    }
+    TARGET(CMD_LOAD_RIR) {
+        uint64_t offset = (uint64_t) REG_B;
+        DEST            = 0;
+        if (offset > (uint64_t) (MEM_CAPACITY - IMM_A)) {
+            goto error;
+        }
+        memcpy(&DEST, mem + offset, (size_t) IMM_A);
+        pc++;
+        DISPATCH();
+    }
+    TARGET(CMD_STORE_RII) {
+        memcpy(mem + IMM_B, &DEST, (size_t) IMM_A);
+        pc++;
+        DISPATCH();
+    }
+    TARGET(CMD_STORE_RRI) {
+        uint64_t offset = (uint64_t) REG_B;
+        if (offset > (uint64_t) (MEM_CAPACITY - IMM_A)) {
+            goto error;
+        }
+        memcpy(mem + offset, &DEST, (size_t) IMM_A);
+        pc++;
+        DISPATCH();
+    }
+    TARGET(CMD_COMPOSED) {
+        // Only reached without computed goto, which has no handler per pair
+        for (size_t k = 0; k < 2; k++) {
+            Instruction *part = insn + k;
+#define PART_CASE(form)   \
+    case form:            \
+        PART_##form(part); \
+        break;
+            switch (k ? part->type : COMPOSED_TYPE(insn)) {
+                COMPOSABLE_FORMS(PART_CASE)
+                default:
+                    goto error;
+            }
+#undef PART_CASE
+        }
+        if (COMPOSED_LENGTH(insn) == 3) {
+            BRANCH_ON_FLAGS(insn + 2);
+        } else {
+            pc += 2;
+        }
+        DISPATCH();
+    }
+#if CI_COMPUTED_GOTO
+#define COMPOSED_HANDLER(first, second) \
+    COMPOSED_##first##_##second : {    \
+        PART_##first(insn);             \
+        PART_##second(insn + 1);        \
+        pc += 2;                        \
+        DISPATCH();                     \
+    }
+#define COMPOSED_BRANCH_HANDLER(first, second) \
+    COMPOSED_BRANCH_##first##_##second : {     \
+        PART_##first(insn);                    \
+        PART_##second(insn + 1);               \
+        BRANCH_ON_FLAGS(insn + 2);             \
+        DISPATCH();                            \
+    }
+#define COMPOSED_HANDLERS(first)                              \
+    COMPOSABLE_FORMS_AFTER(COMPOSED_HANDLER, first)           \
+    COMPOSABLE_FORMS_AFTER(COMPOSED_BRANCH_HANDLER, first)
+    COMPOSABLE_FORMS(COMPOSED_HANDLERS)
+#undef COMPOSED_HANDLER
+#undef COMPOSED_BRANCH_HANDLER
+#undef COMPOSED_HANDLERS
+#endif
+    TARGET(CMD_ERR) {
+        goto error;
+    }
+
+#if !CI_COMPUTED_GOTO
+    default:
+        goto error;
     }
+#endif
+
+error:
+    intr->had_error = true;
+done:
+    return prog->length;
+
+#undef DEST
+#undef REG_A
+#undef CON_A
+#undef VAL_B
+#undef REG_B
+#undef IMM_A
+#undef IMM_B
+#undef SET_FLAGS
+#undef BRANCH_ON
+#undef PART_CMD_MOV
+#undef PART_CMD_AND
+#undef PART_CMD_EOR
+#undef PART_CMD_ORR
+#undef PART_CMD_ADD_RRR
+#undef PART_CMD_ADD_RRI
+#undef PART_CMD_SUB_RRR
+#undef PART_CMD_SUB_RRI
+#undef PART_CMD_CMP_RR
+#undef PART_CMD_CMP_RI
+#undef PART_CMD_CMP_U_RR
+#undef PART_CMD_CMP_U_RI
+#undef PART_CMD_LSL_RRI
+#undef PART_CMD_LSR_RRI
+#undef PART_CMD_ASR_RRI
+#undef PART_CMD_LOAD_RII
+#undef PART_CMD_STORE_RII
+#undef BRANCH_ON_FLAGS
+#undef TARGET
+#undef DISPATCH
+}
+
+/**
+ * @brief Executes a whole program with the threaded engine.
+ *
+ * @param intr The pointer to the interpreter holding variable state.
+ * @param prog The program to execute.
+ */
+static void run_threaded(Interpreter *intr, Program *prog) {
+    void **handlers = NULL;
+    interpret_threaded(intr, prog, 0, 0, &handlers);
+    free(handlers);
+}
+
+/**
+ * @brief Initializes the tier counters of a program, with every function in
+ * the reference engine.
+ *
+ * @param tiers Pointer to the `Tiers` to initialize.
+ * @param prog Pointer to the unfused, unspecialized `Program` to run.
+ * @return true on success, false if memory could not be allocated.
+ */
+static bool tiers_init(Tiers *tiers, Program *prog) {
+    memset(tiers, 0, sizeof(*tiers));
+    tiers->owner = malloc((prog->length + 1) * sizeof(size_t));
+    tiers->calls = calloc(prog->length + 1, sizeof(uint32_t));
+    tiers->loops = calloc(prog->length + 1, sizeof(uint32_t));
+    tiers->hot   = calloc(prog->length + 1, sizeof(bool));
+    if (!tiers->owner || !tiers->calls || !tiers->loops || !tiers->hot) {
+        tiers_free(tiers);
+        return false;
+    }
+
+    // Mark the entries, then extend each function up to the next one
+    for (size_t pc = 0; pc <= prog->length; pc++) {
+        tiers->owner[pc] = SIZE_MAX;
+    }
+    for (size_t pc = 0; pc < prog->length; pc++) {
+        Instruction *insn = &prog->code[pc];
+        if (insn->type == CMD_CALL && insn->target >= 0) {
+            tiers->owner[insn->target] = (size_t) insn->target;
+        }
+    }
+    tiers->owner[0] = 0;
+    for (size_t pc = 1; pc <= prog->length; pc++) {
+        if (tiers->owner[pc] != pc) {
+            tiers->owner[pc] = tiers->owner[pc - 1];
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Frees the tier counters and the optimized code, if it was built.
+ *
+ * @param tiers Pointer to the `Tiers` to free.
+ */
+static void tiers_free(Tiers *tiers) {
+    if (tiers->compiled) {
+        free(tiers->fast.code);
+    }
+    free(tiers->handlers);
+    free(tiers->owner);
+    free(tiers->calls);
+    free(tiers->loops);
+    free(tiers->hot);
+}
+
+/**
+ * @brief Counts a call, and runs the callee in optimized code if it is hot.
+ *
+ * @param tiers Pointer to the `Tiers` of the running program.
+ * @param intr Pointer to the `Interpreter`, with the call's frame pushed.
+ * @param prog Pointer to the `Program` being run.
+ * @param target Index of the callee's first instruction.
+ * @return The index to continue interpreting at: `target`, where the callee
+ * returned to, or the program length if it stopped.
+ */
+static size_t tier_call(Tiers *tiers, Interpreter *intr, Program *prog, size_t target) {
+    if (!tiers->hot[target] && !tiers->failed &&
+        ++tiers->calls[target] + tiers->loops[target] >= TIER_HOT_THRESHOLD) {
+        tier_promote(tiers, intr, prog, target);
+    }
+    return tiers->hot[target] ? tier_enter(tiers, intr, target) : target;
+}
+
+/**
+ * @brief Counts a taken backward branch, and moves the loop to optimized code
+ * if the function it is in is hot.
+ *
+ * A function promoted while it runs thus switches over at its next
+ * iteration rather than its next call.
+ *
+ * @param tiers Pointer to the `Tiers` of the running program.
+ * @param intr Pointer to the `Interpreter` running the program.
+ * @param prog Pointer to the `Program` being run.
+ * @param from Index of the branch.
+ * @param to Index of the branch target.
+ * @return The index to continue interpreting at: `to`, where the function
+ * returned to, or the program length if it stopped.
+ */
+static size_t tier_branch(Tiers *tiers, Interpreter *intr, Program *prog, size_t from, size_t to) {
+    size_t entry = tiers->owner[from];
+    if (!tiers->hot[entry] && !tiers->failed &&
+        ++tiers->loops[entry] + tiers->calls[entry] >= TIER_HOT_THRESHOLD) {
+        tier_promote(tiers, intr, prog, entry);
+    }
+    return tiers->hot[entry] ? tier_enter(tiers, intr, to) : to;
+}
+
+/**
+ * @brief Promotes a function to optimized code, building the optimized code
+ * the first time any function is promoted.
+ *
+ * The copy is fused and specialized as a whole, which changes no index, so
+ * every function can move over without rebuilding it.
+ *
+ * @param tiers Pointer to the `Tiers` of the running program.
+ * @param intr Pointer to the `Interpreter` to log the promotion in.
+ * @param prog Pointer to the `Program` being run.
+ * @param entry Index of the function's first instruction.
+ */
+static void tier_promote(Tiers *tiers, Interpreter *intr, Program *prog, size_t entry) {
+    if (!tiers->compiled) {
+        tiers->fast      = *prog;
+        tiers->fast.code = malloc((prog->length + 1) * sizeof(Instruction));
+        if (!tiers->fast.code) {
+            tiers->failed = true;
+            return;
+        }
+        memcpy(tiers->fast.code, prog->code, (prog->length + 1) * sizeof(Instruction));
+        program_fuse(&tiers->fast);
+        program_specialize(&tiers->fast);
+        tiers->compiled = true;
+    }
+    tiers->hot[entry] = true;
+
+    TierLog *log = &intr->tiers;
+    if (log->num_promotions < TIER_LOG_SIZE) {
+        TierPromotion *promotion = &log->promotions[log->num_promotions];
+        promotion->entry = entry;
+        promotion->name  = NULL;
+        promotion->calls = tiers->calls[entry];
+        promotion->loops = tiers->loops[entry];
+        for (size_t pc = 0; pc < prog->length; pc++) {
+            if (prog->code[pc].type == CMD_CALL && prog->code[pc].target == (int32_t) entry) {
+                promotion->name = PROGRAM_STRING_A(prog, &prog->code[pc]);
+                break;
+            }
+        }
+    }
+    log->num_promotions++;
+}
+
+/**
+ * @brief Runs optimized code from an instruction until the frame it was
+ * entered in returns.
+ *
+ * @param tiers Pointer to the `Tiers` of the running program.
+ * @param intr Pointer to the `Interpreter` running the program.
+ * @param pc Index of a call target or branch target to start at.
+ * @return The index to continue interpreting at, or the program length if
+ * the program stopped.
+ */
+static size_t tier_enter(Tiers *tiers, Interpreter *intr, size_t pc) {
+    intr->tiers.entries++;
+    size_t next = interpret_threaded(intr, &tiers->fast, pc, intr->depth, &tiers->handlers);
+    if (next < tiers->fast.length) {
+        intr->tiers.exits++;
+    }
+    return next;
+}
+
+bool interpreter_exec(Interpreter *intr, Program *prog, Instruction *insn) {
+    switch (insn->type) {
+        case CMD_PRINT: return print_base(intr, prog, insn);
+        case CMD_PUT:   return put_string(intr, prog, insn);
+        case CMD_LOAD:  return load_value(intr, prog, insn);
+        case CMD_STORE: return store_value(intr, prog, insn);
+        default:        return false;
+    }
+}
+
+uint8_t interpreter_flags(Interpreter *intr) {
+    switch (intr->compare_kind) {
+        case COMPARE_SIGNED:   return FLAGS_OF(intr->compare_a, intr->compare_b);
+        case COMPARE_UNSIGNED: return FLAGS_OF((uint64_t) intr->compare_a, (uint64_t) intr->compare_b);
+        default:               return 0;
+    }
+}
+
+void print_interpreter_stats(Interpreter *intr) {
+    if (!intr) {
+        return;
+    }
+
+    printf("Statistics:\n");
+    printf("Memo hits: %zu\n", intr->memo.hits);
+    printf("Memo misses: %zu\n", intr->memo.misses);
+    printf("Memo evictions: %zu\n", intr->memo.evictions);
+    if (intr->engine == ENGINE_TIERED) {
+        const TierLog *log = &intr->tiers;
+        printf("Tier promotions: %zu\n", log->num_promotions);
+        for (size_t i = 0; i < log->num_promotions && i < TIER_LOG_SIZE; i++) {
+            const TierPromotion *promotion = &log->promotions[i];
+            printf("Promoted %s (instruction %zu) after %" PRIu32 " calls and %" PRIu32
+                   " backward branches\n",
+                   promotion->name ? promotion->name : "<entry>", promotion->entry,
+                   promotion->calls, promotion->loops);
+        }
+        printf("Entries into optimized code: %zu\n", log->entries);
+        printf("Returns to the interpreter: %zu\n", log->exits);
+    }
+    printf("\n");
 }
 
 void print_interpreter_state(Interpreter *intr) {
@@ -259,11 +1113,16 @@ void print_interpreter_state(Interpreter *intr) {
         return;
     }
 
+    uint8_t flags = interpreter_flags(intr);
     printf("Error: %d\n", intr->had_error);
     printf("Flags:\n");
-    printf("Is greater: %d\n", intr->is_greater);
-    printf("Is equal: %d\n", intr->is_equal);
-    printf("Is less: %d\n", intr->is_less);
+    printf("Is greater: %d\n", (flags & FLAG_GREATER) != 0);
+    printf("Is equal: %d\n", (flags & FLAG_EQUAL) != 0);
+    printf("Is less: %d\n", (flags & FLAG_LESS) != 0);
+
+    printf("\n");
+
+    printf("Peak call depth: %zu\n", intr->peak_depth);
 
     printf("\n");
 
@@ -287,19 +1146,20 @@ void print_interpreter_state(Interpreter *intr) {
  * @brief Fetches the appropriate value from the given operand.
  *
  * @param intr The pointer to the interpreter holding variable state.
- * @param op The operand used to fetch the value.
+ * @param operand The operand used to fetch the value, as returned by
+ * `PROGRAM_OPERAND_A/B`.
  * @param is_im A boolean representing whether this value is an immediate or
  * must be read in from the interpreter state.
  * @return The fetched value.
  */
-static int64_t fetch_number_value(Interpreter *intr, Operand *op, bool is_im) {
+static int64_t fetch_number_value(Interpreter *intr, int64_t operand, bool is_im) {
     // STUDENT TODO: Fetch either a variable from the interpreter's state or directly output a value
     if (is_im) {
         // Immediate value
-        return op->num_val;
+        return operand;
     } else {
         // Variable value
-        int64_t var_num = op->num_val;
+        int64_t var_num = operand;
         if (var_num < 0 || var_num >= NUM_VARIABLES) {
             intr->had_error = true; 
             return 0;
@@ -308,27 +1168,6 @@ static int64_t fetch_number_value(Interpreter *intr, Operand *op, bool is_im) {
     }
 }
 
-/**
- * @brief Determines whether a given branch condition holds.
- *
- * @param intr The pointer to the interpreter holding the result of the
- * comparison.
- * @param cond The condition to check.
- * @return True if the given condition holds, false otherwise.
- */
-static bool cond_holds(Interpreter *intr, BranchCondition cond) {
-    switch (cond) {
-        case BRANCH_ALWAYS:          return true;
-        case BRANCH_EQUAL:           return intr->is_equal;
-        case BRANCH_NOT_EQUAL:       return !intr->is_equal;
-        case BRANCH_GREATER:         return intr->is_greater;
-        case BRANCH_LESS:            return intr->is_less;
-        case BRANCH_GREATER_EQUAL:   return intr->is_greater || intr->is_equal;
-        case BRANCH_LESS_EQUAL:      return intr->is_less || intr->is_equal;
-        default:                     return false;
-    }
-}
-
 /**
  * @brief Prints the given command's value in a specified base.
  *
@@ -336,9 +1175,9 @@ static bool cond_holds(Interpreter *intr, BranchCondition cond) {
  * @param cmd The command being processed.
  * @return True whether the print was successful, false otherwise.
  */
-static bool print_base(Interpreter *intr, Command *cmd) {
+static bool print_base(Interpreter *intr, Program *prog, Instruction *cmd) {
     // Fetch the value to be printed
-    int64_t value = fetch_number_value(intr, &cmd->val_a, cmd->is_a_immediate);
+    int64_t value = fetch_number_value(intr, PROGRAM_OPERAND_A(prog, cmd), cmd->is_a_immediate);
     if (intr->had_error) return false;  // Ensure no errors occurred
 
     // Declare all necessary variables at the top
@@ -348,13 +1187,13 @@ static bool print_base(Interpreter *intr, Command *cmd) {
     size_t i = 0;  // Declare 'i' before switch
 
     // Handle decimal output case first
-    if (cmd->val_b.base == 'd') { 
+    if (cmd->val_b == 'd') { 
         printf("%" PRId64 "\n", value);  // Print the integer value
         return true;
     }
 
     // Handle other cases (binary, hex, string)
-    switch (cmd->val_b.base) {
+    switch (cmd->val_b) {
         case 'b': // Binary output
             to_binary_string(value, bit_string, sizeof(bit_string));
             printf("%s\n", bit_string);
@@ -363,7 +1202,7 @@ static bool print_base(Interpreter *intr, Command *cmd) {
             printf("0x%" PRIx64 "\n", (uint64_t)value);
             break;
         case 's': // String output
-            offset = fetch_number_value(intr, &cmd->val_a, cmd->is_a_immediate);
+            offset = fetch_number_value(intr, PROGRAM_OPERAND_A(prog, cmd), cmd->is_a_immediate);
             if (intr->had_error) return false;
 
             for (i = 0; i < MEM_CAPACITY - 1; i++) {
@@ -383,6 +1222,196 @@ static bool print_base(Interpreter *intr, Command *cmd) {
     return true;
 }
 
+/**
+ * @brief Loads a value from memory into the command's destination variable.
+ *
+ * @param intr The pointer to the interpreter holding variable state.
+ * @param cmd The load command being processed.
+ * @return True if the load was successful, false otherwise.
+ */
+static bool load_value(Interpreter *intr, Program *prog, Instruction *cmd) {
+    uint8_t *dest_index = (uint8_t*) &intr->variables[cmd->destination];
+    size_t offset = fetch_number_value(intr, PROGRAM_OPERAND_B(prog, cmd), cmd->is_b_immediate);
+    size_t bytes = fetch_number_value(intr, PROGRAM_OPERAND_A(prog, cmd), cmd->is_a_immediate);
+    intr->variables[cmd->destination] = 0;
+    return mem_load(dest_index, offset, bytes);
+}
+
+/**
+ * @brief Stores the command's source variable into memory.
+ *
+ * @param intr The pointer to the interpreter holding variable state.
+ * @param cmd The store command being processed.
+ * @return True if the store was successful, false otherwise.
+ */
+static bool store_value(Interpreter *intr, Program *prog, Instruction *cmd) {
+    int64_t src_index = cmd->destination;
+    int64_t bytes = fetch_number_value(intr, PROGRAM_OPERAND_A(prog, cmd), cmd->is_a_immediate);
+    int64_t offset = fetch_number_value(intr, PROGRAM_OPERAND_B(prog, cmd), cmd->is_b_immediate);
+    return store_bytes(intr->variables[src_index], offset, bytes);
+}
+
+/**
+ * @brief Stores the low `bytes` bytes of a value into memory.
+ *
+ * @param value The value to store.
+ * @param offset The offset in memory where to start storing.
+ * @param bytes The amount of bytes to store.
+ * @return True if the store was successful, false otherwise.
+ */
+static bool store_bytes(int64_t value, int64_t offset, int64_t bytes) {
+    // Validate byte size
+    if (bytes != 1 && bytes != 2 && bytes != 4 && bytes != 8) {
+        return false;
+    }
+    // Validate memory bounds; unsigned, so that negative offsets are out of range too
+    if ((uint64_t) offset > (uint64_t) (MEM_CAPACITY - bytes)) {
+        return false;
+    }
+    uint8_t buffer[8] = {0};
+    // Store bytes in little-endian order
+    for (int i = 0; i < bytes; i++) {
+        buffer[i] = (value >> (i * 8)) & 0xFF;
+    }
+    return mem_store(buffer, (size_t)offset, (size_t)bytes);
+}
+
+/**
+ * @brief Writes the command's string, including its terminator, into memory.
+ *
+ * @param intr The pointer to the interpreter holding variable state.
+ * @param cmd The put command being processed.
+ * @return True if the whole string was written, false otherwise.
+ */
+static bool put_string(Interpreter *intr, Program *prog, Instruction *cmd) {
+    int64_t offset = fetch_number_value(intr, PROGRAM_OPERAND_B(prog, cmd), cmd->is_b_immediate);
+    const char *str = PROGRAM_STRING_A(prog, cmd);
+    if (intr->had_error || !str) {
+        return false;
+    }
+    size_t str_len = strlen(str) + 1;
+    for (size_t i = 0; i < str_len; i++) {
+        if (!mem_store((uint8_t *)&str[i], offset + i, 1)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool interpreter_push_frame(Interpreter *intr, size_t return_pc, uint32_t saves) {
+    if (intr->depth == intr->capacity) {
+        if (intr->max_depth && intr->depth >= intr->max_depth) {
+            printf("Stack overflow: call depth exceeds %zu\n", intr->max_depth);
+            return false;
+        }
+        // Double the stack, but never past the configured limit
+        size_t capacity = intr->capacity ? intr->capacity * 2 : STACK_MIN_SIZE;
+        if (intr->max_depth && capacity > intr->max_depth) {
+            capacity = intr->max_depth;
+        }
+        StackEntry *frames = realloc(intr->the_stack, capacity * sizeof(StackEntry));
+        if (!frames) {
+            return false;
+        }
+        intr->the_stack = frames;
+        intr->capacity  = capacity;
+    }
+
+    // Save the registers the callee may write and the return address
+    StackEntry *stack_entry = &intr->the_stack[intr->depth++];
+    for (uint32_t left = saves; left; left &= left - 1) {
+        size_t i                  = lowest_variable(left);
+        stack_entry->variables[i] = intr->variables[i];
+    }
+    stack_entry->saved     = saves;
+    stack_entry->memo_slot = MEMO_NONE;
+    stack_entry->return_pc = return_pc;
+    if (intr->depth > intr->peak_depth) {
+        intr->peak_depth = intr->depth;
+    }
+    return true;
+}
+
+size_t interpreter_pop_frame(Interpreter *intr) {
+    StackEntry *stack_entry = &intr->the_stack[--intr->depth];
+    // Restore the saved registers except x0
+    for (uint32_t left = stack_entry->saved & ~(uint32_t) 1; left; left &= left - 1) {
+        size_t i           = lowest_variable(left);
+        intr->variables[i] = stack_entry->variables[i];
+    }
+    if (stack_entry->memo_slot != MEMO_NONE) {
+        memo_fill(&intr->memo, stack_entry->memo_slot, intr->depth + 1, intr->variables[0],
+                  interpreter_flags(intr));
+    }
+    return stack_entry->return_pc;
+}
+
+int64_t interpreter_call_memoized(Interpreter *intr, Program *prog, Instruction *insn) {
+    size_t   index  = (size_t) (insn - prog->code);
+    bool     push   = !(insn->is_tail_call && intr->depth > 0);
+    uint32_t slot   = MEMO_NONE;
+    int64_t  result = 0;
+    uint8_t  flags  = 0;
+    if (memo_lookup(&intr->memo, prog, insn->destination, intr->variables, interpreter_flags(intr),
+                    intr->depth + 1, push ? &slot : NULL, &result, &flags)) {
+        intr->variables[0] = result;
+        set_flags(intr, flags);
+        return (int64_t) index + 1;
+    }
+
+    if (push) {
+        if (!interpreter_push_frame(intr, index + 1, PROGRAM_CALL_SAVES(insn))) {
+            return -1;
+        }
+        intr->the_stack[intr->depth - 1].memo_slot = slot;
+    }
+    return insn->target;
+}
+
+/**
+ * @brief Makes the flags read as the given flag word.
+ *
+ * @param intr The pointer to the interpreter holding the flags.
+ * @param flags A flag word as returned by `interpreter_flags`.
+ */
+static void set_flags(Interpreter *intr, uint8_t flags) {
+    // Any compare that produces the word will do, since only the word is observable
+    intr->compare_a    = (flags & FLAG_GREATER) ? 1 : 0;
+    intr->compare_b    = (flags & FLAG_LESS) ? 1 : 0;
+    intr->compare_kind = flags ? COMPARE_SIGNED : COMPARE_NONE;
+}
+
+/**
+ * @brief Finds the lowest variable in a mask.
+ *
+ * @param mask A nonzero mask with bit `i` set for variable `i`.
+ * @return The index of the lowest set bit.
+ */
+static inline size_t lowest_variable(uint32_t mask) {
+#if defined(__GNUC__)
+    return (size_t) __builtin_ctz(mask);
+#else
+    size_t i = 0;
+    while (!(mask & 1)) {
+        mask >>= 1;
+        i++;
+    }
+    return i;
+#endif
+}
+
+/**
+ * @brief Frees the call stack once execution stops, keeping its peak depth.
+ *
+ * @param intr The pointer to the interpreter owning the stack.
+ */
+static void free_stack(Interpreter *intr) {
+    free(intr->the_stack);
+    intr->the_stack = NULL;
+    intr->depth     = 0;
+    intr->capacity  = 0;
+}
+
 // Helper Function for Binary Conversion
 static void to_binary_string(uint64_t num, char *bit_string, size_t bit_string_size) {
     size_t index = 0;
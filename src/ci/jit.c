@@ -0,0 +1,1112 @@
+#define _DEFAULT_SOURCE
+#include "jit.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "command_type.h"
+#include "mem.h"
+
+#if defined(__x86_64__) && defined(__linux__)
+#include <sys/mman.h>
+#define CI_JIT 1
+#else
+#define CI_JIT 0
+#endif
+
+#if CI_JIT
+
+#define JIT_PROLOGUE_SIZE 256  // Room for the entry, exit, error and flag stubs.
+#define JIT_MAX_INSN_SIZE 96   // Upper bound on the code emitted for one instruction.
+#define JIT_SIDE_EXIT_SIZE 16  // Size of the stub leaving a trace at one guard.
+
+// Host registers, numbered as in their x86-64 encoding
+#define RAX 0
+#define RCX 1
+
+// x86-64 condition codes, as used by the jcc and setcc opcodes
+#define CC_BELOW     0x2
+#define CC_EQUAL     0x4
+#define CC_NOT_EQUAL 0x5
+#define CC_ABOVE     0x7
+#define CC_SIGN      0x8
+#define CC_LESS      0xC
+#define CC_GREATER   0xF
+
+/**
+ * @brief A jump whose rel32 displacement still has to be pointed at the code
+ * of an instruction.
+ */
+typedef struct {
+    size_t at;      // Offset of the rel32 field in the code buffer.
+    size_t target;  // Index of the instruction being jumped to.
+} Fixup;
+
+/**
+ * @brief The state of a single compilation.
+ */
+typedef struct {
+    uint8_t *code;        // The code buffer, mapped read/write while compiling.
+    size_t   size;        // Bytes emitted so far.
+    size_t   capacity;    // Size of the mapping.
+    size_t  *offsets;     // Offset of the code for each instruction.
+    Fixup   *fixups;      // Jumps to instructions, patched once all are emitted.
+    size_t   num_fixups;  // Number of entries in `fixups`.
+    size_t   exit;        // Offset of the stub that returns to C.
+    size_t   error;       // Offset of the stub that flags an error and exits.
+    size_t   flags;       // Offset of the subroutine that evaluates the flags.
+    size_t   entry;       // Offset of the prologue, where execution starts.
+    Program *prog;        // The program being compiled.
+} Jit;
+
+/**
+ * @brief A compiled loop trace.
+ */
+struct JitTrace {
+    uint8_t *code;      // The executable code.
+    size_t   capacity;  // Size of the mapping.
+    size_t   entry;     // Offset of the prologue, where execution starts.
+};
+
+/**
+ * @brief Signature of compiled code. Traces return the index of the
+ * instruction to resume interpreting at; whole programs return nothing useful.
+ */
+typedef int64_t (*JitEntry)(Interpreter *intr, int64_t *variables, uint8_t *memory,
+                            void **return_table);
+
+static bool    jit_compile(Jit *jit, Program *prog);
+static bool    jit_begin(Jit *jit, Program *prog, size_t slots, size_t capacity);
+static bool    jit_finish(Jit *jit);
+static void    jit_release(Jit *jit);
+static void    emit_instruction(Jit *jit, Program *prog, size_t index);
+static bool    emit_trace_step(Jit *jit, Program *prog, size_t index, size_t next);
+static bool    emit_operation(Jit *jit, Instruction *insn);
+static void    emit_stubs(Jit *jit);
+static void    emit_alu(Jit *jit, Instruction *insn);
+static void    emit_shift(Jit *jit, Instruction *insn);
+static void    emit_compare(Jit *jit, Instruction *insn);
+static void    emit_branch(Jit *jit, Instruction *insn);
+static void    emit_load(Jit *jit, Instruction *insn);
+static void    emit_store(Jit *jit, Instruction *insn);
+static void    emit_helper(Jit *jit, void *helper, Instruction *insn);
+static void    emit_undefined_label(Jit *jit, Instruction *insn);
+static void    emit_memoized_call(Jit *jit, Instruction *insn, size_t index);
+static uint8_t emit_condition(Jit *jit, BranchCondition cond);
+static void    emit_compare_flags(Jit *jit, uint8_t greater, uint8_t less);
+static void    emit_bounds_check(Jit *jit, int64_t bytes);
+static void    emit_u8(Jit *jit, uint8_t byte);
+static void    emit_u32(Jit *jit, uint32_t value);
+static void    emit_u64(Jit *jit, uint64_t value);
+static void    emit_load_variable(Jit *jit, int reg, int64_t var);
+static void    emit_store_variable(Jit *jit, int64_t var);
+static void    emit_operand(Jit *jit, int reg, int64_t operand, bool is_immediate);
+static void    emit_call(Jit *jit, void *function);
+static size_t  emit_jcc(Jit *jit, uint8_t cc);
+static size_t  emit_jmp(Jit *jit);
+static void    patch(Jit *jit, size_t at, size_t destination);
+static void    jump_to_instruction(Jit *jit, size_t at, int64_t target);
+static int64_t return_helper(Interpreter *intr);
+static void    undefined_label_helper(const char *label);
+
+bool jit_available(void) {
+    return true;
+}
+
+bool jit_run(Interpreter *intr, Program *prog) {
+    if (!intr || !prog) {
+        return false;
+    }
+
+    Jit jit;
+    if (!jit_compile(&jit, prog)) {
+        return false;
+    }
+
+    // ret jumps through this table, as any instruction after a call may be resumed
+    void **return_table = malloc((prog->length + 1) * sizeof(void *));
+    if (!return_table) {
+        jit_release(&jit);
+        return false;
+    }
+    for (size_t i = 0; i <= prog->length; i++) {
+        return_table[i] = jit.code + jit.offsets[i];
+    }
+
+    JitEntry entry = (JitEntry) (void *) (jit.code + jit.entry);
+    entry(intr, intr->variables, mem_image(), return_table);
+
+    free(return_table);
+    jit_release(&jit);
+    return true;
+}
+
+JitTrace *jit_compile_trace(Program *prog, const size_t *pcs, size_t length) {
+    if (!prog || !pcs || length == 0) {
+        return NULL;
+    }
+
+    Jit jit;
+    if (!jit_begin(&jit, prog, length,
+                   JIT_PROLOGUE_SIZE + length * (JIT_MAX_INSN_SIZE + JIT_SIDE_EXIT_SIZE))) {
+        return NULL;
+    }
+
+    size_t loop = jit.size;
+    for (size_t i = 0; i < length; i++) {
+        size_t next = i + 1 < length ? pcs[i + 1] : pcs[0];
+        if (!emit_trace_step(&jit, prog, pcs[i], next)) {
+            jit_release(&jit);
+            return NULL;
+        }
+    }
+    patch(&jit, emit_jmp(&jit), loop);
+
+    // Side exits stay out of line so that the loop body is straight-line code
+    for (size_t i = 0; i < jit.num_fixups; i++) {
+        patch(&jit, jit.fixups[i].at, jit.size);
+        // mov eax, resume_pc; jmp exit
+        emit_u8(&jit, 0xB8);
+        emit_u32(&jit, (uint32_t) jit.fixups[i].target);
+        patch(&jit, emit_jmp(&jit), jit.exit);
+    }
+    jit.num_fixups = 0;
+
+    JitTrace *trace = malloc(sizeof(JitTrace));
+    if (!trace || !jit_finish(&jit)) {
+        free(trace);
+        jit_release(&jit);
+        return NULL;
+    }
+    trace->code     = jit.code;
+    trace->capacity = jit.capacity;
+    trace->entry    = jit.entry;
+
+    jit.code = NULL;  // Now owned by the trace
+    jit_release(&jit);
+    return trace;
+}
+
+size_t jit_run_trace(JitTrace *trace, Interpreter *intr) {
+    JitEntry entry = (JitEntry) (void *) (trace->code + trace->entry);
+    return (size_t) entry(intr, intr->variables, mem_image(), NULL);
+}
+
+void jit_free_trace(JitTrace *trace) {
+    if (!trace) {
+        return;
+    }
+
+    munmap(trace->code, trace->capacity);
+    free(trace);
+}
+
+/**
+ * @brief Translates a whole program into executable machine code.
+ *
+ * @param jit The compilation state to fill in.
+ * @param prog The program to compile.
+ * @return True if the program was compiled, false if it contains instructions
+ * the JIT does not support or memory could not be allocated.
+ */
+static bool jit_compile(Jit *jit, Program *prog) {
+    for (size_t i = 0; i < prog->length; i++) {
+        if (prog->code[i].type > CMD_HALT) {
+            return false;  // Superinstructions and specialized forms are not supported
+        }
+    }
+
+    if (!jit_begin(jit, prog, prog->length,
+                   JIT_PROLOGUE_SIZE + (prog->length + 1) * JIT_MAX_INSN_SIZE)) {
+        return false;
+    }
+
+    for (size_t i = 0; i <= prog->length; i++) {
+        jit->offsets[i] = jit->size;
+        emit_instruction(jit, prog, i);
+    }
+    if (!jit_finish(jit)) {
+        jit_release(jit);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Allocates a code buffer and emits the entry and exit stubs into it.
+ *
+ * @param jit The compilation state to initialize.
+ * @param prog The program being compiled.
+ * @param slots The number of instructions that may be compiled; one more
+ * offset and fixup than this is reserved.
+ * @param capacity The size of the code buffer.
+ * @return True on success, false if memory could not be allocated.
+ */
+static bool jit_begin(Jit *jit, Program *prog, size_t slots, size_t capacity) {
+    jit->prog       = prog;
+    jit->capacity   = capacity;
+    jit->size       = 0;
+    jit->num_fixups = 0;
+    jit->offsets    = malloc((slots + 1) * sizeof(size_t));
+    jit->fixups     = malloc((slots + 1) * sizeof(Fixup));
+    jit->code       = mmap(NULL, jit->capacity, PROT_READ | PROT_WRITE,
+                           MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (jit->code == MAP_FAILED) {
+        jit->code = NULL;
+    }
+    if (!jit->offsets || !jit->fixups || !jit->code) {
+        jit_release(jit);
+        return false;
+    }
+
+    emit_stubs(jit);
+    return true;
+}
+
+/**
+ * @brief Points every pending jump at its instruction and makes the code
+ * executable.
+ *
+ * @param jit The compilation state.
+ * @return True on success, false if the code could not be made executable.
+ */
+static bool jit_finish(Jit *jit) {
+    for (size_t i = 0; i < jit->num_fixups; i++) {
+        patch(jit, jit->fixups[i].at, jit->offsets[jit->fixups[i].target]);
+    }
+    return mprotect(jit->code, jit->capacity, PROT_READ | PROT_EXEC) == 0;
+}
+
+/**
+ * @brief Frees everything owned by a compilation.
+ *
+ * @param jit The compilation state to release.
+ */
+static void jit_release(Jit *jit) {
+    if (jit->code) {
+        munmap(jit->code, jit->capacity);
+    }
+    free(jit->offsets);
+    free(jit->fixups);
+    jit->code    = NULL;
+    jit->offsets = NULL;
+    jit->fixups  = NULL;
+}
+
+/**
+ * @brief Emits the exit, error and flag stubs followed by the entry prologue.
+ *
+ * The generated function keeps the interpreter in r13, the variables in rbx,
+ * the memory image in r12 and the return table in r14. The flag stub is a
+ * subroutine that evaluates the last compare into the packed flag word in
+ * eax, clobbering ecx and edx.
+ *
+ * @param jit The compilation state.
+ */
+static void emit_stubs(Jit *jit) {
+    static const uint8_t exit_code[] = {
+        0x48, 0x83, 0xC4, 0x08,  // add rsp, 8
+        0x41, 0x5F,              // pop r15
+        0x41, 0x5E,              // pop r14
+        0x41, 0x5D,              // pop r13
+        0x41, 0x5C,              // pop r12
+        0x5B,                    // pop rbx
+        0x5D,                    // pop rbp
+        0xC3,                    // ret
+    };
+    static const uint8_t prologue[] = {
+        0x55,                    // push rbp
+        0x53,                    // push rbx
+        0x41, 0x54,              // push r12
+        0x41, 0x55,              // push r13
+        0x41, 0x56,              // push r14
+        0x41, 0x57,              // push r15
+        0x48, 0x83, 0xEC, 0x08,  // sub rsp, 8 (keeps calls 16-byte aligned)
+        0x49, 0x89, 0xFD,        // mov r13, rdi
+        0x48, 0x89, 0xF3,        // mov rbx, rsi
+        0x49, 0x89, 0xD4,        // mov r12, rdx
+        0x49, 0x89, 0xCE,        // mov r14, rcx
+    };
+
+    jit->exit = jit->size;
+    for (size_t i = 0; i < sizeof(exit_code); i++) {
+        emit_u8(jit, exit_code[i]);
+    }
+
+    // mov byte [r13 + had_error], 1; jmp exit
+    jit->error = jit->size;
+    emit_u8(jit, 0x41);
+    emit_u8(jit, 0xC6);
+    emit_u8(jit, 0x85);
+    emit_u32(jit, (uint32_t) offsetof(Interpreter, had_error));
+    emit_u8(jit, 1);
+    patch(jit, emit_jmp(jit), jit->exit);
+
+    // xor eax, eax; xor ecx, ecx
+    jit->flags = jit->size;
+    emit_u8(jit, 0x31);
+    emit_u8(jit, 0xC0);
+    emit_u8(jit, 0x31);
+    emit_u8(jit, 0xC9);
+    // movzx edx, byte [r13 + compare_kind]; test edx, edx; jz done
+    emit_u8(jit, 0x41);
+    emit_u8(jit, 0x0F);
+    emit_u8(jit, 0xB6);
+    emit_u8(jit, 0x95);
+    emit_u32(jit, (uint32_t) offsetof(Interpreter, compare_kind));
+    emit_u8(jit, 0x85);
+    emit_u8(jit, 0xD2);
+    size_t none = emit_jcc(jit, CC_EQUAL);
+    // cmp edx, COMPARE_UNSIGNED; mov rdx, [r13 + compare_a]; je unsigned
+    emit_u8(jit, 0x83);
+    emit_u8(jit, 0xFA);
+    emit_u8(jit, COMPARE_UNSIGNED);
+    emit_u8(jit, 0x49);
+    emit_u8(jit, 0x8B);
+    emit_u8(jit, 0x95);
+    emit_u32(jit, (uint32_t) offsetof(Interpreter, compare_a));
+    size_t is_unsigned = emit_jcc(jit, CC_EQUAL);
+    // Signed: cmp rdx, [r13 + compare_b]; setg al; setl cl; jmp combine
+    emit_compare_flags(jit, CC_GREATER, CC_LESS);
+    size_t combine = emit_jmp(jit);
+    // Unsigned: cmp rdx, [r13 + compare_b]; seta al; setb cl
+    patch(jit, is_unsigned, jit->size);
+    emit_compare_flags(jit, CC_ABOVE, CC_BELOW);
+    // Exactly one flag is set, so the word is 2 - greater + 2 * less:
+    // neg eax; lea eax, [rax + rcx * 2 + 2]
+    patch(jit, combine, jit->size);
+    emit_u8(jit, 0xF7);
+    emit_u8(jit, 0xD8);
+    emit_u8(jit, 0x8D);
+    emit_u8(jit, 0x44);
+    emit_u8(jit, 0x48);
+    emit_u8(jit, 0x02);
+    // done: ret
+    patch(jit, none, jit->size);
+    emit_u8(jit, 0xC3);
+
+    // Pad so that the prologue falls through into the first instruction
+    jit->size  = JIT_PROLOGUE_SIZE - sizeof(prologue);
+    jit->entry = jit->size;
+    for (size_t i = 0; i < sizeof(prologue); i++) {
+        emit_u8(jit, prologue[i]);
+    }
+}
+
+/**
+ * @brief Emits the code for a single instruction.
+ *
+ * @param jit The compilation state.
+ * @param prog The program being compiled.
+ * @param index The index of the instruction to compile.
+ */
+static void emit_instruction(Jit *jit, Program *prog, size_t index) {
+    Instruction *insn = &prog->code[index];
+    switch (insn->type) {
+        case CMD_BRANCH:
+            emit_branch(jit, insn);
+            break;
+        case CMD_CALL:
+            if (insn->target == PROGRAM_NO_TARGET) {
+                emit_undefined_label(jit, insn);
+                break;
+            }
+            if (insn->is_memoized) {
+                emit_memoized_call(jit, insn, index);
+                break;
+            }
+            if (insn->is_tail_call) {
+                // cmp qword [r13 + depth], 0; jne target
+                emit_u8(jit, 0x49);
+                emit_u8(jit, 0x83);
+                emit_u8(jit, 0xBD);
+                emit_u32(jit, (uint32_t) offsetof(Interpreter, depth));
+                emit_u8(jit, 0);
+                jump_to_instruction(jit, emit_jcc(jit, CC_NOT_EQUAL), insn->target);
+            }
+            // mov rdi, r13; mov rsi, return_pc; mov edx, saves; call interpreter_push_frame
+            emit_u8(jit, 0x4C);
+            emit_u8(jit, 0x89);
+            emit_u8(jit, 0xEF);
+            emit_u8(jit, 0x48);
+            emit_u8(jit, 0xBE);
+            emit_u64(jit, index + 1);
+            emit_u8(jit, 0xBA);
+            emit_u32(jit, PROGRAM_CALL_SAVES(insn));
+            emit_call(jit, (void *) interpreter_push_frame);
+            // test al, al; jz error; jmp target
+            emit_u8(jit, 0x84);
+            emit_u8(jit, 0xC0);
+            patch(jit, emit_jcc(jit, CC_EQUAL), jit->error);
+            jump_to_instruction(jit, emit_jmp(jit), insn->target);
+            break;
+        case CMD_RET:
+            // mov rdi, r13; call return_helper
+            emit_u8(jit, 0x4C);
+            emit_u8(jit, 0x89);
+            emit_u8(jit, 0xEF);
+            emit_call(jit, (void *) return_helper);
+            // test rax, rax; js exit; jmp [r14 + rax * 8]
+            emit_u8(jit, 0x48);
+            emit_u8(jit, 0x85);
+            emit_u8(jit, 0xC0);
+            patch(jit, emit_jcc(jit, CC_SIGN), jit->exit);
+            emit_u8(jit, 0x41);
+            emit_u8(jit, 0xFF);
+            emit_u8(jit, 0x24);
+            emit_u8(jit, 0xC6);
+            break;
+        case CMD_HALT:
+            patch(jit, emit_jmp(jit), jit->exit);
+            break;
+        default:
+            if (!emit_operation(jit, insn)) {
+                patch(jit, emit_jmp(jit), jit->error);
+            }
+            break;
+    }
+}
+
+/**
+ * @brief Emits the code for one step of a trace.
+ *
+ * Branches become guards: the trace continues the way the branch went while
+ * recording, and leaves through a side exit otherwise.
+ *
+ * @param jit The compilation state.
+ * @param prog The program being compiled.
+ * @param index The index of the instruction to compile.
+ * @param next The index of the instruction that followed it while recording.
+ * @return True on success, false if the instruction cannot appear in a trace.
+ */
+static bool emit_trace_step(Jit *jit, Program *prog, size_t index, size_t next) {
+    Instruction *insn = &prog->code[index];
+    switch (insn->type) {
+        case CMD_BRANCH: {
+            if (insn->branch_condition == BRANCH_ALWAYS) {
+                return insn->target == (int64_t) next;
+            }
+            if (insn->target == (int64_t) index + 1) {
+                return next == index + 1;  // Either way, control falls through
+            }
+
+            // A guard on an undefined label resumes at the branch, which reports it
+            bool    taken = next != index + 1;
+            uint8_t cc    = emit_condition(jit, insn->branch_condition);
+            if (taken) {
+                jump_to_instruction(jit, emit_jcc(jit, cc ^ 1), index + 1);
+            } else if (insn->target == PROGRAM_NO_TARGET) {
+                jump_to_instruction(jit, emit_jcc(jit, cc), index);
+            } else {
+                jump_to_instruction(jit, emit_jcc(jit, cc), insn->target);
+            }
+            return true;
+        }
+        case CMD_CALL:
+        case CMD_RET:
+        case CMD_HALT:
+            return false;
+        default:
+            return next == index + 1 && emit_operation(jit, insn);
+    }
+}
+
+/**
+ * @brief Emits the code for an instruction that always falls through.
+ *
+ * @param jit The compilation state.
+ * @param insn The instruction to compile.
+ * @return True on success, false if `insn` is not such an instruction.
+ */
+static bool emit_operation(Jit *jit, Instruction *insn) {
+    switch (insn->type) {
+        case CMD_MOV:
+            emit_operand(jit, RAX, PROGRAM_OPERAND_A(jit->prog, insn), insn->is_a_immediate);
+            emit_store_variable(jit, insn->destination);
+            return true;
+        case CMD_ADD:
+        case CMD_SUB:
+        case CMD_AND:
+        case CMD_EOR:
+        case CMD_ORR:
+            emit_alu(jit, insn);
+            return true;
+        case CMD_LSL:
+        case CMD_LSR:
+        case CMD_ASR:
+            emit_shift(jit, insn);
+            return true;
+        case CMD_CMP:
+        case CMD_CMP_U:
+            emit_compare(jit, insn);
+            return true;
+        case CMD_LOAD:
+            emit_load(jit, insn);
+            return true;
+        case CMD_STORE:
+            emit_store(jit, insn);
+            return true;
+        case CMD_PRINT:
+        case CMD_PUT:
+            emit_helper(jit, (void *) interpreter_exec, insn);
+            return true;
+        default:
+            return false;
+    }
+}
+
+/**
+ * @brief Emits add, sub, and, eor or orr.
+ *
+ * @param jit The compilation state.
+ * @param insn The instruction to compile.
+ */
+static void emit_alu(Jit *jit, Instruction *insn) {
+    uint8_t opcode;
+    switch (insn->type) {
+        case CMD_ADD: opcode = 0x01; break;
+        case CMD_SUB: opcode = 0x29; break;
+        case CMD_AND: opcode = 0x21; break;
+        case CMD_EOR: opcode = 0x31; break;
+        default:      opcode = 0x09; break;
+    }
+
+    emit_load_variable(jit, RAX, insn->val_a);
+    emit_operand(jit, RCX, PROGRAM_OPERAND_B(jit->prog, insn), insn->is_b_immediate);
+    // op rax, rcx
+    emit_u8(jit, 0x48);
+    emit_u8(jit, opcode);
+    emit_u8(jit, 0xC8);
+    emit_store_variable(jit, insn->destination);
+}
+
+/**
+ * @brief Emits lsl, lsr or asr, failing on amounts outside 0..63.
+ *
+ * @param jit The compilation state.
+ * @param insn The instruction to compile.
+ */
+static void emit_shift(Jit *jit, Instruction *insn) {
+    uint8_t modrm = insn->type == CMD_LSL ? 0xE0 : insn->type == CMD_LSR ? 0xE8 : 0xF8;
+
+    if (insn->is_b_immediate) {
+        int64_t amount = PROGRAM_OPERAND_B(jit->prog, insn);
+        if (amount < 0 || amount > 63) {
+            patch(jit, emit_jmp(jit), jit->error);
+            return;
+        }
+        emit_load_variable(jit, RAX, insn->val_a);
+        // shl/shr/sar rax, imm8
+        emit_u8(jit, 0x48);
+        emit_u8(jit, 0xC1);
+        emit_u8(jit, modrm);
+        emit_u8(jit, (uint8_t) amount);
+    } else {
+        emit_load_variable(jit, RAX, insn->val_a);
+        emit_load_variable(jit, RCX, insn->val_b);
+        // cmp rcx, 63; ja error (an unsigned compare also rejects negative amounts)
+        emit_u8(jit, 0x48);
+        emit_u8(jit, 0x81);
+        emit_u8(jit, 0xF9);
+        emit_u32(jit, 63);
+        patch(jit, emit_jcc(jit, CC_ABOVE), jit->error);
+        // shl/shr/sar rax, cl
+        emit_u8(jit, 0x48);
+        emit_u8(jit, 0xD3);
+        emit_u8(jit, modrm);
+    }
+    emit_store_variable(jit, insn->destination);
+}
+
+/**
+ * @brief Emits cmp or cmp_u, recording its operands and kind in the
+ * interpreter. The flags are only evaluated by the branches that read them.
+ *
+ * @param jit The compilation state.
+ * @param insn The instruction to compile.
+ */
+static void emit_compare(Jit *jit, Instruction *insn) {
+    emit_load_variable(jit, RAX, insn->val_a);
+    emit_operand(jit, RCX, PROGRAM_OPERAND_B(jit->prog, insn), insn->is_b_immediate);
+    // mov [r13 + compare_a], rax
+    emit_u8(jit, 0x49);
+    emit_u8(jit, 0x89);
+    emit_u8(jit, 0x85);
+    emit_u32(jit, (uint32_t) offsetof(Interpreter, compare_a));
+    // mov [r13 + compare_b], rcx
+    emit_u8(jit, 0x49);
+    emit_u8(jit, 0x89);
+    emit_u8(jit, 0x8D);
+    emit_u32(jit, (uint32_t) offsetof(Interpreter, compare_b));
+    // mov byte [r13 + compare_kind], kind
+    emit_u8(jit, 0x41);
+    emit_u8(jit, 0xC6);
+    emit_u8(jit, 0x85);
+    emit_u32(jit, (uint32_t) offsetof(Interpreter, compare_kind));
+    emit_u8(jit, insn->type == CMD_CMP ? COMPARE_SIGNED : COMPARE_UNSIGNED);
+}
+
+/**
+ * @brief Emits a conditional or unconditional branch.
+ *
+ * @param jit The compilation state.
+ * @param insn The instruction to compile.
+ */
+static void emit_branch(Jit *jit, Instruction *insn) {
+    if (insn->branch_condition == BRANCH_ALWAYS) {
+        if (insn->target == PROGRAM_NO_TARGET) {
+            emit_undefined_label(jit, insn);
+        } else {
+            jump_to_instruction(jit, emit_jmp(jit), insn->target);
+        }
+        return;
+    }
+
+    uint8_t taken = emit_condition(jit, insn->branch_condition);
+    if (insn->target != PROGRAM_NO_TARGET) {
+        jump_to_instruction(jit, emit_jcc(jit, taken), insn->target);
+        return;
+    }
+
+    // Only report the undefined label if the branch is actually taken
+    size_t skip = emit_jcc(jit, taken ^ 1);
+    emit_undefined_label(jit, insn);
+    patch(jit, skip, jit->size);
+}
+
+/**
+ * @brief Emits code that tests the flags for a branch condition.
+ *
+ * Calls the flag stub and looks the resulting flag word up in the
+ * condition's row of `CONDITION_TABLE`.
+ *
+ * @param jit The compilation state.
+ * @param cond The condition to test; must not be BRANCH_ALWAYS.
+ * @return The condition code under which the branch is taken.
+ */
+static uint8_t emit_condition(Jit *jit, BranchCondition cond) {
+    // call flags
+    emit_u8(jit, 0xE8);
+    size_t at = jit->size;
+    emit_u32(jit, 0);
+    patch(jit, at, jit->flags);
+    // mov ecx, mask; bt ecx, eax
+    emit_u8(jit, 0xB9);
+    emit_u32(jit, CONDITION_TABLE[cond]);
+    emit_u8(jit, 0x0F);
+    emit_u8(jit, 0xA3);
+    emit_u8(jit, 0xC1);
+    return CC_BELOW;
+}
+
+/**
+ * @brief Emits one path of the flag stub: compares the operands of the last
+ * compare, held in rdx and at `compare_b`, and sets al and cl.
+ *
+ * @param jit The compilation state.
+ * @param greater The condition code for "greater" in this signedness.
+ * @param less The condition code for "less" in this signedness.
+ */
+static void emit_compare_flags(Jit *jit, uint8_t greater, uint8_t less) {
+    // cmp rdx, [r13 + compare_b]
+    emit_u8(jit, 0x49);
+    emit_u8(jit, 0x3B);
+    emit_u8(jit, 0x95);
+    emit_u32(jit, (uint32_t) offsetof(Interpreter, compare_b));
+    // setcc al; setcc cl
+    emit_u8(jit, 0x0F);
+    emit_u8(jit, 0x90 | greater);
+    emit_u8(jit, 0xC0);
+    emit_u8(jit, 0x0F);
+    emit_u8(jit, 0x90 | less);
+    emit_u8(jit, 0xC1);
+}
+
+/**
+ * @brief Emits a load, zero-extending the loaded bytes into the destination.
+ *
+ * @param jit The compilation state.
+ * @param insn The instruction to compile.
+ */
+static void emit_load(Jit *jit, Instruction *insn) {
+    int64_t bytes = PROGRAM_OPERAND_A(jit->prog, insn);
+    if (!insn->is_a_immediate) {
+        emit_helper(jit, (void *) interpreter_exec, insn);
+        return;
+    }
+
+    // The destination is cleared even when the load fails, as in the interpreter
+    emit_operand(jit, RCX, PROGRAM_OPERAND_B(jit->prog, insn), insn->is_b_immediate);
+    // mov qword [rbx + destination], 0
+    emit_u8(jit, 0x48);
+    emit_u8(jit, 0xC7);
+    emit_u8(jit, 0x83);
+    emit_u32(jit, (uint32_t) (insn->destination * sizeof(int64_t)));
+    emit_u32(jit, 0);
+    if (bytes != 1 && bytes != 2 && bytes != 4 && bytes != 8) {
+        patch(jit, emit_jmp(jit), jit->error);
+        return;
+    }
+    emit_bounds_check(jit, bytes);
+
+    switch (bytes) {
+        case 1:  // movzx eax, byte [r12 + rcx]
+            emit_u8(jit, 0x41);
+            emit_u8(jit, 0x0F);
+            emit_u8(jit, 0xB6);
+            break;
+        case 2:  // movzx eax, word [r12 + rcx]
+            emit_u8(jit, 0x41);
+            emit_u8(jit, 0x0F);
+            emit_u8(jit, 0xB7);
+            break;
+        case 4:  // mov eax, [r12 + rcx]
+            emit_u8(jit, 0x41);
+            emit_u8(jit, 0x8B);
+            break;
+        default:  // mov rax, [r12 + rcx]
+            emit_u8(jit, 0x49);
+            emit_u8(jit, 0x8B);
+            break;
+    }
+    emit_u8(jit, 0x04);
+    emit_u8(jit, 0x0C);
+    emit_store_variable(jit, insn->destination);
+}
+
+/**
+ * @brief Emits a store of the low bytes of the source variable.
+ *
+ * @param jit The compilation state.
+ * @param insn The instruction to compile.
+ */
+static void emit_store(Jit *jit, Instruction *insn) {
+    int64_t bytes = PROGRAM_OPERAND_A(jit->prog, insn);
+    if (!insn->is_a_immediate) {
+        emit_helper(jit, (void *) interpreter_exec, insn);
+        return;
+    }
+    if (bytes != 1 && bytes != 2 && bytes != 4 && bytes != 8) {
+        patch(jit, emit_jmp(jit), jit->error);
+        return;
+    }
+
+    emit_operand(jit, RCX, PROGRAM_OPERAND_B(jit->prog, insn), insn->is_b_immediate);
+    emit_bounds_check(jit, bytes);
+    emit_load_variable(jit, RAX, insn->destination);
+    switch (bytes) {
+        case 1:  // mov [r12 + rcx], al
+            emit_u8(jit, 0x41);
+            emit_u8(jit, 0x88);
+            break;
+        case 2:  // mov [r12 + rcx], ax
+            emit_u8(jit, 0x66);
+            emit_u8(jit, 0x41);
+            emit_u8(jit, 0x89);
+            break;
+        case 4:  // mov [r12 + rcx], eax
+            emit_u8(jit, 0x41);
+            emit_u8(jit, 0x89);
+            break;
+        default:  // mov [r12 + rcx], rax
+            emit_u8(jit, 0x49);
+            emit_u8(jit, 0x89);
+            break;
+    }
+    emit_u8(jit, 0x04);
+    emit_u8(jit, 0x0C);
+}
+
+/**
+ * @brief Emits a check that the address in rcx leaves room for `bytes` bytes
+ * of memory, jumping to the error stub otherwise.
+ *
+ * @param jit The compilation state.
+ * @param bytes The access width.
+ */
+static void emit_bounds_check(Jit *jit, int64_t bytes) {
+    // cmp rcx, MEM_CAPACITY - bytes; ja error
+    emit_u8(jit, 0x48);
+    emit_u8(jit, 0x81);
+    emit_u8(jit, 0xF9);
+    emit_u32(jit, (uint32_t) (MEM_CAPACITY - bytes));
+    patch(jit, emit_jcc(jit, CC_ABOVE), jit->error);
+}
+
+/**
+ * @brief Emits a call to `helper(intr, prog, insn)`, exiting with an error if
+ * it returns false.
+ *
+ * @param jit The compilation state.
+ * @param helper A function taking the interpreter, the program and the
+ * instruction.
+ * @param insn The instruction to pass along.
+ */
+static void emit_helper(Jit *jit, void *helper, Instruction *insn) {
+    // mov rdi, r13; mov rsi, prog; mov rdx, insn
+    emit_u8(jit, 0x4C);
+    emit_u8(jit, 0x89);
+    emit_u8(jit, 0xEF);
+    emit_u8(jit, 0x48);
+    emit_u8(jit, 0xBE);
+    emit_u64(jit, (uint64_t) (uintptr_t) jit->prog);
+    emit_u8(jit, 0x48);
+    emit_u8(jit, 0xBA);
+    emit_u64(jit, (uint64_t) (uintptr_t) insn);
+    emit_call(jit, helper);
+    // test al, al; jz error
+    emit_u8(jit, 0x84);
+    emit_u8(jit, 0xC0);
+    patch(jit, emit_jcc(jit, CC_EQUAL), jit->error);
+}
+
+/**
+ * @brief Emits a call to a pure function through `interpreter_call_memoized`,
+ * which either answers it from the memo table or sets up the call.
+ *
+ * @param jit The compilation state.
+ * @param insn The call to compile.
+ * @param index The index of the call.
+ */
+static void emit_memoized_call(Jit *jit, Instruction *insn, size_t index) {
+    // mov rdi, r13; mov rsi, prog; mov rdx, insn; call interpreter_call_memoized
+    emit_u8(jit, 0x4C);
+    emit_u8(jit, 0x89);
+    emit_u8(jit, 0xEF);
+    emit_u8(jit, 0x48);
+    emit_u8(jit, 0xBE);
+    emit_u64(jit, (uint64_t) (uintptr_t) jit->prog);
+    emit_u8(jit, 0x48);
+    emit_u8(jit, 0xBA);
+    emit_u64(jit, (uint64_t) (uintptr_t) insn);
+    emit_call(jit, (void *) interpreter_call_memoized);
+    // test rax, rax; js error
+    emit_u8(jit, 0x48);
+    emit_u8(jit, 0x85);
+    emit_u8(jit, 0xC0);
+    patch(jit, emit_jcc(jit, CC_SIGN), jit->error);
+    // cmp rax, index + 1; je next; jmp target
+    emit_u8(jit, 0x48);
+    emit_u8(jit, 0x3D);
+    emit_u32(jit, (uint32_t) (index + 1));
+    jump_to_instruction(jit, emit_jcc(jit, CC_EQUAL), (int64_t) index + 1);
+    jump_to_instruction(jit, emit_jmp(jit), insn->target);
+}
+
+/**
+ * @brief Emits the report for a branch or call to an undefined label.
+ *
+ * @param jit The compilation state.
+ * @param insn The branch or call referring to the label.
+ */
+static void emit_undefined_label(Jit *jit, Instruction *insn) {
+    // mov rdi, label; call undefined_label_helper; jmp error
+    emit_u8(jit, 0x48);
+    emit_u8(jit, 0xBF);
+    emit_u64(jit, (uint64_t) (uintptr_t) PROGRAM_STRING_A(jit->prog, insn));
+    emit_call(jit, (void *) undefined_label_helper);
+    patch(jit, emit_jmp(jit), jit->error);
+}
+
+/**
+ * @brief Appends a byte to the code buffer.
+ *
+ * @param jit The compilation state.
+ * @param byte The byte to append.
+ */
+static void emit_u8(Jit *jit, uint8_t byte) {
+    jit->code[jit->size++] = byte;
+}
+
+/**
+ * @brief Appends a little-endian 32-bit value to the code buffer.
+ *
+ * @param jit The compilation state.
+ * @param value The value to append.
+ */
+static void emit_u32(Jit *jit, uint32_t value) {
+    for (int i = 0; i < 4; i++) {
+        emit_u8(jit, (uint8_t) (value >> (i * 8)));
+    }
+}
+
+/**
+ * @brief Appends a little-endian 64-bit value to the code buffer.
+ *
+ * @param jit The compilation state.
+ * @param value The value to append.
+ */
+static void emit_u64(Jit *jit, uint64_t value) {
+    emit_u32(jit, (uint32_t) value);
+    emit_u32(jit, (uint32_t) (value >> 32));
+}
+
+/**
+ * @brief Emits `mov reg, [rbx + var * 8]`.
+ *
+ * @param jit The compilation state.
+ * @param reg The host register to load into.
+ * @param var The variable to load.
+ */
+static void emit_load_variable(Jit *jit, int reg, int64_t var) {
+    emit_u8(jit, 0x48);
+    emit_u8(jit, 0x8B);
+    emit_u8(jit, (uint8_t) (0x83 | (reg << 3)));
+    emit_u32(jit, (uint32_t) (var * sizeof(int64_t)));
+}
+
+/**
+ * @brief Emits `mov [rbx + var * 8], rax`.
+ *
+ * @param jit The compilation state.
+ * @param var The variable to store into.
+ */
+static void emit_store_variable(Jit *jit, int64_t var) {
+    emit_u8(jit, 0x48);
+    emit_u8(jit, 0x89);
+    emit_u8(jit, 0x83);
+    emit_u32(jit, (uint32_t) (var * sizeof(int64_t)));
+}
+
+/**
+ * @brief Loads an immediate or a variable operand into a host register.
+ *
+ * @param jit The compilation state.
+ * @param reg The host register to load into.
+ * @param operand The operand, as returned by `PROGRAM_OPERAND_A/B`.
+ * @param is_immediate Whether `operand` is an immediate.
+ */
+static void emit_operand(Jit *jit, int reg, int64_t operand, bool is_immediate) {
+    if (!is_immediate) {
+        emit_load_variable(jit, reg, operand);
+        return;
+    }
+    // mov reg, imm64
+    emit_u8(jit, 0x48);
+    emit_u8(jit, (uint8_t) (0xB8 + reg));
+    emit_u64(jit, (uint64_t) operand);
+}
+
+/**
+ * @brief Emits `mov rax, function; call rax`.
+ *
+ * @param jit The compilation state.
+ * @param function The C function to call.
+ */
+static void emit_call(Jit *jit, void *function) {
+    emit_u8(jit, 0x48);
+    emit_u8(jit, 0xB8);
+    emit_u64(jit, (uint64_t) (uintptr_t) function);
+    emit_u8(jit, 0xFF);
+    emit_u8(jit, 0xD0);
+}
+
+/**
+ * @brief Emits a conditional jump with a placeholder displacement.
+ *
+ * @param jit The compilation state.
+ * @param cc The condition code of the jump.
+ * @return The offset of the displacement, for `patch`.
+ */
+static size_t emit_jcc(Jit *jit, uint8_t cc) {
+    emit_u8(jit, 0x0F);
+    emit_u8(jit, 0x80 | cc);
+    size_t at = jit->size;
+    emit_u32(jit, 0);
+    return at;
+}
+
+/**
+ * @brief Emits an unconditional jump with a placeholder displacement.
+ *
+ * @param jit The compilation state.
+ * @return The offset of the displacement, for `patch`.
+ */
+static size_t emit_jmp(Jit *jit) {
+    emit_u8(jit, 0xE9);
+    size_t at = jit->size;
+    emit_u32(jit, 0);
+    return at;
+}
+
+/**
+ * @brief Points a jump's displacement at a code offset.
+ *
+ * @param jit The compilation state.
+ * @param at The offset of the displacement.
+ * @param destination The code offset to jump to.
+ */
+static void patch(Jit *jit, size_t at, size_t destination) {
+    int32_t rel = (int32_t) ((int64_t) destination - (int64_t) (at + 4));
+    for (int i = 0; i < 4; i++) {
+        jit->code[at + i] = (uint8_t) ((uint32_t) rel >> (i * 8));
+    }
+}
+
+/**
+ * @brief Records a jump to an instruction, patched once all code is emitted.
+ *
+ * @param jit The compilation state.
+ * @param at The offset of the displacement.
+ * @param target The index of the instruction to jump to.
+ */
+static void jump_to_instruction(Jit *jit, size_t at, int64_t target) {
+    jit->fixups[jit->num_fixups].at     = at;
+    jit->fixups[jit->num_fixups].target = (size_t) target;
+    jit->num_fixups++;
+}
+
+/**
+ * @brief Pops a call frame on behalf of compiled code.
+ *
+ * @param intr The interpreter owning the stack.
+ * @return The index to resume at, or -1 if the stack is empty and execution
+ * should end.
+ */
+static int64_t return_helper(Interpreter *intr) {
+    if (intr->depth == 0) {
+        return -1;
+    }
+    return (int64_t) interpreter_pop_frame(intr);
+}
+
+/**
+ * @brief Reports a branch or call to an undefined label.
+ *
+ * @param label The name of the label.
+ */
+static void undefined_label_helper(const char *label) {
+    printf("Label not found: %s\n", label);
+}
+
+#else
+
+bool jit_available(void) {
+    return false;
+}
+
+bool jit_run(Interpreter *intr, Program *prog) {
+    (void) intr;
+    (void) prog;
+    return false;
+}
+
+JitTrace *jit_compile_trace(Program *prog, const size_t *pcs, size_t length) {
+    (void) prog;
+    (void) pcs;
+    (void) length;
+    return NULL;
+}
+
+size_t jit_run_trace(JitTrace *trace, Interpreter *intr) {
+    (void) trace;
+    (void) intr;
+    return 0;
+}
+
+void jit_free_trace(JitTrace *trace) {
+    (void) trace;
+}
+
+#endif
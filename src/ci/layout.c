@@ -0,0 +1,414 @@
+#include "layout.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cfg.h"
+#include "command_type.h"
+#include "linker.h"
+#include "rewrite.h"
+
+#define LAYOUT_NONE ((size_t) -1)  // No block: the end of a chain, or of the program.
+#define LABEL_SIZE  32             // Longest label `label_of` makes up.
+
+/**
+ * @brief A block ending in a conditional branch, which may be chained to
+ * either of its successors.
+ */
+typedef struct {
+    size_t   block;   // The block.
+    uint64_t weight;  // Times its branch ran.
+} Choice;
+
+/**
+ * @brief What has to change at the end of a block once it is moved.
+ */
+typedef enum {
+    FIX_NONE,    // It still falls into the block it used to, or never falls through.
+    FIX_INVERT,  // Its branch now targets the old fallthrough, with the opposite condition.
+    FIX_JUMP,    // An unconditional branch to the old fallthrough follows it.
+} Fix;
+
+// The condition that holds exactly when another does not, once a compare ran
+static const BranchCondition INVERSE[] = {
+    [BRANCH_EQUAL]         = BRANCH_NOT_EQUAL,
+    [BRANCH_NOT_EQUAL]     = BRANCH_EQUAL,
+    [BRANCH_GREATER]       = BRANCH_LESS_EQUAL,
+    [BRANCH_LESS]          = BRANCH_GREATER_EQUAL,
+    [BRANCH_GREATER_EQUAL] = BRANCH_LESS,
+    [BRANCH_LESS_EQUAL]    = BRANCH_GREATER,
+};
+
+static bool     matches_profile(const Cfg *cfg, const Profile *profile);
+static void     chain_blocks(const Cfg *cfg, const uint64_t *taken, const uint64_t *not_taken,
+                             Choice *choices, size_t *next, size_t *prev);
+static bool     link_blocks(size_t *next, size_t *prev, size_t from, size_t to);
+static bool     plan_fixes(const Cfg *cfg, const size_t *order, Fix *fixes, Command **jumps,
+                           char **labels);
+static void     relink(Command **commands, const Cfg *cfg, const size_t *order, const Fix *fixes,
+                       Command **jumps, char **labels);
+static bool     can_invert(const Cfg *cfg, size_t block);
+static size_t   target_block(const Cfg *cfg, size_t block);
+static size_t   fallthrough_of(const Cfg *cfg, size_t block);
+static Command *first_command(const Cfg *cfg, size_t block);
+static char    *label_of(const Cfg *cfg, size_t block);
+static int      compare_choice_weight(const void *a, const void *b);
+
+bool layout_blocks(Command **commands, const Profile *profile) {
+    Cfg cfg;
+    if (!*commands || !cfg_build(&cfg, *commands)) {
+        return true;
+    }
+    if (!matches_profile(&cfg, profile)) {
+        cfg_free(&cfg);
+        return false;
+    }
+
+    size_t    count     = cfg.array.count;
+    size_t    n         = cfg.num_blocks;
+    uint64_t *taken     = calloc(count, sizeof(uint64_t));
+    uint64_t *not_taken = calloc(count, sizeof(uint64_t));
+    Choice   *choices   = malloc(n * sizeof(Choice));
+    size_t   *next      = malloc(n * sizeof(size_t));
+    size_t   *prev      = malloc(n * sizeof(size_t));
+    size_t   *order     = malloc(n * sizeof(size_t));
+    Fix      *fixes     = calloc(n, sizeof(Fix));
+    Command **jumps     = calloc(n, sizeof(Command *));
+    char    **labels    = calloc(n, sizeof(char *));
+    if (taken && not_taken && choices && next && prev && order && fixes && jumps && labels) {
+        for (size_t i = 0; i < profile->num_branches; i++) {
+            taken[profile->branches[i].index] += profile->branches[i].taken;
+            not_taken[profile->branches[i].index] += profile->branches[i].not_taken;
+        }
+        chain_blocks(&cfg, taken, not_taken, choices, next, prev);
+
+        // The first block heads the first chain; the rest follow by their head
+        size_t placed = 0;
+        bool   moved  = false;
+        for (size_t head = 0; head < n; head++) {
+            if (prev[head] != LAYOUT_NONE) {
+                continue;
+            }
+            for (size_t b = head; b != LAYOUT_NONE; b = next[b]) {
+                moved |= b != placed;
+                order[placed++] = b;
+            }
+        }
+        if (moved && plan_fixes(&cfg, order, fixes, jumps, labels)) {
+            relink(commands, &cfg, order, fixes, jumps, labels);
+        }
+    }
+
+    free(taken);
+    free(not_taken);
+    free(choices);
+    free(next);
+    free(prev);
+    free(order);
+    free(fixes);
+    free(jumps);
+    free(labels);
+    cfg_free(&cfg);
+    return true;
+}
+
+/**
+ * @brief Determines whether a profile was recorded for a command list.
+ *
+ * @param cfg The control-flow graph of the list.
+ * @param profile The profile.
+ * @return true if the profile has as many instructions as the list has
+ * commands and every branch it counted is a branch of the list.
+ */
+static bool matches_profile(const Cfg *cfg, const Profile *profile) {
+    if (profile->length != cfg->array.count) {
+        return false;
+    }
+    for (size_t i = 0; i < profile->num_branches; i++) {
+        size_t index = profile->branches[i].index;
+        if (index >= cfg->array.count || cfg->array.commands[index]->type != CMD_BRANCH) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Links blocks into chains that will be laid out one after the other.
+ *
+ * @param cfg The control-flow graph.
+ * @param taken Times the branch at each command index jumped.
+ * @param not_taken Times the branch at each command index fell through.
+ * @param choices Space for one entry per block.
+ * @param next Set to the block after each block in its chain, or LAYOUT_NONE.
+ * @param prev Set to the block before each block in its chain, or LAYOUT_NONE.
+ */
+static void chain_blocks(const Cfg *cfg, const uint64_t *taken, const uint64_t *not_taken,
+                         Choice *choices, size_t *next, size_t *prev) {
+    size_t num_choices = 0;
+    for (size_t b = 0; b < cfg->num_blocks; b++) {
+        next[b] = LAYOUT_NONE;
+        prev[b] = LAYOUT_NONE;
+    }
+
+    // Blocks that fall through without branching stay with their fallthrough
+    for (size_t b = 0; b < cfg->num_blocks; b++) {
+        size_t   last = cfg->blocks[b].last;
+        Command *cmd  = cfg->array.commands[last];
+        if (cmd->type == CMD_RET ||
+            (cmd->type == CMD_BRANCH && cmd->branch_condition == BRANCH_ALWAYS)) {
+            continue;
+        }
+        if (cmd->type == CMD_BRANCH) {
+            choices[num_choices].block  = b;
+            choices[num_choices].weight = taken[last] + not_taken[last];
+            num_choices++;
+        } else if (fallthrough_of(cfg, b) != LAYOUT_NONE) {
+            link_blocks(next, prev, b, b + 1);
+        }
+    }
+
+    // The most executed branches pick their successor first
+    qsort(choices, num_choices, sizeof(Choice), compare_choice_weight);
+    for (size_t c = 0; c < num_choices; c++) {
+        size_t b      = choices[c].block;
+        size_t last   = cfg->blocks[b].last;
+        size_t target = target_block(cfg, b);
+        if (target != LAYOUT_NONE && taken[last] > not_taken[last] && can_invert(cfg, b) &&
+            link_blocks(next, prev, b, target)) {
+            continue;
+        }
+        if (fallthrough_of(cfg, b) != LAYOUT_NONE) {
+            link_blocks(next, prev, b, b + 1);
+        }
+    }
+}
+
+/**
+ * @brief Places one block right after another, if both are free to.
+ *
+ * @param next The block after each block in its chain.
+ * @param prev The block before each block in its chain.
+ * @param from The block to end a chain with.
+ * @param to The block to start a chain with.
+ * @return true if the blocks were linked, false if `from` already has a
+ * successor, `to` already has a predecessor or is the first block, or `to`'s
+ * chain leads to `from`.
+ */
+static bool link_blocks(size_t *next, size_t *prev, size_t from, size_t to) {
+    if (to == 0 || next[from] != LAYOUT_NONE || prev[to] != LAYOUT_NONE) {
+        return false;
+    }
+    for (size_t b = to; b != LAYOUT_NONE; b = next[b]) {
+        if (b == from) {
+            return false;
+        }
+    }
+    next[from] = to;
+    prev[to]   = from;
+    return true;
+}
+
+/**
+ * @brief Decides how each moved block keeps reaching its old fallthrough, and
+ * allocates the branches and labels that takes.
+ *
+ * @param cfg The control-flow graph.
+ * @param order The blocks in their new order.
+ * @param fixes Set to the fix each block needs.
+ * @param jumps Set to the branch to add after each block, if any.
+ * @param labels Set to the new label of each inverted branch, if any.
+ * @return true on success, false if memory could not be allocated, in which
+ * case everything allocated is freed again.
+ */
+static bool plan_fixes(const Cfg *cfg, const size_t *order, Fix *fixes, Command **jumps,
+                       char **labels) {
+    size_t n = cfg->num_blocks;
+    for (size_t k = 0; k < n; k++) {
+        size_t   b           = order[k];
+        size_t   after       = (k + 1 < n) ? order[k + 1] : LAYOUT_NONE;
+        size_t   fallthrough = fallthrough_of(cfg, b);
+        Command *cmd         = cfg->array.commands[cfg->blocks[b].last];
+        if (cmd->type == CMD_RET ||
+            (cmd->type == CMD_BRANCH && cmd->branch_condition == BRANCH_ALWAYS) ||
+            after == fallthrough) {
+            continue;
+        }
+
+        char *label = label_of(cfg, fallthrough);
+        if (!label) {
+            goto fail;
+        }
+        if (cmd->type == CMD_BRANCH && target_block(cfg, b) == after && can_invert(cfg, b)) {
+            fixes[b]  = FIX_INVERT;
+            labels[b] = label;
+            continue;
+        }
+        Command *jump = command_new_branch(BRANCH_ALWAYS, first_command(cfg, fallthrough), label);
+        free(label);
+        if (!jump) {
+            goto fail;
+        }
+        fixes[b] = FIX_JUMP;
+        jumps[b] = jump;
+    }
+    return true;
+
+fail:
+    for (size_t b = 0; b < n; b++) {
+        free_command(jumps[b]);
+        free(labels[b]);
+        jumps[b]  = NULL;
+        labels[b] = NULL;
+        fixes[b]  = FIX_NONE;
+    }
+    return false;
+}
+
+/**
+ * @brief Relinks the command list in the new block order, applying the fixes.
+ *
+ * @param commands Pointer to the head of the linked list.
+ * @param cfg The control-flow graph.
+ * @param order The blocks in their new order.
+ * @param fixes The fix each block needs.
+ * @param jumps The branch to add after each block, if any.
+ * @param labels The new label of each inverted branch, if any.
+ */
+static void relink(Command **commands, const Cfg *cfg, const size_t *order, const Fix *fixes,
+                   Command **jumps, char **labels) {
+    Command  *head = NULL;
+    Command **link = &head;
+    for (size_t k = 0; k < cfg->num_blocks; k++) {
+        size_t b = order[k];
+        for (size_t i = cfg->blocks[b].first; i <= cfg->blocks[b].last; i++) {
+            *link = cfg->array.commands[i];
+            link  = &(*link)->next;
+        }
+
+        Command *cmd = cfg->array.commands[cfg->blocks[b].last];
+        if (fixes[b] == FIX_INVERT) {
+            free(cmd->val_a.str_val);
+            cmd->val_a.str_val    = labels[b];
+            cmd->branch_condition = INVERSE[cmd->branch_condition];
+            cmd->target           = first_command(cfg, fallthrough_of(cfg, b));
+        } else if (fixes[b] == FIX_JUMP) {
+            *link = jumps[b];
+            link  = &(*link)->next;
+        }
+    }
+    *link     = NULL;
+    *commands = head;
+}
+
+/**
+ * @brief Determines whether the branch ending a block can be inverted.
+ *
+ * Before any compare the flags are clear, and neither an ordered condition
+ * nor its inverse holds. A compare earlier in the same block rules that out.
+ *
+ * @param cfg The control-flow graph.
+ * @param block A block ending in a conditional branch.
+ * @return true if inverting the branch's condition makes it jump exactly
+ * when it used to fall through.
+ */
+static bool can_invert(const Cfg *cfg, size_t block) {
+    Command *branch = cfg->array.commands[cfg->blocks[block].last];
+    if (branch->branch_condition == BRANCH_EQUAL || branch->branch_condition == BRANCH_NOT_EQUAL) {
+        return true;
+    }
+    for (size_t i = cfg->blocks[block].first; i < cfg->blocks[block].last; i++) {
+        CommandType type = cfg->array.commands[i]->type;
+        if (type == CMD_CMP || type == CMD_CMP_U) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Finds the block the branch ending a block jumps to.
+ *
+ * @param cfg The control-flow graph.
+ * @param block A block ending in a branch.
+ * @return The target block, or LAYOUT_NONE if the branch leaves the program
+ * or its label is undefined.
+ */
+static size_t target_block(const Cfg *cfg, size_t block) {
+    int64_t target = cfg->array.targets[cfg->blocks[block].last];
+    return (target >= 0) ? cfg->block_of[target] : LAYOUT_NONE;
+}
+
+/**
+ * @brief Finds the block that follows a block in source order.
+ *
+ * @param cfg The control-flow graph.
+ * @param block The block.
+ * @return The next block, or LAYOUT_NONE for the last block.
+ */
+static size_t fallthrough_of(const Cfg *cfg, size_t block) {
+    return (block + 1 < cfg->num_blocks) ? block + 1 : LAYOUT_NONE;
+}
+
+/**
+ * @brief Finds the command a branch to a block should target.
+ *
+ * @param cfg The control-flow graph.
+ * @param block The block, or LAYOUT_NONE for the end of the program.
+ * @return The block's first command, or `LINK_HALT`.
+ */
+static Command *first_command(const Cfg *cfg, size_t block) {
+    return (block != LAYOUT_NONE) ? cfg->array.commands[cfg->blocks[block].first] : LINK_HALT;
+}
+
+/**
+ * @brief Names a block for a branch added to it.
+ *
+ * Reuses the label of a branch or call that already targets the block. Other
+ * blocks get a ".L" label, like the undefined labels that end the program.
+ *
+ * @param cfg The control-flow graph.
+ * @param block The block, or LAYOUT_NONE for the end of the program.
+ * @return A newly allocated label, or NULL if memory could not be allocated.
+ */
+static char *label_of(const Cfg *cfg, size_t block) {
+    const char *name = NULL;
+    char        made_up[LABEL_SIZE];
+    if (block == LAYOUT_NONE) {
+        name = ".Lhalt";
+    } else {
+        int64_t first = (int64_t) cfg->blocks[block].first;
+        for (size_t i = 0; i < cfg->array.count && !name; i++) {
+            Command *cmd = cfg->array.commands[i];
+            if (cfg->array.targets[i] == first && cmd->is_a_string && cmd->val_a.str_val) {
+                name = cmd->val_a.str_val;
+            }
+        }
+        if (!name) {
+            snprintf(made_up, sizeof(made_up), ".Lblock%zu", cfg->blocks[block].first);
+            name = made_up;
+        }
+    }
+
+    char *label = malloc(strlen(name) + 1);
+    if (label) {
+        strcpy(label, name);
+    }
+    return label;
+}
+
+/**
+ * @brief Orders choices by decreasing weight, then by block.
+ *
+ * @param a Pointer to the first `Choice`.
+ * @param b Pointer to the second `Choice`.
+ * @return A negative, zero or positive value, as required by `qsort`.
+ */
+static int compare_choice_weight(const void *a, const void *b) {
+    const Choice *x = a;
+    const Choice *y = b;
+    if (x->weight != y->weight) {
+        return (x->weight > y->weight) ? -1 : 1;
+    }
+    return (x->block > y->block) - (x->block < y->block);
+}
@@ -0,0 +1,292 @@
+#include "licm.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include "cfg.h"
+#include "command_type.h"
+#include "linker.h"
+#include "liveness.h"
+
+static size_t hoist_one_loop(Command **commands, bool dumps_state, bool calls_may_fail);
+static size_t find_invariants(Cfg *cfg, Loop *loop, const uint64_t *live, bool *is_hoisted,
+                              size_t *order);
+static bool   can_enter_preheader(Cfg *cfg, Loop *loop);
+static bool   is_hoistable(Cfg *cfg, Loop *loop, size_t i, const uint64_t *live,
+                           const bool *is_hoisted, uint64_t defs, const size_t *def_count,
+                           bool writes_memory);
+static void   move_to_preheader(Command **commands, Cfg *cfg, Loop *loop, const bool *is_hoisted,
+                                const size_t *order, size_t num_hoisted);
+static bool   in_loop(Cfg *cfg, Loop *loop, size_t i);
+static size_t lowest_bit(uint64_t mask);
+
+size_t hoist_loop_invariants(Command **commands, bool dumps_state, bool calls_may_fail) {
+    if (!commands) {
+        return 0;
+    }
+
+    // Every hoist reshapes the list, so analyze it afresh until no loop changes
+    size_t hoisted = 0;
+    size_t pass;
+    do {
+        pass = hoist_one_loop(commands, dumps_state, calls_may_fail);
+        hoisted += pass;
+    } while (pass > 0);
+    return hoisted;
+}
+
+/**
+ * @brief Hoists the invariant commands of the innermost loop that has any.
+ *
+ * @param commands Pointer to the head of the linked list.
+ * @param dumps_state Whether the variables and flags are printed at the end.
+ * @param calls_may_fail Whether a call can fail, ending the program.
+ * @return The number of commands hoisted.
+ */
+static size_t hoist_one_loop(Command **commands, bool dumps_state, bool calls_may_fail) {
+    Cfg cfg;
+    if (!*commands || !cfg_build(&cfg, *commands)) {
+        return 0;
+    }
+    Liveness liveness;
+    if (!liveness_compute(&liveness, &cfg.array, dumps_state, calls_may_fail)) {
+        cfg_free(&cfg);
+        return 0;
+    }
+
+    size_t  count       = cfg.array.count;
+    bool   *is_hoisted  = calloc(count + 1, sizeof(bool));
+    size_t *order       = malloc((count + 1) * sizeof(size_t));
+    size_t  num_hoisted = 0;
+    if (is_hoisted && order) {
+        for (size_t l = 0; l < cfg.num_loops && num_hoisted == 0; l++) {
+            Loop *loop  = &cfg.loops[l];
+            num_hoisted = find_invariants(&cfg, loop, liveness.live, is_hoisted, order);
+            if (num_hoisted > 0) {
+                move_to_preheader(commands, &cfg, loop, is_hoisted, order, num_hoisted);
+            }
+        }
+    }
+
+    free(is_hoisted);
+    free(order);
+    liveness_free(&liveness);
+    cfg_free(&cfg);
+    return num_hoisted;
+}
+
+/**
+ * @brief Finds the commands of a loop that can be hoisted.
+ *
+ * @param cfg The control-flow graph.
+ * @param loop The loop to search.
+ * @param live What is live on entry to each command.
+ * @param is_hoisted Set for every command found.
+ * @param order Set to the commands found, in the order the preheader must run them.
+ * @return The number of commands found.
+ */
+static size_t find_invariants(Cfg *cfg, Loop *loop, const uint64_t *live, bool *is_hoisted,
+                              size_t *order) {
+    if (!can_enter_preheader(cfg, loop)) {
+        return 0;
+    }
+
+    // Everything the loop writes; calls write x0 and the flags, and maybe memory
+    uint64_t defs                         = 0;
+    size_t   def_count[NUM_VARIABLES + 1] = {0};
+    bool     writes_memory                = false;
+    for (size_t b = 0; b < cfg->num_blocks; b++) {
+        if (!loop->blocks[b]) {
+            continue;
+        }
+        for (size_t i = cfg->blocks[b].first; i <= cfg->blocks[b].last; i++) {
+            Command *cmd = cfg->array.commands[i];
+            uint64_t w   = command_writes(cmd);
+            if (cmd->type == CMD_CALL) {
+                w             = LIVE_AT_RET;
+                writes_memory = true;
+            } else if (cmd->type == CMD_STORE || cmd->type == CMD_PUT) {
+                writes_memory = true;
+            }
+            for (uint64_t left = w; left; left &= left - 1) {
+                def_count[lowest_bit(left)]++;
+            }
+            defs |= w;
+        }
+    }
+
+    // Hoisting a command can make the commands reading its result invariant
+    size_t num_hoisted = 0;
+    bool   changed     = true;
+    while (changed) {
+        changed = false;
+        for (size_t b = 0; b < cfg->num_blocks; b++) {
+            if (!loop->blocks[b]) {
+                continue;
+            }
+            for (size_t i = cfg->blocks[b].first; i <= cfg->blocks[b].last; i++) {
+                if (!is_hoisted[i] && is_hoistable(cfg, loop, i, live, is_hoisted, defs, def_count,
+                                                   writes_memory)) {
+                    is_hoisted[i]        = true;
+                    order[num_hoisted++] = i;
+                    defs &= ~command_writes(cfg->array.commands[i]);
+                    changed = true;
+                }
+            }
+        }
+    }
+    return num_hoisted;
+}
+
+/**
+ * @brief Determines whether a preheader can be placed just before a loop's
+ * header without being run again on every iteration.
+ *
+ * @param cfg The control-flow graph.
+ * @param loop The loop.
+ * @return False if the header is called, or is fallen into from inside the loop.
+ */
+static bool can_enter_preheader(Cfg *cfg, Loop *loop) {
+    size_t header = cfg->blocks[loop->header].first;
+    for (size_t i = 0; i < cfg->array.count; i++) {
+        if (cfg->array.commands[i]->type == CMD_CALL && cfg->array.targets[i] == (int64_t) header) {
+            return false;
+        }
+    }
+    if (header == 0 || !in_loop(cfg, loop, header - 1)) {
+        return true;
+    }
+
+    Command *prev = cfg->array.commands[header - 1];
+    return prev->type == CMD_RET ||
+           (prev->type == CMD_BRANCH && prev->branch_condition == BRANCH_ALWAYS);
+}
+
+/**
+ * @brief Determines whether a command of a loop can be hoisted.
+ *
+ * @param cfg The control-flow graph.
+ * @param loop The loop.
+ * @param i Index of the command.
+ * @param live What is live on entry to each command.
+ * @param is_hoisted Which commands have been hoisted so far.
+ * @param defs What the loop's commands that stay in the loop write.
+ * @param def_count How many commands of the loop write each variable.
+ * @param writes_memory Whether the loop may write memory.
+ * @return True if the command can be moved to the loop's preheader.
+ */
+static bool is_hoistable(Cfg *cfg, Loop *loop, size_t i, const uint64_t *live,
+                         const bool *is_hoisted, uint64_t defs, const size_t *def_count,
+                         bool writes_memory) {
+    Command *cmd = cfg->array.commands[i];
+    switch (cmd->type) {
+        case CMD_MOV:
+        case CMD_ADD:
+        case CMD_SUB:
+        case CMD_AND:
+        case CMD_EOR:
+        case CMD_ORR:
+        case CMD_LSL:
+        case CMD_LSR:
+        case CMD_ASR:
+            break;
+        case CMD_LOAD:
+            if (writes_memory) {
+                return false;
+            }
+            break;
+        default:
+            return false;
+    }
+
+    uint64_t w = command_writes(cmd);
+    if (!w || def_count[lowest_bit(w)] != 1 || (command_reads(cmd) & defs)) {
+        return false;
+    }
+
+    // The header's leading commands run first anyway, even if they then fail
+    size_t header = cfg->blocks[loop->header].first;
+    bool   prefix = cfg->block_of[i] == loop->header;
+    for (size_t j = header; j < i && prefix; j++) {
+        prefix = is_hoisted[j];
+    }
+    return prefix || (!command_may_fail(cmd) && !(live[header] & w));
+}
+
+/**
+ * @brief Moves hoisted commands into a preheader just before the loop header.
+ *
+ * Branches into the loop from outside now enter through the preheader, while
+ * branches within the loop skip it. Branches to a hoisted command go to the
+ * next command that stayed behind.
+ *
+ * @param commands Pointer to the head of the linked list.
+ * @param cfg The control-flow graph.
+ * @param loop The loop.
+ * @param is_hoisted Which commands are hoisted.
+ * @param order The hoisted commands, in the order the preheader runs them.
+ * @param num_hoisted Number of entries in `order`.
+ */
+static void move_to_preheader(Command **commands, Cfg *cfg, Loop *loop, const bool *is_hoisted,
+                              const size_t *order, size_t num_hoisted) {
+    CommandArray *array     = &cfg->array;
+    size_t        header    = cfg->blocks[loop->header].first;
+    Command      *preheader = array->commands[order[0]];
+
+    for (size_t k = 0; k < array->count; k++) {
+        int64_t target = array->targets[k];
+        if (target < 0 || (target != (int64_t) header && !is_hoisted[target])) {
+            continue;
+        }
+        if (!in_loop(cfg, loop, k)) {
+            array->commands[k]->target = preheader;
+            continue;
+        }
+        size_t next = (size_t) target;
+        while (next < array->count && is_hoisted[next]) {
+            next++;
+        }
+        array->commands[k]->target = (next < array->count) ? array->commands[next] : LINK_HALT;
+    }
+
+    Command  *head = NULL;
+    Command **link = &head;
+    for (size_t i = 0; i < array->count; i++) {
+        if (i == header) {
+            for (size_t h = 0; h < num_hoisted; h++) {
+                *link = array->commands[order[h]];
+                link  = &(*link)->next;
+            }
+        }
+        if (!is_hoisted[i]) {
+            *link = array->commands[i];
+            link  = &(*link)->next;
+        }
+    }
+    *link     = NULL;
+    *commands = head;
+}
+
+/**
+ * @brief Determines whether a command belongs to a loop.
+ *
+ * @param cfg The control-flow graph.
+ * @param loop The loop.
+ * @param i Index of the command.
+ * @return True if the command's block is part of the loop.
+ */
+static bool in_loop(Cfg *cfg, Loop *loop, size_t i) {
+    return loop->blocks[cfg->block_of[i]];
+}
+
+/**
+ * @brief Finds the lowest set bit of a liveness mask.
+ *
+ * @param mask A nonzero mask.
+ * @return The index of the lowest set bit.
+ */
+static size_t lowest_bit(uint64_t mask) {
+    size_t bit = 0;
+    while (!((mask >> bit) & 1)) {
+        bit++;
+    }
+    return bit;
+}
@@ -0,0 +1,153 @@
+#include "linker.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * @brief Associates a parsed command with its position in the list.
+ */
+typedef struct {
+    Command *command;  // The parsed command.
+    size_t   index;    // Its position in the list.
+} CommandIndex;
+
+static int     compare_command_index(const void *lhs, const void *rhs);
+static int64_t index_of(Command *target, CommandIndex *table, size_t count);
+
+Command link_halt = {.type = CMD_RET, .branch_condition = BRANCH_NONE};
+
+size_t link_commands(Command *commands, LabelMap *map) {
+    size_t undefined = 0;
+
+    for (Command *cmd = commands; cmd; cmd = cmd->next) {
+        if (cmd->type != CMD_BRANCH && cmd->type != CMD_CALL) {
+            continue;
+        }
+
+        char  *label = cmd->val_a.str_val;
+        Entry *entry = get_label(map, label);
+        if (entry) {
+            cmd->target = entry->command;
+        } else if (cmd->type == CMD_BRANCH && strncmp(label, ".L", 2) == 0) {
+            cmd->target = LINK_HALT;
+        } else {
+            cmd->target = NULL;
+            fprintf(stderr, "Warning: undefined label: %s\n", label);
+            undefined++;
+        }
+    }
+
+    return undefined;
+}
+
+bool command_array_init(CommandArray *array, Command *commands) {
+    array->count = 0;
+    for (Command *cmd = commands; cmd; cmd = cmd->next) {
+        array->count++;
+    }
+
+    array->commands     = malloc((array->count + 1) * sizeof(Command *));
+    array->targets      = malloc((array->count + 1) * sizeof(int64_t));
+    CommandIndex *table = malloc((array->count + 1) * sizeof(CommandIndex));
+    if (!array->commands || !array->targets || !table) {
+        free(table);
+        command_array_free(array);
+        return false;
+    }
+
+    size_t i = 0;
+    for (Command *cmd = commands; cmd; cmd = cmd->next, i++) {
+        array->commands[i] = cmd;
+        table[i].command   = cmd;
+        table[i].index     = i;
+    }
+    qsort(table, array->count, sizeof(CommandIndex), compare_command_index);
+    for (i = 0; i < array->count; i++) {
+        array->targets[i] = index_of(array->commands[i]->target, table, array->count);
+    }
+
+    free(table);
+    return true;
+}
+
+size_t remove_commands(Command **commands, CommandArray *array, const bool *removed) {
+    Command  *head          = NULL;
+    Command **link          = &head;
+    Command  *kept          = LINK_HALT;
+    size_t    removed_count = 0;
+
+    // Walking backwards leaves each removed command's replacement in `target`
+    for (size_t i = array->count; i-- > 0;) {
+        if (removed[i]) {
+            array->commands[i]->target = kept;
+        } else {
+            kept = array->commands[i];
+        }
+    }
+    for (size_t i = 0; i < array->count; i++) {
+        Command *cmd    = array->commands[i];
+        int64_t  target = array->targets[i];
+        if (removed[i]) {
+            continue;
+        }
+        if (target >= 0 && removed[target]) {
+            cmd->target = array->commands[target]->target;
+        }
+        *link = cmd;
+        link  = &cmd->next;
+    }
+    *link = NULL;
+
+    for (size_t i = 0; i < array->count; i++) {
+        if (removed[i]) {
+            array->commands[i]->next = NULL;
+            free_command(array->commands[i]);
+            removed_count++;
+        }
+    }
+    *commands = head;
+    return removed_count;
+}
+
+void command_array_free(CommandArray *array) {
+    if (!array) {
+        return;
+    }
+
+    free(array->commands);
+    free(array->targets);
+    array->commands = NULL;
+    array->targets  = NULL;
+    array->count    = 0;
+}
+
+/**
+ * @brief Orders `CommandIndex` entries by command address.
+ *
+ * @param lhs Pointer to the first `CommandIndex`.
+ * @param rhs Pointer to the second `CommandIndex`.
+ * @return A negative, zero or positive value, as required by `qsort`.
+ */
+static int compare_command_index(const void *lhs, const void *rhs) {
+    const Command *a = ((const CommandIndex *) lhs)->command;
+    const Command *b = ((const CommandIndex *) rhs)->command;
+    return (a > b) - (a < b);
+}
+
+/**
+ * @brief Finds the position of a linked target in the list.
+ *
+ * @param target The command set by the linker, `LINK_HALT`, or NULL.
+ * @param table The command-to-index table, sorted by command address.
+ * @param count Number of entries in `table`.
+ * @return The index of `target`, or LINK_NO_INDEX if it is not in the list.
+ */
+static int64_t index_of(Command *target, CommandIndex *table, size_t count) {
+    if (!target) {
+        return LINK_NO_INDEX;
+    }
+
+    CommandIndex  key   = {target, 0};
+    CommandIndex *found = bsearch(&key, table, count, sizeof(CommandIndex), compare_command_index);
+    return found ? (int64_t) found->index : LINK_NO_INDEX;
+}
@@ -0,0 +1,264 @@
+#include "liveness.h"
+#include <stdlib.h>
+#include <string.h>
+#include "command_type.h"
+#include "mem.h"
+
+static void     mark_reachable(CommandArray *array, size_t start, bool enter_calls, bool *marked,
+                               size_t *worklist);
+static uint64_t live_before(CommandArray *array, size_t i, const uint64_t *live, uint64_t exit_live,
+                            bool top_level, bool in_function, bool calls_may_fail);
+static uint64_t variable_bit(int64_t index);
+
+bool liveness_compute(Liveness *liveness, CommandArray *array, bool dumps_state,
+                      bool calls_may_fail) {
+    size_t  count         = array->count;
+    size_t *worklist      = malloc((count + 1) * sizeof(size_t));
+    liveness->reached     = calloc(count + 1, sizeof(bool));
+    liveness->top_level   = calloc(count + 1, sizeof(bool));
+    liveness->in_function = calloc(count + 1, sizeof(bool));
+    liveness->live        = calloc(count + 1, sizeof(uint64_t));
+    if (!worklist || !liveness->reached || !liveness->top_level || !liveness->in_function ||
+        !liveness->live) {
+        free(worklist);
+        liveness_free(liveness);
+        return false;
+    }
+
+    // Code reached without entering a call may end the program when it returns
+    mark_reachable(array, 0, false, liveness->top_level, worklist);
+    for (size_t i = 0; i < count; i++) {
+        if (liveness->top_level[i] && array->commands[i]->type == CMD_CALL && array->targets[i] >= 0) {
+            mark_reachable(array, (size_t) array->targets[i], true, liveness->in_function, worklist);
+        }
+    }
+    for (size_t i = 0; i < count; i++) {
+        liveness->reached[i] = liveness->top_level[i] || liveness->in_function[i];
+    }
+    free(worklist);
+
+    // Both ending the program and failing are followed by the dump
+    uint64_t  exit_live = dumps_state ? LIVE_ALL : 0;
+    uint64_t *live      = liveness->live;
+    live[count]         = exit_live;
+    bool changed        = true;
+    while (changed) {
+        changed = false;
+        for (size_t i = count; i-- > 0;) {
+            if (!liveness->reached[i]) {
+                continue;
+            }
+            uint64_t in = live_before(array, i, live, exit_live, liveness->top_level[i],
+                                      liveness->in_function[i], calls_may_fail);
+            if (in != live[i]) {
+                live[i] = in;
+                changed = true;
+            }
+        }
+    }
+    return true;
+}
+
+void liveness_free(Liveness *liveness) {
+    if (!liveness) {
+        return;
+    }
+
+    free(liveness->reached);
+    free(liveness->top_level);
+    free(liveness->in_function);
+    free(liveness->live);
+    liveness->reached     = NULL;
+    liveness->top_level   = NULL;
+    liveness->in_function = NULL;
+    liveness->live        = NULL;
+}
+
+bool command_may_fail(const Command *cmd) {
+    int64_t b = cmd->val_b.num_val;
+    switch (cmd->type) {
+        case CMD_MOV:
+        case CMD_ADD:
+        case CMD_SUB:
+        case CMD_AND:
+        case CMD_EOR:
+        case CMD_ORR:
+        case CMD_CMP:
+        case CMD_CMP_U:
+            return false;
+        case CMD_LSL:
+        case CMD_LSR:
+        case CMD_ASR:
+            return !cmd->is_b_immediate || b < 0 || b > 63;
+        case CMD_LOAD:
+        case CMD_STORE: {
+            int64_t bytes = cmd->val_a.num_val;
+            if (bytes != 1 && bytes != 2 && bytes != 4 && bytes != 8) {
+                return true;
+            }
+            return !cmd->is_b_immediate || b < 0 || b > MEM_CAPACITY - bytes;
+        }
+        case CMD_PUT: {
+            int64_t length = (int64_t) strlen(cmd->val_a.str_val) + 1;
+            return !cmd->is_b_immediate || b < 0 || b > MEM_CAPACITY - length;
+        }
+        case CMD_PRINT:
+            return cmd->val_b.base != 'd' && cmd->val_b.base != 'x' && cmd->val_b.base != 'b';
+        default:
+            return true;
+    }
+}
+
+uint64_t command_reads(const Command *cmd) {
+    uint64_t a = cmd->is_a_immediate || cmd->is_a_string ? 0 : variable_bit(cmd->val_a.num_val);
+    uint64_t b = cmd->is_b_immediate ? 0 : variable_bit(cmd->val_b.num_val);
+    switch (cmd->type) {
+        case CMD_MOV:
+        case CMD_PRINT:
+            return a;
+        case CMD_LOAD:
+        case CMD_PUT:
+            return b;
+        case CMD_STORE:
+            return variable_bit(cmd->destination.num_val) | b;
+        default:
+            return a | b;
+    }
+}
+
+uint64_t command_writes(const Command *cmd) {
+    switch (cmd->type) {
+        case CMD_CMP:
+        case CMD_CMP_U:
+            return LIVE_FLAGS;
+        case CMD_MOV:
+        case CMD_ADD:
+        case CMD_SUB:
+        case CMD_AND:
+        case CMD_EOR:
+        case CMD_ORR:
+        case CMD_LSL:
+        case CMD_LSR:
+        case CMD_ASR:
+        case CMD_LOAD:
+            return variable_bit(cmd->destination.num_val);
+        default:
+            return 0;
+    }
+}
+
+/**
+ * @brief Marks every command reachable from a starting command.
+ *
+ * @param array The command list.
+ * @param start Index of the first command to mark.
+ * @param enter_calls Whether to follow calls into their targets, as well as
+ * to the command they return to.
+ * @param marked Flags to set; commands already marked are not followed again.
+ * @param worklist Scratch space for `array->count` indices.
+ */
+static void mark_reachable(CommandArray *array, size_t start, bool enter_calls, bool *marked,
+                           size_t *worklist) {
+    if (start >= array->count || marked[start]) {
+        return;
+    }
+
+    size_t pending      = 0;
+    marked[start]       = true;
+    worklist[pending++] = start;
+    while (pending > 0) {
+        size_t   i      = worklist[--pending];
+        Command *cmd    = array->commands[i];
+        int64_t  target = array->targets[i];
+        int64_t  next[2];
+        size_t   num_next = 0;
+
+        switch (cmd->type) {
+            case CMD_RET:
+                break;
+            case CMD_BRANCH:
+                next[num_next++] = target;
+                if (cmd->branch_condition != BRANCH_ALWAYS) {
+                    next[num_next++] = (int64_t) i + 1;
+                }
+                break;
+            case CMD_CALL:
+                if (enter_calls) {
+                    next[num_next++] = target;
+                }
+                next[num_next++] = (int64_t) i + 1;
+                break;
+            default:
+                next[num_next++] = (int64_t) i + 1;
+                break;
+        }
+
+        for (size_t k = 0; k < num_next; k++) {
+            if (next[k] >= 0 && (size_t) next[k] < array->count && !marked[next[k]]) {
+                marked[next[k]]     = true;
+                worklist[pending++] = (size_t) next[k];
+            }
+        }
+    }
+}
+
+/**
+ * @brief Computes what is live on entry to a command.
+ *
+ * @param array The command list.
+ * @param i Index of the command.
+ * @param live What is live on entry to each command, with `live[count]` for
+ * falling off the end.
+ * @param exit_live What the dump reads when the program ends or fails.
+ * @param top_level Whether the command can run outside of any call.
+ * @param in_function Whether the command can run inside a call.
+ * @param calls_may_fail Whether a call can fail, ending the program.
+ * @return A mask of the live variables, with LIVE_FLAGS for the flags.
+ */
+static uint64_t live_before(CommandArray *array, size_t i, const uint64_t *live, uint64_t exit_live,
+                            bool top_level, bool in_function, bool calls_may_fail) {
+    Command *cmd    = array->commands[i];
+    int64_t  target = array->targets[i];
+    uint64_t in;
+
+    switch (cmd->type) {
+        case CMD_RET:
+            in = (top_level ? exit_live : 0) | (in_function ? LIVE_AT_RET : 0);
+            break;
+        case CMD_BRANCH:
+            // Halting and undefined labels both end the program
+            in = (target >= 0) ? live[target] : exit_live;
+            if (cmd->branch_condition != BRANCH_ALWAYS) {
+                in |= live[i + 1] | LIVE_FLAGS;
+            }
+            break;
+        case CMD_CALL:
+            if (target < 0) {
+                in = exit_live;
+                break;
+            }
+            // The return restores everything but x0
+            in = (live[i + 1] & ~(uint64_t) 1) | live[target];
+            if (calls_may_fail) {
+                in |= exit_live;
+            }
+            break;
+        default:
+            in = (live[i + 1] & ~command_writes(cmd)) | command_reads(cmd);
+            if (command_may_fail(cmd)) {
+                in |= exit_live;
+            }
+            break;
+    }
+    return in;
+}
+
+/**
+ * @brief Converts a variable index into a liveness mask.
+ *
+ * @param index The variable index.
+ * @return The variable's bit, or 0 if `index` is not a variable.
+ */
+static uint64_t variable_bit(int64_t index) {
+    return (index >= 0 && index < NUM_VARIABLES) ? (uint64_t) 1 << index : 0;
+}
@@ -19,7 +19,7 @@ static bool validate_bytes(size_t bytes) {
 }
 
 bool mem_load(uint8_t *destination, size_t offset, size_t bytes) {
-    if (!validate_bytes(bytes) || !destination || offset + bytes > MEM_CAPACITY) {
+    if (!validate_bytes(bytes) || !destination || offset > MEM_CAPACITY - bytes) {
         return false;
     }
 
@@ -28,7 +28,7 @@ bool mem_load(uint8_t *destination, size_t offset, size_t bytes) {
 }
 
 bool mem_store(uint8_t *source, size_t offset, size_t bytes) {
-    if (!validate_bytes(bytes) || !source || offset + bytes > MEM_CAPACITY) {
+    if (!validate_bytes(bytes) || !source || offset > MEM_CAPACITY - bytes) {
         return false;
     }
 
@@ -36,6 +36,10 @@ bool mem_store(uint8_t *source, size_t offset, size_t bytes) {
     return true;
 }
 
+uint8_t *mem_image(void) {
+    return mem;
+}
+
 void mem_print(void) {
     printf("Memory state:\n");
 
@@ -0,0 +1,115 @@
+#include "memo.h"
+#include <stdlib.h>
+
+static uint32_t memo_hash(const PureFunction *fn, uint8_t function, const int64_t *variables,
+                          uint8_t flags);
+static bool     memo_matches(const MemoEntry *entry, const PureFunction *fn, uint8_t function,
+                             const int64_t *variables, uint8_t flags);
+
+void memo_init(MemoTable *memo) {
+    memo->entries   = NULL;
+    memo->hits      = 0;
+    memo->misses    = 0;
+    memo->evictions = 0;
+}
+
+void memo_free(MemoTable *memo) {
+    free(memo->entries);
+    memo->entries = NULL;
+}
+
+bool memo_lookup(MemoTable *memo, Program *prog, uint8_t function, const int64_t *variables,
+                 uint8_t flags, size_t depth, uint32_t *slot, int64_t *result,
+                 uint8_t *flags_out) {
+    const PureFunction *fn = &prog->pure[function];
+    if (!fn->reads_flags) {
+        flags = 0;
+    }
+    if (!memo->entries) {
+        memo->entries = calloc(MEMO_CAPACITY, sizeof(MemoEntry));
+    }
+    if (slot) {
+        *slot = MEMO_NONE;
+    }
+    if (!memo->entries) {
+        memo->misses++;
+        return false;
+    }
+
+    uint32_t   index = memo_hash(fn, function, variables, flags);
+    MemoEntry *entry = &memo->entries[index];
+    if (entry->state == MEMO_READY && memo_matches(entry, fn, function, variables, flags)) {
+        memo->hits++;
+        *result    = entry->result;
+        *flags_out = entry->flags_out;
+        return true;
+    }
+
+    memo->misses++;
+    if (!slot) {
+        return false;
+    }
+    if (entry->state == MEMO_READY) {
+        memo->evictions++;
+    }
+    entry->state    = MEMO_PENDING;
+    entry->function = function;
+    entry->flags_in = flags;
+    entry->depth    = (uint32_t) depth;
+    for (uint8_t i = 0; i < fn->num_inputs; i++) {
+        entry->inputs[i] = variables[fn->inputs[i]];
+    }
+    *slot = index;
+    return false;
+}
+
+void memo_fill(MemoTable *memo, uint32_t slot, size_t depth, int64_t result, uint8_t flags) {
+    MemoEntry *entry = &memo->entries[slot];
+    if (entry->state != MEMO_PENDING || entry->depth != (uint32_t) depth) {
+        return;  // Evicted while the call was running
+    }
+    entry->state     = MEMO_READY;
+    entry->result    = result;
+    entry->flags_out = flags;
+}
+
+/**
+ * @brief Hashes a call to the index of its entry.
+ *
+ * @param fn The function being called.
+ * @param function Index of the function.
+ * @param variables The variables at the time of the call.
+ * @param flags The flag word, or 0 if the function does not read it.
+ * @return The index of the call's entry.
+ */
+static uint32_t memo_hash(const PureFunction *fn, uint8_t function, const int64_t *variables,
+                          uint8_t flags) {
+    uint64_t hash = ((uint64_t) function << 8 | flags) * 0x9E3779B97F4A7C15u;
+    for (uint8_t i = 0; i < fn->num_inputs; i++) {
+        hash = (hash ^ (uint64_t) variables[fn->inputs[i]]) * 0x9E3779B97F4A7C15u;
+    }
+    return (uint32_t) (hash >> 32) & (MEMO_CAPACITY - 1);
+}
+
+/**
+ * @brief Determines whether an entry was recorded for the given call.
+ *
+ * @param entry The entry to check, which must hold a result.
+ * @param fn The function being called.
+ * @param function Index of the function.
+ * @param variables The variables at the time of the call.
+ * @param flags The flag word, or 0 if the function does not read it.
+ * @return True if the entry's function and inputs match the call.
+ */
+static bool memo_matches(const MemoEntry *entry, const PureFunction *fn, uint8_t function,
+                         const int64_t *variables, uint8_t flags) {
+    if (entry->function != function || entry->flags_in != flags) {
+        return false;
+    }
+    for (uint8_t i = 0; i < fn->num_inputs; i++) {
+        if (entry->inputs[i] != variables[fn->inputs[i]]) {
+            return false;
+        }
+    }
+    return true;
+}
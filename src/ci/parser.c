@@ -98,6 +98,7 @@ static Command *create_command(CommandType type) {
     cmd->is_b_immediate   = false;
     cmd->is_b_string      = false;
     cmd->branch_condition = BRANCH_NONE;
+    cmd->target           = NULL;
     return cmd;
 }
 
@@ -0,0 +1,443 @@
+#include "peephole.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "command_type.h"
+#include "constprop.h"
+#include "linker.h"
+#include "liveness.h"
+
+#define NO_COMMAND ((size_t) -1)  // No next command in the same block.
+
+/**
+ * @brief The commands a pass looks at, and what it has changed so far.
+ */
+typedef struct {
+    CommandArray *array;      // The commands, with their targets as indices.
+    ConstState   *states;     // Known variable values on entry to each command.
+    bool         *is_target;  // Whether each command is jumped to.
+    bool         *removed;    // Commands dropped by a rule.
+    bool         *touched;    // Commands rewritten by a rule, whose state is stale.
+} Window;
+
+/**
+ * @brief A rule's rewrite, tried on the window starting at command `i`.
+ *
+ * Returns true if it applied. A rule that rewrites a command marks it as
+ * touched; one that drops a command marks it as removed.
+ */
+typedef bool (*RuleFunction)(Window *w, size_t i);
+
+/**
+ * @brief A named entry of the rule table.
+ */
+typedef struct {
+    const char  *name;   // The name reported by `print_peephole_hits`.
+    RuleFunction apply;  // The rewrite.
+} RuleEntry;
+
+static size_t peephole_pass(Command **commands, size_t *hits);
+static bool   redundant_move(Window *w, size_t i);
+static bool   zero_operand(Window *w, size_t i);
+static bool   add_chain(Window *w, size_t i);
+static bool   shift_chain(Window *w, size_t i);
+static bool   redundant_mask(Window *w, size_t i);
+static bool   dead_compare(Window *w, size_t i);
+static size_t next_in_block(Window *w, size_t i);
+static bool   has_value(Window *w, size_t i, int64_t index, int64_t value);
+static bool   is_variable_a(const Command *cmd);
+static void   make_copy(Window *w, size_t i, int64_t source);
+static void   make_move(Window *w, size_t i, int64_t value);
+
+// Rules are tried in order; adding one only takes a function and an entry here
+static const RuleEntry RULES[PEEPHOLE_NUM_RULES] = {
+    [PEEPHOLE_REDUNDANT_MOVE] = {"redundant-move", redundant_move},
+    [PEEPHOLE_ZERO_OPERAND]   = {"zero-operand", zero_operand},
+    [PEEPHOLE_ADD_CHAIN]      = {"add-chain", add_chain},
+    [PEEPHOLE_SHIFT_CHAIN]    = {"shift-chain", shift_chain},
+    [PEEPHOLE_REDUNDANT_MASK] = {"redundant-mask", redundant_mask},
+    [PEEPHOLE_DEAD_COMPARE]   = {"dead-compare", dead_compare},
+};
+
+size_t peephole_optimize(Command **commands, size_t *hits) {
+    if (!commands || !hits) {
+        return 0;
+    }
+
+    // Rewritten commands are only looked at again in a later pass
+    size_t applied = 0;
+    size_t pass;
+    do {
+        pass = peephole_pass(commands, hits);
+        applied += pass;
+    } while (pass > 0);
+    return applied;
+}
+
+void print_peephole_hits(const size_t *hits) {
+    if (!hits) {
+        return;
+    }
+
+    printf("Peephole rule hits:\n");
+    for (size_t r = 0; r < PEEPHOLE_NUM_RULES; r++) {
+        printf("%s: %zu\n", RULES[r].name, hits[r]);
+    }
+    printf("\n");
+}
+
+/**
+ * @brief Tries every rule once on every command.
+ *
+ * @param commands Pointer to the head of the linked list.
+ * @param hits The per-rule counters to increase.
+ * @return The number of times any rule applied.
+ */
+static size_t peephole_pass(Command **commands, size_t *hits) {
+    CommandArray array;
+    if (!*commands || !command_array_init(&array, *commands)) {
+        return 0;
+    }
+
+    size_t count = array.count;
+    Window w     = {&array, constants_compute(&array), calloc(count + 1, sizeof(bool)),
+                    calloc(count + 1, sizeof(bool)), calloc(count + 1, sizeof(bool))};
+    size_t applied = 0;
+    if (!w.states || !w.is_target || !w.removed || !w.touched) {
+        goto done;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        if (array.targets[i] >= 0) {
+            w.is_target[array.targets[i]] = true;
+        }
+    }
+    for (size_t i = 0; i < count; i++) {
+        if (w.removed[i] || w.touched[i] || !w.states[i].reached) {
+            continue;
+        }
+        for (size_t r = 0; r < PEEPHOLE_NUM_RULES; r++) {
+            if (RULES[r].apply(&w, i)) {
+                hits[r]++;
+                applied++;
+                break;
+            }
+        }
+    }
+    remove_commands(commands, &array, w.removed);
+
+done:
+    command_array_free(&array);
+    free(w.states);
+    free(w.is_target);
+    free(w.removed);
+    free(w.touched);
+    return applied;
+}
+
+/**
+ * @brief Drops a command that writes its destination's own value back, such
+ * as `add x1 x1 0` or `orr x1 x1 xZ` with xZ zero.
+ */
+static bool redundant_move(Window *w, size_t i) {
+    Command *cmd  = w->array->commands[i];
+    int64_t  dest = cmd->destination.num_val;
+    int64_t  b    = cmd->val_b.num_val;
+    if (!is_variable_a(cmd) || cmd->val_a.num_val != dest) {
+        return false;
+    }
+
+    bool zero_b = cmd->is_b_immediate ? b == 0 : has_value(w, i, b, 0);
+    bool same   = false;
+    switch (cmd->type) {
+        case CMD_ADD:
+        case CMD_SUB:
+        case CMD_LSL:
+        case CMD_LSR:
+        case CMD_ASR:
+            same = zero_b;
+            break;
+        case CMD_ORR:
+            same = zero_b || (!cmd->is_b_immediate && b == dest);
+            break;
+        case CMD_EOR:
+            same = zero_b;
+            break;
+        case CMD_AND:
+            same = !cmd->is_b_immediate && (has_value(w, i, b, -1) || b == dest);
+            break;
+        default:
+            break;
+    }
+    if (same) {
+        w->removed[i] = true;
+    }
+    return same;
+}
+
+/**
+ * @brief Turns an operation with an operand known to be zero, or all ones for
+ * `and`, into a copy of the other operand or a move of zero.
+ */
+static bool zero_operand(Window *w, size_t i) {
+    Command *cmd = w->array->commands[i];
+    int64_t  a   = cmd->val_a.num_val;
+    int64_t  b   = cmd->val_b.num_val;
+    if (!is_variable_a(cmd) || cmd->is_b_immediate) {
+        return false;
+    }
+
+    switch (cmd->type) {
+        case CMD_ADD:
+        case CMD_ORR:
+        case CMD_EOR:
+            if (has_value(w, i, b, 0)) {
+                make_copy(w, i, a);
+                return true;
+            }
+            if (has_value(w, i, a, 0)) {
+                make_copy(w, i, b);
+                return true;
+            }
+            return false;
+        case CMD_SUB:
+        case CMD_LSL:
+        case CMD_LSR:
+        case CMD_ASR:
+            if (has_value(w, i, b, 0)) {
+                make_copy(w, i, a);
+                return true;
+            }
+            return false;
+        case CMD_AND:
+            if (has_value(w, i, a, 0) || has_value(w, i, b, 0)) {
+                make_move(w, i, 0);
+                return true;
+            }
+            if (has_value(w, i, b, -1)) {
+                make_copy(w, i, a);
+                return true;
+            }
+            if (has_value(w, i, a, -1)) {
+                make_copy(w, i, b);
+                return true;
+            }
+            return false;
+        default:
+            return false;
+    }
+}
+
+/**
+ * @brief Merges `add xD xS i; add xD xD j` into `add xD xS i+j`, for any mix
+ * of immediate adds and subtracts.
+ */
+static bool add_chain(Window *w, size_t i) {
+    Command *first = w->array->commands[i];
+    size_t   j     = next_in_block(w, i);
+    if ((first->type != CMD_ADD && first->type != CMD_SUB) || !first->is_b_immediate ||
+        j == NO_COMMAND) {
+        return false;
+    }
+    Command *second = w->array->commands[j];
+    int64_t  dest   = first->destination.num_val;
+    if ((second->type != CMD_ADD && second->type != CMD_SUB) || !second->is_b_immediate ||
+        second->destination.num_val != dest || second->val_a.num_val != dest) {
+        return false;
+    }
+
+    uint64_t offset = (first->type == CMD_ADD) ? (uint64_t) first->val_b.num_val
+                                                : -(uint64_t) first->val_b.num_val;
+    offset += (second->type == CMD_ADD) ? (uint64_t) second->val_b.num_val
+                                        : -(uint64_t) second->val_b.num_val;
+    second->type          = CMD_ADD;
+    second->val_a.num_val = first->val_a.num_val;
+    second->val_b.num_val = (int64_t) offset;
+    w->removed[i]         = true;
+    w->touched[j]         = true;
+    return true;
+}
+
+/**
+ * @brief Merges two immediate shifts of the same kind of one variable, such as
+ * `lsl xD xS 3; lsl xD xD 2` into `lsl xD xS 5`.
+ */
+static bool shift_chain(Window *w, size_t i) {
+    Command *first = w->array->commands[i];
+    size_t   j     = next_in_block(w, i);
+    if ((first->type != CMD_LSL && first->type != CMD_LSR && first->type != CMD_ASR) ||
+        command_may_fail(first) || j == NO_COMMAND) {
+        return false;
+    }
+    Command *second = w->array->commands[j];
+    int64_t  dest   = first->destination.num_val;
+    if (second->type != first->type || command_may_fail(second) ||
+        second->destination.num_val != dest || second->val_a.num_val != dest) {
+        return false;
+    }
+
+    // Shifting everything out leaves zero, or the sign for asr
+    int64_t amount = first->val_b.num_val + second->val_b.num_val;
+    if (amount <= 63) {
+        second->val_a.num_val = first->val_a.num_val;
+        second->val_b.num_val = amount;
+        w->touched[j]         = true;
+    } else if (second->type == CMD_ASR) {
+        second->val_a.num_val = first->val_a.num_val;
+        second->val_b.num_val = 63;
+        w->touched[j]         = true;
+    } else {
+        make_move(w, j, 0);
+    }
+    w->removed[i] = true;
+    return true;
+}
+
+/**
+ * @brief Drops an `and` after an immediate shift of the same variable when
+ * the mask keeps every bit the shift can leave set.
+ */
+static bool redundant_mask(Window *w, size_t i) {
+    Command *shift = w->array->commands[i];
+    size_t   j     = next_in_block(w, i);
+    if ((shift->type != CMD_LSL && shift->type != CMD_LSR) || command_may_fail(shift) ||
+        j == NO_COMMAND) {
+        return false;
+    }
+    Command *and_cmd = w->array->commands[j];
+    int64_t  dest    = shift->destination.num_val;
+    if (and_cmd->type != CMD_AND || and_cmd->destination.num_val != dest) {
+        return false;
+    }
+
+    int64_t mask_var;
+    if (and_cmd->val_a.num_val == dest) {
+        mask_var = and_cmd->val_b.num_val;
+    } else if (and_cmd->val_b.num_val == dest) {
+        mask_var = and_cmd->val_a.num_val;
+    } else {
+        return false;
+    }
+    int64_t mask;
+    if (mask_var == dest || !constant_value(&w->states[j], mask_var, &mask)) {
+        return false;
+    }
+
+    // lsr leaves the top bits clear, lsl the bottom ones
+    uint64_t amount = (uint64_t) shift->val_b.num_val;
+    uint64_t kept   = (amount == 0) ? UINT64_MAX
+                      : (shift->type == CMD_LSR) ? UINT64_MAX >> amount
+                                                 : UINT64_MAX << amount;
+    if (((uint64_t) mask & kept) != kept) {
+        return false;
+    }
+    w->removed[j] = true;
+    return true;
+}
+
+/**
+ * @brief Drops a compare whose flags are replaced by another compare before
+ * any branch, call or return, or any command that may fail, can see them.
+ */
+static bool dead_compare(Window *w, size_t i) {
+    Command *cmd = w->array->commands[i];
+    if (cmd->type != CMD_CMP && cmd->type != CMD_CMP_U) {
+        return false;
+    }
+
+    for (size_t j = next_in_block(w, i); j != NO_COMMAND; j = next_in_block(w, j)) {
+        Command *next = w->array->commands[j];
+        if (next->type == CMD_CMP || next->type == CMD_CMP_U) {
+            w->removed[i] = true;
+            return true;
+        }
+        if (command_may_fail(next)) {
+            return false;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Finds the command that runs right after another in the same block.
+ *
+ * @param w The window.
+ * @param i Index of the command.
+ * @return The index of the next command that is not dropped, or NO_COMMAND
+ * if `i` is control flow, or the next command is jumped to or was rewritten.
+ */
+static size_t next_in_block(Window *w, size_t i) {
+    CommandType type = w->array->commands[i]->type;
+    if (type == CMD_BRANCH || type == CMD_CALL || type == CMD_RET) {
+        return NO_COMMAND;
+    }
+
+    size_t j = i + 1;
+    while (j < w->array->count && w->removed[j] && !w->is_target[j]) {
+        j++;
+    }
+    if (j >= w->array->count || w->is_target[j] || w->touched[j] || w->removed[j]) {
+        return NO_COMMAND;
+    }
+    return j;
+}
+
+/**
+ * @brief Determines whether a variable is known to hold a value before a
+ * command runs.
+ *
+ * @param w The window.
+ * @param i Index of the command.
+ * @param index The variable index.
+ * @param value The value to check for.
+ * @return True if the variable always holds `value` on entry to command `i`.
+ */
+static bool has_value(Window *w, size_t i, int64_t index, int64_t value) {
+    int64_t known;
+    return constant_value(&w->states[i], index, &known) && known == value;
+}
+
+/**
+ * @brief Determines whether a command's first operand is a variable.
+ *
+ * @param cmd The command.
+ * @return True if `val_a` holds a variable index.
+ */
+static bool is_variable_a(const Command *cmd) {
+    return !cmd->is_a_immediate && !cmd->is_a_string;
+}
+
+/**
+ * @brief Rewrites a command into a copy of a variable into its destination.
+ *
+ * @param w The window.
+ * @param i Index of the command.
+ * @param source The variable to copy.
+ */
+static void make_copy(Window *w, size_t i, int64_t source) {
+    Command *cmd        = w->array->commands[i];
+    cmd->type           = CMD_ADD;
+    cmd->val_a.num_val  = source;
+    cmd->is_a_immediate = false;
+    cmd->val_b.num_val  = 0;
+    cmd->is_b_immediate = true;
+    w->touched[i]       = true;
+}
+
+/**
+ * @brief Rewrites a command into a move of an immediate into its destination.
+ *
+ * @param w The window.
+ * @param i Index of the command.
+ * @param value The immediate to move.
+ */
+static void make_move(Window *w, size_t i, int64_t value) {
+    Command *cmd        = w->array->commands[i];
+    cmd->type           = CMD_MOV;
+    cmd->val_a.num_val  = value;
+    cmd->is_a_immediate = true;
+    cmd->val_b.num_val  = 0;
+    cmd->is_b_immediate = false;
+    w->touched[i]       = true;
+}
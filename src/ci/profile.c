@@ -0,0 +1,301 @@
+#include "profile.h"
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include "command_type.h"
+#include "specialize.h"
+
+#define PROFILE_LINE_SIZE 256  // Longest line `profile_read` accepts.
+
+static bool add_branch(Profile *profile, size_t *capacity, size_t index, uint64_t taken,
+                       uint64_t not_taken);
+static bool add_sequence(Profile *profile, size_t *capacity, const uint8_t *forms, uint8_t length,
+                         uint64_t count);
+static int  compare_sequence_count(const void *a, const void *b);
+static bool parse_count(const char *token, uint64_t *count);
+static bool parse_form(const char *name, uint8_t *form);
+
+// Names of the forms an instruction can have after `program_specialize`
+static const char *const FORM_NAMES[] = {
+    [CMD_ADD] = "add",         [CMD_AND] = "and",         [CMD_ASR] = "asr",
+    [CMD_BRANCH] = "b",        [CMD_CALL] = "call",       [CMD_CMP] = "cmp",
+    [CMD_CMP_U] = "cmp_u",     [CMD_ERR] = "err",         [CMD_EOR] = "eor",
+    [CMD_LOAD] = "load",       [CMD_LSL] = "lsl",         [CMD_LSR] = "lsr",
+    [CMD_MOV] = "mov",         [CMD_ORR] = "orr",         [CMD_PRINT] = "print",
+    [CMD_PUT] = "put",         [CMD_RET] = "ret",         [CMD_STORE] = "store",
+    [CMD_SUB] = "sub",         [CMD_ADD_RRR] = "add_rrr", [CMD_ADD_RRI] = "add_rri",
+    [CMD_SUB_RRR] = "sub_rrr", [CMD_SUB_RRI] = "sub_rri", [CMD_CMP_RR] = "cmp_rr",
+    [CMD_CMP_RI] = "cmp_ri",   [CMD_CMP_U_RR] = "cmp_u_rr", [CMD_CMP_U_RI] = "cmp_u_ri",
+    [CMD_LSL_RRI] = "lsl_rri", [CMD_LSR_RRI] = "lsr_rri", [CMD_ASR_RRI] = "asr_rri",
+    [CMD_LOAD_RII] = "load_rii", [CMD_LOAD_RIR] = "load_rir", [CMD_STORE_RII] = "store_rii",
+    [CMD_STORE_RRI] = "store_rri",
+};
+
+#define NUM_FORM_NAMES (sizeof(FORM_NAMES) / sizeof(FORM_NAMES[0]))
+
+bool profiler_init(Profiler *profiler, Program *prog) {
+    memset(profiler, 0, sizeof(*profiler));
+    profiler->length    = prog->length;
+    profiler->forms     = malloc(prog->length + 1);
+    profiler->pairs     = calloc(prog->length + 1, sizeof(uint64_t));
+    profiler->triples   = calloc(prog->length + 1, sizeof(uint64_t));
+    profiler->taken     = calloc(prog->length + 1, sizeof(uint64_t));
+    profiler->not_taken = calloc(prog->length + 1, sizeof(uint64_t));
+
+    // Specialize a copy of the code to learn the form of each instruction
+    Program copy = *prog;
+    copy.code    = malloc((prog->length + 1) * sizeof(Instruction));
+    if (!profiler->forms || !profiler->pairs || !profiler->triples || !profiler->taken ||
+        !profiler->not_taken || !copy.code) {
+        free(copy.code);
+        profiler_free(profiler);
+        return false;
+    }
+    memcpy(copy.code, prog->code, (prog->length + 1) * sizeof(Instruction));
+    program_specialize(&copy);
+    for (size_t pc = 0; pc <= prog->length; pc++) {
+        profiler->forms[pc] = copy.code[pc].type;
+    }
+    free(copy.code);
+    return true;
+}
+
+void profiler_free(Profiler *profiler) {
+    free(profiler->forms);
+    free(profiler->pairs);
+    free(profiler->triples);
+    free(profiler->taken);
+    free(profiler->not_taken);
+    profiler->forms     = NULL;
+    profiler->pairs     = NULL;
+    profiler->triples   = NULL;
+    profiler->taken     = NULL;
+    profiler->not_taken = NULL;
+}
+
+bool profiler_summarize(const Profiler *profiler, Profile *profile) {
+    memset(profile, 0, sizeof(*profile));
+    profile->length        = profiler->length;
+    size_t capacity        = 0;
+    size_t branch_capacity = 0;
+    for (size_t pc = 0; pc < profiler->length; pc++) {
+        if ((profiler->taken[pc] || profiler->not_taken[pc]) &&
+            !add_branch(profile, &branch_capacity, pc, profiler->taken[pc],
+                        profiler->not_taken[pc])) {
+            profile_free(profile);
+            return false;
+        }
+    }
+    for (size_t pc = 1; pc < profiler->length; pc++) {
+        if (profiler->pairs[pc] &&
+            !add_sequence(profile, &capacity, &profiler->forms[pc - 1], 2, profiler->pairs[pc])) {
+            profile_free(profile);
+            return false;
+        }
+        if (pc >= 2 && profiler->triples[pc] &&
+            !add_sequence(profile, &capacity, &profiler->forms[pc - 2], 3, profiler->triples[pc])) {
+            profile_free(profile);
+            return false;
+        }
+    }
+    if (profile->num_sequences) {
+        qsort(profile->sequences, profile->num_sequences, sizeof(ProfileSequence),
+              compare_sequence_count);
+    }
+    return true;
+}
+
+bool profile_write(const Profile *profile, FILE *out) {
+    fprintf(out, "# Instructions profiled, branches by index with their taken and not taken\n");
+    fprintf(out, "# counts, then instruction sequences by times run: count, then each form\n");
+    fprintf(out, "instructions %zu\n", profile->length);
+    for (size_t i = 0; i < profile->num_branches; i++) {
+        const ProfileBranch *branch = &profile->branches[i];
+        fprintf(out, "branch %zu %" PRIu64 " %" PRIu64 "\n", branch->index, branch->taken,
+                branch->not_taken);
+    }
+    for (size_t i = 0; i < profile->num_sequences; i++) {
+        const ProfileSequence *sequence = &profile->sequences[i];
+        fprintf(out, "%" PRIu64, sequence->count);
+        for (uint8_t k = 0; k < sequence->length; k++) {
+            fprintf(out, " %s", FORM_NAMES[sequence->forms[k]]);
+        }
+        fprintf(out, "\n");
+    }
+    return !ferror(out);
+}
+
+bool profile_read(Profile *profile, FILE *in) {
+    memset(profile, 0, sizeof(*profile));
+    size_t capacity        = 0;
+    size_t branch_capacity = 0;
+    char   line[PROFILE_LINE_SIZE];
+    while (fgets(line, sizeof(line), in)) {
+        char *token = strtok(line, " \t\r\n");
+        if (!token || token[0] == '#') {
+            continue;
+        }
+        if (strcmp(token, "instructions") == 0 || strcmp(token, "branch") == 0) {
+            bool     is_branch = token[0] == 'b';
+            uint64_t values[3];
+            size_t   num_values = 0;
+            bool     valid      = true;
+            while (valid && (token = strtok(NULL, " \t\r\n"))) {
+                valid = num_values < 3 && parse_count(token, &values[num_values++]);
+            }
+            valid = valid && num_values == (is_branch ? 3u : 1u);
+            if (valid && !is_branch) {
+                profile->length = (size_t) values[0];
+            }
+            if (!valid || (is_branch && !add_branch(profile, &branch_capacity, (size_t) values[0],
+                                                    values[1], values[2]))) {
+                profile_free(profile);
+                return false;
+            }
+            continue;
+        }
+
+        uint64_t count;
+        uint8_t  forms[PROFILE_MAX_LENGTH + 1];
+        uint8_t  length = 0;
+        bool     valid  = parse_count(token, &count);
+        while (valid && (token = strtok(NULL, " \t\r\n"))) {
+            valid = length < PROFILE_MAX_LENGTH && parse_form(token, &forms[length++]);
+        }
+        if (!valid || length < 2 || !add_sequence(profile, &capacity, forms, length, count)) {
+            profile_free(profile);
+            return false;
+        }
+    }
+    if (profile->num_sequences) {
+        qsort(profile->sequences, profile->num_sequences, sizeof(ProfileSequence),
+              compare_sequence_count);
+    }
+    return !ferror(in);
+}
+
+void profile_free(Profile *profile) {
+    free(profile->sequences);
+    free(profile->branches);
+    profile->sequences     = NULL;
+    profile->num_sequences = 0;
+    profile->branches      = NULL;
+    profile->num_branches  = 0;
+}
+
+/**
+ * @brief Adds the direction counts of a branch to a profile.
+ *
+ * @param profile The profile to add to.
+ * @param capacity Number of entries allocated for `profile->branches`.
+ * @param index Index of the branch.
+ * @param taken Times the branch jumped to its target.
+ * @param not_taken Times it fell through.
+ * @return false if memory could not be allocated, true otherwise.
+ */
+static bool add_branch(Profile *profile, size_t *capacity, size_t index, uint64_t taken,
+                       uint64_t not_taken) {
+    if (profile->num_branches == *capacity) {
+        size_t         new_capacity = *capacity ? *capacity * 2 : 64;
+        ProfileBranch *branches = realloc(profile->branches, new_capacity * sizeof(ProfileBranch));
+        if (!branches) {
+            return false;
+        }
+        profile->branches = branches;
+        *capacity         = new_capacity;
+    }
+    ProfileBranch *branch = &profile->branches[profile->num_branches++];
+    branch->index         = index;
+    branch->taken         = taken;
+    branch->not_taken     = not_taken;
+    return true;
+}
+
+/**
+ * @brief Adds a count to a sequence of a profile, adding the sequence if it
+ * is not there yet.
+ *
+ * @param profile The profile to add to.
+ * @param capacity Number of entries allocated for `profile->sequences`.
+ * @param forms The forms of the sequence.
+ * @param length Number of forms in the sequence.
+ * @param count The count to add.
+ * @return false if memory could not be allocated, true otherwise.
+ */
+static bool add_sequence(Profile *profile, size_t *capacity, const uint8_t *forms, uint8_t length,
+                         uint64_t count) {
+    for (size_t i = 0; i < profile->num_sequences; i++) {
+        ProfileSequence *sequence = &profile->sequences[i];
+        if (sequence->length == length && memcmp(sequence->forms, forms, length) == 0) {
+            sequence->count += count;
+            return true;
+        }
+    }
+
+    if (profile->num_sequences == *capacity) {
+        size_t           new_capacity = *capacity ? *capacity * 2 : 64;
+        ProfileSequence *sequences =
+            realloc(profile->sequences, new_capacity * sizeof(ProfileSequence));
+        if (!sequences) {
+            return false;
+        }
+        profile->sequences = sequences;
+        *capacity          = new_capacity;
+    }
+    ProfileSequence *sequence = &profile->sequences[profile->num_sequences++];
+    memset(sequence, 0, sizeof(*sequence));
+    memcpy(sequence->forms, forms, length);
+    sequence->length = length;
+    sequence->count  = count;
+    return true;
+}
+
+/**
+ * @brief Orders sequences by decreasing count, then by length and forms so
+ * that ties come out the same every time.
+ *
+ * @param a Pointer to the first `ProfileSequence`.
+ * @param b Pointer to the second `ProfileSequence`.
+ * @return A negative, zero or positive value, as required by `qsort`.
+ */
+static int compare_sequence_count(const void *a, const void *b) {
+    const ProfileSequence *x = a;
+    const ProfileSequence *y = b;
+    if (x->count != y->count) {
+        return (x->count > y->count) ? -1 : 1;
+    }
+    if (x->length != y->length) {
+        return (int) x->length - (int) y->length;
+    }
+    return memcmp(x->forms, y->forms, x->length);
+}
+
+/**
+ * @brief Reads a count written by `profile_write`.
+ *
+ * @param token The text of the count.
+ * @param count Set to the count if the text is a decimal number.
+ * @return true if the text is a decimal number, false otherwise.
+ */
+static bool parse_count(const char *token, uint64_t *count) {
+    char *end;
+    *count = strtoull(token, &end, 10);
+    return *end == '\0' && end != token && token[0] != '-';
+}
+
+/**
+ * @brief Looks up a form by its name in a profile.
+ *
+ * @param name The name of the form.
+ * @param form Set to the form's `CommandType` if it is found.
+ * @return true if the name is a known form, false otherwise.
+ */
+static bool parse_form(const char *name, uint8_t *form) {
+    for (size_t i = 0; i < NUM_FORM_NAMES; i++) {
+        if (FORM_NAMES[i] && strcmp(FORM_NAMES[i], name) == 0) {
+            *form = (uint8_t) i;
+            return true;
+        }
+    }
+    return false;
+}
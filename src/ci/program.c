@@ -0,0 +1,196 @@
+#include "program.h"
+#include <stdlib.h>
+#include "command_type.h"
+#include "linker.h"
+
+/**
+ * @brief Associates a parsed command with its index in the lowered program.
+ */
+typedef struct {
+    Command *command;  // The parsed command.
+    size_t   index;    // Its position in the instruction array.
+} CommandIndex;
+
+static int     compare_command_index(const void *lhs, const void *rhs);
+static int64_t resolve_target(Program *prog, Command *target, CommandIndex *table);
+static bool    fits_inline(int64_t value);
+static int32_t pack_number(Program *prog, int64_t value, bool *is_pooled);
+
+bool program_init(Program *prog, Command *commands) {
+    if (!prog) {
+        return false;
+    }
+
+    prog->code          = NULL;
+    prog->length        = 0;
+    prog->constants     = NULL;
+    prog->num_constants = 0;
+    prog->strings       = NULL;
+    prog->num_strings   = 0;
+    prog->pure          = NULL;
+    prog->num_pure      = 0;
+
+    // Size the pools exactly, so that they cost nothing for typical programs
+    size_t count         = 0;
+    size_t num_constants = 0;
+    size_t num_strings   = 0;
+    for (Command *cmd = commands; cmd; cmd = cmd->next) {
+        count++;
+        num_strings += cmd->is_a_string;
+        num_constants += !cmd->is_a_string && !fits_inline(cmd->val_a.num_val);
+        num_constants += cmd->type != CMD_PRINT && !fits_inline(cmd->val_b.num_val);
+    }
+
+    // One extra slot holds the CMD_HALT sentinel that ends execution
+    prog->code          = calloc(count + 1, sizeof(Instruction));
+    prog->constants     = malloc((num_constants + 1) * sizeof(int64_t));
+    prog->strings       = malloc((num_strings + 1) * sizeof(char *));
+    CommandIndex *table = malloc((count + 1) * sizeof(CommandIndex));
+    if (!prog->code || !prog->constants || !prog->strings || !table) {
+        free(table);
+        program_free(prog);
+        return false;
+    }
+
+    size_t i = 0;
+    for (Command *cmd = commands; cmd; cmd = cmd->next, i++) {
+        Instruction *insn      = &prog->code[i];
+        bool         pooled    = false;
+        insn->type             = (uint8_t) cmd->type;
+        insn->branch_condition = (int8_t) cmd->branch_condition;
+        insn->destination      = (uint8_t) cmd->destination.num_val;
+        insn->target           = PROGRAM_NO_TARGET;
+        insn->is_a_immediate   = cmd->is_a_immediate;
+        insn->is_b_immediate   = cmd->is_b_immediate;
+        insn->is_a_string      = cmd->is_a_string;
+
+        if (cmd->is_a_string) {
+            // The program now owns the string; keep free_command from releasing it
+            insn->val_a                        = (int32_t) prog->num_strings;
+            prog->strings[prog->num_strings++] = cmd->val_a.str_val;
+            cmd->val_a.str_val                 = NULL;
+        } else {
+            insn->val_a       = pack_number(prog, cmd->val_a.num_val, &pooled);
+            insn->is_a_pooled = pooled;
+        }
+        if (cmd->type == CMD_PRINT) {
+            insn->val_b = cmd->val_b.base;
+        } else if (cmd->type == CMD_CALL) {
+            insn->val_b = (int32_t) PROGRAM_SAVE_ALL;
+        } else {
+            insn->val_b       = pack_number(prog, cmd->val_b.num_val, &pooled);
+            insn->is_b_pooled = pooled;
+        }
+
+        table[i].command = cmd;
+        table[i].index   = i;
+    }
+    prog->length = count;
+
+    prog->code[count].type             = CMD_HALT;
+    prog->code[count].branch_condition = BRANCH_NONE;
+    prog->code[count].target           = PROGRAM_NO_TARGET;
+
+    // A call directly followed by ret can return straight to its caller's caller
+    for (i = 0; i + 1 < count; i++) {
+        Instruction *insn  = &prog->code[i];
+        insn->is_tail_call = insn->type == CMD_CALL && insn[1].type == CMD_RET;
+    }
+
+    // The linker points at commands, so translate those pointers into indices
+    qsort(table, count, sizeof(CommandIndex), compare_command_index);
+    i = 0;
+    for (Command *cmd = commands; cmd; cmd = cmd->next, i++) {
+        if (cmd->type == CMD_BRANCH || cmd->type == CMD_CALL) {
+            prog->code[i].target = resolve_target(prog, cmd->target, table);
+        }
+    }
+
+    free(table);
+    return true;
+}
+
+void program_free(Program *prog) {
+    if (!prog) {
+        return;
+    }
+
+    for (size_t i = 0; i < prog->num_strings; i++) {
+        free(prog->strings[i]);
+    }
+    free(prog->code);
+    free(prog->constants);
+    free(prog->strings);
+    free(prog->pure);
+    prog->code          = NULL;
+    prog->length        = 0;
+    prog->constants     = NULL;
+    prog->num_constants = 0;
+    prog->strings       = NULL;
+    prog->num_strings   = 0;
+    prog->pure          = NULL;
+    prog->num_pure      = 0;
+}
+
+/**
+ * @brief Orders `CommandIndex` entries by command address.
+ *
+ * @param lhs Pointer to the first `CommandIndex`.
+ * @param rhs Pointer to the second `CommandIndex`.
+ * @return A negative, zero or positive value, as required by `qsort`.
+ */
+static int compare_command_index(const void *lhs, const void *rhs) {
+    const Command *a = ((const CommandIndex *) lhs)->command;
+    const Command *b = ((const CommandIndex *) rhs)->command;
+    return (a > b) - (a < b);
+}
+
+/**
+ * @brief Finds the instruction index of a linked target.
+ *
+ * @param prog The program being lowered.
+ * @param target The command set by the linker, `LINK_HALT`, or NULL.
+ * @param table The command-to-index table, sorted by command address.
+ * @return The index of the target instruction, `prog->length` for
+ * `LINK_HALT`, or PROGRAM_NO_TARGET if the target is undefined.
+ */
+static int64_t resolve_target(Program *prog, Command *target, CommandIndex *table) {
+    if (target == LINK_HALT) {
+        return (int64_t) prog->length;
+    }
+    if (!target) {
+        return PROGRAM_NO_TARGET;
+    }
+
+    CommandIndex  key   = {target, 0};
+    CommandIndex *found =
+        bsearch(&key, table, prog->length, sizeof(CommandIndex), compare_command_index);
+    return found ? (int64_t) found->index : PROGRAM_NO_TARGET;
+}
+
+/**
+ * @brief Determines whether a number can be stored directly in an instruction.
+ *
+ * @param value The number to check.
+ * @return True if `value` fits in an instruction's 32-bit operand field.
+ */
+static bool fits_inline(int64_t value) {
+    return value >= INT32_MIN && value <= INT32_MAX;
+}
+
+/**
+ * @brief Packs a numeric operand, moving it to the constant pool if needed.
+ *
+ * @param prog The program being lowered, with room left in its constant pool.
+ * @param value The variable index or immediate to pack.
+ * @param is_pooled Set to whether the value was moved to the constant pool.
+ * @return The value to store in the instruction's operand field.
+ */
+static int32_t pack_number(Program *prog, int64_t value, bool *is_pooled) {
+    *is_pooled = !fits_inline(value);
+    if (!*is_pooled) {
+        return (int32_t) value;
+    }
+    prog->constants[prog->num_constants] = value;
+    return (int32_t) prog->num_constants++;
+}
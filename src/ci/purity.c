@@ -0,0 +1,363 @@
+#include "purity.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "command_type.h"
+#include "interpreter.h"
+
+#define FLAGS_BIT   ((uint64_t) 1 << NUM_VARIABLES)  // The flags, in a liveness mask.
+#define LIVE_AT_RET ((uint64_t) 1 | FLAGS_BIT)       // What a return hands back: x0 and the flags.
+
+/**
+ * @brief A call target and what is known about it.
+ */
+typedef struct {
+    size_t   entry;   // Index of the function's first instruction.
+    size_t  *body;    // Instructions reachable from `entry` before it returns.
+    size_t   length;  // Number of entries in `body`.
+    bool     pure;    // Whether the function may be memoized.
+    uint64_t inputs;  // Variables, and FLAGS_BIT, read before being written.
+} Function;
+
+static bool     collect_body(Program *prog, Function *fn, bool *seen);
+static bool     is_pure_instruction(Instruction *insn);
+static int64_t  callee(Program *prog, Instruction *insn, const int32_t *function_of);
+static uint64_t compute_inputs(Program *prog, Function *fn, Function *functions,
+                               const int32_t *function_of, uint64_t *live);
+static uint64_t reads(Program *prog, Instruction *insn);
+static uint64_t writes(Instruction *insn);
+static uint64_t variable_bit(int64_t index);
+static size_t   count_inputs(uint64_t inputs);
+
+size_t program_find_pure(Program *prog) {
+    if (!prog || prog->length == 0) {
+        return 0;
+    }
+
+    size_t    slots       = prog->length + 1;
+    int32_t  *function_of = malloc(slots * sizeof(int32_t));
+    Function *functions   = calloc(slots, sizeof(Function));
+    bool     *seen        = malloc(slots * sizeof(bool));
+    uint64_t *live        = calloc(slots, sizeof(uint64_t));
+    size_t    count       = 0;
+    size_t    memoized    = 0;
+    if (!function_of || !functions || !seen || !live) {
+        goto done;
+    }
+
+    // Gather every call target and the instructions it runs before returning
+    for (size_t i = 0; i < slots; i++) {
+        function_of[i] = -1;
+    }
+    for (size_t i = 0; i < prog->length; i++) {
+        Instruction *insn = &prog->code[i];
+        if (insn->type != CMD_CALL || insn->target == PROGRAM_NO_TARGET ||
+            (size_t) insn->target >= prog->length || function_of[insn->target] >= 0) {
+            continue;
+        }
+        functions[count].entry    = (size_t) insn->target;
+        function_of[insn->target] = (int32_t) count;
+        if (!collect_body(prog, &functions[count++], seen)) {
+            goto done;
+        }
+    }
+
+    // A function is only pure if everything it calls is
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (size_t f = 0; f < count; f++) {
+            Function *fn = &functions[f];
+            for (size_t k = 0; fn->pure && k < fn->length; k++) {
+                Instruction *insn = &prog->code[fn->body[k]];
+                if (insn->type == CMD_CALL && !insn->is_tail_call) {
+                    int64_t g = callee(prog, insn, function_of);
+                    if (g < 0 || !functions[g].pure) {
+                        fn->pure = false;
+                        changed  = true;
+                    }
+                }
+            }
+        }
+    }
+
+    // Inputs only grow, so iterate until no function's inputs change
+    changed = true;
+    while (changed) {
+        changed = false;
+        for (size_t f = 0; f < count; f++) {
+            Function *fn = &functions[f];
+            if (!fn->pure) {
+                continue;
+            }
+            uint64_t inputs = compute_inputs(prog, fn, functions, function_of, live);
+            if (inputs != fn->inputs) {
+                fn->inputs = inputs;
+                changed    = true;
+            }
+        }
+    }
+
+    // Record the functions that can be memoized and mark the calls to them
+    prog->pure = malloc((count + 1) * sizeof(PureFunction));
+    if (!prog->pure) {
+        goto done;
+    }
+    int32_t *pure_index = function_of;  // Reused: function index -> pure index
+    for (size_t f = 0; f < count; f++) {
+        Function *fn = &functions[f];
+        if (!fn->pure || count_inputs(fn->inputs) > PROGRAM_MAX_INPUTS ||
+            prog->num_pure == PROGRAM_MAX_PURE) {
+            pure_index[fn->entry] = -1;
+            continue;
+        }
+        PureFunction *pure = &prog->pure[prog->num_pure];
+        pure->num_inputs   = 0;
+        pure->reads_flags  = (fn->inputs & FLAGS_BIT) != 0;
+        for (uint8_t v = 0; v < NUM_VARIABLES; v++) {
+            if (fn->inputs & variable_bit(v)) {
+                pure->inputs[pure->num_inputs++] = v;
+            }
+        }
+        pure_index[fn->entry] = (int32_t) prog->num_pure++;
+    }
+    for (size_t i = 0; i < prog->length; i++) {
+        Instruction *insn = &prog->code[i];
+        if (insn->type == CMD_CALL && insn->target != PROGRAM_NO_TARGET &&
+            (size_t) insn->target < prog->length && pure_index[insn->target] >= 0) {
+            insn->is_memoized = true;
+            insn->destination = (uint8_t) pure_index[insn->target];
+            memoized++;
+        }
+    }
+
+done:
+    for (size_t f = 0; f < count; f++) {
+        free(functions[f].body);
+    }
+    free(function_of);
+    free(functions);
+    free(seen);
+    free(live);
+    return memoized;
+}
+
+/**
+ * @brief Collects the instructions a function runs before it returns, and
+ * whether any of them rules out memoizing it.
+ *
+ * Nested calls are stepped over, since they return to the next instruction;
+ * tail calls are followed into their callee, which returns for this function.
+ *
+ * @param prog The program being analyzed.
+ * @param fn The function, with `entry` set.
+ * @param seen Scratch space for `prog->length + 1` flags.
+ * @return True on success, false if memory could not be allocated.
+ */
+static bool collect_body(Program *prog, Function *fn, bool *seen) {
+    fn->body = malloc((prog->length + 1) * sizeof(size_t));
+    if (!fn->body) {
+        return false;
+    }
+    memset(seen, 0, (prog->length + 1) * sizeof(bool));
+
+    fn->pure               = true;
+    fn->length             = 0;
+    fn->body[fn->length++] = fn->entry;
+    seen[fn->entry]        = true;
+    for (size_t k = 0; k < fn->length; k++) {
+        size_t       pc   = fn->body[k];
+        Instruction *insn = &prog->code[pc];
+        size_t       next[2];
+        size_t       num_next = 0;
+
+        if (!is_pure_instruction(insn)) {
+            fn->pure = false;
+        }
+        switch (insn->type) {
+            case CMD_HALT:
+            case CMD_RET:
+                break;
+            case CMD_BRANCH:
+                if (insn->target != PROGRAM_NO_TARGET) {
+                    next[num_next++] = (size_t) insn->target;
+                }
+                if (insn->branch_condition != BRANCH_ALWAYS) {
+                    next[num_next++] = pc + 1;
+                }
+                break;
+            case CMD_CALL:
+                if (insn->target != PROGRAM_NO_TARGET) {
+                    next[num_next++] = insn->is_tail_call ? (size_t) insn->target : pc + 1;
+                }
+                break;
+            default:
+                next[num_next++] = pc + 1;
+                break;
+        }
+
+        for (size_t i = 0; i < num_next; i++) {
+            if (!seen[next[i]]) {
+                seen[next[i]]          = true;
+                fn->body[fn->length++] = next[i];
+            }
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Determines whether an instruction is allowed in a pure function.
+ *
+ * @param insn The instruction to check.
+ * @return False if `insn` touches memory, prints, or refers to an undefined
+ * label, true otherwise.
+ */
+static bool is_pure_instruction(Instruction *insn) {
+    switch (insn->type) {
+        case CMD_MOV:
+        case CMD_ADD:
+        case CMD_SUB:
+        case CMD_AND:
+        case CMD_EOR:
+        case CMD_ORR:
+        case CMD_LSL:
+        case CMD_LSR:
+        case CMD_ASR:
+        case CMD_CMP:
+        case CMD_CMP_U:
+        case CMD_RET:
+        case CMD_HALT:
+            return true;
+        case CMD_BRANCH:
+        case CMD_CALL:
+            return insn->target != PROGRAM_NO_TARGET;
+        default:
+            return false;
+    }
+}
+
+/**
+ * @brief Finds the function a call enters.
+ *
+ * @param prog The program being analyzed.
+ * @param insn A linked call.
+ * @param function_of The function index of each call target, or -1.
+ * @return The index of the called function, or -1 if there is none.
+ */
+static int64_t callee(Program *prog, Instruction *insn, const int32_t *function_of) {
+    if ((size_t) insn->target >= prog->length) {
+        return -1;
+    }
+    return function_of[insn->target];
+}
+
+/**
+ * @brief Computes which variables and flags a pure function may read before
+ * writing them, given the current inputs of the functions it calls.
+ *
+ * @param prog The program being analyzed.
+ * @param fn The function to analyze.
+ * @param functions Every function in the program.
+ * @param function_of The function index of each call target, or -1.
+ * @param live Scratch space for `prog->length + 1` masks.
+ * @return The function's inputs.
+ */
+static uint64_t compute_inputs(Program *prog, Function *fn, Function *functions,
+                               const int32_t *function_of, uint64_t *live) {
+    for (size_t k = 0; k < fn->length; k++) {
+        live[fn->body[k]] = 0;
+    }
+
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (size_t k = fn->length; k-- > 0;) {
+            size_t       pc   = fn->body[k];
+            Instruction *insn = &prog->code[pc];
+            uint64_t     in;
+            switch (insn->type) {
+                case CMD_HALT:
+                    in = 0;
+                    break;
+                case CMD_RET:
+                    in = LIVE_AT_RET;
+                    break;
+                case CMD_BRANCH:
+                    in = live[insn->target];
+                    if (insn->branch_condition != BRANCH_ALWAYS) {
+                        in |= live[pc + 1] | FLAGS_BIT;
+                    }
+                    break;
+                case CMD_CALL:
+                    if (insn->is_tail_call) {
+                        in = live[insn->target];
+                    } else {
+                        // The callee hands back x0 and the flags; the rest is restored
+                        int64_t g = callee(prog, insn, function_of);
+                        in        = (live[pc + 1] & ~LIVE_AT_RET) | functions[g].inputs;
+                    }
+                    break;
+                default:
+                    in = (live[pc + 1] & ~writes(insn)) | reads(prog, insn);
+                    break;
+            }
+            if (in != live[pc]) {
+                live[pc] = in;
+                changed  = true;
+            }
+        }
+    }
+    return live[fn->entry];
+}
+
+/**
+ * @brief Finds the variables an operation reads.
+ *
+ * @param prog The program holding the instruction's constants.
+ * @param insn An instruction that is neither control flow nor a call.
+ * @return A mask of the variables read.
+ */
+static uint64_t reads(Program *prog, Instruction *insn) {
+    uint64_t a = insn->is_a_immediate ? 0 : variable_bit(PROGRAM_OPERAND_A(prog, insn));
+    uint64_t b = insn->is_b_immediate ? 0 : variable_bit(PROGRAM_OPERAND_B(prog, insn));
+    return insn->type == CMD_MOV ? a : a | b;
+}
+
+/**
+ * @brief Finds the variables and flags an operation writes.
+ *
+ * @param insn An instruction that is neither control flow nor a call.
+ * @return A mask of what is written, with FLAGS_BIT for compares.
+ */
+static uint64_t writes(Instruction *insn) {
+    if (insn->type == CMD_CMP || insn->type == CMD_CMP_U) {
+        return FLAGS_BIT;
+    }
+    return variable_bit(insn->destination);
+}
+
+/**
+ * @brief Converts a variable index into a liveness mask.
+ *
+ * @param index The variable index.
+ * @return The variable's bit, or 0 if `index` is not a variable.
+ */
+static uint64_t variable_bit(int64_t index) {
+    return (index >= 0 && index < NUM_VARIABLES) ? (uint64_t) 1 << index : 0;
+}
+
+/**
+ * @brief Counts the input variables in a liveness mask.
+ *
+ * @param inputs The mask to count.
+ * @return The number of variables set, not counting the flags.
+ */
+static size_t count_inputs(uint64_t inputs) {
+    size_t count = 0;
+    for (uint64_t left = inputs & ~FLAGS_BIT; left; left &= left - 1) {
+        count++;
+    }
+    return count;
+}
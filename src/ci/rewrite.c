@@ -0,0 +1,165 @@
+#include "rewrite.h"
+#include <stdlib.h>
+#include <string.h>
+#include "command_type.h"
+#include "interpreter.h"
+#include "liveness.h"
+
+static bool  uses_destination(const Command *cmd);
+static bool  uses_a(const Command *cmd);
+static bool  uses_b(const Command *cmd);
+static bool  is_variable(int64_t index);
+static char *copy_string(const char *text);
+
+Command *command_new(CommandType type) {
+    Command *cmd = calloc(1, sizeof(Command));
+    if (cmd) {
+        cmd->type             = type;
+        cmd->branch_condition = BRANCH_NONE;
+    }
+    return cmd;
+}
+
+Command *command_new_branch(BranchCondition condition, Command *target, const char *label) {
+    Command *cmd = command_new(CMD_BRANCH);
+    if (cmd && !(cmd->val_a.str_val = copy_string(label))) {
+        free(cmd);
+        return NULL;
+    }
+    if (cmd) {
+        cmd->branch_condition = condition;
+        cmd->is_a_string      = true;
+        cmd->target           = target;
+    }
+    return cmd;
+}
+
+Command *command_copy(const Command *cmd, const int8_t *rename) {
+    Command *copy = malloc(sizeof(Command));
+    if (!copy) {
+        return NULL;
+    }
+    *copy      = *cmd;
+    copy->next = NULL;
+    if (cmd->is_a_string) {
+        copy->val_a.str_val = copy_string(cmd->val_a.str_val);
+    }
+    if (cmd->is_b_string) {
+        copy->val_b.str_val = copy_string(cmd->val_b.str_val);
+    }
+    if ((cmd->is_a_string && !copy->val_a.str_val) || (cmd->is_b_string && !copy->val_b.str_val)) {
+        free_command(copy);
+        return NULL;
+    }
+    if (!rename) {
+        return copy;
+    }
+
+    if (uses_destination(cmd) && rename[cmd->destination.num_val] != REWRITE_NO_VARIABLE) {
+        copy->destination.num_val = rename[cmd->destination.num_val];
+    }
+    if (uses_a(cmd) && rename[cmd->val_a.num_val] != REWRITE_NO_VARIABLE) {
+        copy->val_a.num_val = rename[cmd->val_a.num_val];
+    }
+    if (uses_b(cmd) && rename[cmd->val_b.num_val] != REWRITE_NO_VARIABLE) {
+        copy->val_b.num_val = rename[cmd->val_b.num_val];
+    }
+    return copy;
+}
+
+int64_t find_spare_variable(uint64_t used, uint64_t live_after, uint64_t written,
+                            bool *restore) {
+    for (size_t t = NUM_VARIABLES - 1; t > 0; t--) {
+        if (!(used >> t & 1) && !(live_after >> t & 1)) {
+            *restore = false;
+            return (int64_t) t;
+        }
+    }
+    for (size_t t = NUM_VARIABLES - 1; t > 0; t--) {
+        if (!(used >> t & 1) && !(written >> t & 1)) {
+            *restore = true;
+            return (int64_t) t;
+        }
+    }
+    return REWRITE_NO_VARIABLE;
+}
+
+/**
+ * @brief Determines whether a command's destination is a variable.
+ *
+ * @param cmd The command.
+ * @return True if `destination` is a variable the command reads or writes.
+ */
+static bool uses_destination(const Command *cmd) {
+    return (cmd->type == CMD_STORE || command_writes(cmd) & ~LIVE_FLAGS) &&
+           is_variable(cmd->destination.num_val);
+}
+
+/**
+ * @brief Determines whether a command reads the variable in its first operand.
+ *
+ * @param cmd The command.
+ * @return True if `val_a` is a variable the command reads.
+ */
+static bool uses_a(const Command *cmd) {
+    if (cmd->is_a_immediate || cmd->is_a_string || !is_variable(cmd->val_a.num_val)) {
+        return false;
+    }
+    switch (cmd->type) {
+        case CMD_BRANCH:
+        case CMD_CALL:
+        case CMD_RET:
+        case CMD_LOAD:
+        case CMD_STORE:
+        case CMD_PUT:
+            return false;
+        default:
+            return true;
+    }
+}
+
+/**
+ * @brief Determines whether a command reads the variable in its second operand.
+ *
+ * @param cmd The command.
+ * @return True if `val_b` is a variable the command reads.
+ */
+static bool uses_b(const Command *cmd) {
+    if (cmd->is_b_immediate || cmd->is_b_string || !is_variable(cmd->val_b.num_val)) {
+        return false;
+    }
+    switch (cmd->type) {
+        case CMD_BRANCH:
+        case CMD_CALL:
+        case CMD_RET:
+        case CMD_MOV:
+        case CMD_PRINT:
+            return false;
+        default:
+            return true;
+    }
+}
+
+/**
+ * @brief Determines whether an operand value names a variable.
+ *
+ * @param index The operand value.
+ * @return True if it is a valid variable index.
+ */
+static bool is_variable(int64_t index) {
+    return index >= 0 && index < NUM_VARIABLES;
+}
+
+/**
+ * @brief Copies a label or string operand.
+ *
+ * @param text The text to copy.
+ * @return A newly allocated copy, or NULL if memory could not be allocated.
+ */
+static char *copy_string(const char *text) {
+    char *copy = malloc(strlen(text) + 1);
+    if (copy) {
+        strcpy(copy, text);
+    }
+    return copy;
+}
@@ -0,0 +1,60 @@
+#include "specialize.h"
+#include <stdbool.h>
+
+static bool has_access_width(Instruction *insn);
+
+size_t program_specialize(Program *prog) {
+    if (!prog) {
+        return 0;
+    }
+
+    size_t specialized = 0;
+    for (size_t i = 0; i < prog->length; i++) {
+        Instruction *insn   = &prog->code[i];
+        bool         b_imm  = insn->is_b_immediate;
+        CommandType  before = insn->type;
+        if (insn->is_a_pooled || insn->is_b_pooled) {
+            continue;  // Wide immediates stay in the generic forms, which read the pool
+        }
+        switch (insn->type) {
+            case CMD_ADD:   insn->type = b_imm ? CMD_ADD_RRI : CMD_ADD_RRR; break;
+            case CMD_SUB:   insn->type = b_imm ? CMD_SUB_RRI : CMD_SUB_RRR; break;
+            case CMD_CMP:   insn->type = b_imm ? CMD_CMP_RI : CMD_CMP_RR; break;
+            case CMD_CMP_U: insn->type = b_imm ? CMD_CMP_U_RI : CMD_CMP_U_RR; break;
+            case CMD_LSL:   insn->type = insn->is_verified ? CMD_LSL_RRI : CMD_LSL; break;
+            case CMD_LSR:   insn->type = insn->is_verified ? CMD_LSR_RRI : CMD_LSR; break;
+            case CMD_ASR:   insn->type = insn->is_verified ? CMD_ASR_RRI : CMD_ASR; break;
+            case CMD_LOAD:
+                if (insn->is_verified) {
+                    insn->type = CMD_LOAD_RII;
+                } else if (!b_imm && has_access_width(insn)) {
+                    insn->type = CMD_LOAD_RIR;
+                }
+                break;
+            case CMD_STORE:
+                if (insn->is_verified) {
+                    insn->type = CMD_STORE_RII;
+                } else if (!b_imm && has_access_width(insn)) {
+                    insn->type = CMD_STORE_RRI;
+                }
+                break;
+            default:
+                break;
+        }
+        if (insn->type != before) {
+            specialized++;
+        }
+    }
+    return specialized;
+}
+
+/**
+ * @brief Determines whether a load or store has a valid immediate width.
+ *
+ * @param insn The load or store to check.
+ * @return True if the width is an immediate 1, 2, 4 or 8, false otherwise.
+ */
+static bool has_access_width(Instruction *insn) {
+    return insn->is_a_immediate &&
+           (insn->val_a == 1 || insn->val_a == 2 || insn->val_a == 4 || insn->val_a == 8);
+}
@@ -0,0 +1,848 @@
+#include "ssa.h"
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "command_type.h"
+#include "linker.h"
+#include "liveness.h"
+#include "rewrite.h"
+
+#define SLOT_BIT(slot) ((uint64_t) 1 << (slot))
+#define ALL_SLOTS      (SLOT_BIT(SSA_NUM_SLOTS) - 1)
+
+static bool     find_reached(SsaProgram *ssa, const bool *is_root);
+static bool     find_preds(SsaProgram *ssa, const bool *is_root);
+static bool     place_phis(SsaProgram *ssa, const bool *is_root, size_t *entry);
+static bool     rename_values(SsaProgram *ssa, const bool *is_root, const size_t *entry);
+static void     fill_phi_args(SsaProgram *ssa, const size_t *entry);
+static bool     rename_instr(SsaProgram *ssa, size_t i, size_t *current);
+static uint64_t block_writes(const SsaProgram *ssa, size_t b);
+static uint64_t instr_writes(const Command *cmd);
+static bool     reads_a(const Command *cmd);
+static bool     reads_b(const Command *cmd);
+static bool     reads_memory(const Command *cmd);
+static bool     is_variable(int64_t index);
+static size_t   new_value(SsaProgram *ssa, SsaValueKind kind, size_t slot, size_t block,
+                          size_t def);
+static size_t   pool_alloc(SsaProgram *ssa, size_t count);
+static void     print_instr(const SsaProgram *ssa, size_t i);
+static void     print_slot(size_t slot);
+static void     print_operand(const SsaInstr *instr, SsaOperand operand, int64_t num_val,
+                              bool is_register);
+
+// Mnemonics of the command types the parser produces, for `ssa_print`
+static const char *const NAMES[] = {
+    [CMD_ADD] = "add",   [CMD_AND] = "and",     [CMD_ASR] = "asr",   [CMD_BRANCH] = "b",
+    [CMD_CALL] = "call", [CMD_CMP] = "cmp",     [CMD_CMP_U] = "cmp_u", [CMD_EOR] = "eor",
+    [CMD_LOAD] = "load", [CMD_LSL] = "lsl",     [CMD_LSR] = "lsr",   [CMD_MOV] = "mov",
+    [CMD_ORR] = "orr",   [CMD_PRINT] = "print", [CMD_PUT] = "put",   [CMD_RET] = "ret",
+    [CMD_STORE] = "store", [CMD_SUB] = "sub",
+};
+
+// Suffixes of the branch conditions, indexed by BranchCondition
+static const char *const CONDITIONS[] = {"", ".eq", ".ne", ".gt", ".lt", ".ge", ".le"};
+
+bool ssa_build(SsaProgram *ssa, Command *commands) {
+    ssa->blocks     = NULL;
+    ssa->instrs     = NULL;
+    ssa->values     = NULL;
+    ssa->num_values = 0;
+    ssa->phis       = NULL;
+    ssa->num_phis   = 0;
+    ssa->pool       = NULL;
+    ssa->pool_size  = 0;
+    ssa->pool_cap   = 0;
+    if (!cfg_build(&ssa->cfg, commands)) {
+        return false;
+    }
+
+    Cfg    *cfg     = &ssa->cfg;
+    bool   *is_root = calloc(cfg->num_blocks + 1, sizeof(bool));
+    size_t *entry   = malloc((cfg->num_blocks + 1) * sizeof(size_t));
+    ssa->blocks     = calloc(cfg->num_blocks + 1, sizeof(SsaBlock));
+    ssa->instrs     = calloc(cfg->array.count + 1, sizeof(SsaInstr));
+    bool built      = false;
+    if (!is_root || !entry || !ssa->blocks || !ssa->instrs) {
+        goto done;
+    }
+
+    // The same roots as the graph's: the first block and every called block
+    if (cfg->num_blocks > 0) {
+        is_root[0] = true;
+    }
+    for (size_t i = 0; i < cfg->array.count; i++) {
+        if (cfg->array.commands[i]->type == CMD_CALL && cfg->array.targets[i] >= 0) {
+            is_root[cfg->block_of[cfg->array.targets[i]]] = true;
+        }
+    }
+
+    built = find_reached(ssa, is_root) && find_preds(ssa, is_root) &&
+            place_phis(ssa, is_root, entry) && rename_values(ssa, is_root, entry);
+    if (built) {
+        fill_phi_args(ssa, entry);
+    }
+
+done:
+    free(is_root);
+    free(entry);
+    if (!built) {
+        ssa_free(ssa);
+    }
+    return built;
+}
+
+void ssa_free(SsaProgram *ssa) {
+    if (!ssa) {
+        return;
+    }
+
+    cfg_free(&ssa->cfg);
+    free(ssa->blocks);
+    free(ssa->instrs);
+    free(ssa->values);
+    free(ssa->phis);
+    free(ssa->pool);
+    ssa->blocks     = NULL;
+    ssa->instrs     = NULL;
+    ssa->values     = NULL;
+    ssa->num_values = 0;
+    ssa->phis       = NULL;
+    ssa->num_phis   = 0;
+    ssa->pool       = NULL;
+    ssa->pool_size  = 0;
+    ssa->pool_cap   = 0;
+}
+
+void ssa_print(const SsaProgram *ssa) {
+    if (!ssa) {
+        return;
+    }
+
+    printf("SSA form:\n");
+    for (size_t b = 0; b < ssa->cfg.num_blocks; b++) {
+        const SsaBlock *block = &ssa->blocks[b];
+        printf("b%zu:", b);
+        if (!block->reached) {
+            printf(" (unreachable)");
+        }
+        for (size_t p = 0; p < block->num_preds; p++) {
+            size_t pred = ssa->pool[block->preds + p];
+            printf(p == 0 ? " preds " : ", ");
+            (pred == SSA_ENTRY) ? printf("entry") : printf("b%zu", pred);
+        }
+        printf("\n");
+
+        for (size_t k = block->phis; k < block->phis + block->num_phis; k++) {
+            const SsaPhi *phi = &ssa->phis[k];
+            printf("    v%zu = phi ", phi->value);
+            print_slot(ssa->values[phi->value].slot);
+            for (size_t p = 0; p < block->num_preds; p++) {
+                size_t pred = ssa->pool[block->preds + p];
+                (pred == SSA_ENTRY) ? printf(" [entry") : printf(" [b%zu", pred);
+                printf(": v%zu]", ssa->pool[phi->args + p]);
+            }
+            printf("\n");
+        }
+        for (size_t i = ssa->cfg.blocks[b].first; i <= ssa->cfg.blocks[b].last; i++) {
+            print_instr(ssa, i);
+        }
+    }
+    printf("\n");
+}
+
+bool ssa_lower(SsaProgram *ssa, Command **commands) {
+    if (!ssa || !commands) {
+        return false;
+    }
+
+    // Phis only disappear if all their arguments live in the same variable
+    for (size_t k = 0; k < ssa->num_phis; k++) {
+        const SsaPhi *phi   = &ssa->phis[k];
+        size_t        slot  = ssa->values[phi->value].slot;
+        size_t        block = ssa->values[phi->value].block;
+        for (size_t p = 0; p < ssa->blocks[block].num_preds; p++) {
+            if (ssa->values[ssa->pool[phi->args + p]].slot != slot) {
+                return false;
+            }
+        }
+    }
+
+    CommandArray *array   = &ssa->cfg.array;
+    size_t        count   = array->count;
+    Command     **lowered = calloc(count + 1, sizeof(Command *));
+    Command     **kept_at = malloc((count + 1) * sizeof(Command *));
+    bool          ok      = lowered && kept_at;
+    for (size_t i = 0; i < count && ok; i++) {
+        if (!ssa->instrs[i].removed) {
+            lowered[i] = command_copy(ssa->instrs[i].cmd, NULL);
+            ok         = lowered[i] != NULL;
+        }
+    }
+    if (!ok) {
+        for (size_t i = 0; lowered && i < count; i++) {
+            free_command(lowered[i]);
+        }
+        free(lowered);
+        free(kept_at);
+        return false;
+    }
+
+    // Walk backwards so each removed instruction knows the next one kept
+    Command *next_kept = LINK_HALT;
+    for (size_t i = count; i-- > 0;) {
+        if (lowered[i]) {
+            next_kept = lowered[i];
+        }
+        kept_at[i] = next_kept;
+    }
+
+    Command  *head = NULL;
+    Command **link = &head;
+    for (size_t i = 0; i < count; i++) {
+        if (!lowered[i]) {
+            continue;
+        }
+        const SsaInstr *instr = &ssa->instrs[i];
+        Command        *cmd   = lowered[i];
+        if (array->targets[i] >= 0) {
+            cmd->target = kept_at[array->targets[i]];
+        }
+        if (instr->uses[SSA_OPERAND_DEST] != SSA_NO_VALUE) {
+            cmd->destination.num_val = (int64_t) ssa->values[instr->uses[SSA_OPERAND_DEST]].slot;
+        }
+        if (instr->uses[SSA_OPERAND_A] != SSA_NO_VALUE) {
+            cmd->val_a.num_val = (int64_t) ssa->values[instr->uses[SSA_OPERAND_A]].slot;
+        }
+        if (instr->uses[SSA_OPERAND_B] != SSA_NO_VALUE) {
+            cmd->val_b.num_val = (int64_t) ssa->values[instr->uses[SSA_OPERAND_B]].slot;
+        }
+        if (instr->result != SSA_NO_VALUE && cmd->type != CMD_CALL) {
+            cmd->destination.num_val = (int64_t) ssa->values[instr->result].slot;
+        }
+        *link = cmd;
+        link  = &cmd->next;
+    }
+
+    free(kept_at);
+    free(lowered);
+    *commands = head;
+    return true;
+}
+
+/**
+ * @brief Marks the blocks that can run, starting from the roots.
+ *
+ * @param ssa The form being built.
+ * @param is_root Whether each block is entered from outside the graph.
+ * @return True on success, false if memory could not be allocated.
+ */
+static bool find_reached(SsaProgram *ssa, const bool *is_root) {
+    Cfg    *cfg      = &ssa->cfg;
+    size_t *worklist = malloc((cfg->num_blocks + 1) * sizeof(size_t));
+    if (!worklist) {
+        return false;
+    }
+
+    size_t pending = 0;
+    for (size_t b = 0; b < cfg->num_blocks; b++) {
+        if (is_root[b]) {
+            ssa->blocks[b].reached = true;
+            worklist[pending++]    = b;
+        }
+    }
+    while (pending > 0) {
+        size_t b = worklist[--pending];
+        for (size_t s = 0; s < cfg->blocks[b].num_succs; s++) {
+            size_t succ = cfg->blocks[b].succs[s];
+            if (!ssa->blocks[succ].reached) {
+                ssa->blocks[succ].reached = true;
+                worklist[pending++]       = succ;
+            }
+        }
+    }
+    free(worklist);
+    return true;
+}
+
+/**
+ * @brief Lists the predecessors of every reachable block.
+ *
+ * @param ssa The form being built, with reachable blocks marked.
+ * @param is_root Whether each block is entered from outside the graph.
+ * @return True on success, false if memory could not be allocated.
+ */
+static bool find_preds(SsaProgram *ssa, const bool *is_root) {
+    Cfg *cfg = &ssa->cfg;
+    for (size_t b = 0; b < cfg->num_blocks; b++) {
+        if (!ssa->blocks[b].reached) {
+            continue;
+        }
+        for (size_t s = 0; s < cfg->blocks[b].num_succs; s++) {
+            ssa->blocks[cfg->blocks[b].succs[s]].num_preds++;
+        }
+    }
+    for (size_t b = 0; b < cfg->num_blocks; b++) {
+        SsaBlock *block = &ssa->blocks[b];
+        block->num_preds += is_root[b];
+        block->preds = pool_alloc(ssa, block->num_preds);
+        if (block->preds == SSA_NO_VALUE) {
+            return false;
+        }
+        block->num_preds = 0;
+        if (is_root[b]) {
+            ssa->pool[block->preds + block->num_preds++] = SSA_ENTRY;
+        }
+    }
+    for (size_t b = 0; b < cfg->num_blocks; b++) {
+        if (!ssa->blocks[b].reached) {
+            continue;
+        }
+        for (size_t s = 0; s < cfg->blocks[b].num_succs; s++) {
+            SsaBlock *succ                             = &ssa->blocks[cfg->blocks[b].succs[s]];
+            ssa->pool[succ->preds + succ->num_preds++] = b;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Decides which slots need a phi at the start of each block, creates
+ * the phis and the entry values of the roots.
+ *
+ * A slot gets a phi in the iterated dominance frontier of the blocks that
+ * write it. Roots that are also entered from inside the graph, and blocks
+ * that no single block dominates, may see the entry values of different
+ * roots, so they get a phi for every slot.
+ *
+ * @param ssa The form being built, with predecessors listed.
+ * @param is_root Whether each block is entered from outside the graph.
+ * @param entry Set to the first of each root's SSA_NUM_SLOTS entry values.
+ * @return True on success, false if memory could not be allocated.
+ */
+static bool place_phis(SsaProgram *ssa, const bool *is_root, size_t *entry) {
+    Cfg      *cfg        = &ssa->cfg;
+    size_t    num_blocks = cfg->num_blocks;
+    uint64_t *defs       = calloc(num_blocks + 1, sizeof(uint64_t));
+    uint64_t *phi_slots  = calloc(num_blocks + 1, sizeof(uint64_t));
+    bool      placed     = false;
+    if (!defs || !phi_slots) {
+        goto done;
+    }
+
+    for (size_t b = 0; b < num_blocks; b++) {
+        const SsaBlock *block = &ssa->blocks[b];
+        if (!block->reached) {
+            continue;
+        }
+        defs[b] = block_writes(ssa, b);
+        if (cfg->blocks[b].idom == CFG_NO_BLOCK && block->num_preds > is_root[b]) {
+            phi_slots[b] = ALL_SLOTS;
+        }
+    }
+
+    // A join is in the dominance frontier of each block from a predecessor up
+    // to, but not including, the join's immediate dominator
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (size_t b = 0; b < num_blocks; b++) {
+            const SsaBlock *block = &ssa->blocks[b];
+            size_t          idom  = cfg->blocks[b].idom;
+            if (!block->reached || block->num_preds < 2 || idom == CFG_NO_BLOCK) {
+                continue;
+            }
+            for (size_t p = 0; p < block->num_preds; p++) {
+                for (size_t runner = ssa->pool[block->preds + p]; runner != idom;
+                     runner        = cfg->blocks[runner].idom) {
+                    uint64_t add = (defs[runner] | phi_slots[runner]) & ~phi_slots[b];
+                    if (add) {
+                        phi_slots[b] |= add;
+                        changed = true;
+                    }
+                }
+            }
+        }
+    }
+
+    size_t num_phis  = 0;
+    size_t num_roots = 0;
+    size_t num_defs  = 3 * cfg->array.count;  // A result, flags and memory at most
+    for (size_t b = 0; b < num_blocks; b++) {
+        for (size_t s = 0; s < SSA_NUM_SLOTS; s++) {
+            num_phis += (phi_slots[b] >> s) & 1;
+        }
+        num_roots += is_root[b];
+    }
+    ssa->phis   = malloc((num_phis + 1) * sizeof(SsaPhi));
+    ssa->values = malloc((num_phis + num_roots * SSA_NUM_SLOTS + num_defs + 1) * sizeof(SsaValue));
+    if (!ssa->phis || !ssa->values) {
+        goto done;
+    }
+
+    for (size_t b = 0; b < num_blocks; b++) {
+        entry[b] = SSA_NO_VALUE;
+        if (is_root[b]) {
+            entry[b] = ssa->num_values;
+            for (size_t s = 0; s < SSA_NUM_SLOTS; s++) {
+                new_value(ssa, SSA_VALUE_ENTRY, s, b, SSA_NO_VALUE);
+            }
+        }
+    }
+    for (size_t b = 0; b < num_blocks; b++) {
+        SsaBlock *block = &ssa->blocks[b];
+        block->phis     = ssa->num_phis;
+        for (size_t s = 0; s < SSA_NUM_SLOTS; s++) {
+            if (!(phi_slots[b] & SLOT_BIT(s))) {
+                continue;
+            }
+            SsaPhi *phi = &ssa->phis[ssa->num_phis];
+            phi->value  = new_value(ssa, SSA_VALUE_PHI, s, b, ssa->num_phis);
+            phi->args   = pool_alloc(ssa, block->num_preds);
+            if (phi->args == SSA_NO_VALUE) {
+                goto done;
+            }
+            ssa->num_phis++;
+            block->num_phis++;
+        }
+    }
+    placed = true;
+
+done:
+    free(defs);
+    free(phi_slots);
+    return placed;
+}
+
+/**
+ * @brief Gives every instruction its values, walking the dominator tree so
+ * that a block starts from what its immediate dominator ends with.
+ *
+ * @param ssa The form being built, with phis placed.
+ * @param is_root Whether each block is entered from outside the graph.
+ * @param entry The first entry value of each root.
+ * @return True on success, false if memory could not be allocated.
+ */
+static bool rename_values(SsaProgram *ssa, const bool *is_root, const size_t *entry) {
+    Cfg    *cfg        = &ssa->cfg;
+    size_t  num_blocks = cfg->num_blocks;
+    size_t *start      = calloc(num_blocks + 2, sizeof(size_t));
+    size_t *children   = malloc((num_blocks + 1) * sizeof(size_t));
+    size_t *stack      = malloc((num_blocks + 1) * sizeof(size_t));
+    bool    renamed    = false;
+    if (!start || !children || !stack) {
+        goto done;
+    }
+
+    for (size_t i = 0; i < cfg->array.count; i++) {
+        SsaInstr *instr = &ssa->instrs[i];
+        instr->cmd      = cfg->array.commands[i];
+        instr->block    = cfg->block_of[i];
+        for (size_t k = 0; k < SSA_NUM_OPERANDS; k++) {
+            instr->uses[k] = SSA_NO_VALUE;
+        }
+        instr->flags_in   = SSA_NO_VALUE;
+        instr->memory_in  = SSA_NO_VALUE;
+        instr->result     = SSA_NO_VALUE;
+        instr->flags_out  = SSA_NO_VALUE;
+        instr->memory_out = SSA_NO_VALUE;
+        instr->state      = SSA_NO_VALUE;
+    }
+
+    // Children of each block in the dominator tree, stored back to back
+    size_t pending = 0;
+    for (size_t b = 0; b < num_blocks; b++) {
+        ssa->blocks[b].out = SSA_NO_VALUE;
+        if (!ssa->blocks[b].reached) {
+            continue;
+        }
+        if (cfg->blocks[b].idom == CFG_NO_BLOCK) {
+            stack[pending++] = b;
+        } else {
+            start[cfg->blocks[b].idom + 2]++;
+        }
+    }
+    for (size_t b = 0; b < num_blocks; b++) {
+        start[b + 2] += start[b + 1];
+    }
+    for (size_t b = 0; b < num_blocks; b++) {
+        if (ssa->blocks[b].reached && cfg->blocks[b].idom != CFG_NO_BLOCK) {
+            children[start[cfg->blocks[b].idom + 1]++] = b;
+        }
+    }
+
+    while (pending > 0) {
+        size_t    b     = stack[--pending];
+        SsaBlock *block = &ssa->blocks[b];
+        size_t    idom  = cfg->blocks[b].idom;
+        size_t    current[SSA_NUM_SLOTS];
+        for (size_t s = 0; s < SSA_NUM_SLOTS; s++) {
+            if (idom != CFG_NO_BLOCK) {
+                current[s] = ssa->pool[ssa->blocks[idom].out + s];
+            } else {
+                current[s] = is_root[b] ? entry[b] + s : SSA_NO_VALUE;
+            }
+        }
+        for (size_t k = block->phis; k < block->phis + block->num_phis; k++) {
+            current[ssa->values[ssa->phis[k].value].slot] = ssa->phis[k].value;
+        }
+        for (size_t i = cfg->blocks[b].first; i <= cfg->blocks[b].last; i++) {
+            if (!rename_instr(ssa, i, current)) {
+                goto done;
+            }
+        }
+
+        block->out = pool_alloc(ssa, SSA_NUM_SLOTS);
+        if (block->out == SSA_NO_VALUE) {
+            goto done;
+        }
+        for (size_t s = 0; s < SSA_NUM_SLOTS; s++) {
+            ssa->pool[block->out + s] = current[s];
+        }
+        for (size_t c = start[b]; c < start[b + 1]; c++) {
+            stack[pending++] = children[c];
+        }
+    }
+    renamed = true;
+
+done:
+    free(start);
+    free(children);
+    free(stack);
+    return renamed;
+}
+
+/**
+ * @brief Fills in every phi's arguments: the value its slot has at the end of
+ * each predecessor, or the root's entry value for the edge from outside.
+ *
+ * @param ssa The form being built, with every block's values known.
+ * @param entry The first entry value of each root.
+ */
+static void fill_phi_args(SsaProgram *ssa, const size_t *entry) {
+    for (size_t k = 0; k < ssa->num_phis; k++) {
+        const SsaPhi   *phi   = &ssa->phis[k];
+        const SsaValue *value = &ssa->values[phi->value];
+        const SsaBlock *block = &ssa->blocks[value->block];
+        for (size_t p = 0; p < block->num_preds; p++) {
+            size_t pred = ssa->pool[block->preds + p];
+            size_t arg  = (pred == SSA_ENTRY) ? entry[value->block] + value->slot
+                                              : ssa->pool[ssa->blocks[pred].out + value->slot];
+            ssa->pool[phi->args + p] = arg;
+        }
+    }
+}
+
+/**
+ * @brief Records the values an instruction reads and gives it new values for
+ * what it writes.
+ *
+ * @param ssa The form being built.
+ * @param i Index of the instruction.
+ * @param current The value of every slot before the instruction, updated to
+ * those after it.
+ * @return True on success, false if memory could not be allocated.
+ */
+static bool rename_instr(SsaProgram *ssa, size_t i, size_t *current) {
+    SsaInstr *instr = &ssa->instrs[i];
+    Command  *cmd   = instr->cmd;
+    if (cmd->type == CMD_STORE && is_variable(cmd->destination.num_val)) {
+        instr->uses[SSA_OPERAND_DEST] = current[cmd->destination.num_val];
+    }
+    if (reads_a(cmd)) {
+        instr->uses[SSA_OPERAND_A] = current[cmd->val_a.num_val];
+    }
+    if (reads_b(cmd)) {
+        instr->uses[SSA_OPERAND_B] = current[cmd->val_b.num_val];
+    }
+    if (cmd->type == CMD_BRANCH && cmd->branch_condition != BRANCH_ALWAYS) {
+        instr->flags_in = current[SSA_FLAGS];
+    }
+    if (reads_memory(cmd)) {
+        instr->memory_in = current[SSA_MEMORY];
+    }
+    if (cmd->type == CMD_CALL || cmd->type == CMD_RET) {
+        instr->state = pool_alloc(ssa, SSA_NUM_SLOTS);
+        if (instr->state == SSA_NO_VALUE) {
+            return false;
+        }
+        for (size_t s = 0; s < SSA_NUM_SLOTS; s++) {
+            ssa->pool[instr->state + s] = current[s];
+        }
+    }
+
+    uint64_t writes = instr_writes(cmd);
+    size_t   block  = instr->block;
+    if (writes & LIVE_ALL & ~LIVE_FLAGS) {
+        size_t dest   = (cmd->type == CMD_CALL) ? 0 : (size_t) cmd->destination.num_val;
+        instr->result = new_value(ssa, SSA_VALUE_INSTR, dest, block, i);
+        current[dest] = instr->result;
+    }
+    if (writes & SLOT_BIT(SSA_FLAGS)) {
+        instr->flags_out   = new_value(ssa, SSA_VALUE_INSTR, SSA_FLAGS, block, i);
+        current[SSA_FLAGS] = instr->flags_out;
+    }
+    if (writes & SLOT_BIT(SSA_MEMORY)) {
+        instr->memory_out   = new_value(ssa, SSA_VALUE_INSTR, SSA_MEMORY, block, i);
+        current[SSA_MEMORY] = instr->memory_out;
+    }
+    return true;
+}
+
+/**
+ * @brief Finds the slots any instruction of a block writes.
+ *
+ * @param ssa The form being built.
+ * @param b The block.
+ * @return A mask with bit `s` set for every slot `s` written.
+ */
+static uint64_t block_writes(const SsaProgram *ssa, size_t b) {
+    const Cfg *cfg    = &ssa->cfg;
+    uint64_t   writes = 0;
+    for (size_t i = cfg->blocks[b].first; i <= cfg->blocks[b].last; i++) {
+        writes |= instr_writes(cfg->array.commands[i]);
+    }
+    return writes;
+}
+
+/**
+ * @brief Finds the slots a command writes.
+ *
+ * @param cmd The command.
+ * @return A mask with bit `s` set for every slot `s` written; a call writes
+ * x0, the flags and memory.
+ */
+static uint64_t instr_writes(const Command *cmd) {
+    switch (cmd->type) {
+        case CMD_CALL:
+            return SLOT_BIT(0) | SLOT_BIT(SSA_FLAGS) | SLOT_BIT(SSA_MEMORY);
+        case CMD_STORE:
+        case CMD_PUT:
+            return SLOT_BIT(SSA_MEMORY);
+        default:
+            return command_writes(cmd);
+    }
+}
+
+/**
+ * @brief Determines whether a command reads the variable in its first operand.
+ *
+ * @param cmd The command.
+ * @return True if `val_a` is a variable the command reads.
+ */
+static bool reads_a(const Command *cmd) {
+    if (cmd->is_a_immediate || cmd->is_a_string || !is_variable(cmd->val_a.num_val)) {
+        return false;
+    }
+    switch (cmd->type) {
+        case CMD_BRANCH:
+        case CMD_CALL:
+        case CMD_RET:
+        case CMD_LOAD:
+        case CMD_STORE:
+        case CMD_PUT:
+            return false;
+        default:
+            return true;
+    }
+}
+
+/**
+ * @brief Determines whether a command reads the variable in its second operand.
+ *
+ * @param cmd The command.
+ * @return True if `val_b` is a variable the command reads.
+ */
+static bool reads_b(const Command *cmd) {
+    if (cmd->is_b_immediate || cmd->is_b_string || !is_variable(cmd->val_b.num_val)) {
+        return false;
+    }
+    switch (cmd->type) {
+        case CMD_BRANCH:
+        case CMD_CALL:
+        case CMD_RET:
+        case CMD_MOV:
+        case CMD_PRINT:
+            return false;
+        default:
+            return true;
+    }
+}
+
+/**
+ * @brief Determines whether a command reads memory.
+ *
+ * @param cmd The command.
+ * @return True for loads, stores, `put`, `print` of a string, calls and returns.
+ */
+static bool reads_memory(const Command *cmd) {
+    switch (cmd->type) {
+        case CMD_LOAD:
+        case CMD_STORE:
+        case CMD_PUT:
+        case CMD_CALL:
+        case CMD_RET:
+            return true;
+        case CMD_PRINT:
+            return cmd->val_b.base == 's';
+        default:
+            return false;
+    }
+}
+
+/**
+ * @brief Determines whether an operand value names a variable.
+ *
+ * @param index The operand value.
+ * @return True if `index` is within 0..NUM_VARIABLES-1.
+ */
+static bool is_variable(int64_t index) {
+    return index >= 0 && index < NUM_VARIABLES;
+}
+
+/**
+ * @brief Adds a value; `values` is allocated for every value up front.
+ *
+ * @param ssa The form being built.
+ * @param kind How the value is defined.
+ * @param slot The slot it is a version of.
+ * @param block The block it is defined in.
+ * @param def The defining instruction or phi.
+ * @return The index of the new value.
+ */
+static size_t new_value(SsaProgram *ssa, SsaValueKind kind, size_t slot, size_t block,
+                        size_t def) {
+    SsaValue *value = &ssa->values[ssa->num_values];
+    value->kind     = kind;
+    value->slot     = slot;
+    value->block    = block;
+    value->def      = def;
+    return ssa->num_values++;
+}
+
+/**
+ * @brief Reserves entries at the end of the pool, growing it as needed.
+ *
+ * @param ssa The form being built.
+ * @param count Number of entries to reserve.
+ * @return The index of the first entry, or SSA_NO_VALUE if memory could not
+ * be allocated.
+ */
+static size_t pool_alloc(SsaProgram *ssa, size_t count) {
+    if (ssa->pool_size + count > ssa->pool_cap) {
+        size_t  cap  = (ssa->pool_cap > 0) ? ssa->pool_cap * 2 : 64;
+        while (cap < ssa->pool_size + count) {
+            cap *= 2;
+        }
+        size_t *pool = realloc(ssa->pool, cap * sizeof(size_t));
+        if (!pool) {
+            return SSA_NO_VALUE;
+        }
+        ssa->pool     = pool;
+        ssa->pool_cap = cap;
+    }
+    size_t start = ssa->pool_size;
+    ssa->pool_size += count;
+    return start;
+}
+
+/**
+ * @brief Prints an instruction as its written values, its mnemonic and its
+ * operands, followed by the flags and memory it reads.
+ *
+ * @param ssa The form.
+ * @param i Index of the instruction.
+ */
+static void print_instr(const SsaProgram *ssa, size_t i) {
+    const SsaInstr *instr = &ssa->instrs[i];
+    const Command  *cmd   = instr->cmd;
+    const char     *sep   = "    ";
+    size_t          outs[] = {instr->result, instr->flags_out, instr->memory_out};
+    for (size_t k = 0; k < 3; k++) {
+        if (outs[k] != SSA_NO_VALUE) {
+            printf("%sv%zu:", sep, outs[k]);
+            print_slot(ssa->values[outs[k]].slot);
+            sep = ", ";
+        }
+    }
+    printf("%s%s", (sep[0] == ',') ? " = " : sep, NAMES[cmd->type]);
+
+    int64_t target = ssa->cfg.array.targets[i];
+    switch (cmd->type) {
+        case CMD_BRANCH:
+            printf("%s", CONDITIONS[cmd->branch_condition]);
+            // fall through
+        case CMD_CALL:
+            if (target >= 0) {
+                printf(" b%zu", ssa->cfg.block_of[target]);
+            } else {
+                printf(" %s", (cmd->target == LINK_HALT) ? "halt" : "undefined");
+            }
+            break;
+        case CMD_RET:
+            break;
+        case CMD_PUT:
+            printf(" \"%s\"", cmd->val_a.str_val);
+            print_operand(instr, SSA_OPERAND_B, cmd->val_b.num_val, reads_b(cmd));
+            break;
+        case CMD_PRINT:
+            print_operand(instr, SSA_OPERAND_A, cmd->val_a.num_val, reads_a(cmd));
+            printf(" %c", cmd->val_b.base);
+            break;
+        case CMD_MOV:
+            print_operand(instr, SSA_OPERAND_A, cmd->val_a.num_val, reads_a(cmd));
+            break;
+        case CMD_STORE:
+            // Written as value, address, width
+            print_operand(instr, SSA_OPERAND_DEST, cmd->destination.num_val,
+                          is_variable(cmd->destination.num_val));
+            print_operand(instr, SSA_OPERAND_B, cmd->val_b.num_val, reads_b(cmd));
+            print_operand(instr, SSA_OPERAND_A, cmd->val_a.num_val, reads_a(cmd));
+            break;
+        default:
+            print_operand(instr, SSA_OPERAND_A, cmd->val_a.num_val, reads_a(cmd));
+            print_operand(instr, SSA_OPERAND_B, cmd->val_b.num_val, reads_b(cmd));
+            break;
+    }
+
+    if (instr->flags_in != SSA_NO_VALUE) {
+        printf(" (flags v%zu)", instr->flags_in);
+    }
+    if (instr->memory_in != SSA_NO_VALUE) {
+        printf(" (memory v%zu)", instr->memory_in);
+    }
+    printf("\n");
+}
+
+/**
+ * @brief Prints an operand as its value, or as the variable or immediate it
+ * names in an unreachable instruction.
+ *
+ * @param instr The instruction.
+ * @param operand Which operand to print.
+ * @param num_val The operand's number in the command.
+ * @param is_register Whether the operand names a variable.
+ */
+static void print_operand(const SsaInstr *instr, SsaOperand operand, int64_t num_val,
+                          bool is_register) {
+    if (instr->uses[operand] != SSA_NO_VALUE) {
+        printf(" v%zu", instr->uses[operand]);
+    } else {
+        printf(is_register ? " x%" PRId64 : " %" PRId64, num_val);
+    }
+}
+
+/**
+ * @brief Prints the name of a slot.
+ *
+ * @param slot The slot.
+ */
+static void print_slot(size_t slot) {
+    if (slot == SSA_FLAGS) {
+        printf("flags");
+    } else if (slot == SSA_MEMORY) {
+        printf("memory");
+    } else {
+        printf("x%zu", slot);
+    }
+}
@@ -0,0 +1,96 @@
+#include "trace.h"
+#include <stdlib.h>
+#include "command_type.h"
+
+#define TRACE_BLACKLISTED   UINT32_MAX  // Counter value of headers never to trace.
+
+static void finish_recording(TraceCache *cache, bool compile);
+
+bool trace_cache_init(TraceCache *cache, Program *prog) {
+    if (!cache || !prog) {
+        return false;
+    }
+
+    cache->prog     = prog;
+    cache->counters = calloc(prog->length + 1, sizeof(uint32_t));
+    cache->traces   = calloc(prog->length + 1, sizeof(JitTrace *));
+    cache->recorded = malloc(TRACE_MAX_LENGTH * sizeof(size_t));
+    cache->length   = 0;
+    cache->header   = TRACE_NOT_RECORDING;
+    if (!cache->counters || !cache->traces || !cache->recorded) {
+        trace_cache_free(cache);
+        return false;
+    }
+    return true;
+}
+
+void trace_cache_free(TraceCache *cache) {
+    if (!cache) {
+        return;
+    }
+
+    if (cache->traces) {
+        for (size_t i = 0; i <= cache->prog->length; i++) {
+            jit_free_trace(cache->traces[i]);
+        }
+    }
+    free(cache->counters);
+    free(cache->traces);
+    free(cache->recorded);
+    cache->counters = NULL;
+    cache->traces   = NULL;
+    cache->recorded = NULL;
+}
+
+size_t trace_branch(TraceCache *cache, Interpreter *intr, size_t from, size_t to) {
+    if (to > from || to >= cache->prog->length || cache->header != TRACE_NOT_RECORDING) {
+        return to;
+    }
+
+    if (cache->traces[to]) {
+        size_t pc = jit_run_trace(cache->traces[to], intr);
+        return intr->had_error ? cache->prog->length : pc;
+    }
+    if (cache->counters[to] != TRACE_BLACKLISTED && ++cache->counters[to] >= TRACE_HOT_THRESHOLD) {
+        cache->header = (int64_t) to;
+        cache->length = 0;
+    }
+    return to;
+}
+
+void trace_record(TraceCache *cache, size_t pc) {
+    if (cache->length > 0 && pc == (size_t) cache->header) {
+        finish_recording(cache, true);
+        return;
+    }
+
+    CommandType type = cache->prog->code[pc].type;
+    if (cache->length == TRACE_MAX_LENGTH || type == CMD_CALL || type == CMD_RET) {
+        finish_recording(cache, false);
+        return;
+    }
+    cache->recorded[cache->length++] = pc;
+}
+
+/**
+ * @brief Stops recording, installing the compiled trace or blacklisting the
+ * loop header if it could not be compiled.
+ *
+ * @param cache Pointer to the `TraceCache` that is recording.
+ * @param compile Whether the recording is a complete loop iteration.
+ */
+static void finish_recording(TraceCache *cache, bool compile) {
+    size_t    header = (size_t) cache->header;
+    JitTrace *trace  = NULL;
+    if (compile) {
+        trace = jit_compile_trace(cache->prog, cache->recorded, cache->length);
+    }
+
+    if (trace) {
+        cache->traces[header] = trace;
+    } else {
+        cache->counters[header] = TRACE_BLACKLISTED;
+    }
+    cache->header = TRACE_NOT_RECORDING;
+    cache->length = 0;
+}
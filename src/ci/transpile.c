@@ -0,0 +1,768 @@
+#include "transpile.h"
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include "command_type.h"
+#include "interpreter.h"
+#include "mem.h"
+
+/**
+ * @brief What the translation of a program needs to know while writing it.
+ */
+typedef struct {
+    Program *prog;         // The program being translated.
+    FILE    *out;          // The stream the C source goes to.
+    bool    *is_label;     // Whether each instruction is jumped to by a goto.
+    bool     has_ret;      // Whether any `ret` may pop a frame.
+    bool     uses_fail;    // Whether any instruction may fail.
+    uint32_t registers;    // The variables the generated code declares.
+    bool     uses_flags;   // Whether the flag word is read or written.
+    bool     uses_load;    // Whether any load needs its success flag.
+    bool     uses_memo;    // Whether any call is memoized.
+} Emitter;
+
+static void scan_program(Emitter *e, bool dumps_state);
+static bool is_b_immediate(const Instruction *insn);
+static bool is_valid_register(int64_t operand, bool is_immediate);
+static void emit_instruction(Emitter *e, size_t pc);
+static void emit_call(Emitter *e, size_t pc);
+static void emit_ret(Emitter *e);
+static void emit_goto(Emitter *e, int64_t target);
+static void emit_operand(Emitter *e, int64_t operand, bool is_immediate);
+static void emit_number(Emitter *e, int64_t value);
+static void emit_string(Emitter *e, const char *str);
+static void emit_fail(Emitter *e);
+
+// The generated program's runtime: memory, the call stack, the memo table,
+// and the accesses and dumps that mirror the interpreter's
+static const char *const RUNTIME[] = {
+    "#include <inttypes.h>\n",
+    "#include <stdbool.h>\n",
+    "#include <stdint.h>\n",
+    "#include <stdio.h>\n",
+    "#include <stdlib.h>\n",
+    "#include <string.h>\n",
+    "\n",
+    "#define STACK_MIN_SIZE 64\n",
+    "#define MEMO_CAPACITY  16384\n",
+    "#define MEMO_NONE      UINT32_MAX\n",
+    "#define FLAG_GREATER   0x1\n",
+    "#define FLAG_EQUAL     0x2\n",
+    "#define FLAG_LESS      0x4\n",
+    "#define FLAGS_OF(a, b)                                                 \\\n",
+    "    ((uint8_t) (((a) > (b)) * FLAG_GREATER | ((a) == (b)) * FLAG_EQUAL | \\\n",
+    "                ((a) < (b)) * FLAG_LESS))\n",
+    "\n",
+    "typedef struct {\n",
+    "    uint32_t site;       // The call that pushed the frame.\n",
+    "    uint32_t memo_slot;  // Memo entry to record the call's result in, or MEMO_NONE.\n",
+    "    int64_t  saved[32];  // The variables the call saves.\n",
+    "} Frame;\n",
+    "\n",
+    "typedef struct {\n",
+    "    uint8_t  state;  // 0 when empty, 1 while the call runs, 2 once it returned.\n",
+    "    uint8_t  function;\n",
+    "    uint8_t  flags_in;\n",
+    "    uint8_t  flags_out;\n",
+    "    uint32_t depth;\n",
+    "    int64_t  inputs[4];\n",
+    "    int64_t  result;\n",
+    "} MemoEntry;\n",
+    "\n",
+    "static uint8_t    mem[MEM_CAPACITY];\n",
+    "static Frame     *stack;\n",
+    "static size_t     depth;\n",
+    "static size_t     capacity;\n",
+    "static size_t     peak_depth;\n",
+    "static MemoEntry *memo;\n",
+    "\n",
+    "static inline bool push_frame(uint32_t site) {\n",
+    "    if (depth == capacity) {\n",
+    "        if (MAX_DEPTH && depth == MAX_DEPTH) {\n",
+    "            printf(\"Stack overflow: call depth exceeds %zu\\n\", (size_t) MAX_DEPTH);\n",
+    "            return false;\n",
+    "        }\n",
+    "        size_t new_capacity = capacity ? capacity * 2 : STACK_MIN_SIZE;\n",
+    "        if (MAX_DEPTH && new_capacity > MAX_DEPTH) {\n",
+    "            new_capacity = MAX_DEPTH;\n",
+    "        }\n",
+    "        Frame *frames = realloc(stack, new_capacity * sizeof(Frame));\n",
+    "        if (!frames) {\n",
+    "            return false;\n",
+    "        }\n",
+    "        stack    = frames;\n",
+    "        capacity = new_capacity;\n",
+    "    }\n",
+    "    stack[depth].site      = site;\n",
+    "    stack[depth].memo_slot = MEMO_NONE;\n",
+    "    if (++depth > peak_depth) {\n",
+    "        peak_depth = depth;\n",
+    "    }\n",
+    "    return true;\n",
+    "}\n",
+    "\n",
+    "static inline int64_t load(int64_t offset, int64_t bytes, bool *ok) {\n",
+    "    int64_t value = 0;\n",
+    "    *ok = (bytes == 1 || bytes == 2 || bytes == 4 || bytes == 8) &&\n",
+    "          (uint64_t) offset <= (uint64_t) (MEM_CAPACITY - bytes);\n",
+    "    if (*ok) {\n",
+    "        memcpy(&value, &mem[offset], (size_t) bytes);\n",
+    "    }\n",
+    "    return value;\n",
+    "}\n",
+    "\n",
+    "static inline bool store(int64_t value, int64_t offset, int64_t bytes) {\n",
+    "    if ((bytes != 1 && bytes != 2 && bytes != 4 && bytes != 8) ||\n",
+    "        (uint64_t) offset > (uint64_t) (MEM_CAPACITY - bytes)) {\n",
+    "        return false;\n",
+    "    }\n",
+    "    for (int64_t i = 0; i < bytes; i++) {\n",
+    "        mem[offset + i] = (uint8_t) (value >> (i * 8));\n",
+    "    }\n",
+    "    return true;\n",
+    "}\n",
+    "\n",
+    "static inline bool put(const char *str, int64_t offset) {\n",
+    "    size_t length = strlen(str) + 1;\n",
+    "    for (size_t i = 0; i < length; i++) {\n",
+    "        if ((uint64_t) offset + i >= MEM_CAPACITY) {\n",
+    "            return false;\n",
+    "        }\n",
+    "        mem[offset + i] = (uint8_t) str[i];\n",
+    "    }\n",
+    "    return true;\n",
+    "}\n",
+    "\n",
+    "static inline bool print_string(int64_t offset) {\n",
+    "    char   str[MEM_CAPACITY];\n",
+    "    size_t i;\n",
+    "    for (i = 0; i < MEM_CAPACITY - 1; i++) {\n",
+    "        if ((uint64_t) offset + i >= MEM_CAPACITY) {\n",
+    "            return false;\n",
+    "        }\n",
+    "        str[i] = (char) mem[offset + i];\n",
+    "        if (str[i] == '\\0') {\n",
+    "            break;\n",
+    "        }\n",
+    "    }\n",
+    "    str[i] = '\\0';\n",
+    "    printf(\"%s\\n\", str);\n",
+    "    return true;\n",
+    "}\n",
+    "\n",
+    "static inline void print_binary(uint64_t value) {\n",
+    "    char   bits[67] = \"0b0\";\n",
+    "    size_t length   = 2;\n",
+    "    for (int i = 63; i >= 0; i--) {\n",
+    "        if (length > 2 || (value >> i) & 1) {\n",
+    "            bits[length++] = ((value >> i) & 1) ? '1' : '0';\n",
+    "        }\n",
+    "    }\n",
+    "    bits[length > 2 ? length : 3] = '\\0';\n",
+    "    printf(\"%s\\n\", bits);\n",
+    "}\n",
+    "\n",
+    "static inline bool memo_lookup(uint8_t function, const int64_t *inputs, uint8_t num_inputs,\n",
+    "                               uint8_t flags, bool claim, uint32_t *slot, int64_t *result,\n",
+    "                               uint8_t *flags_out) {\n",
+    "    *slot = MEMO_NONE;\n",
+    "    if (!memo) {\n",
+    "        memo = calloc(MEMO_CAPACITY, sizeof(MemoEntry));\n",
+    "    }\n",
+    "    if (!memo) {\n",
+    "        return false;\n",
+    "    }\n",
+    "\n",
+    "    uint64_t hash = ((uint64_t) function << 8 | flags) * 0x9E3779B97F4A7C15u;\n",
+    "    for (uint8_t i = 0; i < num_inputs; i++) {\n",
+    "        hash = (hash ^ (uint64_t) inputs[i]) * 0x9E3779B97F4A7C15u;\n",
+    "    }\n",
+    "    uint32_t   index = (uint32_t) (hash >> 32) & (MEMO_CAPACITY - 1);\n",
+    "    MemoEntry *entry = &memo[index];\n",
+    "    if (entry->state == 2 && entry->function == function && entry->flags_in == flags &&\n",
+    "        memcmp(entry->inputs, inputs, num_inputs * sizeof(int64_t)) == 0) {\n",
+    "        *result    = entry->result;\n",
+    "        *flags_out = entry->flags_out;\n",
+    "        return true;\n",
+    "    }\n",
+    "    if (!claim) {\n",
+    "        return false;\n",
+    "    }\n",
+    "    entry->state    = 1;\n",
+    "    entry->function = function;\n",
+    "    entry->flags_in = flags;\n",
+    "    entry->depth    = (uint32_t) (depth + 1);\n",
+    "    memcpy(entry->inputs, inputs, num_inputs * sizeof(int64_t));\n",
+    "    *slot = index;\n",
+    "    return false;\n",
+    "}\n",
+    "\n",
+    "static inline void memo_fill(uint32_t slot, int64_t result, uint8_t flags) {\n",
+    "    MemoEntry *entry = &memo[slot];\n",
+    "    if (entry->state == 1 && entry->depth == (uint32_t) (depth + 1)) {\n",
+    "        entry->state     = 2;\n",
+    "        entry->result    = result;\n",
+    "        entry->flags_out = flags;\n",
+    "    }\n",
+    "}\n",
+    "\n",
+    "static inline void dump_state(const int64_t *x, uint8_t flags, bool had_error) {\n",
+    "    printf(\"Error: %d\\n\", had_error);\n",
+    "    printf(\"Flags:\\n\");\n",
+    "    printf(\"Is greater: %d\\n\", (flags & FLAG_GREATER) != 0);\n",
+    "    printf(\"Is equal: %d\\n\", (flags & FLAG_EQUAL) != 0);\n",
+    "    printf(\"Is less: %d\\n\", (flags & FLAG_LESS) != 0);\n",
+    "    printf(\"\\n\");\n",
+    "    printf(\"Peak call depth: %zu\\n\", peak_depth);\n",
+    "    printf(\"\\n\");\n",
+    "    printf(\"Variable values:\\n\");\n",
+    "    for (size_t i = 0; i < 32; i++) {\n",
+    "        printf(\"x%zu: %\" PRId64 \"\", i, x[i]);\n",
+    "        if (i < 31) {\n",
+    "            printf(\", \");\n",
+    "        }\n",
+    "        if ((i + 1) % 8 == 0) {\n",
+    "            printf(\"\\n\");\n",
+    "        }\n",
+    "    }\n",
+    "    printf(\"\\n\");\n",
+    "\n",
+    "    printf(\"Memory state:\\n\");\n",
+    "    int    addr_width = 1;\n",
+    "    size_t temp       = MEM_CAPACITY - 1;\n",
+    "    while (temp >>= 4) {\n",
+    "        addr_width++;\n",
+    "    }\n",
+    "    size_t first = 0;\n",
+    "    while (first < MEM_CAPACITY && mem[first] == 0) {\n",
+    "        first++;\n",
+    "    }\n",
+    "    if (first == MEM_CAPACITY) {\n",
+    "        printf(\"Unmodified\\n\");\n",
+    "        return;\n",
+    "    }\n",
+    "    size_t last = MEM_CAPACITY - 1;\n",
+    "    while (last > first && mem[last] == 0) {\n",
+    "        last--;\n",
+    "    }\n",
+    "    size_t start = first & ~(size_t) 0xF;\n",
+    "    size_t end   = (last + 16) & ~(size_t) 0xF;\n",
+    "    if (end > MEM_CAPACITY) {\n",
+    "        end = MEM_CAPACITY;\n",
+    "    }\n",
+    "    printf(\"0x%0*zx-0x%0*zx:\\n\", addr_width, start, addr_width, end - 1);\n",
+    "    for (size_t j = start; j < end; j += 16) {\n",
+    "        printf(\"    0x%0*zx: \", addr_width, j);\n",
+    "        for (size_t k = 0; k < 16 && j + k < end; k++) {\n",
+    "            printf(\"%02x\", mem[j + k]);\n",
+    "            if ((k + 1) % 4 == 0) {\n",
+    "                printf(\" \");\n",
+    "            }\n",
+    "        }\n",
+    "        printf(\"\\n\");\n",
+    "    }\n",
+    "}\n",
+    NULL,
+};
+
+// Conditions on the flag word, indexed by BranchCondition
+static const char *const CONDITIONS[] = {
+    "1",
+    "flags & FLAG_EQUAL",
+    "!(flags & FLAG_EQUAL)",
+    "flags & FLAG_GREATER",
+    "flags & FLAG_LESS",
+    "flags & (FLAG_GREATER | FLAG_EQUAL)",
+    "flags & (FLAG_LESS | FLAG_EQUAL)",
+};
+
+bool program_emit_c(Program *prog, FILE *out, size_t max_depth, bool dumps_state) {
+    if (!prog || !out) {
+        return false;
+    }
+
+    Emitter e = {prog, out, calloc(prog->length + 1, sizeof(bool)), false, false, 0, false,
+                 false, false};
+    if (!e.is_label) {
+        return false;
+    }
+    scan_program(&e, dumps_state);
+
+    fprintf(out, "// Generated by ci --emit-c\n");
+    fprintf(out, "#define MAX_DEPTH    ((size_t) %zu)  // Deepest the call stack may grow, or 0\n",
+            max_depth);
+    fprintf(out, "#define MEM_CAPACITY %d\n\n", MEM_CAPACITY);
+    for (size_t k = 0; RUNTIME[k]; k++) {
+        fputs(RUNTIME[k], out);
+    }
+
+    fprintf(out, "\nint main(void) {\n");
+    // Without the dumps, a variable may be written and never read
+    for (size_t i = 0; i < NUM_VARIABLES; i++) {
+        if (e.registers & ((uint32_t) 1 << i)) {
+            fprintf(out, "    int64_t x%zu = 0;", i);
+            fprintf(out, dumps_state ? "\n" : " (void) x%zu;\n", i);
+        }
+    }
+    if (e.uses_flags) {
+        fprintf(out, "    uint8_t flags = 0;%s\n", dumps_state ? "" : " (void) flags;");
+    }
+    if (e.uses_load) {
+        fprintf(out, "    bool ok;\n");
+    }
+    if (e.uses_memo) {
+        fprintf(out, "    uint32_t slot;\n    int64_t inputs[4] = {0};\n");
+        fprintf(out, "    int64_t result;\n    uint8_t flags_out;\n");
+    }
+    fprintf(out, "    bool had_error = false;\n\n");
+
+    for (size_t pc = 0; pc < prog->length; pc++) {
+        if (e.is_label[pc]) {
+            fprintf(out, "L%zu:\n", pc);
+        }
+        emit_instruction(&e, pc);
+    }
+
+    fprintf(out, "    goto halt;\n");
+    if (e.uses_fail) {
+        fprintf(out, "fail:\n    had_error = true;\n");
+    }
+    fprintf(out, "halt:\n    free(stack);\n    free(memo);\n");
+    if (dumps_state) {
+        fprintf(out, "    dump_state((const int64_t[]) {");
+        for (size_t i = 0; i < NUM_VARIABLES; i++) {
+            fprintf(out, "%sx%zu", (i == 0) ? "" : ", ", i);
+        }
+        fprintf(out, "}, flags, had_error);\n");
+    }
+    fprintf(out, "    return had_error ? -1 : 0;\n}\n");
+
+    free(e.is_label);
+    return !ferror(out);
+}
+
+/**
+ * @brief Finds the labels and declarations the generated code needs.
+ *
+ * @param e The emitter, with `is_label` cleared.
+ * @param dumps_state Whether the final dump reads every variable and the flags.
+ */
+static void scan_program(Emitter *e, bool dumps_state) {
+    Program *prog = e->prog;
+    e->registers  = dumps_state ? UINT32_MAX : 0;
+    e->uses_flags = dumps_state;
+    for (size_t pc = 0; pc < prog->length; pc++) {
+        Instruction *insn = &prog->code[pc];
+        switch (insn->type) {
+            case CMD_BRANCH:
+                if (insn->target >= 0 && (size_t) insn->target < prog->length) {
+                    e->is_label[insn->target] = true;
+                }
+                e->uses_flags |= insn->branch_condition != BRANCH_ALWAYS;
+                continue;
+            case CMD_CALL:
+                if (insn->target >= 0 && (size_t) insn->target < prog->length) {
+                    e->is_label[insn->target] = true;
+                }
+                e->registers |= PROGRAM_CALL_SAVES(insn) & ~(uint32_t) 1;
+                if (insn->is_memoized) {
+                    const PureFunction *fn = &prog->pure[insn->destination];
+                    for (uint8_t k = 0; k < fn->num_inputs; k++) {
+                        e->registers |= (uint32_t) 1 << fn->inputs[k];
+                    }
+                    e->registers       |= 1;
+                    e->uses_flags       = true;
+                    e->uses_memo        = true;
+                    e->is_label[pc + 1] = true;  // Where a hit resumes
+                }
+                continue;
+            case CMD_RET:
+                e->has_ret = true;
+                continue;
+            case CMD_CMP:
+            case CMD_CMP_U:
+                e->uses_flags = true;
+                break;
+            case CMD_LOAD:
+                e->uses_load = true;
+                break;
+            default:
+                break;
+        }
+
+        if (insn->type != CMD_PUT && !insn->is_a_immediate && insn->val_a >= 0 &&
+            insn->val_a < NUM_VARIABLES) {
+            e->registers |= (uint32_t) 1 << insn->val_a;
+        }
+        if (insn->type != CMD_MOV && insn->type != CMD_PRINT && !is_b_immediate(insn) &&
+            insn->val_b >= 0 && insn->val_b < NUM_VARIABLES) {
+            e->registers |= (uint32_t) 1 << insn->val_b;
+        }
+        if (insn->type != CMD_PRINT && insn->type != CMD_PUT &&
+            insn->destination < NUM_VARIABLES) {
+            e->registers |= (uint32_t) 1 << insn->destination;
+        }
+    }
+}
+
+/**
+ * @brief Determines whether an instruction's second operand is read as an
+ * immediate. The logical instructions always read a variable, as the engines do.
+ *
+ * @param insn The instruction.
+ * @return True if the second operand is an immediate.
+ */
+static bool is_b_immediate(const Instruction *insn) {
+    return insn->is_b_immediate && insn->type != CMD_AND && insn->type != CMD_EOR &&
+           insn->type != CMD_ORR;
+}
+
+/**
+ * @brief Determines whether a variable operand names one of the variables.
+ *
+ * @param operand The operand, as returned by `PROGRAM_OPERAND_A/B`.
+ * @param is_immediate Whether the operand is an immediate, which is always valid.
+ * @return False if the operand would make the interpreter fail.
+ */
+static bool is_valid_register(int64_t operand, bool is_immediate) {
+    return is_immediate || (operand >= 0 && operand < NUM_VARIABLES);
+}
+
+/**
+ * @brief Writes the C statements of one instruction.
+ *
+ * @param e The emitter.
+ * @param pc Index of the instruction.
+ */
+static void emit_instruction(Emitter *e, size_t pc) {
+    Program     *prog  = e->prog;
+    FILE        *out   = e->out;
+    Instruction *insn  = &prog->code[pc];
+    int64_t      a     = insn->is_a_string ? 0 : PROGRAM_OPERAND_A(prog, insn);
+    int64_t      b     = PROGRAM_OPERAND_B(prog, insn);
+    bool         b_imm = is_b_immediate(insn);
+    bool         a_ok  = is_valid_register(a, insn->is_a_immediate || insn->is_a_string);
+    bool         b_ok  = is_valid_register(b, b_imm);
+    unsigned     dest  = insn->destination;
+
+    switch (insn->type) {
+        case CMD_MOV:
+            if (!a_ok) {
+                emit_fail(e);
+                break;
+            }
+            fprintf(out, "    x%u = ", dest);
+            emit_operand(e, a, insn->is_a_immediate);
+            fprintf(out, ";\n");
+            break;
+        case CMD_ADD:
+        case CMD_SUB:
+        case CMD_AND:
+        case CMD_EOR:
+        case CMD_ORR: {
+            bool        wraps = insn->type == CMD_ADD || insn->type == CMD_SUB;
+            const char *op    = (insn->type == CMD_ADD)   ? "+"
+                                : (insn->type == CMD_SUB) ? "-"
+                                : (insn->type == CMD_AND) ? "&"
+                                : (insn->type == CMD_EOR) ? "^"
+                                                          : "|";
+            if (!is_valid_register(a, false) || !b_ok) {
+                emit_fail(e);
+                break;
+            }
+            fprintf(out, "    x%u = %s", dest, wraps ? "(int64_t) ((uint64_t) " : "");
+            emit_operand(e, a, false);
+            fprintf(out, " %s %s", op, wraps ? "(uint64_t) " : "");
+            emit_operand(e, b, b_imm);
+            fprintf(out, "%s;\n", wraps ? ")" : "");
+            break;
+        }
+        case CMD_LSL:
+        case CMD_LSR:
+        case CMD_ASR:
+            if (!is_valid_register(a, false) || !b_ok ||
+                (b_imm && (b < 0 || b > 63))) {
+                emit_fail(e);
+                break;
+            }
+            if (!b_imm) {
+                fprintf(out, "    if (x%" PRId64 " < 0 || x%" PRId64 " > 63) goto fail;\n", b, b);
+                e->uses_fail = true;
+            }
+            if (insn->type == CMD_ASR) {
+                fprintf(out, "    x%u = x%" PRId64 " >> ", dest, a);
+            } else {
+                fprintf(out, "    x%u = (int64_t) ((uint64_t) x%" PRId64 " %s ", dest, a,
+                        (insn->type == CMD_LSL) ? "<<" : ">>");
+            }
+            emit_operand(e, b, b_imm);
+            fprintf(out, "%s;\n", (insn->type == CMD_ASR) ? "" : ")");
+            break;
+        case CMD_CMP:
+        case CMD_CMP_U: {
+            const char *cast = (insn->type == CMD_CMP_U) ? "(uint64_t) " : "";
+            if (!is_valid_register(a, false) || !b_ok) {
+                emit_fail(e);
+                break;
+            }
+            fprintf(out, "    flags = FLAGS_OF(%s", cast);
+            emit_operand(e, a, false);
+            fprintf(out, ", %s", cast);
+            emit_operand(e, b, b_imm);
+            fprintf(out, ");\n");
+            break;
+        }
+        case CMD_PRINT:
+            if (!a_ok) {
+                emit_fail(e);
+                break;
+            }
+            switch (insn->val_b) {
+                case 'd':
+                    fprintf(out, "    printf(\"%%\" PRId64 \"\\n\", ");
+                    emit_operand(e, a, insn->is_a_immediate);
+                    fprintf(out, ");\n");
+                    break;
+                case 'x':
+                    fprintf(out, "    printf(\"0x%%\" PRIx64 \"\\n\", (uint64_t) ");
+                    emit_operand(e, a, insn->is_a_immediate);
+                    fprintf(out, ");\n");
+                    break;
+                case 'b':
+                    fprintf(out, "    print_binary((uint64_t) ");
+                    emit_operand(e, a, insn->is_a_immediate);
+                    fprintf(out, ");\n");
+                    break;
+                case 's':
+                    fprintf(out, "    if (!print_string(");
+                    emit_operand(e, a, insn->is_a_immediate);
+                    fprintf(out, ")) goto fail;\n");
+                    e->uses_fail = true;
+                    break;
+                default:
+                    emit_fail(e);
+                    break;
+            }
+            break;
+        case CMD_LOAD:
+            if (!a_ok || !b_ok) {
+                emit_fail(e);
+                break;
+            }
+            fprintf(out, "    x%u = load(", dest);
+            emit_operand(e, b, b_imm);
+            fprintf(out, ", ");
+            emit_operand(e, a, insn->is_a_immediate);
+            fprintf(out, ", &ok);\n    if (!ok) goto fail;\n");
+            e->uses_fail = true;
+            break;
+        case CMD_STORE:
+            if (!a_ok || !b_ok) {
+                emit_fail(e);
+                break;
+            }
+            fprintf(out, "    if (!store(x%u, ", dest);
+            emit_operand(e, b, b_imm);
+            fprintf(out, ", ");
+            emit_operand(e, a, insn->is_a_immediate);
+            fprintf(out, ")) goto fail;\n");
+            e->uses_fail = true;
+            break;
+        case CMD_PUT:
+            if (!b_ok) {
+                emit_fail(e);
+                break;
+            }
+            fprintf(out, "    if (!put(");
+            emit_string(e, PROGRAM_STRING_A(prog, insn));
+            fprintf(out, ", ");
+            emit_operand(e, b, b_imm);
+            fprintf(out, ")) goto fail;\n");
+            e->uses_fail = true;
+            break;
+        case CMD_BRANCH:
+            if (insn->branch_condition != BRANCH_ALWAYS) {
+                fprintf(out, "    if (%s) ", CONDITIONS[insn->branch_condition]);
+            } else {
+                fprintf(out, "    ");
+            }
+            if (insn->target == PROGRAM_NO_TARGET) {
+                fprintf(out, "{\n        printf(\"Label not found: %%s\\n\", ");
+                emit_string(e, PROGRAM_STRING_A(prog, insn));
+                fprintf(out, ");\n        goto fail;\n    }\n");
+                e->uses_fail = true;
+            } else {
+                emit_goto(e, insn->target);
+            }
+            break;
+        case CMD_CALL:
+            emit_call(e, pc);
+            break;
+        case CMD_RET:
+            emit_ret(e);
+            break;
+        default:
+            emit_fail(e);
+            break;
+    }
+}
+
+/**
+ * @brief Writes the C statements of a call, followed by its return site.
+ *
+ * @param e The emitter.
+ * @param pc Index of the call.
+ */
+static void emit_call(Emitter *e, size_t pc) {
+    Program     *prog = e->prog;
+    FILE        *out  = e->out;
+    Instruction *insn = &prog->code[pc];
+    if (insn->target == PROGRAM_NO_TARGET) {
+        fprintf(out, "    printf(\"Label not found: %%s\\n\", ");
+        emit_string(e, PROGRAM_STRING_A(prog, insn));
+        fprintf(out, ");\n    goto fail;\n");
+        e->uses_fail = true;
+        return;
+    }
+
+    // A hit sets x0 and the flags without running the callee
+    if (insn->is_memoized) {
+        const PureFunction *fn = &prog->pure[insn->destination];
+        for (uint8_t k = 0; k < fn->num_inputs; k++) {
+            fprintf(out, "    inputs[%u] = x%u;\n", k, fn->inputs[k]);
+        }
+        fprintf(out, "    if (memo_lookup(%u, inputs, %u, %s, %s, &slot, &result, &flags_out)) {\n",
+                insn->destination, fn->num_inputs, fn->reads_flags ? "flags" : "0",
+                insn->is_tail_call ? "depth == 0" : "true");
+        fprintf(out, "        x0    = result;\n        flags = flags_out;\n        ");
+        emit_goto(e, (int64_t) pc + 1);
+        fprintf(out, "    }\n");
+    }
+
+    // A tail call returns straight to the caller's caller
+    if (insn->is_tail_call) {
+        fprintf(out, "    if (depth > 0) ");
+        emit_goto(e, insn->target);
+    }
+    fprintf(out, "    if (!push_frame(%zu)) goto fail;\n", pc);
+    e->uses_fail   = true;
+    uint32_t saves = PROGRAM_CALL_SAVES(insn) & ~(uint32_t) 1;
+    for (size_t i = 0; i < NUM_VARIABLES; i++) {
+        if (saves & ((uint32_t) 1 << i)) {
+            fprintf(out, "    stack[depth - 1].saved[%zu] = x%zu;\n", i, i);
+        }
+    }
+    if (insn->is_memoized) {
+        fprintf(out, "    stack[depth - 1].memo_slot = slot;\n");
+    }
+    fprintf(out, "    ");
+    emit_goto(e, insn->target);
+    if (!e->has_ret) {
+        return;
+    }
+
+    // Returning restores what the call saved, except x0
+    fprintf(out, "R%zu:\n", pc);
+    for (size_t i = 0; i < NUM_VARIABLES; i++) {
+        if (saves & ((uint32_t) 1 << i)) {
+            fprintf(out, "    x%zu = stack[depth].saved[%zu];\n", i, i);
+        }
+    }
+    if (insn->is_memoized) {
+        fprintf(out, "    if (stack[depth].memo_slot != MEMO_NONE) ");
+        fprintf(out, "memo_fill(stack[depth].memo_slot, x0, flags);\n");
+    }
+}
+
+/**
+ * @brief Writes the C statements of a return, which pops a frame and resumes
+ * at the return site of the call that pushed it.
+ *
+ * @param e The emitter.
+ */
+static void emit_ret(Emitter *e) {
+    Program *prog = e->prog;
+    FILE    *out  = e->out;
+    fprintf(out, "    if (depth == 0) goto halt;\n");
+    fprintf(out, "    switch (stack[--depth].site) {\n");
+    for (size_t pc = 0; pc < prog->length; pc++) {
+        Instruction *insn = &prog->code[pc];
+        if (insn->type == CMD_CALL && insn->target != PROGRAM_NO_TARGET) {
+            fprintf(out, "        case %zu: goto R%zu;\n", pc, pc);
+        }
+    }
+    fprintf(out, "        default: goto halt;\n    }\n");
+}
+
+/**
+ * @brief Writes a goto to an instruction, or to the end of the program.
+ *
+ * @param e The emitter.
+ * @param target Index of the instruction.
+ */
+static void emit_goto(Emitter *e, int64_t target) {
+    if (target < 0 || (size_t) target >= e->prog->length) {
+        fprintf(e->out, "goto halt;\n");
+    } else {
+        fprintf(e->out, "goto L%" PRId64 ";\n", target);
+    }
+}
+
+/**
+ * @brief Writes an operand as a variable or a C integer constant.
+ *
+ * @param e The emitter.
+ * @param operand The operand, as returned by `PROGRAM_OPERAND_A/B`.
+ * @param is_immediate Whether the operand is an immediate.
+ */
+static void emit_operand(Emitter *e, int64_t operand, bool is_immediate) {
+    if (is_immediate) {
+        emit_number(e, operand);
+    } else {
+        fprintf(e->out, "x%" PRId64, operand);
+    }
+}
+
+/**
+ * @brief Writes a C constant expression of type int64_t.
+ *
+ * @param e The emitter.
+ * @param value The value.
+ */
+static void emit_number(Emitter *e, int64_t value) {
+    if (value == INT64_MIN) {
+        fprintf(e->out, "INT64_MIN");
+    } else {
+        fprintf(e->out, "INT64_C(%" PRId64 ")", value);
+    }
+}
+
+/**
+ * @brief Writes a C string literal, escaping everything but printable ASCII.
+ *
+ * @param e The emitter.
+ * @param str The string.
+ */
+static void emit_string(Emitter *e, const char *str) {
+    fputc('"', e->out);
+    for (const unsigned char *c = (const unsigned char *) str; *c; c++) {
+        if (*c == '"' || *c == '\\' || *c == '?') {
+            fprintf(e->out, "\\%c", *c);
+        } else if (*c < 0x20 || *c > 0x7E) {
+            fprintf(e->out, "\\%03o", *c);
+        } else {
+            fputc(*c, e->out);
+        }
+    }
+    fputc('"', e->out);
+}
+
+/**
+ * @brief Writes a jump to the error exit, for an instruction that always fails.
+ *
+ * @param e The emitter.
+ */
+static void emit_fail(Emitter *e) {
+    fprintf(e->out, "    goto fail;\n");
+    e->uses_fail = true;
+}
@@ -0,0 +1,381 @@
+#include "unroll.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include "cfg.h"
+#include "command_type.h"
+#include "linker.h"
+#include "liveness.h"
+#include "rewrite.h"
+
+#define UNROLLED_LABEL  ".Lunrolled"   // Label of the branch back to the unrolled copies.
+#define REMAINDER_LABEL ".Lremainder"  // Label of the branch to the original loop.
+#define GUARD_LABEL     ".Lguard"      // Label of the branch keeping the guard's clamped bound.
+#define DONE_LABEL      ".Ldone"       // Label of the branch leaving after the unrolled copies.
+
+// The condition under which a branch goes the other way, right after a compare
+static const BranchCondition INVERSE[] = {
+    [BRANCH_GREATER]       = BRANCH_LESS_EQUAL,
+    [BRANCH_LESS_EQUAL]    = BRANCH_GREATER,
+    [BRANCH_LESS]          = BRANCH_GREATER_EQUAL,
+    [BRANCH_GREATER_EQUAL] = BRANCH_LESS,
+};
+
+/**
+ * @brief A loop that steps a variable towards a bound, and how to unroll it.
+ */
+typedef struct {
+    size_t   first;     // Index of the loop's first command.
+    size_t   last;      // Index of the branch closing it.
+    size_t   update;    // Index of the command stepping the variable.
+    int64_t  var;       // The variable stepped.
+    int64_t  step;      // What one iteration adds to it.
+    bool     merge;     // Whether the copies step it just once, as nothing else reads it.
+    uint64_t used;      // Variables the loop reads or writes.
+    int64_t  distance;  // What the guard takes off the bound; see `plan_guard`.
+    int64_t  bound;     // The guard's bound, when the loop's bound is an immediate.
+    int64_t  spare;     // Variable holding the guard's bound, or REWRITE_NO_VARIABLE.
+    bool     restore;   // Whether `spare` must be zeroed again when the loop ends.
+} CountedLoop;
+
+static bool     find_counted_loop(const Cfg *cfg, const Loop *loop, size_t factor,
+                                  bool dumps_state, CountedLoop *counted);
+static bool     plan_guard(const Command *cmp, BranchCondition condition, size_t factor,
+                           CountedLoop *counted);
+static bool     unroll(Command **commands, const CommandArray *array, size_t factor,
+                       const CountedLoop *counted);
+static bool     add_copies(Command ***link, const CommandArray *array, size_t factor,
+                           const CountedLoop *counted);
+static Command *new_compare(int64_t var, int64_t bound, bool is_immediate);
+static Command *new_move(int64_t var, int64_t value);
+static bool     append(Command ***link, Command *cmd);
+
+size_t unroll_loops(Command **commands, size_t factor, bool dumps_state, bool calls_may_fail) {
+    Cfg cfg;
+    if (factor < 2 || !*commands || !cfg_build(&cfg, *commands)) {
+        return 0;
+    }
+    Liveness liveness;
+    if (!liveness_compute(&liveness, &cfg.array, dumps_state, calls_may_fail)) {
+        cfg_free(&cfg);
+        return 0;
+    }
+
+    // Variables nothing writes stay zero, so a guard may borrow them and re-zero them
+    uint64_t written = 0;
+    for (size_t i = 0; i < cfg.array.count; i++) {
+        written |= command_writes(cfg.array.commands[i]);
+    }
+
+    // Unrolling only adds commands around a loop, so the analysis holds for all
+    // of them. Going backwards, a loop's exit already leads into the next
+    // loop's new commands.
+    size_t unrolled = 0;
+    for (size_t b = cfg.num_blocks; b-- > 0;) {
+        for (size_t l = 0; l < cfg.num_loops; l++) {
+            CountedLoop counted;
+            if (cfg.loops[l].header != b ||
+                !find_counted_loop(&cfg, &cfg.loops[l], factor, dumps_state, &counted) ||
+                !liveness.reached[counted.first]) {
+                continue;
+            }
+            counted.spare   = REWRITE_NO_VARIABLE;
+            counted.restore = false;
+            if (!cfg.array.commands[counted.last - 1]->is_b_immediate && counted.distance != 0) {
+                counted.spare = find_spare_variable(counted.used, liveness.live[counted.last + 1],
+                                                    written, &counted.restore);
+                if (counted.spare == REWRITE_NO_VARIABLE) {
+                    continue;
+                }
+            }
+            unrolled += unroll(commands, &cfg.array, factor, &counted);
+        }
+    }
+
+    liveness_free(&liveness);
+    cfg_free(&cfg);
+    return unrolled;
+}
+
+/**
+ * @brief Determines whether a loop is a counted loop that can be unrolled.
+ *
+ * @param cfg The control-flow graph.
+ * @param loop The loop.
+ * @param factor Number of iterations per unrolled trip.
+ * @param dumps_state Whether the variables and flags are printed at the end.
+ * @param counted Filled in with the loop's shape if it can be unrolled.
+ * @return true if the loop can be unrolled, false otherwise.
+ */
+static bool find_counted_loop(const Cfg *cfg, const Loop *loop, size_t factor,
+                              bool dumps_state, CountedLoop *counted) {
+    const CommandArray *array = &cfg->array;
+    const BasicBlock   *block = &cfg->blocks[loop->header];
+    if (loop->num_blocks != 1 || block->last < block->first + 2) {
+        return false;
+    }
+
+    // The block ends with `cmp var, bound` and a branch back to its start
+    Command *branch = array->commands[block->last];
+    Command *cmp    = array->commands[block->last - 1];
+    if (branch->type != CMD_BRANCH || array->targets[block->last] != (int64_t) block->first ||
+        cmp->type != CMD_CMP || cmp->is_a_immediate || cmp->is_a_string || cmp->is_b_string) {
+        return false;
+    }
+    if ((block->last - 1 - block->first) * factor > UNROLL_MAX_COMMANDS) {
+        return false;
+    }
+
+    counted->first  = block->first;
+    counted->last   = block->last;
+    counted->update = block->first;
+    counted->var    = cmp->val_a.num_val;
+    counted->step   = 0;
+    counted->merge  = true;
+    counted->used   = command_reads(cmp);
+    counted->bound  = 0;
+    uint64_t var    = (uint64_t) 1 << counted->var;
+    uint64_t bound  = cmp->is_b_immediate ? 0 : (uint64_t) 1 << cmp->val_b.num_val;
+    size_t   steps  = 0;
+    for (size_t i = block->first; i < block->last - 1; i++) {
+        Command *cmd    = array->commands[i];
+        uint64_t reads  = command_reads(cmd);
+        uint64_t writes = command_writes(cmd) & ~LIVE_FLAGS;
+        if ((dumps_state && command_may_fail(cmd)) || writes & bound) {
+            return false;
+        }
+        counted->used |= reads | writes;
+        if (!(writes & var)) {
+            counted->merge = counted->merge && !(reads & var);
+            continue;
+        }
+
+        // The one write to the variable adds an immediate to it or subtracts one
+        if ((cmd->type != CMD_ADD && cmd->type != CMD_SUB) || ++steps > 1 ||
+            cmd->is_a_immediate || cmd->val_a.num_val != counted->var || !cmd->is_b_immediate ||
+            cmd->val_b.num_val == 0 || cmd->val_b.num_val == INT64_MIN) {
+            return false;
+        }
+        counted->update = i;
+        counted->step   = cmd->type == CMD_ADD ? cmd->val_b.num_val : -cmd->val_b.num_val;
+    }
+    return steps == 1 && !(bound & var) &&
+           plan_guard(cmp, branch->branch_condition, factor, counted);
+}
+
+/**
+ * @brief Works out the bound that lets the guard start a trip of copies.
+ *
+ * Every test a trip skips passes if the variable, plus the steps of
+ * `factor - 1` iterations, still passes the loop's test. With `distance`
+ * those steps, less one for `b.le` or plus one for `b.ge`, that is the
+ * variable being strictly below (or above) the bound less `distance`, which
+ * also rules out overflow. An immediate bound is worked out here, and the
+ * loop left alone if the result does not fit.
+ *
+ * @param cmp The loop's compare.
+ * @param condition The condition of the loop's branch back.
+ * @param factor Number of iterations per unrolled trip.
+ * @param counted The loop, whose `distance` and `bound` are filled in.
+ * @return true if the loop can be guarded, false otherwise.
+ */
+static bool plan_guard(const Command *cmp, BranchCondition condition, size_t factor,
+                       CountedLoop *counted) {
+    bool    ascending = counted->step > 0;
+    int64_t magnitude = ascending ? counted->step : -counted->step;
+    if (ascending ? condition != BRANCH_LESS && condition != BRANCH_LESS_EQUAL
+                  : condition != BRANCH_GREATER && condition != BRANCH_GREATER_EQUAL) {
+        return false;
+    }
+    if (magnitude > INT64_MAX / (int64_t) factor) {
+        return false;
+    }
+
+    int64_t steps     = counted->step * (int64_t) (factor - 1);
+    bool    inclusive = condition == BRANCH_LESS_EQUAL || condition == BRANCH_GREATER_EQUAL;
+    counted->distance = ascending ? steps - inclusive : steps + inclusive;
+    if (!cmp->is_b_immediate) {
+        return true;
+    }
+    int64_t bound = cmp->val_b.num_val;
+    if (ascending ? bound < INT64_MIN + counted->distance
+                  : bound > INT64_MAX + counted->distance) {
+        return false;
+    }
+    counted->bound = bound - counted->distance;
+    return true;
+}
+
+/**
+ * @brief Puts the unrolled copies of a loop in front of it.
+ *
+ * The new commands set up the guard's bound when it needs a variable, skip to
+ * the original loop unless a whole trip can run, and run the copies, looping
+ * back while another whole trip can. They then make the loop's own test,
+ * leaving if it fails and carrying on in the original loop, which runs the
+ * last iterations, if it passes. Both ways out end on the loop's compare, so
+ * the flags are the same as after the original loop. Branches into the loop
+ * now enter the new commands, except the loop's own branch back.
+ *
+ * @param commands Pointer to the head of the linked list.
+ * @param array The command list.
+ * @param factor Number of iterations per unrolled trip.
+ * @param counted The loop.
+ * @return true on success, false if memory could not be allocated, in which
+ * case the loop is left alone.
+ */
+static bool unroll(Command **commands, const CommandArray *array, size_t factor,
+                   const CountedLoop *counted) {
+    Command  *loop      = array->commands[counted->first];
+    Command  *branch    = array->commands[counted->last];
+    Command  *cmp       = array->commands[counted->last - 1];
+    bool      ascending = counted->step > 0;
+    Command  *zero      = counted->restore ? new_move(counted->spare, 0) : NULL;
+    Command  *exit      = zero ? zero : branch->next ? branch->next : LINK_HALT;
+    Command  *head      = NULL;
+    Command **link      = &head;
+    bool      ok        = !counted->restore || zero;
+
+    // The guard's bound is clamped so that no trip starts when it would overflow
+    int64_t var   = counted->var;
+    bool    imm   = cmp->is_b_immediate;
+    int64_t bound = imm ? counted->bound : cmp->val_b.num_val;
+    Command *skip = NULL;
+    if (ok && counted->spare != REWRITE_NO_VARIABLE) {
+        int64_t  clamp    = ascending ? INT64_MIN : INT64_MAX;
+        Command *subtract = command_new(CMD_SUB);
+        skip = command_new_branch(ascending ? BRANCH_LESS : BRANCH_GREATER, NULL, GUARD_LABEL);
+        // Link whatever was allocated, so that a failure frees it with the rest
+        ok = append(&link, new_move(counted->spare, clamp));
+        ok = append(&link, new_compare(bound, clamp + counted->distance, true)) && ok;
+        ok = append(&link, skip) && ok;
+        ok = append(&link, subtract) && ok;
+        if (subtract) {
+            subtract->destination.num_val = counted->spare;
+            subtract->val_a.num_val       = bound;
+            subtract->val_b.num_val       = counted->distance;
+            subtract->is_b_immediate      = true;
+        }
+        bound = counted->spare;
+    }
+
+    BranchCondition guard = ascending ? BRANCH_LESS : BRANCH_GREATER;
+    bool            fixed = imm && counted->spare == REWRITE_NO_VARIABLE;
+    Command       **start = link;
+    ok = ok && append(&link, new_compare(var, bound, fixed)) &&
+         append(&link, command_new_branch(INVERSE[guard], loop, REMAINDER_LABEL));
+    if (skip && *start) {
+        skip->target = *start;
+    }
+    Command **copies = link;
+    ok = ok && add_copies(&link, array, factor, counted) &&
+         append(&link, new_compare(var, bound, fixed));
+    ok = ok && append(&link, command_new_branch(guard, *copies, UNROLLED_LABEL)) &&
+         append(&link, command_copy(cmp, NULL)) &&
+         append(&link, command_new_branch(INVERSE[branch->branch_condition], exit, DONE_LABEL));
+    if (!ok) {
+        free_command(head);
+        free_command(zero);
+        return false;
+    }
+
+    // Enter through the new commands, and zero a borrowed variable on the way out
+    for (size_t k = 0; k < array->count; k++) {
+        if (k != counted->last && array->targets[k] == (int64_t) counted->first) {
+            array->commands[k]->target = head;
+        }
+    }
+    *link = loop;
+    if (counted->first == 0) {
+        *commands = head;
+    } else {
+        array->commands[counted->first - 1]->next = head;
+    }
+    if (zero) {
+        zero->next   = branch->next;
+        branch->next = zero;
+    }
+    return true;
+}
+
+/**
+ * @brief Appends `factor` copies of a loop's body, without its compare and
+ * branch.
+ *
+ * If nothing but the step reads the variable, only the last copy steps it, by
+ * `factor` steps at once.
+ *
+ * @param link Where to link the next command, advanced past those added.
+ * @param array The command list.
+ * @param factor Number of copies.
+ * @param counted The loop.
+ * @return true on success, false if memory could not be allocated.
+ */
+static bool add_copies(Command ***link, const CommandArray *array, size_t factor,
+                       const CountedLoop *counted) {
+    for (size_t copy = 1; copy <= factor; copy++) {
+        for (size_t i = counted->first; i < counted->last - 1; i++) {
+            if (counted->merge && i == counted->update && copy < factor) {
+                continue;
+            }
+            Command *cmd = command_copy(array->commands[i], NULL);
+            if (!append(link, cmd)) {
+                return false;
+            }
+            if (counted->merge && i == counted->update) {
+                cmd->val_b.num_val *= (int64_t) factor;
+            }
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Creates a signed compare of a variable with a bound.
+ *
+ * @param var The variable.
+ * @param bound The bound, a variable or an immediate.
+ * @param is_immediate Whether `bound` is an immediate.
+ * @return The command, or NULL if memory could not be allocated.
+ */
+static Command *new_compare(int64_t var, int64_t bound, bool is_immediate) {
+    Command *cmd = command_new(CMD_CMP);
+    if (cmd) {
+        cmd->val_a.num_val  = var;
+        cmd->val_b.num_val  = bound;
+        cmd->is_b_immediate = is_immediate;
+    }
+    return cmd;
+}
+
+/**
+ * @brief Creates a move of an immediate into a variable.
+ *
+ * @param var The variable.
+ * @param value The immediate.
+ * @return The command, or NULL if memory could not be allocated.
+ */
+static Command *new_move(int64_t var, int64_t value) {
+    Command *cmd = command_new(CMD_MOV);
+    if (cmd) {
+        cmd->destination.num_val = var;
+        cmd->val_a.num_val       = value;
+        cmd->is_a_immediate      = true;
+    }
+    return cmd;
+}
+
+/**
+ * @brief Links a command at the end of a list being built.
+ *
+ * @param link Where to link the command, advanced past it.
+ * @param cmd The command, or NULL if it could not be allocated.
+ * @return true if the command was linked, false if it is NULL.
+ */
+static bool append(Command ***link, Command *cmd) {
+    if (!cmd) {
+        return false;
+    }
+    **link = cmd;
+    *link  = &cmd->next;
+    return true;
+}
@@ -0,0 +1,140 @@
+#include "verify.h"
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include "command_type.h"
+#include "interpreter.h"
+#include "mem.h"
+
+static bool verify_instruction(Program *prog, Instruction *insn, const char **failure);
+static bool verify_access(Program *prog, Instruction *insn, const char **failure);
+static bool is_variable(int64_t index);
+
+size_t program_verify(Program *prog) {
+    if (!prog) {
+        return 0;
+    }
+
+    size_t failing = 0;
+    for (size_t i = 0; i < prog->length; i++) {
+        const char *failure = NULL;
+        prog->code[i].is_verified = verify_instruction(prog, &prog->code[i], &failure);
+        if (failure) {
+            fprintf(stderr, "Warning: instruction %zu always fails: %s\n", i, failure);
+            failing++;
+        }
+    }
+    return failing;
+}
+
+/**
+ * @brief Determines whether an instruction can never fail at runtime.
+ *
+ * @param prog The program holding the instruction's constants.
+ * @param insn The instruction to verify.
+ * @param failure Set to a description of the problem if the instruction is
+ * known to always fail; left untouched otherwise.
+ * @return True if the instruction is verified, false otherwise.
+ */
+static bool verify_instruction(Program *prog, Instruction *insn, const char **failure) {
+    bool dest  = is_variable(insn->destination);
+    bool reg_a = !insn->is_a_immediate && is_variable(PROGRAM_OPERAND_A(prog, insn));
+    bool reg_b = !insn->is_b_immediate && is_variable(PROGRAM_OPERAND_B(prog, insn));
+    bool val_a = insn->is_a_immediate || reg_a;
+    bool val_b = insn->is_b_immediate || reg_b;
+
+    switch (insn->type) {
+        case CMD_MOV:
+            return dest && val_a;
+        case CMD_ADD:
+        case CMD_SUB:
+        case CMD_CMP:
+        case CMD_CMP_U:
+            return dest && reg_a && val_b;
+        case CMD_AND:
+        case CMD_EOR:
+        case CMD_ORR:
+            return dest && reg_a && reg_b;
+        case CMD_LSL:
+        case CMD_LSR:
+        case CMD_ASR: {
+            if (!insn->is_b_immediate) {
+                return false;  // The amount is only known at runtime
+            }
+            int64_t amount = PROGRAM_OPERAND_B(prog, insn);
+            if (amount < 0 || amount > 63) {
+                *failure = "shift amount out of range";
+                return false;
+            }
+            return dest && reg_a;
+        }
+        case CMD_LOAD:
+        case CMD_STORE:
+            return verify_access(prog, insn, failure) && dest;
+        case CMD_PUT: {
+            if (!insn->is_b_immediate) {
+                return false;
+            }
+            int64_t address = PROGRAM_OPERAND_B(prog, insn);
+            int64_t length  = (int64_t) strlen(PROGRAM_STRING_A(prog, insn)) + 1;
+            if (address < 0 || address > MEM_CAPACITY - length) {
+                *failure = "address out of range";
+                return false;
+            }
+            return true;
+        }
+        case CMD_PRINT:
+            switch (insn->val_b) {
+                case 'd':
+                case 'x':
+                case 'b': return val_a;
+                case 's': return false;  // Reads memory up to a terminator
+                default:  *failure = "invalid print base"; return false;
+            }
+        case CMD_BRANCH:
+            return insn->target != PROGRAM_NO_TARGET;
+        case CMD_RET:
+            return true;
+        default:
+            return false;  // Calls may run out of memory for the frame
+    }
+}
+
+/**
+ * @brief Verifies the width and address of a load or store.
+ *
+ * @param prog The program holding the instruction's constants.
+ * @param insn The load or store to verify.
+ * @param failure Set to a description of the problem if the access is known
+ * to always fail; left untouched otherwise.
+ * @return True if the access is verified, false otherwise.
+ */
+static bool verify_access(Program *prog, Instruction *insn, const char **failure) {
+    if (!insn->is_a_immediate) {
+        return false;
+    }
+    int64_t bytes = PROGRAM_OPERAND_A(prog, insn);
+    if (bytes != 1 && bytes != 2 && bytes != 4 && bytes != 8) {
+        *failure = "invalid access width";
+        return false;
+    }
+    if (!insn->is_b_immediate) {
+        return false;  // The address is only known at runtime
+    }
+    int64_t address = PROGRAM_OPERAND_B(prog, insn);
+    if (address < 0 || address > MEM_CAPACITY - bytes) {
+        *failure = "address out of range";
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Determines whether an index names a variable.
+ *
+ * @param index The index to check.
+ * @return True if `index` is within x0..x31.
+ */
+static bool is_variable(int64_t index) {
+    return index >= 0 && index < NUM_VARIABLES;
+}
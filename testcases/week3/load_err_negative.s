@@ -0,0 +1,6 @@
+// Loading from a negative address in a variable fails on every engine.
+mov x1 0x1122334455667788
+store x1 0 8
+sub x2 x31 1
+load x3 8 x2
+print x3 x
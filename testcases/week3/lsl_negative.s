@@ -0,0 +1,11 @@
+// Shifting a negative value left, and shifting bits out of the top, wraps
+// the same way on every engine.
+mov x1 0x8000000000000001
+sub x2 x31 3
+lsl x3 x1 1
+lsl x4 x2 62
+mov x5 63
+lsl x6 x2 x5
+print x3 d
+print x4 d
+print x6 d
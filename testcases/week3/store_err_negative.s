@@ -0,0 +1,6 @@
+// Storing to a negative address in a variable fails on every engine, and
+// leaves memory untouched.
+mov x1 0x1122334455667788
+sub x2 x31 7
+store x1 x2 8
+print x1 x
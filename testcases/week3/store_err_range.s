@@ -0,0 +1,6 @@
+// A store whose address plus width overflows must fail with an error, also
+// in the C program that --emit-c translates it to.
+mov x1 0x1122334455667788
+store x1 0 8
+store x1 0x7FFFFFFFFFFFFFFF 8
+print x1 x
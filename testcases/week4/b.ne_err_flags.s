@@ -0,0 +1,8 @@
+// The compare's flags are only read by the dump after the failing shift,
+// so fusing it with the branch must keep them. Is equal is 1 with -t too.
+    mov x1 1
+    cmp x7 x4
+    b.ne L2
+    lsl x4 x1 64
+L2:
+    cmp x9 1
@@ -0,0 +1,17 @@
+// down recurses 10 calls deep, for a peak call depth of 11. Prints 20 under
+// --max-depth 11; under --max-depth 10 every engine stops with a stack
+// overflow when the innermost call would go past the limit.
+    mov x0 0
+    mov x1 10
+    call down
+    print x0 d
+    ret
+
+down:
+    cmp x1 0
+    b.eq base
+    sub x1 x1 1
+    call down
+    add x0 x0 2
+base:
+    ret
@@ -0,0 +1,20 @@
+// Under --max-depth 1 the call from wrap overflows, even though the pure sq
+// was already called with the same input. Every engine prints 4 and then
+// stops with a stack overflow; without the limit it prints 4 and 5.
+    mov x0 2
+    call sq
+    print x0 d
+    mov x0 2
+    call wrap
+    print x0 d
+    ret
+
+wrap:
+    call sq
+    add x0 x0 1
+    ret
+
+sq:
+    add x1 x0 0
+    add x0 x0 x1
+    ret
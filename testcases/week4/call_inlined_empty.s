@@ -0,0 +1,18 @@
+// -O removes the calls to nop, whose body is only a ret, including the one
+// the loop branches back to; -O -p reports them as inlined. Prints 3 and 3
+// with and without -O.
+    mov x0 0
+    mov x1 0
+loop:
+    call nop
+    call nop
+    add x0 x0 1
+    add x1 x1 1
+    cmp x1 3
+    b.lt loop
+    print x0 d
+    print x1 d
+    ret
+
+nop:
+    ret
@@ -0,0 +1,19 @@
+// A call in a loop that -O inlines: the callee reads and writes x1, which a
+// return restores, so the copy works on a spare variable set from x1 first.
+// Run with and without -O -t; both print 30 and 5.
+    mov x0 0
+    mov x1 5
+    mov x2 0
+loop:
+    call scale
+    add x2 x2 1
+    cmp x2 3
+    b.lt loop
+    print x0 d
+    print x1 d
+    ret
+
+scale:
+    add x1 x1 x1
+    add x0 x0 x1
+    ret
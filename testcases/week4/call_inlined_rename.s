@@ -0,0 +1,23 @@
+// mix is a leaf that -O inlines into the loop: it writes x2 and x3, which its
+// return restores, so -O -p reports them renamed to the unused x31 and x30,
+// and the copy reads x2 through its stand-in. Prints 881, 10 and 20 with and
+// without -O; only the peak call depth differs, dropping to 0.
+    mov x0 1
+    mov x2 10
+    mov x3 20
+    mov x4 0
+loop:
+    call mix
+    add x4 x4 1
+    cmp x4 4
+    b.lt loop
+    print x0 d
+    print x2 d
+    print x3 d
+    ret
+
+mix:
+    add x2 x0 x2
+    lsl x3 x2 1
+    add x0 x0 x3
+    ret
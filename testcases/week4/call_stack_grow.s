@@ -0,0 +1,17 @@
+// down recurses 100 calls deep and adds 2 after each returns, so no call is a
+// tail call: the stack grows past its first 64 frames and the peak call depth
+// is 101. Prints 200 with any engine, with and without -O.
+    mov x0 0
+    mov x1 100
+    call down
+    print x0 d
+    ret
+
+down:
+    cmp x1 0
+    b.eq base
+    sub x1 x1 1
+    call down
+    add x0 x0 2
+base:
+    ret
@@ -0,0 +1,19 @@
+// count calls itself 200000 times, each time as its last command, so every
+// call is a tail call that reuses the caller's frame: the program runs in
+// constant stack, reports a peak call depth of 1 and stops without error
+// even under --max-depth 1. Prints 600000 with any engine, with and without -O.
+    mov x0 0
+    mov x1 200000
+    call count
+    print x0 d
+    ret
+
+count:
+    cmp x1 0
+    b.eq done
+    sub x1 x1 1
+    add x0 x0 3
+    call count
+    ret
+done:
+    ret
@@ -0,0 +1,12 @@
+// The call to set is directly followed by ret, but at the top level, where
+// that ret ends the program, so it stays a normal call: returning restores
+// x1, and the final dump shows x0 = 7 and x1 = 1, not 2, with any engine.
+    mov x0 0
+    mov x1 1
+    call set
+    ret
+
+set:
+    mov x0 7
+    mov x1 2
+    ret
@@ -0,0 +1,14 @@
+// A loop counting x1 down by 2 with sub and b.ge, from 20 to 0 in 10 runs.
+// Nothing else reads x1, so -O's unrolled copies step it once, by 8. Prints
+// 30 and 0, and ends with the same flags, with and without -O, for any
+// --unroll factor.
+    mov x0 0
+    mov x1 20
+loop:
+    add x0 x0 3
+    sub x1 x1 2
+    cmp x1 1
+    b.ge loop
+    print x0 d
+    print x1 d
+    ret
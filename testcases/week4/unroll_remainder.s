@@ -0,0 +1,19 @@
+// Two loops whose trip counts, 3 and 7, do not divide by 4: -O unrolls both,
+// and the first never starts a trip of copies, running only the original
+// loop. Prints 24 and 7, with and without -O, for any --unroll factor.
+    mov x0 0
+    mov x1 0
+short:
+    add x0 x0 1
+    add x1 x1 1
+    cmp x1 3
+    b.lt short
+    mov x1 0
+long:
+    add x0 x0 x1
+    add x1 x1 1
+    cmp x1 7
+    b.lt long
+    print x0 d
+    print x1 d
+    ret
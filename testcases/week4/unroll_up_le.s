@@ -0,0 +1,14 @@
+// A loop counting x1 up with b.le: it runs 10 times, which -O unrolls by 4
+// into two trips of copies and two iterations of the original loop. Prints
+// 45 and 10, and ends with the same flags, with and without -O, for any
+// --unroll factor.
+    mov x0 0
+    mov x1 0
+loop:
+    add x0 x0 x1
+    add x1 x1 1
+    cmp x1 9
+    b.le loop
+    print x0 d
+    print x1 d
+    ret
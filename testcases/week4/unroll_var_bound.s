@@ -0,0 +1,19 @@
+// A loop whose bound is in x2, loaded from memory so that -O cannot fold it:
+// the unrolled loop's guard keeps its own bound in x31, which ends up zero
+// again. It runs 5 times, so one trip of 4 copies and one iteration of the
+// original loop. Prints 30 and 15, with and without -O, for any --unroll
+// factor.
+    mov x0 0
+    mov x1 0
+    mov x2 13
+    mov x3 64
+    store x2 x3 8
+    load x2 8 x3
+loop:
+    add x0 x0 x1
+    add x1 x1 3
+    cmp x1 x2
+    b.lt loop
+    print x0 d
+    print x1 d
+    ret